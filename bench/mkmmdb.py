@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""
+mkmmdb.py — Writes bench/geoip-test.mmdb, the MaxMind DB that
+`spectrumbench geoip` checks src/mmdb.cpp and GeoResolver against.
+
+A handful of IPv4 and IPv6 networks in an IPv6 tree (IPv4 under ::/96, as
+GeoLite2 lays it out), with the shared key strings stored once and reached
+through pointers, a 3000-byte string ahead of them so the pointers need more
+than 11 bits, and nested maps for the names.
+
+Usage:
+    python3 bench/mkmmdb.py                     # 28-bit records
+    python3 bench/mkmmdb.py --record-size 24 OUT.mmdb
+
+Format: https://maxmind.github.io/MaxMind-DB/
+"""
+
+import ipaddress
+import os
+import struct
+import sys
+
+# Field types
+POINTER, STRING, DOUBLE, UINT16, UINT32, MAP, ARRAY, BOOLEAN = 1, 2, 3, 5, 6, 7, 11, 14
+
+NETWORKS = [
+    ("81.0.0.0/8", {
+        "country": {"iso_code": "GR",
+                    "names": {"en": "Greece", "de": "Griechenland"}},
+        "location": {"latitude": 37.9, "longitude": 23.7},
+        "city": {"names": {"en": "Athens"}},
+    }),
+    ("82.104.0.0/16", {
+        "city": {"geoname_id": 3169070, "names": {"de": "Rom", "en": "Rome"}},
+        "country": {"iso_code": "IT", "names": {"en": "Italy"}},
+        "subdivisions": [{"iso_code": "62"}],
+    }),
+    # No country, only the registrant's
+    ("8.8.8.0/24", {
+        "registered_country": {"iso_code": "US",
+                               "names": {"en": "United States"}},
+        "is_anycast": True,
+    }),
+    # Country without a city
+    ("2a01:4f8::/32", {
+        "country": {"iso_code": "DE", "names": {"en": "Germany"}},
+    }),
+]
+
+# Stored once, every other use is a pointer
+SHARED = ["names", "en", "iso_code", "country", "city"]
+
+
+def control(kind, size):
+    if kind > 7:
+        first, extended = 0, bytes([kind - 7])
+    else:
+        first, extended = kind << 5, b""
+    if size < 29:
+        return bytes([first | size]) + extended
+    if size < 285:
+        return bytes([first | 29]) + extended + bytes([size - 29])
+    if size < 65821:
+        return bytes([first | 30]) + extended + struct.pack(">H", size - 285)
+    return bytes([first | 31]) + extended + (size - 65821).to_bytes(3, "big")
+
+
+def pointer(offset):
+    if offset < 2048:
+        return bytes([0x20 | (offset >> 8), offset & 0xFF])
+    offset -= 2048
+    if offset < 524288:
+        return bytes([0x28 | (offset >> 16)]) + (offset & 0xFFFF).to_bytes(2, "big")
+    offset -= 524288
+    return bytes([0x30 | (offset >> 24)]) + (offset & 0xFFFFFF).to_bytes(3, "big")
+
+
+def encode(value, shared=None):
+    if isinstance(value, str):
+        if shared is not None and value in shared:
+            return pointer(shared[value])
+        raw = value.encode()
+        return control(STRING, len(raw)) + raw
+    if isinstance(value, bool):
+        return control(BOOLEAN, int(value))
+    if isinstance(value, int):
+        raw = value.to_bytes((value.bit_length() + 7) // 8, "big")
+        return control(UINT16 if value < 65536 else UINT32, len(raw)) + raw
+    if isinstance(value, float):
+        return control(DOUBLE, 8) + struct.pack(">d", value)
+    if isinstance(value, list):
+        return control(ARRAY, len(value)) + b"".join(encode(v, shared) for v in value)
+    if isinstance(value, dict):
+        return control(MAP, len(value)) + b"".join(
+            encode(k, shared) + encode(v, shared) for k, v in value.items())
+    raise TypeError(value)
+
+
+def build(record_size):
+    data = bytearray(encode("x" * 3000))
+    shared = {}
+    for s in SHARED:
+        shared[s] = len(data)
+        data += encode(s)
+    offsets = []
+    for _, record in NETWORKS:
+        offsets.append(len(data))
+        data += encode(record, shared)
+
+    # [left, right]: a node index, ("data", offset) or None for no record
+    nodes = [[None, None]]
+    for (cidr, _), offset in zip(NETWORKS, offsets):
+        net = ipaddress.ip_network(cidr)
+        address = int(net.network_address)
+        bits = net.prefixlen + (96 if net.version == 4 else 0)
+        node = 0
+        for i in range(bits):
+            bit = (address >> (127 - i)) & 1
+            if i == bits - 1:
+                nodes[node][bit] = ("data", offset)
+            else:
+                if not isinstance(nodes[node][bit], int):
+                    nodes.append([None, None])
+                    nodes[node][bit] = len(nodes) - 1
+                node = nodes[node][bit]
+
+    count = len(nodes)
+
+    def record(r):
+        if r is None:
+            return count
+        if isinstance(r, tuple):
+            return count + 16 + r[1]
+        return r
+
+    tree = bytearray()
+    for left, right in nodes:
+        a, b = record(left), record(right)
+        if record_size == 24:
+            tree += a.to_bytes(3, "big") + b.to_bytes(3, "big")
+        elif record_size == 28:
+            tree += ((a & 0xFFFFFF).to_bytes(3, "big")
+                     + bytes([((a >> 24) << 4) | (b >> 24)])
+                     + (b & 0xFFFFFF).to_bytes(3, "big"))
+        else:
+            tree += a.to_bytes(4, "big") + b.to_bytes(4, "big")
+
+    metadata = {
+        "node_count": count, "record_size": record_size, "ip_version": 6,
+        "database_type": "Test-City", "languages": ["en"],
+        "binary_format_major_version": 2, "binary_format_minor_version": 0,
+        "build_epoch": 1700000000,
+        "description": {"en": "spectrumbench geoip test database"},
+    }
+    return (bytes(tree) + b"\0" * 16 + bytes(data)
+            + b"\xab\xcd\xefMaxMind.com" + encode(metadata))
+
+
+def main():
+    args = sys.argv[1:]
+    record_size = 28
+    if args[:1] == ["--record-size"] and len(args) > 1:
+        record_size = int(args[1])
+        args = args[2:]
+    if record_size not in (24, 28, 32):
+        sys.exit("record size is 24, 28 or 32")
+    out = args[0] if args else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "geoip-test.mmdb")
+    with open(out, "wb") as f:
+        f.write(build(record_size))
+    print(f"{out}: {len(NETWORKS)} networks, {record_size}-bit records")
+
+
+if __name__ == "__main__":
+    main()
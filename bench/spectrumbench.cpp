@@ -0,0 +1,1426 @@
+// spectrumbench — offline micro-benchmarks for the spectrum server hot paths.
+// Runs without SDR hardware or network.
+//
+//   spectrumbench [convert]     sample format conversion, GS/s per format
+//   spectrumbench [quantize]    post-FFT power / quantize / pyramid pass
+//   spectrumbench [wire]        audio / waterfall frame framing, allocations
+//   spectrumbench [agc]         look-ahead AGC, rings against the old deques
+//   spectrumbench [dc]          audio DC blocker, block against per sample,
+//                               ring filters against the ones they replaced
+//   spectrumbench [geoip] [db]  MaxMind DB lookups and GeoResolver caching
+//                               against bench/geoip-test.mmdb (run from the
+//                               source tree), damaged copies of it
+//   spectrumbench load [opts]   simulated listeners against the full frame
+//                               pipeline; ramps to the most that keep up
+//
+// Build: meson compile -C build spectrumbench
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/circular_buffer.hpp>
+#include <nlohmann/json.hpp>
+
+#include "fft.h"
+#include "fftplancache.h"
+#include "framedispatch.h"
+#include "georesolver.h"
+#include "metrics.h"
+#include "mmdb.h"
+#include "sampleconvert.h"
+#include "samplereader.h"
+#include "signal.h"
+#include "spectrumquantize.h"
+#include "threadteam.h"
+#include "waterfall.h"
+#include "waterfallcompression.h"
+#include "wireformat.h"
+#include "workerpool.h"
+
+// Every heap allocation in the process, for the wire benchmark.  GCC flags
+// free() on memory from the (replaced) operator new as a mismatch.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+static std::atomic<uint64_t> heap_allocations{0};
+
+void *operator new(size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+using bench_clock = std::chrono::steady_clock;
+
+// Runs fn repeatedly for about min_seconds and returns seconds per call
+double time_per_call(const std::function<void()> &fn,
+                     double min_seconds = 0.25) {
+    fn(); // warm up caches and page in the buffers
+    size_t calls = 0;
+    const auto start = bench_clock::now();
+    double elapsed = 0;
+    do {
+        fn();
+        calls++;
+        elapsed = std::chrono::duration<double>(bench_clock::now() - start)
+                      .count();
+    } while (elapsed < min_seconds);
+    return elapsed / calls;
+}
+
+// ── convert ─────────────────────────────────────────────────────────────────
+// One hop of a 1M-bin real FFT: what the reader thread converts per frame.
+template <typename T> void bench_convert_format(const char *name) {
+    constexpr size_t num = 1 << 20;
+    std::vector<T> raw(num);
+    std::mt19937 rng(1);
+    for (auto &x : raw) {
+        if constexpr (std::is_floating_point_v<T>) {
+            x = (T)((int)(rng() % 2001) - 1000) / 1000;
+        } else {
+            x = (T)rng();
+        }
+    }
+    std::vector<float> out(num);
+    std::vector<float> window(num, 0.5f / sample_full_scale<T>());
+    const float gain = 1.f / sample_full_scale<T>();
+
+    const ConvertISA best = convert_isa();
+    force_convert_isa(ConvertISA::SCALAR);
+    const double scalar = time_per_call(
+        [&] { convert_samples<T>(out.data(), raw.data(), gain, num); });
+    force_convert_isa(best);
+    const double simd = time_per_call(
+        [&] { convert_samples<T>(out.data(), raw.data(), gain, num); });
+    const double windowed = time_per_call([&] {
+        convert_samples_windowed<T>(out.data(), raw.data(), window.data(),
+                                    num);
+    });
+
+    printf("  %-4s  scalar %6.2f GS/s   %-7s %6.2f GS/s   +window %6.2f GS/s\n",
+           name, num / scalar / 1e9, convert_isa_name(best), num / simd / 1e9,
+           num / windowed / 1e9);
+}
+
+void bench_convert() {
+    printf("convert: %s kernels, 1M samples per call\n",
+           convert_isa_name(convert_isa()));
+    bench_convert_format<uint8_t>("u8");
+    bench_convert_format<int8_t>("s8");
+    bench_convert_format<uint16_t>("u16");
+    bench_convert_format<int16_t>("s16");
+    bench_convert_format<float>("f32");
+    bench_convert_format<double>("f64");
+}
+
+// ── quantize ────────────────────────────────────────────────────────────────
+// One frame of a 1M-bin IQ FFT down to a 2048-bin waterfall, with the 0 Hz
+// wraparound for 192 kHz audio slices at 2 MS/s.
+void bench_quantize() {
+    constexpr size_t n = 1 << 20;
+    constexpr int levels = 10;
+    constexpr size_t wrap = 1 << 17;
+    std::mt19937 rng(1);
+    std::normal_distribution<float> noise(0.f, 1000.f);
+    std::vector<float> spectrum((n + wrap) * 2);
+    for (size_t i = 0; i < n * 2; i++) spectrum[i] = noise(rng);
+
+    std::vector<float> work(spectrum.size());
+    std::vector<int8_t> ref_q(n * 2), tiled_q(n * 2);
+    float *powerbuf = new (std::align_val_t(32)) float[n * 2];
+
+    SpectrumQuantizeJob job{work.data(), nullptr, n, n / 2 + 1, (float)n,
+                            levels, 20, wrap};
+    // Each call normalises in place, so restore the input first; the copy is
+    // timed separately and subtracted.
+    const double copy = time_per_call([&] {
+        memcpy(work.data(), spectrum.data(), sizeof(float) * n * 2);
+    });
+
+    job.quantized = ref_q.data();
+    const double passes = time_per_call([&] {
+        memcpy(work.data(), spectrum.data(), sizeof(float) * n * 2);
+        quantize_spectrum_passes(job, powerbuf);
+    }) - copy;
+    const std::vector<float> ref_spectrum = work;
+
+    printf("quantize: %zu bins, %d levels, %zu wrap bins\n", n, levels, wrap);
+    printf("  passes (omp)         %7.3f ms\n", passes * 1e3);
+
+    job.quantized = tiled_q.data();
+    const int all = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    std::vector<int> thread_counts{1};
+    if (all > 1) thread_counts.push_back(all);
+    for (int threads : thread_counts) {
+        ThreadTeam team("bench", threads);
+        const double tiled = time_per_call([&] {
+            memcpy(work.data(), spectrum.data(), sizeof(float) * n * 2);
+            quantize_spectrum_tiled(job, team);
+        }) - copy;
+        const bool same = ref_q == tiled_q && ref_spectrum == work;
+        printf("  tiled, %2d thread%s    %7.3f ms  %5.2fx%s\n", threads,
+               threads == 1 ? " " : "s", tiled * 1e3, passes / tiled,
+               same ? "" : "  MISMATCH");
+    }
+    operator delete[](powerbuf, std::align_val_t(32));
+}
+
+// ── wire ────────────────────────────────────────────────────────────────────
+// Framing of one audio packet and one waterfall row per client, CBOR (the
+// json map + to_cbor path every client used before wire_format) against the
+// packed header.  The websocket message is modelled as a reused std::string
+// (websocketpp's message payload); compression and the socket write are the
+// same for both formats and left out.
+void bench_wire() {
+    using json = nlohmann::json;
+    constexpr int clients = 500;
+    constexpr int packets_per_second = 50;
+    constexpr size_t audio_bytes = 600;   // a FLAC frame of 12 kHz audio
+    constexpr size_t waterfall_bytes = 1024;
+
+    struct ClientState {
+        json audio_packet;
+        json waterfall_packet;
+        std::vector<uint8_t> packed_row;
+        std::string message;
+    };
+    std::vector<ClientState> state(clients);
+    std::vector<uint8_t> audio(audio_bytes, 0x5a);
+    std::vector<int8_t> row(waterfall_bytes, -60);
+    const std::string codec_name = "flac";
+    uint64_t frame_num = 0;
+    size_t sink = 0;
+
+    const auto send = [&](ClientState &c,
+                          std::initializer_list<std::pair<const void *, size_t>>
+                              bufs) {
+        c.message.clear();
+        for (auto &b : bufs) {
+            c.message.append(static_cast<const char *>(b.first), b.second);
+        }
+        sink += c.message.size();
+    };
+
+    const auto cbor_frame = [&] {
+        frame_num++;
+        for (auto &c : state) {
+            json &packet = c.audio_packet;
+            packet["frame_num"] = frame_num;
+            packet["l"] = 1000;
+            packet["m"] = 1024.5;
+            packet["r"] = 1100;
+            packet["pwr"] = 0.001;
+            packet["channels"] = 1;
+            packet["sam_locked"] = false;
+            packet["codec"] = codec_name;
+            packet["data"] = json::binary(
+                std::vector<uint8_t>(audio.begin(), audio.end()));
+            auto cbor = json::to_cbor(packet);
+            send(c, {{cbor.data(), cbor.size()}});
+
+            json &wf = c.waterfall_packet;
+            wf["frame_num"] = frame_num;
+            wf["l"] = 0;
+            wf["r"] = 1024;
+            wf["data"] = json::binary(std::vector<uint8_t>(
+                (uint8_t *)row.data(), (uint8_t *)row.data() + row.size()));
+            auto wf_cbor = json::to_cbor(wf);
+            send(c, {{wf_cbor.data(), wf_cbor.size()}});
+        }
+    };
+
+    const auto packed_frame = [&] {
+        frame_num++;
+        for (auto &c : state) {
+            AudioFrameHeader h;
+            h.frame_num = frame_num;
+            h.l = 1000;
+            h.m = 1024.5;
+            h.r = 1100;
+            h.pwr = 0.001;
+            uint8_t header[WIRE_AUDIO_HEADER_BYTES];
+            pack_audio_header(header, h);
+            send(c, {{header, sizeof(header)}, {audio.data(), audio.size()}});
+
+            c.packed_row.resize(WIRE_WATERFALL_HEADER_BYTES + row.size());
+            pack_waterfall_header(c.packed_row.data(), {frame_num, 0, 1024});
+            memcpy(c.packed_row.data() + WIRE_WATERFALL_HEADER_BYTES,
+                   row.data(), row.size());
+            send(c, {{c.packed_row.data(), c.packed_row.size()}});
+        }
+    };
+
+    printf("wire: %d clients, 1 audio packet + 1 waterfall row each at %d Hz\n",
+           clients, packets_per_second);
+    for (auto [name, fn] : {std::pair<const char *, std::function<void()>>{
+                                "cbor", cbor_frame},
+                            {"packed v1", packed_frame}}) {
+        fn(); // first frame sizes the per-client buffers
+        const uint64_t before = heap_allocations.load();
+        constexpr int frames = 20;
+        const auto start = bench_clock::now();
+        for (int i = 0; i < frames; i++) fn();
+        const double seconds =
+            std::chrono::duration<double>(bench_clock::now() - start).count();
+        const double per_frame =
+            double(heap_allocations.load() - before) / frames;
+        printf("  %-9s  %6.2f allocs/packet  %9.0f allocs/s  %6.1f us/frame "
+               "(all clients)\n",
+               name, per_frame / (clients * 2),
+               per_frame * packets_per_second, seconds / frames * 1e6);
+    }
+    if (sink == 0) printf("\n");
+}
+
+// ── agc ─────────────────────────────────────────────────────────────────────
+// The look-ahead AGC every audio client runs, with the server's settings and
+// the SSB profile, against the implementation it replaced: std::deque
+// look-ahead and peak queue, a copy of the input per call and one pow() per
+// gain stage per sample.  Both must produce the same audio.
+class DequeAGC {
+  public:
+    DequeAGC(float desired_level, float attack_ms, float release_ms,
+             float lookahead_ms, float sr)
+        : desired_level{desired_level} {
+        look_ahead_samples = (size_t)(lookahead_ms * sr / 1000.0f);
+        attack_coeff = 1.0f - std::exp(-1.0f / (attack_ms * 0.001f * sr));
+        release_coeff =
+            1.0f - std::exp(-1.0f / (release_ms * 0.001f * sr * 5.0f));
+        fast_attack_coeff = 1.0f - std::exp(-1.0f / (0.003f * sr));
+        hang_time = (size_t)(0.40f * sr);
+        am_attack_coeff = attack_coeff * 0.2f;
+        am_release_coeff = release_coeff * 0.20f;
+    }
+
+    void process(float *arr, size_t len) {
+        std::vector<float> buffer(arr, arr + len);
+        for (size_t i = 0; i < len; ++i) {
+            push(buffer[i]);
+            if (lookahead_buffer.size() == look_ahead_samples) {
+                float current_sample = lookahead_buffer.front();
+                float peak_sample = lookahead_max.empty()
+                                        ? 0.0f
+                                        : std::abs(lookahead_max.front());
+                float desired_gain =
+                    std::min(desired_level / (peak_sample + 1e-15f), max_gain);
+                progressive(desired_gain);
+                float total_gain = 1.0f;
+                for (float g : gains) total_gain *= g;
+                total_gain = std::min(total_gain, max_gain);
+                arr[i] = current_sample * (total_gain * 0.01f);
+            } else {
+                arr[i] = 0.0f;
+            }
+        }
+    }
+
+  private:
+    void push(float sample) {
+        lookahead_buffer.push_back(sample);
+        while (!lookahead_max.empty() &&
+               std::abs(lookahead_max.back()) < std::abs(sample)) {
+            lookahead_max.pop_back();
+        }
+        lookahead_max.push_back(sample);
+        if (lookahead_buffer.size() > look_ahead_samples) {
+            float oldest = lookahead_buffer.front();
+            lookahead_buffer.pop_front();
+            if (!lookahead_max.empty() && oldest == lookahead_max.front()) {
+                lookahead_max.pop_front();
+            }
+        }
+    }
+
+    void progressive(float desired_gain) {
+        if (hang_counter > 0) hang_counter--;
+        for (size_t i = 0; i < gains.size(); ++i) {
+            float stage = std::min(
+                std::pow(desired_gain, 1.0f / gains.size()), max_gain);
+            if (stage < gains[i] * hang_threshold) hang_counter = hang_time;
+            if (hang_counter > 0) continue;
+            float fast = gains[i] * (1.0f - fast_attack_coeff) +
+                         stage * fast_attack_coeff;
+            float slow =
+                stage < gains[i]
+                    ? gains[i] * (1.0f - am_attack_coeff) +
+                          stage * am_attack_coeff
+                    : gains[i] * (1.0f - am_release_coeff) +
+                          stage * am_release_coeff;
+            gains[i] = std::min(fast, slow);
+        }
+        if (desired_gain > gains[0]) {
+            gains[0] = std::min(gains[0] * (1.0f - release_coeff * 0.1f) +
+                                    desired_gain * release_coeff * 0.1f,
+                                max_gain);
+        }
+    }
+
+    float desired_level, attack_coeff, release_coeff, fast_attack_coeff;
+    float am_attack_coeff, am_release_coeff;
+    float max_gain = 1000.0f, hang_threshold = 0.15f;
+    size_t look_ahead_samples, hang_time, hang_counter = 0;
+    std::vector<float> gains = std::vector<float>(5, 1.0f);
+    std::deque<float> lookahead_buffer, lookahead_max;
+};
+
+// One second of audio in 50 ms frames: a keyed carrier with noise and
+// impulses, so the gain moves and the peak queue sees both rising and
+// falling runs.
+void bench_agc() {
+    printf("agc: 100 ms look-ahead, SSB profile, 50 ms frames\n");
+    for (int rate : {12000, 48000, 192000}) {
+        const size_t frame = rate / 20;
+        std::vector<float> input(rate);
+        std::mt19937 rng(1);
+        std::normal_distribution<float> noise(0.f, 0.01f);
+        for (int i = 0; i < rate; i++) {
+            const bool keyed = (i / (rate / 8)) % 2 == 0;
+            input[i] = (keyed ? 0.5f : 0.02f) *
+                           std::sin(2 * (float)M_PI * 700.f * i / rate) +
+                       noise(rng) + (i % (rate / 7) == 0 ? 0.9f : 0.f);
+        }
+
+        std::vector<float> ring_out(input.size()), deque_out(input.size());
+        uint64_t ring_allocs = 0, deque_allocs = 0;
+        const auto run = [&](auto &agc, std::vector<float> &out,
+                             uint64_t &allocs) {
+            out = input;
+            const uint64_t before = heap_allocations.load();
+            for (size_t i = 0; i + frame <= out.size(); i += frame) {
+                agc.process(out.data() + i, frame);
+            }
+            allocs = heap_allocations.load() - before;
+        };
+
+        // Fresh state each pass, as the outputs are compared afterwards
+        AGC ring(0.1f, 100.0f, 30.0f, 100.0f, (float)rate);
+        const double ring_s = time_per_call([&] {
+            ring.reset();
+            run(ring, ring_out, ring_allocs);
+        });
+        const double deque_s = time_per_call([&] {
+            DequeAGC agc(0.1f, 100.0f, 30.0f, 100.0f, (float)rate);
+            run(agc, deque_out, deque_allocs);
+        });
+
+        float max_diff = 0;
+        for (size_t i = 0; i < input.size(); i++) {
+            max_diff = std::max(max_diff, std::abs(ring_out[i] - deque_out[i]));
+        }
+        printf("  %6d Hz  deque %7.2f ns/sample %4.0f allocs/s   ring %7.2f "
+               "ns/sample %4.0f allocs/s  %5.2fx%s\n",
+               rate, deque_s / rate * 1e9, (double)deque_allocs,
+               ring_s / rate * 1e9, (double)ring_allocs, deque_s / ring_s,
+               max_diff == 0 ? "" : "  MISMATCH");
+    }
+}
+
+// ── dc ──────────────────────────────────────────────────────────────────────
+// The DC blocker every audio client runs (AudioClient::dc), sized as the
+// server sizes it, over 50 ms frames: removeDC() against processSample() on
+// every sample, which must produce the same audio, and both against the
+// boost::circular_buffer filters they replaced.  Those kept a float running
+// sum that drifts, so for float the ring version only has to stay closer to
+// a double-precision run than the old one; MovingAverage<double> (the sample
+// rate estimate), MovingAverage<int> and MovingMode<int> (AudioClient::mm)
+// must match the old ones exactly.
+template <typename T> class CircularMovingAverage {
+  public:
+    CircularMovingAverage(int length) : length{length}, q{(size_t)length, 0} {}
+    T insert(T val) {
+        sum -= q.back();
+        q.push_front(val);
+        sum += val;
+        return getAverage();
+    }
+    T getAverage() { return sum / length; }
+    boost::circular_buffer<T> &getBuffer() { return q; }
+
+  private:
+    int length;
+    boost::circular_buffer<T> q;
+    std::conditional_t<std::is_floating_point_v<T>, Neumaier<T>, T> sum{0};
+};
+
+template <typename T> class SetMovingMode {
+  public:
+    SetMovingMode(int length) : q{(size_t)length, 0} {}
+    T insert(T val) {
+        increment(q.back(), -1);
+        q.push_front(val);
+        increment(val, 1);
+        return v.empty() ? 0 : v.begin()->second;
+    }
+
+  private:
+    void increment(T val, int amount) {
+        v.erase({m[val], val});
+        m[val] += amount;
+        if (m[val] > 0) {
+            v.insert({m[val], val});
+        } else {
+            m.erase(val);
+        }
+    }
+
+    boost::circular_buffer<T> q;
+    std::set<std::pair<int, T>, std::greater<std::pair<int, T>>> v;
+    std::unordered_map<T, int> m;
+};
+
+class CircularDCBlocker {
+  public:
+    CircularDCBlocker(int delay)
+        : delay{delay}, movingAverage1{delay}, movingAverage2{delay} {}
+    float processSample(float s) {
+        float ma1 = movingAverage1.insert(s);
+        float ma2 = movingAverage2.insert(ma1);
+        return movingAverage1.getBuffer()[delay - 1] - ma2;
+    }
+
+  private:
+    int delay;
+    CircularMovingAverage<float> movingAverage1;
+    CircularMovingAverage<float> movingAverage2;
+};
+
+// Inserts every value into both filters; the number of differing outputs
+template <typename Old, typename New, typename T>
+size_t count_mismatches(Old &old_filter, New &new_filter,
+                        const std::vector<T> &values) {
+    size_t mismatches = 0;
+    for (T x : values) {
+        mismatches += old_filter.insert(x) != new_filter.insert(x);
+    }
+    return mismatches;
+}
+
+void bench_dc() {
+    printf("dc: two moving averages of sps / 750 * 2, 50 ms frames\n");
+    for (int rate : {12000, 48000, 192000}) {
+        const int delay = rate / 750 * 2;
+        const size_t frame = rate / 20;
+        std::vector<float> input(rate);
+        std::mt19937 rng(1);
+        std::normal_distribution<float> noise(0.f, 0.3f);
+        for (auto &x : input) x = 0.25f + noise(rng);
+
+        std::vector<float> block_out, sample_out, old_out;
+        const double block = time_per_call([&] {
+            DCBlocker<float> dc(delay);
+            block_out = input;
+            for (size_t i = 0; i + frame <= block_out.size(); i += frame) {
+                dc.removeDC(block_out.data() + i, frame);
+            }
+        });
+        const double sample = time_per_call([&] {
+            DCBlocker<float> dc(delay);
+            sample_out = input;
+            for (auto &x : sample_out) x = dc.processSample(x);
+        });
+        const double old = time_per_call([&] {
+            CircularDCBlocker dc(delay);
+            old_out = input;
+            for (auto &x : old_out) x = dc.processSample(x);
+        });
+
+        // Error of either against the same filter run in double
+        DCBlocker<double> exact(delay);
+        double new_error = 0, old_error = 0;
+        for (size_t i = 0; i < input.size(); i++) {
+            const double y = exact.processSample(input[i]);
+            new_error = std::max(new_error, std::abs(block_out[i] - y));
+            old_error = std::max(old_error, std::abs(old_out[i] - y));
+        }
+        printf("  %6d Hz  delay %3d  old %6.2f ns/sample   per sample %6.2f "
+               "ns/sample   block %6.2f ns/sample  %5.2fx%s\n",
+               rate, delay, old / rate * 1e9, sample / rate * 1e9,
+               block / rate * 1e9, old / block,
+               block_out == sample_out ? "" : "  MISMATCH");
+        printf("           error against double: old %.2g, ring %.2g%s\n",
+               old_error, new_error,
+               new_error <= old_error ? "" : "  MISMATCH");
+    }
+
+    std::mt19937 rng(2);
+    std::normal_distribution<double> sps(2.048e6, 300.0);
+    std::vector<double> doubles(200000);
+    for (auto &x : doubles) x = sps(rng);
+    std::vector<int> ints(200000), modes(200000);
+    for (auto &x : ints) x = (int)(rng() % 100000);
+    for (auto &x : modes) x = (int)(rng() % 7);
+
+    CircularMovingAverage<double> old_double(60);
+    MovingAverage<double> new_double(60);
+    CircularMovingAverage<int> old_int(10);
+    MovingAverage<int> new_int(10);
+    SetMovingMode<int> old_mode(10);
+    MovingMode<int> new_mode(10);
+    printf("  old against ring, 200000 inserts: MovingAverage<double> %zu, "
+           "MovingAverage<int> %zu, MovingMode<int> %zu differ\n",
+           count_mismatches(old_double, new_double, doubles),
+           count_mismatches(old_int, new_int, ints),
+           count_mismatches(old_mode, new_mode, modes));
+}
+
+// ── geoip ───────────────────────────────────────────────────────────────────
+// Lookups in bench/geoip-test.mmdb (written by bench/mkmmdb.py): IPv4 and
+// IPv6 networks in one tree, key strings reached through pointers, names in
+// nested maps.  Then GeoResolver over it with a two-entry cache, so a third
+// network evicts the first, and over a database that is missing or damaged.
+// Truncated copies and copies with bytes overwritten must either be refused
+// when opened or give misses; a crash here is a bug in mmdb.cpp.
+const char *const kGeoTestDatabase = "bench/geoip-test.mmdb";
+
+// Every lookup geoip-test.mmdb answers, and some it must not
+struct GeoCase {
+    const char *ip;
+    std::initializer_list<std::string_view> path;
+    const char *expected;
+};
+const GeoCase kGeoCases[] = {
+    {"81.2.3.4", {"city", "names", "en"}, "Athens"},
+    {"81.2.3.4", {"country", "iso_code"}, "GR"},
+    {"81.2.3.4", {"country", "names", "en"}, "Greece"},
+    {"81.2.3.4", {"country", "names", "de"}, "Griechenland"},
+    {"81.2.3.4", {"city", "names", "de"}, ""},
+    {"81.2.3.4", {"location"}, ""},   // a map, not a string
+    {"::ffff:81.1.1.1", {"country", "iso_code"}, "GR"},
+    {"82.104.7.9", {"city", "names", "en"}, "Rome"},
+    {"82.104.7.9", {"city", "names", "de"}, "Rom"},
+    {"82.104.7.9", {"country", "iso_code"}, "IT"},
+    {"82.105.0.1", {"country", "iso_code"}, ""},
+    {"8.8.8.8", {"country", "iso_code"}, ""},
+    {"8.8.8.8", {"registered_country", "iso_code"}, "US"},
+    {"2a01:4f8:1:2::5", {"country", "iso_code"}, "DE"},
+    {"2a01:4f8:1:2::5", {"city", "names", "en"}, ""},
+    {"2a02::1", {"country", "iso_code"}, ""},
+    {"not-an-ip", {"country", "iso_code"}, ""},
+};
+// Addresses the test database has no record for
+const std::set<std::string> kGeoMisses = {"82.105.0.1", "2a02::1",
+                                          "not-an-ip"};
+
+bool write_file(const std::string &path, const std::vector<uint8_t> &bytes) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    const bool ok = fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+    return fclose(f) == 0 && ok;
+}
+
+// Opens path and runs every lookup; false if the database refused to open
+bool geoip_lookups(const std::string &path, size_t &sink) {
+    std::unique_ptr<MaxMindDB> db;
+    try {
+        db = std::make_unique<MaxMindDB>(path);
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    for (const GeoCase &c : kGeoCases) {
+        sink += db->get_string(db->find(c.ip), c.path).size();
+    }
+    return true;
+}
+
+void bench_geoip(const std::string &path) {
+    printf("geoip: %s\n", path.c_str());
+    std::unique_ptr<MaxMindDB> db;
+    try {
+        db = std::make_unique<MaxMindDB>(path);
+    } catch (const std::runtime_error &e) {
+        printf("  %s  MISMATCH\n", e.what());
+        return;
+    }
+    printf("  %s, %u nodes\n", db->database_type().c_str(), db->nodes());
+
+    for (const GeoCase &c : kGeoCases) {
+        const int64_t record = db->find(c.ip);
+        const std::string_view got = db->get_string(record, c.path);
+        std::string field;
+        for (std::string_view key : c.path) {
+            if (!field.empty()) field += '.';
+            field += key;
+        }
+        const bool miss = kGeoMisses.count(c.ip) != 0;
+        printf("  %-16s %-28s %-14s%s\n", c.ip, field.c_str(),
+               record < 0 ? "(no record)" : std::string(got).c_str(),
+               got == c.expected && (record < 0) == miss ? "" : "  MISMATCH");
+    }
+    size_t sink = 0;
+    const double lookup = time_per_call([&] {
+        for (const char *ip : {"81.2.3.4", "2a01:4f8:1:2::5"}) {
+            const int64_t record = db->find(ip);
+            sink += db->get_string(record, {"city", "names", "en"}).size() +
+                    db->get_string(record, {"country", "iso_code"}).size();
+        }
+    });
+    printf("  lookup + 2 fields %6.0f ns\n", lookup / 2 * 1e9);
+
+    // GeoResolver answers inline without online threads: the callback has
+    // run by the time resolve() returns
+    auto &geo = GeoResolver::instance();
+    geo.configure(path, 0, 2, std::chrono::hours(1));
+    const auto resolve = [&](const std::string &ip) {
+        std::string location = "(not answered)";
+        geo.resolve(ip, [&](const std::string &l) { location = l; });
+        return location;
+    };
+    struct Step {
+        const char *ip;
+        const char *expected;
+        bool hit;
+    };
+    const Step steps[] = {
+        {"81.2.3.4", "🇬🇷 Athens, GR", false},
+        {"81.2.3.99", "🇬🇷 Athens, GR", true},   // same /24
+        {"::ffff:82.104.7.9", "🇮🇹 Rome, IT", false},
+        {"8.8.8.8", "🇺🇸 US", false},            // evicts 81.2.3.0/24
+        {"82.104.7.1", "🇮🇹 Rome, IT", true},
+        {"81.2.3.4", "🇬🇷 Athens, GR", false},   // evicts 8.8.8.0/24
+        {"8.8.8.8", "🇺🇸 US", false},
+        {"2a01:4f8:1:2::5", "🇩🇪 Germany", false},
+        {"2a01:4f8:1:2::77", "🇩🇪 Germany", true}, // same /64
+        {"192.168.1.1", "Local", false},
+        {"9.9.9.9", "", false},                   // nobody to ask
+        {"9.9.9.10", "", true},                   // a cached miss
+    };
+    printf("  resolver, 2 cache entries:\n");
+    for (const Step &s : steps) {
+        const uint64_t hits = geo.cache_hits();
+        const std::string got = resolve(s.ip);
+        const bool hit = geo.cache_hits() != hits;
+        printf("    %-18s %s  '%s'%s\n", s.ip, hit ? "hit " : "miss",
+               got.c_str(),
+               got == s.expected && hit == s.hit ? "" : "  MISMATCH");
+    }
+    const double cached = time_per_call([&] { resolve("2a01:4f8:1:2::5"); });
+    printf("    cache hit %6.0f ns\n", cached * 1e9);
+
+    // A database that is missing or not one is left out, not fatal
+    const std::string damaged =
+        (std::filesystem::temp_directory_path() / "spectrumbench-geoip.mmdb")
+            .string();
+    std::vector<uint8_t> original;
+    if (FILE *f = fopen(path.c_str(), "rb")) {
+        uint8_t buf[4096];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+            original.insert(original.end(), buf, buf + n);
+        }
+        fclose(f);
+    }
+    const std::vector<uint8_t> text = {'n', 'o', 't', ' ', 'a', 'n', ' ',
+                                       'm', 'm', 'd', 'b', '\n'};
+    // Up to and including the metadata marker
+    static constexpr uint8_t marker[] = {0xAB, 0xCD, 0xEF, 'M', 'a', 'x', 'M',
+                                         'i',  'n',  'd',  '.', 'c', 'o', 'm'};
+    auto metadata = std::search(original.begin(), original.end(),
+                                std::begin(marker), std::end(marker));
+    if (metadata != original.end()) metadata += sizeof(marker);
+    for (const auto &[what, db_path, bytes] :
+         {std::tuple{"missing", std::string("/nonexistent/geoip.mmdb"),
+                     std::vector<uint8_t>()},
+          std::tuple{"not a database", damaged, text},
+          std::tuple{"metadata cut off", damaged,
+                     std::vector<uint8_t>(original.begin(), metadata)}}) {
+        if (!bytes.empty() && !write_file(db_path, bytes)) {
+            printf("  cannot write %s  MISMATCH\n", db_path.c_str());
+            continue;
+        }
+        bool refused = false;
+        try {
+            MaxMindDB bad(db_path);
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+        geo.configure(db_path, 0, 2, std::chrono::hours(1));
+        // Not in the cache from the runs above
+        const std::string got = resolve("82.104.200.1");
+        printf("  %-18s %s, resolves '%s'%s\n", what,
+               refused ? "refused" : "opened", got.c_str(),
+               refused && got.empty() ? "" : "  MISMATCH");
+    }
+
+    // Damaged copies: every prefix length at a stride through the tree, the
+    // data and the metadata, then random bytes overwritten
+    size_t opened = 0, refused = 0;
+    for (size_t length = 1; length < original.size(); length += 7) {
+        const std::vector<uint8_t> prefix(original.begin(),
+                                          original.begin() + length);
+        if (!write_file(damaged, prefix)) break;
+        (geoip_lookups(damaged, sink) ? opened : refused)++;
+    }
+    printf("  truncated copies    %4zu refused, %4zu opened and looked up\n",
+           refused, opened);
+    opened = refused = 0;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<size_t> at(0, original.size() - 1);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (int copy = 0; copy < 2000; copy++) {
+        std::vector<uint8_t> bytes = original;
+        for (int i = 0; i < 1 + copy % 16; i++) bytes[at(rng)] = byte(rng);
+        if (!write_file(damaged, bytes)) break;
+        (geoip_lookups(damaged, sink) ? opened : refused)++;
+    }
+    printf("  overwritten copies  %4zu refused, %4zu opened and looked up\n",
+           refused, opened);
+    std::filesystem::remove(damaged);
+    geo.configure("", 0, 1, std::chrono::hours(1));
+    if (sink == 0) printf("\n");
+}
+
+// ── load ────────────────────────────────────────────────────────────────────
+// The server's frame pipeline with simulated listeners: read a hop, window,
+// FFT and quantize as fft_task does, then demodulate and encode for every
+// audio client on a DSP pool and send every waterfall client its row on a
+// waterfall pool.  Frames are handed out by dispatch_audio_frame() and
+// dispatch_waterfall_frame(), as signal_loop and waterfall_loop hand them
+// out, so channel sharing, the client strands and the backlog drop are all
+// part of the run.  Packets go to a PacketSender that only counts them, so
+// neither an SDR nor a network is involved.
+//
+// Frames run back to back, two FFT generations deep: the FFT of a frame runs
+// while the clients still work on the previous one, then waits for them.  A
+// client is never more than one frame behind, so no frame is dropped and a
+// client count is sustainable when the frame rate keeps up with the input's
+// hop rate (sps / hop size).
+//
+// A user is one audio client (USB, LSB, AM and FM in turn, each group of
+// --cotuned listeners on one frequency, so with the default of 1 shared
+// demodulation never applies) and one waterfall client (every other one on
+// the full band, the rest zoomed in at random, on CBOR, packed v1 and tiled
+// v2 framing in turn).
+struct LoadOptions {
+    int fft_size = 131072;
+    int sps = 2048000;
+    bool is_real = false;
+    int audio_sps = 12000;
+    int waterfall_size = 1024;
+    int tile_bins = 256;
+    audio_compressor codec = AUDIO_FLAC;
+    std::string input;            // raw samples, looped; synthetic if empty
+    std::string format = "s16";
+    int audio_clients = -1;       // either set: one run at that size
+    int waterfall_clients = -1;
+    int dsp_threads = 0;
+    int waterfall_threads = 0;
+    int cotuned = 1;              // audio clients per channel
+    bool share_demod = true;      // [server] share_demod
+    double seconds = 2;           // of input per run
+};
+
+// Counts what the clients send
+class BenchSender : public PacketSender {
+  public:
+    explicit BenchSender(int downsample_levels)
+        : waterfall_slices(downsample_levels),
+          waterfall_slice_mtx(downsample_levels) {}
+
+    using PacketSender::send_binary_packet;
+    using PacketSender::send_text_packet;
+    void send_binary_packet(
+        connection_hdl,
+        const std::initializer_list<std::pair<const void *, size_t>> &bufs)
+        override {
+        size_t size = 0;
+        for (auto &b : bufs) size += b.second;
+        count(size);
+    }
+    void send_binary_packet(
+        connection_hdl,
+        const std::vector<std::pair<const void *, size_t>> &bufs) override {
+        size_t size = 0;
+        for (auto &b : bufs) size += b.second;
+        count(size);
+    }
+    void send_text_packet(connection_hdl,
+                          const std::initializer_list<std::string> &data)
+        override {
+        size_t size = 0;
+        for (auto &d : data) size += d.size();
+        count(size);
+    }
+    // A private address, so AudioClient skips the geo lookup
+    std::string ip_from_hdl(connection_hdl) override { return "127.0.0.1"; }
+    void log(connection_hdl, const std::string &) override {}
+
+    waterfall_slices_t &get_waterfall_slices() override {
+        return waterfall_slices;
+    }
+    waterfall_mutexes_t &get_waterfall_slice_mtx() override {
+        return waterfall_slice_mtx;
+    }
+    signal_slices_t &get_signal_slices() override { return signal_slices; }
+    std::mutex &get_signal_slice_mtx() override { return signal_slice_mtx; }
+    void broadcast_signal_changes(const std::string &, int, double, int,
+                                  const std::string &) override {}
+
+    std::atomic<uint64_t> bytes{0};
+
+    waterfall_slices_t waterfall_slices;
+    waterfall_mutexes_t waterfall_slice_mtx;
+    signal_slices_t signal_slices;
+    std::mutex signal_slice_mtx;
+
+  private:
+    void count(size_t size) {
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+};
+
+// Noise and a few AM carriers as 16-bit samples, looped
+class SyntheticReader : public SampleReader {
+  public:
+    explicit SyntheticReader(bool is_real) {
+        constexpr size_t n = 1 << 20;
+        constexpr int carriers = 24;
+        std::mt19937 rng(1);
+        std::normal_distribution<float> noise(0.f, 40.f);
+        std::uniform_real_distribution<float> freq(is_real ? 0.01f : -0.48f,
+                                                   0.48f);
+        std::uniform_real_distribution<float> level(200.f, 2000.f);
+        std::vector<float> f(carriers), a(carriers);
+        for (int c = 0; c < carriers; c++) {
+            f[c] = freq(rng);
+            a[c] = level(rng);
+        }
+        samples.resize(is_real ? n : n * 2);
+        for (size_t i = 0; i < n; i++) {
+            std::complex<float> v{noise(rng), is_real ? 0.f : noise(rng)};
+            const float mod = 1.f + 0.5f * std::sin(0.003f * i);
+            for (int c = 0; c < carriers; c++) {
+                const double cycles = std::fmod((double)f[c] * i, 1.0);
+                v += std::polar(a[c] * mod,
+                                static_cast<float>(2 * M_PI * cycles));
+            }
+            if (is_real) {
+                samples[i] = clamp(v.real());
+            } else {
+                samples[i * 2] = clamp(v.real());
+                samples[i * 2 + 1] = clamp(v.imag());
+            }
+        }
+    }
+
+    int read(void *arr, int num) override {
+        const auto *src = reinterpret_cast<const uint8_t *>(samples.data());
+        const size_t total = samples.size() * sizeof(int16_t);
+        auto *dst = static_cast<uint8_t *>(arr);
+        for (size_t done = 0; done < static_cast<size_t>(num);) {
+            const size_t n = std::min(total - pos, num - done);
+            memcpy(dst + done, src + pos, n);
+            done += n;
+            pos = (pos + n) % total;
+        }
+        return num;
+    }
+
+  private:
+    static int16_t clamp(float v) {
+        return static_cast<int16_t>(std::clamp(v, -32767.f, 32767.f));
+    }
+
+    std::vector<int16_t> samples;
+    size_t pos = 0;
+};
+
+std::unique_ptr<SampleConverterBase> make_input(const LoadOptions &opt) {
+    std::unique_ptr<SampleReader> reader;
+    std::string format = opt.format;
+    if (opt.input.empty()) {
+        reader = std::make_unique<SyntheticReader>(opt.is_real);
+        format = "s16";
+    } else {
+        // A recording, as fast as possible and starting over at its end
+        reader = std::make_unique<MmapSampleReader>(opt.input, 0, true);
+    }
+    if (format == "u8")
+        return std::make_unique<SampleConverter<uint8_t>>(std::move(reader));
+    if (format == "s8")
+        return std::make_unique<SampleConverter<int8_t>>(std::move(reader));
+    if (format == "u16")
+        return std::make_unique<SampleConverter<uint16_t>>(std::move(reader));
+    if (format == "s16")
+        return std::make_unique<SampleConverter<int16_t>>(std::move(reader));
+    if (format == "f32")
+        return std::make_unique<SampleConverter<float>>(std::move(reader));
+    if (format == "f64")
+        return std::make_unique<SampleConverter<double>>(std::move(reader));
+    throw std::runtime_error("unknown input format " + format);
+}
+
+struct LoadResult {
+    int audio = 0;
+    int waterfall = 0;
+    int frames = 0;
+    double seconds = 0;       // wall
+    double cpu_seconds = 0;   // whole process
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    AudioFrameStats audio_stats;
+    uint64_t waterfall_skipped = 0;
+    uint64_t stage_us[static_cast<int>(Stage::COUNT)] = {};
+    uint64_t stage_calls[static_cast<int>(Stage::COUNT)] = {};
+
+    double frame_rate() const { return frames / seconds; }
+};
+
+// FFT, input and pools, kept across runs
+class LoadPipeline {
+  public:
+    explicit LoadPipeline(const LoadOptions &opt)
+        : opt{opt}, input{make_input(opt)},
+          dsp_pool{"dsp", opt.dsp_threads},
+          waterfall_pool{"waterfall", opt.waterfall_threads} {
+        fft_result_size = opt.is_real ? opt.fft_size / 2 : opt.fft_size;
+        base_idx = opt.is_real ? 0 : opt.fft_size / 2 + 1;
+        audio_fft_size =
+            (int)(std::ceil((double)opt.audio_sps * opt.fft_size / opt.sps /
+                            4.0) *
+                  4);
+        for (int cur = fft_result_size; cur >= opt.waterfall_size; cur /= 2)
+            downsample_levels++;
+        skip_num = std::max(
+            1, (int)floor(((float)opt.sps / opt.fft_size) / 10.) * 2);
+        hop_rate = opt.sps / (opt.fft_size / 2.0);
+
+        fftwf_import_wisdom_from_filename("phantom_fftw_wisdom");
+        fft = std::make_unique<FFTW>(opt.fft_size, 1, downsample_levels, 0);
+        fft->set_output_additional_size(audio_fft_size);
+        if (opt.is_real) {
+            fft->plan_r2c(FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+        } else {
+            fft->plan_c2c(FFT::FORWARD, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+        }
+        FFTPlanCache::instance().warm_audio(audio_fft_size);
+
+        hop_samples = opt.fft_size / 2 * (2 - opt.is_real);
+        const size_t hop_floats =
+            (hop_samples * std::max(sizeof(float), input->sample_size()) +
+             sizeof(float) - 1) /
+            sizeof(float);
+        for (auto &hop : hops) {
+            hop = fft->malloc(hop_floats);
+            input->read_raw(hop, hop_samples);
+        }
+        const size_t spectrum_floats =
+            opt.is_real ? opt.fft_size + 2
+                        : (size_t)(opt.fft_size + audio_fft_size) * 2;
+        const size_t quantized_bytes =
+            opt.is_real ? opt.fft_size : (size_t)opt.fft_size * 2;
+        for (auto &gen : generations) {
+            gen.spectrum = reinterpret_cast<std::complex<float> *>(
+                fftwf_malloc(sizeof(float) * spectrum_floats));
+            gen.quantized = new (std::align_val_t(32)) int8_t[quantized_bytes];
+        }
+    }
+
+    ~LoadPipeline() {
+        for (auto &gen : generations) {
+            fftwf_free(gen.spectrum);
+            operator delete[](gen.quantized, std::align_val_t(32));
+        }
+        for (auto hop : hops) fft->free(hop);
+    }
+
+    LoadResult run(int audio, int waterfall);
+
+    const LoadOptions opt;
+    int fft_result_size = 0;
+    int base_idx = 0;
+    int audio_fft_size = 0;
+    int downsample_levels = 0;
+    int skip_num = 1;
+    double hop_rate = 0;
+
+  private:
+    // A client may have the frame it is on and the next one outstanding.
+    // The previous generation is idle before a frame is dispatched, but a
+    // strand can still hold its finished front entry for a moment.
+    static constexpr size_t max_backlog = 2;
+
+    void add_clients(BenchSender &sender, int audio, int waterfall);
+    void compute_frame(FFTGeneration &gen);
+
+    std::unique_ptr<SampleConverterBase> input;
+    std::unique_ptr<FFT> fft;
+    WorkerPool dsp_pool;
+    WorkerPool waterfall_pool;
+    float *hops[2] = {};          // older, newer
+    int hop_samples = 0;
+    FFTGeneration generations[2];
+    WaterfallEncodeStats waterfall_stats;
+    int frame_num = 0;
+    std::vector<std::shared_ptr<int>> handles;
+    std::vector<std::shared_ptr<AudioClient>> audio_clients;
+    std::vector<std::shared_ptr<WaterfallClient>> waterfall_clients;
+};
+
+// Passband edges below and above the carrier, as the browser sets them
+std::pair<int, int> passband_hz(demodulation_mode mode) {
+    switch (mode) {
+    case USB: return {0, 2700};
+    case LSB: return {2700, 0};
+    case AM: return {4500, 4500};
+    default: return {5000, 5000};
+    }
+}
+
+void LoadPipeline::add_clients(BenchSender &sender, int audio,
+                               int waterfall) {
+    std::mt19937 rng(2);
+    const double bins_per_hz = (double)opt.fft_size / opt.sps;
+    const int edge = audio_fft_size;
+    std::uniform_int_distribution<int> tune(edge, fft_result_size - edge);
+    static constexpr demodulation_mode modes[] = {USB, LSB, AM, FM};
+    int m = 0;
+    for (int i = 0; i < audio; i++) {
+        auto handle = std::make_shared<int>(i);
+        handles.push_back(handle);
+        auto client = std::make_shared<AudioClient>(
+            handle, sender, opt.codec, opt.is_real, audio_fft_size,
+            opt.audio_sps, fft_result_size);
+        const demodulation_mode mode = modes[i / opt.cotuned % 4];
+        client->set_audio_demodulation(mode);
+        {
+            std::scoped_lock lg(sender.signal_slice_mtx);
+            client->it = sender.signal_slices.insert({{0, 0}, client});
+        }
+        if (i % opt.cotuned == 0) m = tune(rng);
+        const auto [below, above] = passband_hz(mode);
+        client->set_audio_range(m - (int)(below * bins_per_hz), m,
+                                m + (int)(above * bins_per_hz));
+        audio_clients.push_back(std::move(client));
+    }
+
+    std::uniform_int_distribution<int> zoom(1, downsample_levels - 1);
+    for (int i = 0; i < waterfall; i++) {
+        auto handle = std::make_shared<int>(audio + i);
+        handles.push_back(handle);
+        auto client = std::make_shared<WaterfallClient>(
+            handle, sender, WATERFALL_ZSTD, opt.waterfall_size);
+        {
+            std::scoped_lock lk(sender.waterfall_slice_mtx[0]);
+            client->it = sender.waterfall_slices[0].insert(
+                {{0, opt.waterfall_size}, client});
+        }
+        client->set_waterfall_range(downsample_levels - 1, 0,
+                                    opt.waterfall_size);
+        client->on_wire_format_message(i % 3);
+        if (i % 2 == 1 && downsample_levels > 1) {
+            const int width = fft_result_size >> zoom(rng);
+            const int l = std::uniform_int_distribution<int>(
+                0, fft_result_size - width)(rng);
+            std::optional<double> m;
+            std::optional<int> level;
+            client->on_window_message(l, m, l + width, level);
+        }
+        waterfall_clients.push_back(std::move(client));
+    }
+}
+
+void LoadPipeline::compute_frame(FFTGeneration &gen) {
+    {
+        StageTimer timer(Stage::READ);
+        input->read_raw(hops[0], hop_samples);
+    }
+    std::swap(hops[0], hops[1]);
+    {
+        StageTimer timer(Stage::WINDOW);
+        fft->load_raw_input(*input, hops[0], hops[1]);
+    }
+    fft->set_output(reinterpret_cast<float *>(gen.spectrum), gen.quantized);
+    fft->execute();
+    if (!opt.is_real && !fft->fills_wraparound()) {
+        memmove(&gen.spectrum[fft_result_size], &gen.spectrum[0],
+                sizeof(fftwf_complex) * audio_fft_size);
+    }
+}
+
+LoadResult LoadPipeline::run(int audio, int waterfall) {
+    BenchSender sender(downsample_levels);
+    add_clients(sender, audio, waterfall);
+
+    AudioFrameStats audio_stats;
+    uint64_t waterfall_skipped = 0;
+    const auto frame = [&] {
+        FFTGeneration &gen = generations[frame_num % 2];
+        compute_frame(gen);
+        generations[(frame_num + 1) % 2].wait_idle();
+        const FrameDispatch dispatch{gen, frame_num, fft_result_size,
+                                     max_backlog};
+        {
+            StageTimer timer(Stage::SIGNAL_DISPATCH);
+            const AudioFrameStats stats = dispatch_audio_frame(
+                sender, dsp_pool, dispatch, base_idx, opt.share_demod);
+            audio_stats.skipped += stats.skipped;
+            audio_stats.channel_frames += stats.channel_frames;
+            audio_stats.channel_sends += stats.channel_sends;
+        }
+        if (frame_num % skip_num == 0) {
+            StageTimer timer(Stage::WATERFALL_DISPATCH);
+            waterfall_skipped += dispatch_waterfall_frame(
+                sender, waterfall_pool, dispatch, downsample_levels,
+                opt.tile_bins, true, waterfall_stats);
+        }
+        frame_num++;
+    };
+    const auto drain = [&] {
+        for (auto &gen : generations) gen.wait_idle();
+    };
+    // Encoders and per-client buffers settle in the first frames
+    for (int i = 0; i < 4; i++) frame();
+    drain();
+    audio_stats = {};
+    waterfall_skipped = 0;
+
+    LoadResult result;
+    result.audio = audio;
+    result.waterfall = waterfall;
+    result.frames = std::max(8, (int)(opt.seconds * hop_rate));
+    Histogram::Snapshot before[static_cast<int>(Stage::COUNT)];
+    for (int s = 0; s < static_cast<int>(Stage::COUNT); s++) {
+        before[s] = metrics().stages[s].snapshot();
+    }
+    const uint64_t allocations = heap_allocations.load();
+    const uint64_t bytes = sender.bytes.load();
+    const std::clock_t cpu_start = std::clock();
+    const auto start = bench_clock::now();
+    for (int i = 0; i < result.frames; i++) frame();
+    drain();
+    result.seconds =
+        std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    result.allocations = heap_allocations.load() - allocations;
+    result.bytes = sender.bytes.load() - bytes;
+    result.audio_stats = audio_stats;
+    result.waterfall_skipped = waterfall_skipped;
+    for (int s = 0; s < static_cast<int>(Stage::COUNT); s++) {
+        const Histogram::Snapshot after = metrics().stages[s].snapshot();
+        result.stage_us[s] = after.sum - before[s].sum;
+        result.stage_calls[s] = after.count - before[s].count;
+    }
+
+    for (auto &client : audio_clients) client->on_close();
+    for (auto &client : waterfall_clients) client->on_close();
+    audio_clients.clear();
+    waterfall_clients.clear();
+    handles.clear();
+    return result;
+}
+
+void print_load_result(const LoadPipeline &pipeline, const LoadResult &r) {
+    const double fps = r.frame_rate();
+    printf("  %5d audio %5d waterfall  %7.1f frames/s  %4.0f%% of budget  "
+           "%5.2f cores  %8.1f allocs/frame  %7.2f Mbit/s out\n",
+           r.audio, r.waterfall, fps, 100.0 * pipeline.hop_rate / fps,
+           r.cpu_seconds / r.seconds, double(r.allocations) / r.frames,
+           r.bytes * 8.0 / r.frames * pipeline.hop_rate / 1e6);
+    // Listener frames served from a shared channel's demodulator, and frames
+    // dropped from client backlogs (none while the run keeps up)
+    if (r.audio_stats.channel_sends > 0) {
+        printf("  %5.1f%% of audio frames shared, %.1f channels/frame\n",
+               100.0 * r.audio_stats.channel_sends /
+                   ((double)r.audio * r.frames),
+               double(r.audio_stats.channel_frames) / r.frames);
+    }
+    if (r.audio_stats.skipped > 0 || r.waterfall_skipped > 0) {
+        printf("  skipped %llu audio and %llu waterfall frames\n",
+               (unsigned long long)r.audio_stats.skipped,
+               (unsigned long long)r.waterfall_skipped);
+    }
+}
+
+void print_load_stages(const LoadResult &r) {
+    printf("  stage               ms/frame   us/call\n");
+    for (int s = 0; s < static_cast<int>(Stage::COUNT); s++) {
+        if (r.stage_calls[s] == 0) continue;
+        printf("  %-18s  %8.3f  %8.1f\n", stage_name(static_cast<Stage>(s)),
+               r.stage_us[s] / 1000.0 / r.frames,
+               double(r.stage_us[s]) / r.stage_calls[s]);
+    }
+}
+
+bool parse_load_options(int argc, char **argv, LoadOptions &opt) {
+    try {
+        for (int i = 2; i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg == "--real") {
+                opt.is_real = true;
+                continue;
+            }
+            if (arg == "--no-share") {
+                opt.share_demod = false;
+                continue;
+            }
+            if (i + 1 >= argc) return false;
+            const std::string value = argv[++i];
+            if (arg == "--fft-size") opt.fft_size = std::stoi(value);
+            else if (arg == "--sps") opt.sps = std::stoi(value);
+            else if (arg == "--audio-sps") opt.audio_sps = std::stoi(value);
+            else if (arg == "--input") opt.input = value;
+            else if (arg == "--format") opt.format = value;
+            else if (arg == "--audio") opt.audio_clients = std::stoi(value);
+            else if (arg == "--waterfall")
+                opt.waterfall_clients = std::stoi(value);
+            else if (arg == "--seconds") opt.seconds = std::stod(value);
+            else if (arg == "--cotuned") opt.cotuned = std::stoi(value);
+            else if (arg == "--dsp-threads")
+                opt.dsp_threads = std::stoi(value);
+            else if (arg == "--waterfall-threads")
+                opt.waterfall_threads = std::stoi(value);
+            else if (arg == "--codec" && value == "flac")
+                opt.codec = AUDIO_FLAC;
+            else if (arg == "--codec" && value == "opus")
+                opt.codec = AUDIO_OPUS;
+            else
+                return false;
+        }
+    } catch (const std::exception &) {
+        return false;
+    }
+    // Listener slices must fit well inside the band
+    return opt.sps > 0 && opt.audio_sps > 0 && opt.cotuned > 0 &&
+           opt.audio_sps * 4 < opt.sps &&
+           opt.fft_size >= 2 * opt.waterfall_size;
+}
+
+void bench_load(const LoadOptions &opt) {
+    LoadPipeline pipeline(opt);
+    printf("load: %d-point %s FFT at %d S/s, %.1f ms hop, waterfall every %d "
+           "frames, %s input\n",
+           opt.fft_size, opt.is_real ? "real" : "IQ", opt.sps,
+           1e3 / pipeline.hop_rate, pipeline.skip_num,
+           opt.input.empty() ? "synthetic" : opt.input.c_str());
+    if (opt.cotuned > 1) {
+        printf("  %d listeners per channel, shared demodulation %s\n",
+               opt.cotuned, opt.share_demod ? "on" : "off");
+    }
+
+    if (opt.audio_clients >= 0 || opt.waterfall_clients >= 0) {
+        const LoadResult r = pipeline.run(std::max(0, opt.audio_clients),
+                                          std::max(0, opt.waterfall_clients));
+        print_load_result(pipeline, r);
+        print_load_stages(r);
+        return;
+    }
+
+    // Double the users until the frame rate falls behind, then bisect to
+    // within 5%.  A user is one audio and one waterfall client.
+    const auto keeps_up = [&](const LoadResult &r) {
+        return r.frame_rate() >= pipeline.hop_rate;
+    };
+    std::optional<LoadResult> best;
+    int good = 0, bad = 0;
+    for (int users = 1; users <= 65536; users *= 2) {
+        LoadResult r = pipeline.run(users, users);
+        print_load_result(pipeline, r);
+        if (!keeps_up(r)) {
+            bad = users;
+            break;
+        }
+        good = users;
+        best = r;
+    }
+    while (bad && bad - good > std::max(1, good / 20)) {
+        const int users = (good + bad) / 2;
+        LoadResult r = pipeline.run(users, users);
+        print_load_result(pipeline, r);
+        if (keeps_up(r)) {
+            good = users;
+            best = r;
+        } else {
+            bad = users;
+        }
+    }
+    if (!best) {
+        printf("  not sustainable even for a single user\n");
+        return;
+    }
+    printf("  max sustainable: %d users (%d audio + %d waterfall clients)\n",
+           good, good, good);
+    print_load_stages(*best);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const std::string what = argc > 1 ? argv[1] : "all";
+    if (what == "load") {
+        LoadOptions opt;
+        if (!parse_load_options(argc, argv, opt)) {
+            fprintf(stderr,
+                    "usage: %s load [--fft-size N] [--sps N] [--real] "
+                    "[--audio-sps N]\n"
+                    "         [--input FILE [--format u8|s8|u16|s16|f32|f64]] "
+                    "[--codec flac|opus]\n"
+                    "         [--audio N] [--waterfall N] [--seconds S]\n"
+                    "         [--dsp-threads N] [--waterfall-threads N]\n"
+                    "         [--cotuned N] [--no-share]\n",
+                    argv[0]);
+            return 1;
+        }
+        bench_load(opt);
+        return 0;
+    }
+    bool ran = false;
+    if (what == "all" || what == "convert") {
+        bench_convert();
+        ran = true;
+    }
+    if (what == "all" || what == "quantize") {
+        bench_quantize();
+        ran = true;
+    }
+    if (what == "all" || what == "wire") {
+        bench_wire();
+        ran = true;
+    }
+    if (what == "all" || what == "agc") {
+        bench_agc();
+        ran = true;
+    }
+    if (what == "all" || what == "dc") {
+        bench_dc();
+        ran = true;
+    }
+    if (what == "all" || what == "geoip") {
+        bench_geoip(what == "geoip" && argc > 2 ? argv[2] : kGeoTestDatabase);
+        ran = true;
+    }
+    if (!ran) {
+        fprintf(stderr,
+                "usage: %s [all|convert|quantize|wire|agc|dc|geoip|load]\n"
+                "       %s geoip [FILE.mmdb]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    return 0;
+}
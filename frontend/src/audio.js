@@ -2,7 +2,7 @@ import { createDecoder, firdes_kaiser_lowpass } from './lib/wrappers'
 import { OpusMLDecoder } from '@wasm-audio-decoders/opus-ml';
 
 import createWindow from 'live-moving-average'
-import { decode as cbor_decode } from 'cbor-x';
+import { decodeAudioPacket, WIRE_FORMAT_VERSION } from './lib/wireformat';
 import { encode } from "./modules/ft8.js";
 import { WSPR_TOTAL_SAMPLES, wspr2SlotPosition } from "./modules/wspr.js";
 import { KiwiSSTVDecoder } from './sstv.js';
@@ -790,6 +790,8 @@ async init() {
     // Advertise codec capabilities before any mode change can trigger C-QUAM.
     // Older servers ignore unknown commands, so this is backward-compatible.
     this._safeSend({ cmd: 'codec_caps', opus: OPUS_ENABLED })
+    // Packed frame headers instead of CBOR; also ignored by older servers.
+    this._safeSend({ cmd: 'wire_format', version: WIRE_FORMAT_VERSION })
   }
   this.audioSocket.onerror = (evt) => this._handleSocketTerminal('error', evt)
   this.audioSocket.onclose = (evt) => this._handleSocketTerminal('close', evt)
@@ -2336,7 +2338,7 @@ setAGC(newAGCSpeed) {
 
   socketMessage(event) {
     if (event.data instanceof ArrayBuffer) {
-      const packet = cbor_decode(new Uint8Array(event.data))
+      const packet = decodeAudioPacket(new Uint8Array(event.data))
       
       // ✅ ADDED: Track channel count for C-QUAM stereo
       this.channels = packet.channels || 1;
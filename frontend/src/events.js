@@ -2,6 +2,10 @@ export default class SpectrumEvent {
   constructor (endpoint) {
     this.endpoint = endpoint
     this.signalClients = {}
+    // Listener handles used by the binary deltas, handle -> id
+    this.handles = new Map()
+    this.seq = null
+    this.deltas = false
     this.lastModified = performance.now()
   }
 
@@ -24,11 +28,19 @@ export default class SpectrumEvent {
   }
 
   socketMessage (event) {
+    if (event.data instanceof ArrayBuffer) {
+      this.applyDelta(event.data)
+      return
+    }
     const data = JSON.parse(event.data)
     this.data = data
     if ('signal_list' in data) {
       this.signalClients = data.signal_list
     }
+    if (data.snapshot) {
+      this.signalClients = {}
+      this.handles.clear()
+    }
     if ('signal_changes' in data) {
       const signalChanges = data.signal_changes
       for (const [user, range] of Object.entries(signalChanges)) {
@@ -39,7 +51,81 @@ export default class SpectrumEvent {
         }
       }
     }
- 
+    if ('signal_handles' in data) {
+      for (const [user, handle] of Object.entries(data.signal_handles)) {
+        this.handles.set(handle, user)
+      }
+    }
+    if ('seq' in data) {
+      this.seq = data.seq
+      if (!this.deltas) {
+        // From here on the server sends only what changed, in binary (see
+        // wireformat.h on the server), starting from the state we have now
+        this.deltas = true
+        this.eventSocket.send(JSON.stringify({
+          cmd: 'wire_format',
+          version: 1,
+          seq: this.seq
+        }))
+      }
+    }
+    this.updateCounts(data)
+    this.lastModified = performance.now()
+  }
+
+  // One tick of listener changes: a 36-byte header, then per change a u8
+  // kind (0 joined, 1 moved, 2 left) and a u32 handle
+  applyDelta (buffer) {
+    const view = new DataView(buffer)
+    if (view.byteLength < 36 || view.getUint8(0) !== 0x44 || view.getUint8(1) !== 1) {
+      return
+    }
+    const count = view.getUint16(2, true)
+    const fromSeq = Number(view.getBigUint64(8, true))
+    const toSeq = Number(view.getBigUint64(16, true))
+    // The server only sends a delta to a client at fromSeq, and follows a
+    // missed one with a snapshot
+    if (fromSeq !== this.seq) {
+      return
+    }
+    const decoder = new TextDecoder()
+    let offset = 36
+    for (let i = 0; i < count; i++) {
+      const kind = view.getUint8(offset)
+      const handle = view.getUint32(offset + 1, true)
+      offset += 5
+      if (kind === 0) {
+        const length = view.getUint8(offset)
+        const id = decoder.decode(new Uint8Array(buffer, offset + 1, length))
+        this.handles.set(handle, id)
+        offset += 1 + length
+      }
+      const user = this.handles.get(handle)
+      if (kind === 2) {
+        if (user !== undefined) delete this.signalClients[user]
+        this.handles.delete(handle)
+        continue
+      }
+      const range = [
+        view.getInt32(offset, true),
+        view.getFloat64(offset + 4, true),
+        view.getInt32(offset + 12, true)
+      ]
+      offset += 16
+      if (user !== undefined) this.signalClients[user] = range
+    }
+    this.seq = toSeq
+    this.data = {
+      signal_clients: view.getUint32(4, true),
+      waterfall_clients: view.getUint32(24, true),
+      waterfall_kbits: view.getFloat32(28, true),
+      audio_kbits: view.getFloat32(32, true)
+    }
+    this.updateCounts(this.data)
+    this.lastModified = performance.now()
+  }
+
+  updateCounts (data) {
     if ('waterfall_clients' in data) {
       // FIX: was data.signal_clients — that's the audio/signal connection count.
       // The waterfall_clients field is the total visible-user count shown in the UI.
@@ -64,7 +150,6 @@ export default class SpectrumEvent {
         </div>
       `;
     }
-    this.lastModified = performance.now()
   }
 
   setUserID (userID) {
@@ -0,0 +1,93 @@
+// Packed binary framing for audio and waterfall frames (see src/wireformat.h
+// on the server).  The client asks for it with { cmd: 'wire_format', version }
+// after connecting; servers that do not know the command keep sending CBOR,
+// so every message is checked: packed frames start with their version byte,
+// CBOR maps with 0xa0..0xbf.
+import { decode as cbor_decode } from 'cbor-x';
+
+// Version requested from the server.  v2 adds tiled waterfall messages; the
+// audio packets and single waterfall rows keep their v1 framing.
+export const WIRE_FORMAT_VERSION = 2
+
+const PACKED_V1 = 1
+const TILED_V2 = 2
+const AUDIO_HEADER_BYTES = 32
+const WATERFALL_HEADER_BYTES = 20
+const TILES_HEADER_BYTES = 24
+const AUDIO_CODECS = ['flac', 'opus', 'pcm']
+
+function isPacked(bytes) {
+  return bytes.length > 0 && bytes[0] === PACKED_V1
+}
+
+// Byte 2 is 'T': as a zstd block header that would be an oversized block, so
+// this never matches a message of the older single zstd stream.
+export function isWaterfallTiles(bytes) {
+  return bytes.length >= TILES_HEADER_BYTES && bytes[0] === TILED_V2 &&
+         bytes[2] === 0x54
+}
+
+// Tiled waterfall message (not zstd-wrapped as a whole): each tile is its own
+// zstd frame, decompressed with the given ZstdStreamDecoder.
+// Returns { frame_num, l, r, data: Int8Array } covering all the tiles.
+export function decodeWaterfallTiles(bytes, zstd) {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+  const tileCount = view.getUint16(20, true)
+  const tileBins = view.getUint16(22, true)
+  const data = new Int8Array(tileCount * tileBins)
+  let offset = TILES_HEADER_BYTES
+  for (let t = 0; t < tileCount && offset + 4 <= bytes.length; t++) {
+    const size = view.getUint32(offset, true)
+    offset += 4
+    zstd.clear()
+    let pos = t * tileBins
+    for (const chunk of zstd.decode(bytes.subarray(offset, offset + size))) {
+      data.set(new Int8Array(chunk.buffer, chunk.byteOffset,
+                             Math.min(chunk.byteLength, data.length - pos)), pos)
+      pos += chunk.byteLength
+    }
+    offset += size
+  }
+  return {
+    l: view.getInt32(4, true),
+    frame_num: Number(view.getBigUint64(8, true)),
+    r: view.getInt32(16, true),
+    data,
+  }
+}
+
+// Returns { frame_num, l, m, r, pwr, channels, sam_locked, codec, data }
+export function decodeAudioPacket(bytes) {
+  if (!isPacked(bytes)) {
+    return cbor_decode(bytes)
+  }
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+  return {
+    codec: AUDIO_CODECS[bytes[1]],
+    channels: bytes[2],
+    sam_locked: (bytes[3] & 1) !== 0,
+    l: view.getInt32(4, true),
+    frame_num: Number(view.getBigUint64(8, true)),
+    m: view.getFloat64(16, true),
+    r: view.getInt32(24, true),
+    pwr: view.getFloat32(28, true),
+    data: bytes.subarray(AUDIO_HEADER_BYTES),
+  }
+}
+
+// Returns { frame_num, l, r, data: Int8Array }
+export function decodeWaterfallPacket(bytes) {
+  if (!isPacked(bytes)) {
+    const packet = cbor_decode(bytes)
+    packet.data = new Int8Array(packet.data)
+    return packet
+  }
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength)
+  return {
+    l: view.getInt32(4, true),
+    frame_num: Number(view.getBigUint64(8, true)),
+    r: view.getInt32(16, true),
+    data: new Int8Array(bytes.buffer, bytes.byteOffset + WATERFALL_HEADER_BYTES,
+                        bytes.byteLength - WATERFALL_HEADER_BYTES),
+  }
+}
@@ -1,6 +1,6 @@
 import { Audio, AudioCodec, ZstdStreamDecoder, firdes_kaiser_lowpass, __wbg_set_wasm } from '../modules/phantomsdrdsp_bg.js'
 import { RollingAvg } from 'efficient-rolling-stats'
-import { decode as cbor_decode } from 'cbor-x';
+import { decodeWaterfallPacket, decodeWaterfallTiles, isWaterfallTiles } from './wireformat';
 import Denque from 'denque'
 
 
@@ -73,19 +73,24 @@ export { firdes_kaiser_lowpass }
 }*/
 
 
-function decodePacket(packet) {
-  packet = cbor_decode(packet)
-  packet.data = new Int8Array(packet.data)
-  return packet
-}
-
 export class ZstdWaterfallDecoder {
   constructor() {
     this.decoder = new ZstdStreamDecoder()
   }
   decode(packet) {
     packet = new Uint8Array(packet)
-    return this.decoder.decode(packet).map(decodePacket)
+    if (isWaterfallTiles(packet)) {
+      return [decodeWaterfallTiles(packet, this.decoder)]
+    }
+    // Packed-format servers send every row as a complete zstd frame (rows
+    // are shared between clients), so start a fresh stream whenever a
+    // message opens with the frame magic.  Continuation blocks of the older
+    // single stream can never start with it.
+    if (packet.length >= 4 && packet[0] === 0x28 && packet[1] === 0xb5 &&
+        packet[2] === 0x2f && packet[3] === 0xfd) {
+      this.decoder.clear()
+    }
+    return this.decoder.decode(packet).map(decodeWaterfallPacket)
   }
   destroy() {
     this.decoder.free()
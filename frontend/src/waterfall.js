@@ -1,5 +1,6 @@
 import getColormap, { computeColormapArray } from './lib/colormaps.js'
 import { JitterBuffer, createWaterfallDecoder } from './lib/wrappers.js'
+import { WIRE_FORMAT_VERSION } from './lib/wireformat.js'
 import Denque from 'denque'
 import 'core-js/actual/set-immediate'
 import 'core-js/actual/clear-immediate'
@@ -433,6 +434,13 @@ export default class SpectrumWaterfall {
     this.waterfallSocket.binaryType = 'arraybuffer'
     this.firstWaterfallMessage = true
     this.waterfallSocket.onmessage = this.socketMessageInitial.bind(this)
+    this.waterfallSocket.onopen = () => {
+      // Packed frame headers instead of CBOR (see lib/wireformat.js)
+      this.waterfallSocket.send(JSON.stringify({
+        cmd: 'wire_format',
+        version: WIRE_FORMAT_VERSION,
+      }))
+    }
 
     this.promise = new Promise((resolve, reject) => {
       this.resolvePromise = resolve
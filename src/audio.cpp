@@ -8,33 +8,65 @@
 
 AudioEncoder::AudioEncoder(websocketpp::connection_hdl hdl,
                            PacketSender &sender)
-    : hdl{hdl}, sender{sender} {
-    set_data(0, 0, 0, 0, 0, 1);
-}
+    : hdl{hdl}, sender{sender} {}
 
 AudioEncoder::~AudioEncoder() = default;
 
 void AudioEncoder::set_data(uint64_t frame_num, int l, double m, int r,
                             double pwr, int channels, bool sam_locked) {
-    packet["frame_num"] = frame_num;
-    packet["l"] = l;
-    packet["m"] = m;
-    packet["r"] = r;
-    packet["pwr"] = pwr;
-    packet["channels"] = channels;
-    packet["sam_locked"] = sam_locked;
+    frame.frame_num = frame_num;
+    frame.l = l;
+    frame.m = m;
+    frame.r = r;
+    frame.pwr = pwr;
+    frame.channels = static_cast<uint8_t>(channels);
+    frame.sam_locked = sam_locked;
 }
 
 int AudioEncoder::send(const void *buffer, size_t bytes, unsigned) {
+    // A subscriber that has gone away must not fail the encoder, which is
+    // still producing this client's stream.
+    auto fan_out = [&](auto &&send_one) {
+        if (!subscribers) return;
+        for (auto &sub : *subscribers) {
+            try {
+                send_one(sub);
+            } catch (...) {
+            }
+        }
+    };
+
     try {
+        if (wire_version != WIRE_CBOR) {
+            // Header and payload are gathered straight into the websocket
+            // message, nothing else is allocated.
+            uint8_t header[WIRE_AUDIO_HEADER_BYTES];
+            pack_audio_header(header, frame);
+            auto send_one = [&](websocketpp::connection_hdl to) {
+                sender.send_binary_packet(
+                    to, {{header, sizeof(header)}, {buffer, bytes}});
+            };
+            fan_out(send_one);
+            if (to_self) send_one(hdl);
+            return 0;
+        }
+
+        packet["frame_num"] = frame.frame_num;
+        packet["l"] = frame.l;
+        packet["m"] = frame.m;
+        packet["r"] = frame.r;
+        packet["pwr"] = frame.pwr;
+        packet["channels"] = frame.channels;
+        packet["sam_locked"] = frame.sam_locked;
         packet["codec"] = codec_name;
         packet["data"] = json::binary(
             std::vector<uint8_t>((uint8_t *)buffer, (uint8_t *)buffer + bytes));
         auto cbor = json::to_cbor(packet);
-        sender.send_binary_packet(hdl, cbor.data(), cbor.size());
-
-
-        
+        auto send_one = [&](websocketpp::connection_hdl to) {
+            sender.send_binary_packet(to, cbor.data(), cbor.size());
+        };
+        fan_out(send_one);
+        if (to_self) send_one(hdl);
         return 0;
     } catch (...) {
         return 1;
@@ -80,6 +112,7 @@ OpusAudioEncoder::OpusAudioEncoder(websocketpp::connection_hdl hdl,
     : AudioEncoder(hdl, sender)
 {
     codec_name = "opus";
+    frame.codec = WIRE_CODEC_OPUS;
     opus_channels = (channels == 2) ? 2 : 1;
     int err = 0;
 
@@ -25,11 +25,24 @@ enum class FlacMode {
 #endif
 
 #include "client.h"
+#include "wireformat.h"
 
 class AudioEncoder {
   public:
     AudioEncoder(websocketpp::connection_hdl hdl, PacketSender& sender);
     void set_data(uint64_t frame_num, int l, double m, int r, double pwr, int channels = 1, bool sam_locked = false);
+    // Framing for the following packets (WIRE_CBOR or a packed version)
+    void set_wire_version(uint8_t version) { wire_version = version; }
+    // Other clients that get the packets of the following process() calls
+    // (shared demodulation).  to_self = false leaves this encoder's own client
+    // out.  The list is not copied and must outlive those calls.
+    void set_recipients(
+        const std::vector<websocketpp::connection_hdl> *subscribers,
+        bool to_self) {
+        this->subscribers = subscribers;
+        this->to_self = to_self;
+    }
+    wire_codec get_codec() const { return frame.codec; }
     virtual int process(int32_t *data, size_t size) = 0;
     virtual int finish_encoder() = 0;
     virtual ~AudioEncoder();
@@ -39,11 +52,18 @@ class AudioEncoder {
     websocketpp::connection_hdl hdl;
     PacketSender& sender;
 
+    // Fields of the next packet.  Only turned into a json map (and CBOR) for
+    // clients still on WIRE_CBOR.
+    AudioFrameHeader frame;
+    uint8_t wire_version = WIRE_CBOR;
+    const std::vector<websocketpp::connection_hdl> *subscribers = nullptr;
+    bool to_self = true;
     json packet;   // no ZSTD stream anymore
     // Codec label attached to every audio packet so the browser knows which
     // decoder produced `data`.  This lets the server swap a client's codec at
     // runtime (e.g. FLAC→Opus when C-QUAM is enabled) and have the frontend
-    // rebuild its decoder in lock-step with the frames.  Subclasses override.
+    // rebuild its decoder in lock-step with the frames.  Subclasses override
+    // both the CBOR name and the packed codec id.
     std::string codec_name{"flac"};
 };
 
@@ -52,6 +72,7 @@ class FlacEncoder : public AudioEncoder, public FLAC::Encoder::Stream {
     FlacEncoder(websocketpp::connection_hdl hdl, PacketSender& sender)
         : AudioEncoder(hdl, sender), FLAC::Encoder::Stream() {
         codec_name = "flac";
+        frame.codec = WIRE_CODEC_FLAC;
         const char* m = std::getenv("FLAC_MODE");
         if (m && std::string(m) == "UltraLowLatency") configure_flac(FlacMode::UltraLowLatency);
         else if (m && std::string(m) == "LowBandwidth") configure_flac(FlacMode::LowBandwidth);
@@ -80,6 +101,7 @@ class PcmEncoder : public AudioEncoder {
     PcmEncoder(websocketpp::connection_hdl hdl, PacketSender& sender)
         : AudioEncoder(hdl, sender) {
         codec_name = "pcm";
+        frame.codec = WIRE_CODEC_PCM;
     }
     ~PcmEncoder() override = default;
 
@@ -196,9 +196,9 @@ void ChatClient::on_chat_message(connection_hdl sender_hdl, std::string& usernam
         // Snapshot the current history for persistence (≤20 items — cheap copy).
         history_snapshot.assign(chat_messages_history.begin(),
                                 chat_messages_history.end());
-        for (const auto& conn : chat_connections) {
-            sender.send_text_packet(conn, formatted_message);
-        }
+        sender.broadcast_text_packet(
+            {chat_connections.begin(), chat_connections.end()},
+            formatted_message);
     } // mutex released here — disk write happens below
 
     // Write history to disk outside the lock so disk latency doesn't block
@@ -367,8 +367,9 @@ void ChatClient::delete_message(const std::string& line) {
         // Clients handle "__CHAT_DELETE__:<line>" by removing that message from
         // their displayed chat UI immediately, with no page reload needed.
         if (shared_sender_) {
-            for (const auto& conn : chat_connections)
-                shared_sender_->send_text_packet(conn, delete_frame);
+            shared_sender_->broadcast_text_packet(
+                {chat_connections.begin(), chat_connections.end()},
+                delete_frame);
         }
     }   // mutex released before disk I/O
 
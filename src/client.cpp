@@ -9,11 +9,31 @@ void PacketSender::send_binary_packet(connection_hdl hdl, const void *data,
     send_binary_packet(hdl, {{data, size}});
 }
 
+void PacketSender::send_binary_packet(
+    connection_hdl hdl,
+    const std::vector<std::pair<const void *, size_t>> &bufs) {
+    std::string joined;
+    for (auto &[data, size] : bufs) {
+        joined.append(static_cast<const char *>(data), size);
+    }
+    send_binary_packet(hdl, {{joined.data(), joined.size()}});
+}
+
 void PacketSender::send_text_packet(connection_hdl hdl,
                                     const std::string &data) {
     send_text_packet(hdl, {data});
 }
 
+size_t PacketSender::broadcast_text_packet(
+    const std::vector<connection_hdl> &hdls, const std::string &data) {
+    for (auto &hdl : hdls) {
+        send_text_packet(hdl, {data});
+    }
+    return hdls.size();
+}
+
+std::optional<bool> PacketSender::frame_wanted(Client &, int) { return true; }
+
 /* clang-format off */
 struct window_cmd {
     int l;
@@ -130,6 +150,24 @@ struct glz::meta<agc_enable_cmd>
     );
 };
 
+// Server-side noise reduction command
+struct noise_reduction_cmd {
+    bool blanker = false;
+    bool spectral = false;
+    std::string lms;
+};
+
+template <>
+struct glz::meta<noise_reduction_cmd>
+{
+    using T = noise_reduction_cmd;
+    static constexpr auto value = object(
+        "blanker", &T::blanker,
+        "spectral", &T::spectral,
+        "lms", &T::lms
+    );
+};
+
 // Codec capability command: the client advertises which codecs it can decode.
 // Currently only Opus support is negotiable; when false the server keeps this
 // client on FLAC even for C-QUAM (see AudioClient::set_am_stereo).
@@ -162,9 +200,25 @@ struct glz::meta<set_codec_cmd>
     );
 };
 
+// Binary frame format (see wireformat.h).  The frontend sends the newest
+// version it can parse; clients that never send it stay on CBOR.
+struct wire_format_cmd {
+    int version;
+};
+
+template <>
+struct glz::meta<wire_format_cmd>
+{
+    using T = wire_format_cmd;
+    static constexpr auto value = object(
+        "version", &T::version
+    );
+};
+
 using msg_variant = std::variant<window_cmd, demodulation_cmd, userid_cmd, mute_cmd, chat_cmd,
                                   noise_gate_enable_cmd, noise_gate_preset_cmd, agc_enable_cmd,
-                                  codec_caps_cmd, set_codec_cmd>;
+                                  codec_caps_cmd, set_codec_cmd, wire_format_cmd,
+                                  noise_reduction_cmd>;
 
 template <>
 struct glz::meta<msg_variant>
@@ -180,7 +234,9 @@ struct glz::meta<msg_variant>
         "noise_gate_preset",
         "agc_enable",
         "codec_caps",
-        "set_codec"
+        "set_codec",
+        "wire_format",
+        "noise_reduction"
     };
 };
 
@@ -226,6 +282,12 @@ void Client::on_message(std::string &msg) {
             },
             [&](set_codec_cmd &cmd) {
                 on_set_codec_message(cmd.codec);
+            },
+            [&](wire_format_cmd &cmd) {
+                on_wire_format_message(cmd.version);
+            },
+            [&](noise_reduction_cmd &cmd) {
+                on_noise_reduction_message(cmd.blanker, cmd.spectral, cmd.lms);
             }
         },
         msg_parsed);
@@ -236,6 +298,12 @@ void Client::on_window_message(int, std::optional<double> &, int,
 void Client::on_demodulation_message(std::string &) {}
 void Client::on_codec_caps_message(bool) {}
 void Client::on_set_codec_message(std::string &) {}
+void Client::on_wire_format_message(int version) {
+    const uint8_t v = version <= WIRE_CBOR ? WIRE_CBOR
+                      : version >= WIRE_LATEST ? WIRE_LATEST
+                                               : static_cast<uint8_t>(version);
+    wire_version.store(v, std::memory_order_relaxed);
+}
 void Client::on_chat_message(connection_hdl, std::string &, std::string &) {}
 void Client::on_userid_message(std::string &userid) {
     // Used for correlating between signal and waterfall sockets
@@ -243,7 +311,9 @@ void Client::on_userid_message(std::string &userid) {
 }
 void Client::on_mute(bool mute) { this->mute = mute; }
 
-// Default empty implementations for noise gate and AGC (AudioClient will override)
+// Default empty implementations for noise gate, AGC and noise reduction
+// (AudioClient will override)
 void Client::on_noise_gate_enable_message(bool) {}
 void Client::on_noise_gate_preset_message(std::string &) {}
-void Client::on_agc_enable_message(bool) {}
\ No newline at end of file
+void Client::on_agc_enable_message(bool) {}
+void Client::on_noise_reduction_message(bool, bool, std::string &) {}
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <optional>
 #include <string>
@@ -9,6 +12,8 @@
 #include <fftw3.h>
 #include <websocketpp/connection.hpp>
 
+#include "wireformat.h"
+
 using websocketpp::connection_hdl;
 
 enum conn_type {
@@ -53,6 +58,7 @@ enum waterfall_compressor { WATERFALL_ZSTD, WATERFALL_AV1 };
 // FLAC/Opus encode cost on the P-cores. See PcmEncoder in audio.h.
 enum audio_compressor { AUDIO_FLAC, AUDIO_OPUS, AUDIO_PCM };
 
+class Client;
 class WaterfallClient;
 class AudioClient;
 class ChatClient;
@@ -73,10 +79,18 @@ class PacketSender {
         const std::initializer_list<std::pair<const void *, size_t>> &bufs) = 0;
     virtual void send_binary_packet(connection_hdl hdl, const void *data,
                                     size_t size);
+    // Gather form for a buffer count only known at run time (waterfall tiles)
+    virtual void send_binary_packet(
+        connection_hdl hdl,
+        const std::vector<std::pair<const void *, size_t>> &bufs);
     virtual void
     send_text_packet(connection_hdl hdl,
                      const std::initializer_list<std::string> &data) = 0;
     virtual void send_text_packet(connection_hdl hdl, const std::string &data);
+    // The same text to every connection in hdls; returns how many it was
+    // queued to.  Connections that are gone or too far behind are skipped.
+    virtual size_t broadcast_text_packet(const std::vector<connection_hdl> &hdls,
+                                         const std::string &data);
     virtual std::string ip_from_hdl(connection_hdl hdl) = 0;
     virtual void log(connection_hdl hdl, const std::string &msg) = 0;
 
@@ -85,6 +99,11 @@ class PacketSender {
     virtual signal_slices_t &get_signal_slices() = 0;
     virtual std::mutex &get_signal_slice_mtx() = 0;
 
+    // Whether client takes frame frame_num (see framedispatch.h): nullopt if
+    // its connection is gone, false while it is held back because it is
+    // falling behind.  Every client takes every frame by default.
+    virtual std::optional<bool> frame_wanted(Client &client, int frame_num);
+
     virtual void broadcast_signal_changes(const std::string &unique_id, int l,
                                           double m, int r,
                                           const std::string &ip = "") = 0;
@@ -92,6 +111,15 @@ class PacketSender {
     virtual ~PacketSender() {}
 };
 
+// Per-client frame queue for the pipelined FFT loop (see dispatch_frame in
+// framedispatch.cpp).  A client's frames run strictly in order and one at a time
+// on the worker pools.  backlog holds the running frame at its front followed
+// by the frames queued behind it; it is empty when the client is idle.
+struct FrameStrand {
+    std::mutex mtx;
+    std::deque<std::function<void()>> backlog;
+};
+
 class Client {
   public:
     Client(connection_hdl hdl, PacketSender &sender, conn_type type);
@@ -108,6 +136,10 @@ class Client {
     virtual void on_noise_gate_enable_message(bool enabled);
     virtual void on_noise_gate_preset_message(std::string &preset);
     virtual void on_agc_enable_message(bool enabled);
+    // blanker / spectral turn on WildNB / SpectralNR; lms is "nr", "notch"
+    // or anything else for off
+    virtual void on_noise_reduction_message(bool blanker, bool spectral,
+                                            std::string &lms);
 
     // Client codec capability (AudioClient overrides). opus_supported=false
     // keeps the client on FLAC even for C-QUAM.
@@ -117,6 +149,10 @@ class Client {
     // encoder (e.g. to raw PCM for the internal autorun loopback client).
     virtual void on_set_codec_message(std::string &codec);
 
+    // Binary frame format request ("wire_format"), see wireformat.h.
+    // Unknown versions fall back to the newest one this server speaks.
+    void on_wire_format_message(int version);
+
     // Type of connection
     conn_type type;
 
@@ -138,6 +174,12 @@ class Client {
     // User requested frequency range
     int l;
     int r;
+
+    FrameStrand strand;
+
+    // Framing of binary audio / waterfall frames (WIRE_CBOR until the client
+    // negotiates).  Written on the I/O thread, read by the encoding workers.
+    std::atomic<uint8_t> wire_version{WIRE_CBOR};
 };
 
 #endif
\ No newline at end of file
@@ -1,13 +1,17 @@
 #include "spectrumserver.h"
+#include "georesolver.h"
+#include "metrics.h"
+#include "wireformat.h"
 
 #include "glaze/glaze.hpp"
 
+#include <algorithm>
 #include <chrono>
-#include <cstdio>    // std::rename
-#include <fstream>
-#include <iomanip>
-#include <sstream>
-#include <sys/stat.h> // ::mkdir for log directory creation
+#include <cstdio>    // std::snprintf
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <tuple>
 
 // ============================================================================
 // USER TRACKING — /users HTTP endpoint + users.json on-disk dump
@@ -34,29 +38,35 @@ static bool is_loopback_ip(const std::string &ip) {
     return false;
 }
 
-std::string broadcast_server::get_users_json() {
-    const auto now_steady = std::chrono::steady_clock::now();
-    const auto now_sys    = std::chrono::system_clock::now();
-    const auto now_t      = std::chrono::system_clock::to_time_t(now_sys);
+namespace {
+// What users.json shows of one client, copied under signal_slice_mtx so the
+// formatting can run after it is released
+struct UserRow {
+    std::string id;
+    std::string ip;
+    std::string geo;
+    const char *mode;
+    int64_t freq_hz;
+    std::chrono::steady_clock::time_point connected_at;
+};
 
-    // ISO-8601 UTC timestamp
-    char ts[32];
-    {
-        struct tm tm_utc{};
-        gmtime_r(&now_t, &tm_utc);
-        std::strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%SZ", &tm_utc);
-    }
+// "🇬🇷 Athens, GR" once the async lookup is done; the raw IP while it is
+// pending, so the field is never blank
+std::string client_geo(const AudioClient &client) {
+    std::lock_guard<std::mutex> glk(*client.geo_mutex_ptr);
+    return client.geo_location_ptr->empty() ? client.ip_address
+                                            : *client.geo_location_ptr;
+}
+} // namespace
 
-    std::ostringstream o;
-    o << "{\n"
-      << "  \"timestamp\": \"" << ts << "\",\n"
-      << "  \"users\": [\n";
+std::string broadcast_server::get_users_json_body() {
+    const auto now_steady = std::chrono::steady_clock::now();
+    const auto now_sys    = std::chrono::system_clock::now();
 
-    size_t total_clients = 0;
+    std::vector<UserRow> rows;
     {
         std::scoped_lock lk(signal_slice_mtx);
-
-        bool first = true;
+        rows.reserve(signal_slices.size());
         for (auto &[slice, client] : signal_slices) {
             // Skip loopback connections (server-local: admin panel, health checks,
             // local browser tab).  They are not real remote listeners and would
@@ -66,106 +76,85 @@ std::string broadcast_server::get_users_json() {
             // on_close() but haven't been erased from signal_slices yet.
             if (client->disconnecting.load(std::memory_order_acquire)) continue;
 
-            ++total_clients;
-            if (!first) o << ",\n";
-            first = false;
-
-            // --- Duration ---
-            const auto secs_total =
-                std::chrono::duration_cast<std::chrono::seconds>(
-                    now_steady - client->connected_at).count();
-            const long hh = secs_total / 3600;
-            const long mm = (secs_total % 3600) / 60;
-            const long ss = secs_total % 60;
-            char dur[16];
-            std::snprintf(dur, sizeof(dur), "%ld:%02ld:%02ld", hh, mm, ss);
-
-            // --- Frequency ---
             // audio_mid is in FFT bin units; see spectrumserver.cpp default_m
             // formula for the inverse: freq_hz = basefreq + audio_mid*sps/fft_size
             const int64_t freq_hz =
                 basefreq + static_cast<int64_t>(
                     std::round(client->audio_mid * sps / fft_size));
-            const double freq_khz = static_cast<double>(freq_hz) / 1000.0;
-
-            // --- Connected-at timestamp (ISO-8601 UTC) ---
-            const auto conn_sys =
-                std::chrono::system_clock::now() -
-                std::chrono::duration_cast<std::chrono::system_clock::duration>(
-                    now_steady - client->connected_at);
-            const auto conn_t = std::chrono::system_clock::to_time_t(conn_sys);
-            char conn_ts[32];
-            {
-                struct tm tm_conn{};
-                gmtime_r(&conn_t, &tm_conn);
-                std::strftime(conn_ts, sizeof(conn_ts), "%Y-%m-%dT%H:%M:%SZ", &tm_conn);
-            }
-
-            // --- Geo location (async-filled; empty string while pending) ---
-            std::string geo;
-            {
-                std::lock_guard<std::mutex> glk(*client->geo_mutex_ptr);
-                geo = *client->geo_location_ptr;
-            }
-            // If still pending show the raw IP so the field is never blank
-            if (geo.empty()) geo = client->ip_address;
-
-            // Escape geo for safe embedding in a JSON string literal.
-            // (append_user_log already does this for JSONL — mirror it here.)
-            std::string geo_esc;
-            geo_esc.reserve(geo.size());
-            for (unsigned char c : geo) {
-                if (c == '"' || c == '\\') geo_esc += '\\';
-                geo_esc += static_cast<char>(c);
-            }
-
-            o << "    {\n"
-              << "      \"id\": \""           << client->get_unique_id() << "\",\n"
-              << "      \"ip\": \""           << client->ip_address      << "\",\n"
-              << "      \"geo\": \""          << geo_esc                 << "\",\n"
-              << "      \"freq_hz\": "        << freq_hz                 << ",\n"
-              << "      \"freq_khz\": "
-                  << std::fixed << std::setprecision(3) << freq_khz      << ",\n"
-              << "      \"mode\": \""         << client->get_mode_str()  << "\",\n"
-              << "      \"connected_at\": \"" << conn_ts                 << "\",\n"
-              << "      \"duration\": \""     << dur                     << "\",\n"
-              << "      \"duration_s\": "     << secs_total              << "\n"
-              << "    }";
+            rows.push_back({client->get_unique_id(), client->ip_address,
+                            client_geo(*client), client->get_mode_str(),
+                            freq_hz, client->connected_at});
         }
     }
 
-    o << "\n  ],\n"
-      << "  \"total\": " << total_clients << "\n"
-      << "}\n";
-
-    return o.str();
-}
-
-void broadcast_server::write_users_json() {
-    const std::string json = get_users_json();
-
-    // Atomic write: write to a .tmp file then rename so readers never see a
-    // partial file (rename is atomic on POSIX when src and dst are on the same
-    // filesystem, which they always are here).
-    // Strip any trailing slash from docroot before appending to avoid double-slash
-    const std::string docroot = (!m_docroot.empty() && m_docroot.back() == '/')
-                                ? m_docroot.substr(0, m_docroot.size() - 1)
-                                : m_docroot;
-    const std::string tmp  = docroot + "/users.json.tmp";
-    const std::string dest = docroot + "/users.json";
+    std::string o;
+    o.reserve(64 + rows.size() * 320);
+    o += "  \"users\": [\n";
+    char buf[256];
+    for (size_t i = 0; i < rows.size(); i++) {
+        const UserRow &row = rows[i];
+        if (i) o += ",\n";
+
+        // --- Duration ---
+        const long secs_total = static_cast<long>(
+            std::chrono::duration_cast<std::chrono::seconds>(
+                now_steady - row.connected_at).count());
+
+        // --- Connected-at timestamp (ISO-8601 UTC) ---
+        const auto conn_sys =
+            now_sys - std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                          now_steady - row.connected_at);
+        const auto conn_t = std::chrono::system_clock::to_time_t(conn_sys);
+        char conn_ts[32];
+        {
+            struct tm tm_conn{};
+            gmtime_r(&conn_t, &tm_conn);
+            std::strftime(conn_ts, sizeof(conn_ts), "%Y-%m-%dT%H:%M:%SZ", &tm_conn);
+        }
 
-    {
-        std::ofstream f(tmp, std::ios::trunc);
-        if (!f) {
-            std::cerr << "write_users_json: cannot open " << tmp << "\n";
-            return;
+        o += "    {\n      \"id\": \"";
+        o += row.id;
+        o += "\",\n      \"ip\": \"";
+        o += row.ip;
+        o += "\",\n      \"geo\": \"";
+        // Escape geo for safe embedding in a JSON string literal
+        for (char c : row.geo) {
+            if (c == '"' || c == '\\') o += '\\';
+            o += c;
         }
-        f << json;
+        std::snprintf(buf, sizeof(buf),
+                      "\",\n"
+                      "      \"freq_hz\": %lld,\n"
+                      "      \"freq_khz\": %.3f,\n"
+                      "      \"mode\": \"%s\",\n"
+                      "      \"connected_at\": \"%s\",\n"
+                      "      \"duration\": \"%ld:%02ld:%02ld\",\n"
+                      "      \"duration_s\": %ld\n"
+                      "    }",
+                      static_cast<long long>(row.freq_hz),
+                      static_cast<double>(row.freq_hz) / 1000.0, row.mode,
+                      conn_ts, secs_total / 3600, (secs_total % 3600) / 60,
+                      secs_total % 60, secs_total);
+        o += buf;
     }
+    o += "\n  ],\n  \"total\": ";
+    o += std::to_string(rows.size());
+    o += "\n}\n";
+    return o;
+}
 
-    if (std::rename(tmp.c_str(), dest.c_str()) != 0) {
-        std::cerr << "write_users_json: rename failed for " << dest << "\n";
+std::string broadcast_server::get_users_json() {
+    // ISO-8601 UTC timestamp
+    const auto now_t =
+        std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    char ts[32];
+    {
+        struct tm tm_utc{};
+        gmtime_r(&now_t, &tm_utc);
+        std::strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%SZ", &tm_utc);
     }
+    return std::string("{\n  \"timestamp\": \"") + ts + "\",\n" +
+           get_users_json_body();
 }
 
 // ============================================================================
@@ -181,46 +170,38 @@ void broadcast_server::write_users_json() {
 //   "tune"       — user connected or changed frequency / mode
 //   "disconnect" — user closed the connection (duration_s = full session length)
 //
-// Files are written to: <docroot>/logs/users_YYYY-MM-DD.jsonl
+// UserLogWriter (userlog.cpp) writes them on its own thread to
+// logs/users_YYYY-MM-DD.jsonl, relative to the working directory (the project
+// root), so outside frontend/dist/ and never touched by Vite builds.
 // ============================================================================
 
 void broadcast_server::append_user_log(const std::string &event,
                                        const std::string &unique_id,
-                                       int l, double audio_mid, int /*r*/) {
-    // Build UTC timestamp and today's log filename.
-    const auto now_sys = std::chrono::system_clock::now();
-    const auto now_t   = std::chrono::system_clock::to_time_t(now_sys);
-    char ts[32], date[12];
-    {
-        struct tm tm_utc{};
-        gmtime_r(&now_t, &tm_utc);
-        std::strftime(ts,   sizeof(ts),   "%Y-%m-%dT%H:%M:%SZ", &tm_utc);
-        std::strftime(date, sizeof(date), "%Y-%m-%d",            &tm_utc);
-    }
+                                       int l, double audio_mid, int r) {
+    UserLogEvent e;
+    e.at         = std::chrono::system_clock::now();
+    e.disconnect = event == "disconnect";
+    e.unique_id  = unique_id;
 
     // Frequency — l == -1 is the disconnect sentinel, no valid freq.
-    int64_t freq_hz  = 0;
-    double  freq_khz = 0.0;
     if (l != -1) {
-        freq_hz  = basefreq + static_cast<int64_t>(std::round(audio_mid * sps / fft_size));
-        freq_khz = static_cast<double>(freq_hz) / 1000.0;
+        e.freq_hz = basefreq + static_cast<int64_t>(std::round(audio_mid * sps / fft_size));
     }
 
-    // Look up the live client to get ip / geo / mode / session duration.
-    std::string ip_str, geo_str, mode_str = "?";
-    long duration_s = 0;
+    // Look up the live client to get ip / geo / mode / session duration.  A
+    // tune has just re-keyed the client to {l, r}; a disconnect does not say
+    // where the client was, so that one scans.
     {
         std::scoped_lock lk(signal_slice_mtx);
-        for (auto &[slice, client] : signal_slices) {
+        auto first = signal_slices.begin(), last = signal_slices.end();
+        if (l != -1) std::tie(first, last) = signal_slices.equal_range({l, r});
+        for (auto it = first; it != last; ++it) {
+            const auto &client = it->second;
             if (client->get_unique_id() == unique_id) {
-                ip_str  = client->ip_address;
-                {
-                    std::lock_guard<std::mutex> glk(*client->geo_mutex_ptr);
-                    geo_str = *client->geo_location_ptr;
-                }
-                if (geo_str.empty()) geo_str = client->ip_address;
-                mode_str   = client->get_mode_str();
-                duration_s = std::chrono::duration_cast<std::chrono::seconds>(
+                e.ip         = client->ip_address;
+                e.geo        = client_geo(*client);
+                e.mode       = client->get_mode_str();
+                e.duration_s = std::chrono::duration_cast<std::chrono::seconds>(
                     std::chrono::steady_clock::now() - client->connected_at).count();
                 break;
             }
@@ -230,79 +211,25 @@ void broadcast_server::append_user_log(const std::string &event,
     // Do not log loopback connections (server-local: admin panel, go.sh health
     // checks, browser tab on the server machine).  They are not real listeners
     // and would skew session statistics.
-    if (is_loopback_ip(ip_str)) return;
-
-    // Ensure logs/ directory exists (no-op if already present).
-    // Write logs to "logs/" relative to the working directory (project root).
-    // The server always runs from ~/PhantomSDR-Plus/ so this resolves to
-    // ~/PhantomSDR-Plus/logs/ — completely outside frontend/dist/ and
-    // therefore never touched by Vite builds.
-    const std::string logdir  = "logs";
-    const std::string logfile = logdir + "/users_" + date + ".jsonl";
-    ::mkdir(logdir.c_str(), 0755);
-
-    // Escape any double-quotes or backslashes in geo string (rare but safe).
-    std::string geo_esc;
-    geo_esc.reserve(geo_str.size());
-    for (unsigned char c : geo_str) {
-        if (c == '"' || c == '\\') geo_esc += '\\';
-        geo_esc += static_cast<char>(c);
-    }
+    if (is_loopback_ip(e.ip)) return;
 
-    // Build and append the JSONL line.
-    std::ostringstream line;
-    line << "{\"ts\":\""       << ts        << "\""
-         << ",\"event\":\""    << event     << "\""
-         << ",\"id\":\""       << unique_id << "\""
-         << ",\"ip\":\""       << ip_str    << "\""
-         << ",\"geo\":\""      << geo_esc   << "\""
-         << ",\"freq_hz\":"    << freq_hz
-         << ",\"freq_khz\":"   << std::fixed << std::setprecision(3) << freq_khz
-         << ",\"mode\":\""     << mode_str  << "\""
-         << ",\"duration_s\":" << duration_s
-         << "}\n";
-
-    std::ofstream f(logfile, std::ios::app);
-    if (!f) {
-        std::cerr << "append_user_log: cannot open " << logfile << "\n";
-    } else {
-        // Dedup: if this line is byte-for-byte identical to the last one logged
-        // for this uid, skip it.  This suppresses duplicate entries that arise
-        // when broadcast_signal_changes() is called twice within the same second
-        // with the same arguments (e.g. initial set_audio_range at connect-time
-        // followed immediately by the client's first window message, or rapid
-        // re-tunes landing in the same 1-second timestamp bucket).
-        // On disconnect (l == -1) we always log and clear the cache entry so the
-        // next connect for this uid starts fresh.
-        static std::mutex dedup_mtx;
-        static std::unordered_map<std::string, std::string> last_logged;
-        {
-            std::lock_guard<std::mutex> dlk(dedup_mtx);
-            auto it_dedup = last_logged.find(unique_id);
-            if (l == -1) {
-                // Always log disconnects; remove from map so the next session starts fresh.
-                // BUG FIX (MEMORY LEAK): also erase stale entries for UIDs that
-                // disconnected without an l==-1 event (abrupt drops, crashes).
-                // The erase here handles the normal disconnect path.
-                if (it_dedup != last_logged.end()) last_logged.erase(it_dedup);
-            } else if (it_dedup != last_logged.end() && it_dedup->second == line.str()) {
-                return; // exact duplicate — drop silently
-            } else {
-                last_logged[unique_id] = line.str();
-            }
-        }
-        f << line.str();
-    }
+    if (user_log) user_log->push(std::move(e));
 }
 
 // ============================================================================
 
+// signal_changes maps a listener to [l, m, r], or [-1, -1, -1] once it has
+// left.  In a snapshot it holds every listener and replaces what the client
+// had.  seq and signal_handles let a client switch to binary deltas.
 struct event_info {
-    size_t waterfall_clients;
-    size_t signal_clients;
+    size_t waterfall_clients = 0;
+    size_t signal_clients = 0;
     std::unordered_map<std::string, std::tuple<int, double, int>> signal_changes;
-    double waterfall_kbits;
-    double audio_kbits;
+    std::unordered_map<std::string, uint32_t> signal_handles;
+    double waterfall_kbits = 0;
+    double audio_kbits = 0;
+    uint64_t seq = 0;
+    bool snapshot = false;
 };
 
 template <> 
@@ -313,8 +240,30 @@ struct glz::meta<event_info>
         "waterfall_clients", &T::waterfall_clients,
         "signal_clients", &T::signal_clients,
         "signal_changes", &T::signal_changes,
+        "signal_handles", &T::signal_handles,
         "waterfall_kbits", &T::waterfall_kbits,
-        "audio_kbits", &T::audio_kbits
+        "audio_kbits", &T::audio_kbits,
+        "seq", &T::seq,
+        "snapshot", &T::snapshot
+    );
+};
+
+// {"cmd": "wire_format", "version": 1, "seq": S} on the events socket:
+// binary deltas from seq S on, S being the last seq the client has seen
+struct events_wire_format_cmd {
+    std::string cmd;
+    int version;
+    std::optional<uint64_t> seq;
+};
+
+template <>
+struct glz::meta<events_wire_format_cmd>
+{
+    using T = events_wire_format_cmd;
+    static constexpr auto value = object(
+        "cmd", &T::cmd,
+        "version", &T::version,
+        "seq", &T::seq
     );
 };
 /* clang-format on */
@@ -355,91 +304,187 @@ static size_t count_signal_clients(const signal_slices_t &slices) {
     return n;
 }
 
-std::string broadcast_server::get_event_info() {
-
-    static auto last_kbits_time = std::chrono::steady_clock::now();
-    auto now = std::chrono::steady_clock::now();
-
-    // Hold the lock for the entire size-check + move to eliminate TOCTOU
-    std::scoped_lock lk(signal_changes_mtx);
-
-    if (!signal_changes.size() && std::chrono::duration_cast<std::chrono::seconds>(now - last_kbits_time).count() >= 10) {
-        event_info info;
-        {
-            std::scoped_lock slk(signal_slice_mtx);
-            info.signal_clients = count_signal_clients(signal_slices);
-        }
-        // BUG FIX: use the mutex-safe helper instead of bare accumulate.
-        info.waterfall_clients = count_waterfall_clients(
-            waterfall_slices, waterfall_slice_mtx);
-        info.waterfall_kbits = waterfall_kbits_per_second.load(std::memory_order_relaxed);
-        info.audio_kbits = audio_kbits_per_second.load(std::memory_order_relaxed);
-        last_kbits_time = now;
-        return glz::write_json(info);
-    } else if (signal_changes.size()) {
-        event_info info;
-        info.waterfall_kbits = waterfall_kbits_per_second.load(std::memory_order_relaxed);
-        info.audio_kbits = audio_kbits_per_second.load(std::memory_order_relaxed);
-        // BUG FIX: use the mutex-safe helper instead of bare accumulate.
-        info.waterfall_clients = count_waterfall_clients(
-            waterfall_slices, waterfall_slice_mtx);
-        {
-            std::scoped_lock slk(signal_slice_mtx);
-            info.signal_clients = count_signal_clients(signal_slices);
-        }
-        if (show_other_users) {
-            info.signal_changes = std::move(signal_changes);
+std::string broadcast_server::get_event_info(const ListenerStore::Batch &batch) {
+    event_info info;
+    info.waterfall_clients = events_waterfall_clients.load(std::memory_order_relaxed);
+    info.signal_clients = events_signal_clients.load(std::memory_order_relaxed);
+    info.waterfall_kbits = waterfall_kbits_per_second.load(std::memory_order_relaxed);
+    info.audio_kbits = audio_kbits_per_second.load(std::memory_order_relaxed);
+    info.seq = batch.to_seq;
+    for (const auto &c : batch.changes) {
+        info.signal_changes.emplace(
+            c.id, std::tuple<int, double, int>{c.listener.l, c.listener.m,
+                                               c.listener.r});
+        if (c.kind == ListenerStore::JOINED) {
+            info.signal_handles.emplace(c.id, c.listener.handle);
         }
-        return glz::write_json(info);
     }
+    return glz::write_json(info);
+}
 
-    return "";
+std::string broadcast_server::get_event_delta(const ListenerStore::Batch &batch) {
+    EventsDeltaHeader h;
+    h.from_seq = batch.from_seq;
+    h.to_seq = batch.to_seq;
+    h.signal_clients = static_cast<uint32_t>(
+        events_signal_clients.load(std::memory_order_relaxed));
+    h.waterfall_clients = static_cast<uint32_t>(
+        events_waterfall_clients.load(std::memory_order_relaxed));
+    h.waterfall_kbits = waterfall_kbits_per_second.load(std::memory_order_relaxed);
+    h.audio_kbits = audio_kbits_per_second.load(std::memory_order_relaxed);
+    h.change_count = static_cast<uint16_t>(batch.changes.size());
+
+    uint8_t header[WIRE_EVENTS_DELTA_HEADER_BYTES];
+    pack_events_delta_header(header, h);
+    std::string out;
+    out.reserve(sizeof(header) + batch.changes.size() * 60);
+    out.append(reinterpret_cast<const char *>(header), sizeof(header));
+
+    auto put = [&out](auto value) {
+        char bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        out.append(bytes, sizeof(value));
+    };
+    for (const auto &c : batch.changes) {
+        put(static_cast<uint8_t>(c.kind));
+        put(static_cast<uint32_t>(c.listener.handle));
+        if (c.kind == ListenerStore::LEFT) continue;
+        if (c.kind == ListenerStore::JOINED) {
+            // Ids are UUIDs, far below the limit
+            const size_t len = std::min<size_t>(c.id.size(), 255);
+            put(static_cast<uint8_t>(len));
+            out.append(c.id, 0, len);
+        }
+        put(static_cast<int32_t>(c.listener.l));
+        put(c.listener.m);
+        put(static_cast<int32_t>(c.listener.r));
+    }
+    return out;
 }
 
+// From the published listener snapshot and the counts of the last tick, so
+// a new connection costs no walk of signal_slices under signal_slice_mtx
 std::string broadcast_server::get_initial_state_info() {
+    const std::shared_ptr<const ListenerStore::Snapshot> snap =
+        listener_store.snapshot();
 
     event_info info;
-    // BUG FIX: use the mutex-safe helper instead of bare accumulate.
-    info.waterfall_clients = count_waterfall_clients(
-        waterfall_slices, waterfall_slice_mtx);
+    info.snapshot = true;
+    info.seq = snap->seq;
+    info.waterfall_clients = events_waterfall_clients.load(std::memory_order_relaxed);
+    info.signal_clients = events_signal_clients.load(std::memory_order_relaxed);
+    info.waterfall_kbits = waterfall_kbits_per_second.load(std::memory_order_relaxed);
+    info.audio_kbits = audio_kbits_per_second.load(std::memory_order_relaxed);
+    info.signal_changes.reserve(snap->listeners.size());
+    info.signal_handles.reserve(snap->listeners.size());
+    for (const auto &[id, listener] : snap->listeners) {
+        info.signal_changes.emplace(
+            id, std::tuple<int, double, int>{listener.l, listener.m, listener.r});
+        info.signal_handles.emplace(id, listener.handle);
+    }
+    return glz::write_json(info);
+}
+
+// Prometheus text for /metrics: the process-wide telemetry in metrics.h
+// plus this server's connections, drops and pool queues
+std::string broadcast_server::get_metrics() {
+    std::string out;
+    out.reserve(32768);
+    metrics().render(out);
+
+    // Connections per type
+    size_t audio = 0, signal = 0, waterfall = 0, events = 0;
     {
-        std::scoped_lock lk(signal_slice_mtx);
-        info.signal_clients = count_signal_clients(signal_slices);
-        if (show_other_users) {
-            info.signal_changes.reserve(signal_slices.size());
-            for (auto &[slice, data] : signal_slices) {
-                if (data->disconnecting.load(std::memory_order_acquire)) continue;
-                // Skip loopback (autorun taps / admin / local): not real listeners.
-                if (is_loopback_ip(data->ip_address)) continue;
-                info.signal_changes.emplace(data->get_unique_id(),
-                                            std::tuple<int, double, int>{
-                                                data->l, data->audio_mid, data->r});
-            }
+        std::scoped_lock lg(signal_slice_mtx);
+        for (auto &[slice, client] : signal_slices) {
+            (client->type == SIGNAL ? signal : audio)++;
         }
     }
-    return glz::write_json(info);
+    for (int i = 0; i < downsample_levels; i++) {
+        std::scoped_lock lg(waterfall_slice_mtx[i]);
+        waterfall += waterfall_slices[i].size();
+    }
+    {
+        std::scoped_lock lg(events_connections_mtx);
+        events = events_connections.size();
+    }
+    metrics_header(out, "phantomsdr_connections", "Open connections",
+                   "gauge");
+    metrics_labelled(out, "phantomsdr_connections", "type", "audio", audio);
+    metrics_labelled(out, "phantomsdr_connections", "type", "signal", signal);
+    metrics_labelled(out, "phantomsdr_connections", "type", "waterfall",
+                     waterfall);
+    metrics_labelled(out, "phantomsdr_connections", "type", "events", events);
+
+    // Drops
+    metrics_counter(out, "phantomsdr_audio_frames_skipped_total",
+                    "Audio frames dropped for clients already behind",
+                    audio_frames_skipped.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_waterfall_frames_skipped_total",
+                    "Waterfall frames dropped for clients already behind",
+                    waterfall_frames_skipped.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_fft_pipeline_stalls_total",
+                    "FFT frames that waited for a free output generation",
+                    fft_pipeline_stalls.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_shared_demod_frames_total",
+                    "Audio frames demodulated once for a channel",
+                    audio_channel_frames.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_shared_demod_sends_total",
+                    "Extra listeners served by shared frames",
+                    audio_channel_sends.load(std::memory_order_relaxed));
+
+    // Server-side noise reduction
+    auto &nr_limits = NoiseReductionLimits::instance();
+    metrics_gauge(out, "phantomsdr_noise_reduction_active",
+                  "Noise reduction chains holding a slot",
+                  static_cast<double>(nr_limits.active()));
+    metrics_counter(out, "phantomsdr_noise_reduction_refused_total",
+                    "Noise reduction requests over the concurrency limit",
+                    nr_limits.refused());
+
+    // Listener locations
+    auto &geo = GeoResolver::instance();
+    metrics_counter(out, "phantomsdr_geoip_cache_hits_total",
+                    "Listener locations answered from the cache",
+                    geo.cache_hits());
+    metrics_counter(out, "phantomsdr_geoip_online_lookups_total",
+                    "Listener locations looked up at ip-api.com",
+                    geo.online_lookups());
+    metrics_counter(out, "phantomsdr_geoip_refused_total",
+                    "Listener locations not looked up (rate or queue limit)",
+                    geo.refused());
+
+    // Pool queues.  The pools exist while the server runs.
+    if (dsp_pool) {
+        metrics_gauge(out, "phantomsdr_dsp_queue_depth",
+                      "Audio tasks queued on the DSP pool",
+                      static_cast<double>(dsp_pool->get_pending()));
+    }
+    if (waterfall_pool) {
+        metrics_gauge(out, "phantomsdr_waterfall_queue_depth",
+                      "Waterfall tasks queued on the encode pool",
+                      static_cast<double>(waterfall_pool->get_pending()));
+    }
+    return out;
 }
 
 void broadcast_server::broadcast_signal_changes(const std::string &unique_id,
                                                 int l, double audio_mid,
                                                 int r, const std::string &ip) {
-    // signal_changes drives waterfall overlays — only populated when
+    // The listener store drives waterfall overlays — only populated when
     // show_other_users, and never for loopback clients (the autorun spot-decoder
     // taps, admin panel, local health checks). Those are server-local, not real
     // listeners, so they must not appear as user labels on the waterfall — the
     // same rule already applied to /users and users.json.
     if (show_other_users && !is_loopback_ip(ip)) {
-        std::scoped_lock lk(signal_changes_mtx);
-        signal_changes[unique_id] = {l, audio_mid, r};
+        listener_store.update(unique_id, l, audio_mid, r);
     }
 
     // Append to daily JSONL statistics log.
     // l == -1 is the disconnect sentinel from AudioClient::on_close().
+    // users.json follows on the writer's next tick, regardless of
+    // show_other_users (which only controls waterfall overlays).
     append_user_log((l == -1) ? "disconnect" : "tune", unique_id, l, audio_mid, r);
-
-    // Always write users.json on every connect / tune / disconnect event,
-    // regardless of show_other_users (which only controls waterfall overlays).
-    write_users_json();
 }
 
 void broadcast_server::on_open_events(connection_hdl hdl) {
@@ -454,14 +499,33 @@ void broadcast_server::on_open_events(connection_hdl hdl) {
     server::connection_ptr con = m_server.get_con_from_hdl(hdl);
     con->set_close_handler(std::bind(&broadcast_server::on_close_events, this,
                                      std::placeholders::_1));
-    con->set_message_handler([](connection_hdl, server::message_ptr) {
-        // Ignore messages
-    });
+    con->set_message_handler(std::bind(&broadcast_server::on_message_events,
+                                       this, std::placeholders::_1,
+                                       std::placeholders::_2));
+}
+
+void broadcast_server::on_message_events(connection_hdl hdl,
+                                         server::message_ptr msg) {
+    // Anything but a wire_format command (the frontend's userid) is ignored
+    events_wire_format_cmd cmd{};
+    if (glz::read_json(cmd, msg->get_payload()) || cmd.cmd != "wire_format") {
+        return;
+    }
+    std::scoped_lock lg(events_connections_mtx);
+    if (!events_connections.count(hdl)) return;
+    if (cmd.version >= WIRE_EVENTS_DELTA_V1) {
+        // A client that is not where it says it is gets a snapshot at the
+        // next tick instead of the delta
+        events_delta_seq[hdl] = cmd.seq.value_or(kEventsResync);
+    } else {
+        events_delta_seq.erase(hdl);
+    }
 }
 
 void broadcast_server::on_close_events(connection_hdl hdl) {
     std::scoped_lock lg(events_connections_mtx);  // ✅ ADDED: Thread-safe removal
     events_connections.erase(hdl);
+    events_delta_seq.erase(hdl);
 }
 
 void broadcast_server::set_event_timer() {
@@ -477,25 +541,87 @@ void broadcast_server::on_timer(websocketpp::lib::error_code const &ec) {
         return;
     }
     
-    std::string info = get_event_info();
-    // Broadcast to all event connections.
-    // Snapshot the list under the lock so we never call m_server.send() while
-    // holding events_connections_mtx — send can trigger a close handler on
-    // another IO thread that calls on_close_events(), which also acquires the
-    // same mutex, causing a deadlock.
-    if (info.length() != 0) {
-        std::vector<connection_hdl> snapshot;
-        {
-            std::scoped_lock lg(events_connections_mtx);
-            snapshot.assign(events_connections.begin(), events_connections.end());
+    // Publish this tick's listener changes and counts.  Without changes the
+    // counts and rates still go out every 10 seconds.
+    static auto last_sent = std::chrono::steady_clock::now();
+    const auto now = std::chrono::steady_clock::now();
+    const ListenerStore::Batch batch = listener_store.publish();
+    {
+        std::scoped_lock slk(signal_slice_mtx);
+        events_signal_clients = count_signal_clients(signal_slices);
+    }
+    events_waterfall_clients =
+        count_waterfall_clients(waterfall_slices, waterfall_slice_mtx);
+    const bool send =
+        !batch.changes.empty() || now - last_sent >= std::chrono::seconds(10);
+    if (send) last_sent = now;
+
+    // Snapshot the list under the lock so we never send while holding
+    // events_connections_mtx — send can trigger a close handler on another
+    // IO thread that calls on_close_events(), which also acquires the same
+    // mutex, causing a deadlock.
+    std::vector<connection_hdl> text_hdls;
+    std::vector<std::pair<connection_hdl, uint64_t>> delta_hdls;
+    {
+        std::scoped_lock lg(events_connections_mtx);
+        for (auto &hdl : events_connections) {
+            auto it = events_delta_seq.find(hdl);
+            if (it == events_delta_seq.end()) text_hdls.push_back(hdl);
+            else delta_hdls.emplace_back(hdl, it->second);
         }
-        for (auto &hdl : snapshot) {
-            try {
-                m_server.send(hdl, info, websocketpp::frame::opcode::text);
-            } catch (...) {
+    }
+
+    // Every message below is framed once, however many connections get it
+    size_t frames = 0, bytes = 0;
+    if (send && !text_hdls.empty()) {
+        const std::string info = get_event_info(batch);
+        const size_t sent = broadcast_text_packet(text_hdls, info);
+        frames += sent;
+        bytes += sent * info.size();
+    }
+
+    // Binary connections at the previous tick's seq get the delta.  The rest
+    // (just switched over, or skipped earlier for being too far behind) get
+    // a snapshot to start again from.
+    const bool delta_fits =
+        batch.changes.size() <= std::numeric_limits<uint16_t>::max();
+    server::message_ptr delta, snapshot;
+    std::vector<connection_hdl> advanced;
+    for (auto &[hdl, seq] : delta_hdls) {
+        server::message_ptr msg;
+        if (seq == batch.from_seq && delta_fits) {
+            if (!send) continue;
+            if (!delta) {
+                delta = prepare_message(websocketpp::frame::opcode::binary,
+                                        get_event_delta(batch));
             }
+            msg = delta;
+        } else {
+            if (!snapshot) {
+                snapshot = prepare_message(websocketpp::frame::opcode::text,
+                                           get_initial_state_info());
+            }
+            msg = snapshot;
+        }
+        if (queue_prepared(hdl, msg)) {
+            advanced.push_back(hdl);
+            frames++;
+            bytes += msg->get_payload().size();
+        }
+    }
+    if (!advanced.empty()) {
+        std::scoped_lock lg(events_connections_mtx);
+        for (auto &hdl : advanced) {
+            auto it = events_delta_seq.find(hdl);
+            if (it != events_delta_seq.end()) it->second = batch.to_seq;
         }
     }
+
+    auto &m = metrics();
+    m.payload_bytes[static_cast<int>(ConnKind::EVENTS)].fetch_add(
+        bytes, std::memory_order_relaxed);
+    m.frames_sent[static_cast<int>(ConnKind::EVENTS)].fetch_add(
+        frames, std::memory_order_relaxed);
     
     // Cleanup dead connections every 10 seconds
     static int cleanup_counter = 0;
@@ -504,9 +630,6 @@ void broadcast_server::on_timer(websocketpp::lib::error_code const &ec) {
         cleanup_dead_connections();
     }
 
-    // Write users.json on every tick (1 s) — cheap file write, always fresh.
-    write_users_json();
-
     // Send info every second
     if (running) {
         set_event_timer();
@@ -1,10 +1,15 @@
 #include "fft.h"
+#include "fftplancache.h"
+#include "metrics.h"
+#include "sampleconvert.h"
 #include "spectrumserver.h"
 #include "utils.h"
 #include "crash_handler.h"
 
+#include <algorithm>
 #include <numeric>
 #include <csignal>
+#include <cstring>
 
 #include <fftw3.h>
 
@@ -21,12 +26,22 @@ void broadcast_server::fft_task() {
     std::unique_ptr<FFT> fft = std::move(this->fft);
 
     // Twice as many floats if it is complex
-    float *input_buffers[3];
+    // One input hop is half an FFT (50% overlap).  The ring holds
+    // input_ring_hops of them plus the reader's discard slot, see SampleRing.
     int input_buffer_size = fft_size / 2 * (2 - is_real);
-    int input_buffer_idx = 0;
-    input_buffers[0] = fft->malloc(input_buffer_size);
-    input_buffers[1] = fft->malloc(input_buffer_size);
-    input_buffers[2] = fft->malloc(input_buffer_size);
+    // CPU FFTs take the raw samples and convert, scale and window them in one
+    // pass (FFT::load_raw_input); the slots then hold raw samples, which are
+    // wider than a float for 64-bit formats.
+    const bool raw_input = fft->accepts_raw_input();
+    const size_t input_slot_floats =
+        raw_input ? (input_buffer_size *
+                         std::max(sizeof(float), reader->sample_size()) +
+                     sizeof(float) - 1) / sizeof(float)
+                  : input_buffer_size;
+    std::vector<float *> input_buffers(input_ring_hops + 1);
+    for (auto &buf : input_buffers) {
+        buf = fft->malloc(input_slot_floats);
+    }
 
     // FFT planning
     if (is_real) {
@@ -35,12 +50,51 @@ void broadcast_server::fft_task() {
         fft->plan_c2c(FFT::FORWARD, FFTW_MEASURE | FFTW_DESTROY_INPUT);
     }
     
+    // Plan the per-client audio IFFTs now, so the first listeners to
+    // connect do not pay for FFTW_MEASURE (and they land in the wisdom file)
+    FFTPlanCache::instance().warm_audio(audio_max_fft_size);
+
     // Export FFTW wisdom after planning
     if (!fftwf_export_wisdom_to_filename("phantom_fftw_wisdom")) {
         std::cout << "Failed to export FFTW wisdom." << std::endl;
     }
 
-    fft_buffer = reinterpret_cast<std::complex<float>*>(fft->get_output_buffer());
+    // ── Pipelined output ring ──────────────────────────────────────────────
+    // Each frame goes into the next FFTGeneration and is handed to the client
+    // tasks without waiting for the previous frame's tasks to finish, so one
+    // slow listener no longer holds back the FFT (and every other listener).
+    // A client that is fft_pipeline_depth - 1 frames behind drops its oldest
+    // queued frame instead (see dispatch_frame in framedispatch.cpp).
+    //
+    // FFTW writes straight into the generation; backends that cannot redirect
+    // their output (cuFFT, clFFT, MKL) are copied out after execute().
+    const int pipeline_depth = fft_pipeline_depth;
+    const size_t spectrum_floats =
+        is_real ? fft_size + 2 : (size_t)(fft_size + audio_max_fft_size) * 2;
+    const size_t quantized_bytes = is_real ? fft_size : (size_t)fft_size * 2;
+    const bool redirect_output = fft->set_output(fft->get_output_buffer(),
+                                                 fft->get_quantized_buffer());
+    // FFTW also writes the 0 Hz wraparound copy while quantizing
+    const bool wraparound_filled = redirect_output && fft->fills_wraparound();
+    fft_generations = std::make_unique<FFTGeneration[]>(pipeline_depth);
+    for (int g = 0; g < pipeline_depth; g++) {
+        FFTGeneration &gen = fft_generations[g];
+        if (g == 0 && redirect_output) {
+            // Reuse the plan's own buffers for the first generation
+            gen.spectrum = reinterpret_cast<std::complex<float> *>(
+                fft->get_output_buffer());
+            gen.quantized = fft->get_quantized_buffer();
+            continue;
+        }
+        gen.spectrum = reinterpret_cast<std::complex<float> *>(
+            fftwf_malloc(sizeof(float) * spectrum_floats));
+        gen.quantized = new (std::align_val_t(32)) int8_t[quantized_bytes];
+        gen.owned = true;
+    }
+    int gen_idx = 0;
+    std::cout << "FFT pipeline depth " << pipeline_depth
+              << (redirect_output ? "" : " (copying FFT output)") << std::endl;
+    auto pipeline_report_at = std::chrono::steady_clock::now();
 
     // Target fps is 10, *2 since 50% overlap -- reduced to 5 for test
     int skip_num = std::max(1, (int)floor(((float)sps / fft_size) / 10.) * 2);
@@ -49,23 +103,40 @@ void broadcast_server::fft_task() {
     MovingAverage<double> sps_measured(60);
     auto prev_data = std::chrono::steady_clock::now();
 
-    auto signal_loop_fn = std::bind(&broadcast_server::signal_loop, this);
-    auto waterfall_loop_fn = std::bind(&broadcast_server::waterfall_loop, this,
-                                       fft->get_quantized_buffer());
-
-    std::future<void> buffer_read = std::async(std::launch::async, [] {});
-    std::vector<std::future<void>> signal_futures;
-    std::vector<std::future<void>> waterfall_futures;
+    // Persistent reader thread: keeps draining the input while the FFT is
+    // busy, instead of one std::async read per hop
+    input_ring = std::make_unique<SampleRing>(*reader, input_buffers,
+                                              input_buffer_size,
+                                              input_ring_policy, raw_input);
+    input_ring->start();
+    std::cout << "Input ring: " << input_ring->get_capacity() << " hops, "
+              << SampleRing::policy_name(input_ring_policy)
+              << " on overrun; " << convert_isa_name(convert_isa())
+              << " sample conversion"
+              << (raw_input ? " fused with the window" : "") << std::endl;
+    uint64_t input_overruns_reported = 0;
+    metrics().input_ring_capacity.store(input_ring->get_capacity(),
+                                        std::memory_order_relaxed);
+    uint64_t audio_skips_reported = 0, wf_skips_reported = 0;
+    uint64_t stalls_reported = 0;
+    uint64_t channel_frames_reported = 0, channel_sends_reported = 0;
+    auto since_report = [](const std::atomic<uint64_t> &counter,
+                           uint64_t &reported) {
+        const uint64_t total = counter.load(std::memory_order_relaxed);
+        const uint64_t delta = total - reported;
+        reported = total;
+        return delta;
+    };
 
     while (running) {
         // Read, convert and scale the input
         // 50% overlap is hardcoded for favourable downconverter properties
-        // FIX: use .get() so any exception thrown by reader->read() (e.g.
-        // RX-888 EOF / read error) surfaces here with a clear log line and
-        // triggers a clean shutdown instead of being silently swallowed when
-        // the future is reassigned below.
+        // FIX: wait_available() rethrows any exception thrown by
+        // reader->read() on the reader thread (e.g. RX-888 EOF / read error)
+        // so it surfaces here with a clear log line and triggers a clean
+        // shutdown instead of being silently swallowed.
         try {
-            buffer_read.get();
+            if (!input_ring->wait_available(2)) break;
         } catch (const std::exception &e) {
             std::cerr << "[FFT] Input stream stopped: " << e.what()
                       << " — shutting down FFT loop." << std::endl;
@@ -100,27 +171,28 @@ void broadcast_server::fft_task() {
             raise(SIGTERM);
             break;
         }
-        float *buf0 = input_buffers[input_buffer_idx];
-        float *buf1 = input_buffers[(input_buffer_idx + 1) % 3];
-        float *buf2 = input_buffers[(input_buffer_idx + 2) % 3];
-        if (is_real) {
-            // Read into buf2 asynchronously
-            buffer_read = std::async(std::launch::async,
-                                     [buf2, fft_size = fft_size, this] {
-                                         reader->read(buf2, fft_size / 2);
-                                     });
-
-            fft->load_real_input(buf0, buf1);
-        } else {
-            // IQ data has twice as many floats
-            buffer_read = std::async(std::launch::async,
-                                     [buf2, fft_size = fft_size, this] {
-                                         reader->read(buf2, fft_size);
-                                     });
-            fft->load_complex_input(buf0, buf1);
+        float *buf0 = input_ring->peek(0);
+        float *buf1 = input_ring->peek(1);
+        {
+            StageTimer timer(Stage::WINDOW);
+            if (raw_input) {
+                fft->load_raw_input(*reader, buf0, buf1);
+            } else if (is_real) {
+                fft->load_real_input(buf0, buf1);
+            } else {
+                fft->load_complex_input(buf0, buf1);
+            }
+        }
+        // buf1 stays in the ring as the first half of the next frame
+        input_ring->pop();
+        {
+            auto &m = metrics();
+            m.input_samples.fetch_add(fft_size / 2, std::memory_order_relaxed);
+            m.input_overruns.store(input_ring->get_overruns(),
+                                   std::memory_order_relaxed);
+            m.input_ring_depth.store(input_ring->get_depth(),
+                                     std::memory_order_relaxed);
         }
-
-        input_buffer_idx = (input_buffer_idx + 1) % 3;
         // Skip FFT computation when no clients are connected.
         // signal_slice_mtx guards signal_slices; waterfall_slices elements
         // each have their own per-level mutex — check them sequentially.
@@ -140,16 +212,28 @@ void broadcast_server::fft_task() {
             if (total == 0) continue;
         }
 
-        // Wait for all the signal and waterfall clients to finish
-        for (auto &f : signal_futures) {
-            f.wait();
+        // Normally free already: clients keep at most depth - 1 frames
+        // outstanding.  Only a single task running longer than that many
+        // frame periods can still hold it.
+        FFTGeneration &gen = fft_generations[gen_idx];
+        if (gen.refs.load(std::memory_order_acquire) != 0) {
+            fft_pipeline_stalls.fetch_add(1, std::memory_order_relaxed);
+            gen.wait_idle();
         }
-        for (auto &f : waterfall_futures) {
-            f.wait();
+        if (redirect_output) {
+            fft->set_output(reinterpret_cast<float *>(gen.spectrum),
+                            gen.quantized);
         }
 
         fft->execute();
-        if (!is_real) {
+        if (!redirect_output) {
+            memcpy(gen.spectrum, fft->get_output_buffer(),
+                   sizeof(fftwf_complex) * (is_real ? fft_size / 2 + 1
+                                                    : fft_result_size));
+            memcpy(gen.quantized, fft->get_quantized_buffer(), quantized_bytes);
+        }
+        std::complex<float> *fft_buffer = gen.spectrum;
+        if (!is_real && !wraparound_filled) {
 
             // If the user requested a range near the 0 frequency,
             // the data will wrap around, copy the front to the back to make
@@ -159,11 +243,63 @@ void broadcast_server::fft_task() {
         }
 
         // Enqueue tasks once the fft is ready
-        signal_futures = signal_loop_fn();
+        {
+            StageTimer timer(Stage::SIGNAL_DISPATCH);
+            signal_loop(gen);
+        }
         if (frame_num % skip_num == 0) {
-            waterfall_futures = waterfall_loop_fn();
+            StageTimer timer(Stage::WATERFALL_DISPATCH);
+            waterfall_loop(gen);
+        }
+        {
+            uint64_t busy = 0;
+            for (int g = 0; g < pipeline_depth; g++) {
+                busy += fft_generations[g].refs.load(
+                            std::memory_order_relaxed) != 0;
+            }
+            metrics().fft_generations_busy.store(busy,
+                                                 std::memory_order_relaxed);
         }
         frame_num++;
+        gen_idx = (gen_idx + 1) % pipeline_depth;
+
+        // Report slow consumers every 10 s, only when something was skipped.
+        // The counters keep running totals for /metrics.
+        const auto now = std::chrono::steady_clock::now();
+        if (now - pipeline_report_at >= std::chrono::seconds(10)) {
+            const uint64_t audio_skips =
+                since_report(audio_frames_skipped, audio_skips_reported);
+            const uint64_t wf_skips =
+                since_report(waterfall_frames_skipped, wf_skips_reported);
+            const uint64_t stalls =
+                since_report(fft_pipeline_stalls, stalls_reported);
+            if (audio_skips || wf_skips || stalls) {
+                std::cout << "[FFT] pipeline: " << audio_skips
+                          << " audio and " << wf_skips
+                          << " waterfall frames skipped by slow clients, "
+                          << stalls << " FFT stalls" << std::endl;
+            }
+            const uint64_t channel_frames =
+                since_report(audio_channel_frames, channel_frames_reported);
+            const uint64_t channel_sends =
+                since_report(audio_channel_sends, channel_sends_reported);
+            if (channel_frames) {
+                std::cout << "[FFT] shared demod: " << channel_frames
+                          << " channel frames served " << channel_sends
+                          << " extra listeners" << std::endl;
+            }
+            const uint64_t input_overruns = input_ring->get_overruns();
+            const uint64_t input_high_water = input_ring->take_high_water();
+            if (input_overruns != input_overruns_reported) {
+                std::cout << "[FFT] input ring: "
+                          << input_overruns - input_overruns_reported
+                          << " hops lost to overruns, high water "
+                          << input_high_water << "/"
+                          << input_ring->get_capacity() << std::endl;
+                input_overruns_reported = input_overruns;
+            }
+            pipeline_report_at = now;
+        }
 
         /*auto cur_data = std::chrono::steady_clock::now();
         std::chrono::duration<double> diff_time = cur_data - prev_data;
@@ -174,11 +310,21 @@ void broadcast_server::fft_task() {
             // sps_measured.getAverage()<<std::endl;
         }*/
     }
-    // Ensure last iteration's async tasks finish before fft is destroyed
-    for (auto &f : signal_futures)    f.wait();
-    for (auto &f : waterfall_futures) f.wait();
+    // Ensure every queued client task is done with the generations before
+    // they (and the fft's own buffers) are freed
+    for (int g = 0; g < pipeline_depth; g++) {
+        FFTGeneration &gen = fft_generations[g];
+        gen.wait_idle();
+        if (gen.owned) {
+            fftwf_free(gen.spectrum);
+            operator delete[](gen.quantized, std::align_val_t(32));
+        }
+    }
+    fft_generations.reset();
 
-    fft->free(input_buffers[0]);
-    fft->free(input_buffers[1]);
-    fft->free(input_buffers[2]);
+    // Joins the reader thread, which blocks until the read in progress returns
+    input_ring.reset();
+    for (float *buf : input_buffers) {
+        fft->free(buf);
+    }
 }
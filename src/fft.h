@@ -2,7 +2,9 @@
 #define FFT_H
 
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #ifdef CUFFT
 #include <cufft.h>
@@ -21,6 +23,9 @@
 #include <fftw3.h>
 #include <cstdlib>  // ::malloc / ::free — no longer pulled in transitively by fftw3 under GCC 14
 
+class SampleConverterBase;
+class ThreadTeam;
+
 // Global lock for FFTW planner
 extern std::mutex fftwf_planner_mutex;
 
@@ -44,8 +49,26 @@ class FFT {
     virtual float *get_input_buffer();
     virtual float *get_output_buffer();
     virtual int8_t *get_quantized_buffer();
+    // Redirect the next execute() to write the spectrum and the quantized
+    // waterfall pyramid into caller-owned buffers of the same size and
+    // alignment as the plan's own.  Returns false if the backend cannot, in
+    // which case the caller copies out of get_output_buffer() /
+    // get_quantized_buffer() after execute().
+    virtual bool set_output(float *outbuf, int8_t *quantizedbuf);
     virtual int load_real_input(float *a1, float *a2) = 0;
     virtual int load_complex_input(float *a1, float *a2) = 0;
+    // Fused input path: convert two hops of raw samples (see
+    // SampleConverterBase::read_raw), scale and window them straight into the
+    // FFT input in a single pass.  Only valid when accepts_raw_input().
+    virtual bool accepts_raw_input() const;
+    virtual int load_raw_input(const SampleConverterBase &conv, const void *a1,
+                               const void *a2);
+    // Threads (including the FFT thread) for the post-FFT power / quantize /
+    // waterfall pyramid pass, optionally pinned.  Ignored by GPU backends.
+    virtual void set_quantize_threads(int threads, const std::vector<int> &cpus);
+    // True if execute() already copied the first additional_size bins past
+    // the end of a complex spectrum, so the caller can skip that memmove.
+    virtual bool fills_wraparound() const;
     virtual int execute() = 0;
     virtual ~FFT();
 
@@ -100,11 +123,28 @@ class FFTW : public FFT {
     virtual int plan_r2c(int options);
     virtual int load_real_input(float *a1, float *a2);
     virtual int load_complex_input(float *a1, float *a2);
+    virtual bool accepts_raw_input() const;
+    virtual int load_raw_input(const SampleConverterBase &conv, const void *a1,
+                               const void *a2);
+    virtual void set_quantize_threads(int threads, const std::vector<int> &cpus);
+    virtual bool fills_wraparound() const;
     virtual int execute();
+    virtual bool set_output(float *outbuf, int8_t *quantizedbuf);
     virtual ~FFTW();
 
   protected:
     fftwf_plan p;
+    bool is_r2c;
+    // Hann window with the converter's 1 / full scale folded in, one entry
+    // per input float (duplicated per I/Q pair for complex input)
+    std::vector<float> scaled_windowbuf;
+    float scaled_window_scale = 0.f;
+    // Buffers allocated by plan_*(); outbuf / quantizedbuf may point
+    // elsewhere after set_output().
+    float *own_outbuf;
+    int8_t *own_quantizedbuf;
+    // Runs the tiled quantize pass, see quantize_spectrum_tiled()
+    std::unique_ptr<ThreadTeam> quantize_team;
 };
 
 #ifdef MKL
@@ -1,6 +1,7 @@
 #include <cassert>
 
 #include "fft.h"
+#include "metrics.h"
 
 cuFFT::cuFFT(size_t size, int nthreads, int downsample_levels, int brightness_offset)
     : FFT(size, nthreads, downsample_levels, brightness_offset), plan{0} {
@@ -128,6 +129,8 @@ __global__ void half_and_quantize(float *powerbuf, float *halfbuf,
 }
 
 int cuFFT::execute() {
+    // Power and quantize run on the GPU too, so it is all one stage
+    StageTimer timer(Stage::FFT);
     if (type == CUFFT_C2C) {
         cufftExecC2C(plan, (cufftComplex *)cuda_inbuf,
                      (cufftComplex *)cuda_outbuf, cuda_direction);  // was hardcoded CUFFT_FORWARD
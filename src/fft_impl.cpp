@@ -6,63 +6,15 @@
 #include <stdexcept>
 
 #include "fft.h"
+#include "metrics.h"
+#include "samplereader.h"
+#include "spectrumquantize.h"
+#include "threadteam.h"
 #include "utils.h"
 #include "utils/dsp.h"
 
 std::mutex fftwf_planner_mutex;
 
-// Compiler autovectorization
-static inline float vec_log2(float val, int power_offset) {
-    uint32_t bit_exponent;
-    memcpy(&bit_exponent, &val, sizeof(bit_exponent));  // avoids strict-aliasing UB
-    float log_val =
-        (float)((int)((bit_exponent >> 23) & 0xFF) - 128) + power_offset;
-    // Set exponent to 0
-    bit_exponent &= ~(255u << 23);
-    bit_exponent += 127u << 23;
-    memcpy(&val, &bit_exponent, sizeof(val));
-    log_val += ((-0.34484843f) * val + 2.02466578f) * val - 0.67487759f;
-    return log_val;
-}
-static inline void power_and_quantize(float *complexbuf, float *powerbuf,
-                                      int8_t *quantizedbuf, float normalize,
-                                      size_t outbuf_len, int power_offset) {
-/*complexbuf = (float *)__builtin_assume_aligned(complexbuf, 32);
-powerbuf = (float *)__builtin_assume_aligned(powerbuf, 32);
-quantizedbuf = (int8_t *)__builtin_assume_aligned(quantizedbuf, 32);
-// Get the compiler to auto-vectorize*
-outbuf_len -= outbuf_len & 15;*/
-#pragma omp parallel for simd
-    for (size_t i = 0; i < outbuf_len; i++) {
-        complexbuf[i * 2] /= normalize;
-        complexbuf[i * 2 + 1] /= normalize;
-        float re = complexbuf[i * 2];
-        float im = complexbuf[i * 2 + 1];
-        float power = re * re + im * im;
-        powerbuf[i] = power;
-        quantizedbuf[i] = static_cast<int8_t>(std::clamp(
-            vec_log2(power, power_offset) * 0.3010299956639812f * 20.f + 127.f,
-            -128.f, 127.f));
-    }
-}
-static inline void half_and_quantize(float *powerbuf, float *halfbuf,
-                                     int8_t *quantizedbuf, size_t outbuf_len,
-                                     int power_offset) {
-    powerbuf = (float *)__builtin_assume_aligned(powerbuf, 32);
-    halfbuf = (float *)__builtin_assume_aligned(halfbuf, 32);
-    quantizedbuf = (int8_t *)__builtin_assume_aligned(quantizedbuf, 32);
-// Get the compiler to auto-vectorize
-// outbuf_len -= outbuf_len & 15;
-#pragma omp parallel for simd
-    for (size_t i = 0; i < outbuf_len; i++) {
-        float power = powerbuf[i * 2] + powerbuf[i * 2 + 1];
-        halfbuf[i] = power;
-        quantizedbuf[i] = static_cast<int8_t>(std::clamp(
-            vec_log2(power, power_offset) * 0.3010299956639812f * 20.f + 127.f,
-            -128.f, 127.f));
-    }
-}
-
 FFT::FFT(size_t size, int nthreads, int downsample_levels,
          int brightness_offset)
     : size{size}, nthreads{nthreads}, downsample_levels{downsample_levels},
@@ -79,9 +31,18 @@ void FFT::set_output_additional_size(size_t size) { additional_size = size; }
 float *FFT::get_input_buffer() { return inbuf; }
 float *FFT::get_output_buffer() { return outbuf; }
 int8_t *FFT::get_quantized_buffer() { return quantizedbuf; }
+bool FFT::set_output(float *, int8_t *) { return false; }
+bool FFT::accepts_raw_input() const { return false; }
+void FFT::set_quantize_threads(int, const std::vector<int> &) {}
+bool FFT::fills_wraparound() const { return false; }
+int FFT::load_raw_input(const SampleConverterBase &, const void *,
+                        const void *) {
+    throw std::logic_error("FFT backend does not take raw input");
+}
 
 FFTW::FFTW(size_t size, int nthreads, int downsample_levels, int brightness_offset)
-    : FFT(size, nthreads, downsample_levels, brightness_offset), p{0} {}
+    : FFT(size, nthreads, downsample_levels, brightness_offset), p{0},
+      is_r2c{false}, own_outbuf{nullptr}, own_quantizedbuf{nullptr} {}
 
 float *FFTW::malloc(size_t size) {
     return (float *)fftwf_malloc(sizeof(float) * size);
@@ -97,6 +58,8 @@ int FFTW::plan_c2c(direction d, int options) {
     outbuf_len = size;
     powerbuf = new (std::align_val_t(32)) float[size * 2];
     quantizedbuf = new (std::align_val_t(32)) int8_t[size * 2];
+    own_outbuf = outbuf;
+    own_quantizedbuf = quantizedbuf;
 
     std::scoped_lock lk(fftwf_planner_mutex);
     fftwf_plan_with_nthreads(nthreads);
@@ -112,6 +75,9 @@ int FFTW::plan_r2c(int options) {
     outbuf_len = size / 2;
     powerbuf = new (std::align_val_t(32)) float[size];
     quantizedbuf = new (std::align_val_t(32)) int8_t[size];
+    own_outbuf = outbuf;
+    own_quantizedbuf = quantizedbuf;
+    is_r2c = true;
 
     std::scoped_lock lk(fftwf_planner_mutex);
     fftwf_plan_with_nthreads(nthreads);
@@ -146,35 +112,69 @@ int FFTW::load_complex_input(float *a1, float *a2) {
                          size / 2);
     return 0;
 }
+bool FFTW::accepts_raw_input() const { return true; }
+int FFTW::load_raw_input(const SampleConverterBase &conv, const void *a1,
+                         const void *a2) {
+    const float scale = conv.full_scale();
+    if (scaled_window_scale != scale) {
+        if (is_r2c) {
+            scaled_windowbuf.resize(size);
+            for (size_t i = 0; i < size; i++) {
+                scaled_windowbuf[i] = windowbuf[i] / scale;
+            }
+        } else {
+            scaled_windowbuf.resize(size * 2);
+            for (size_t i = 0; i < size; i++) {
+                scaled_windowbuf[i * 2] = windowbuf[i] / scale;
+                scaled_windowbuf[i * 2 + 1] = windowbuf[i] / scale;
+            }
+        }
+        scaled_window_scale = scale;
+    }
+    // One hop is half the window: size / 2 floats real, size floats IQ
+    const int hop = is_r2c ? size / 2 : size;
+    conv.convert_windowed(inbuf, a1, scaled_windowbuf.data(), hop);
+    conv.convert_windowed(&inbuf[hop], a2, &scaled_windowbuf[hop], hop);
+    return 0;
+}
+void FFTW::set_quantize_threads(int threads, const std::vector<int> &cpus) {
+    quantize_team = std::make_unique<ThreadTeam>("quantize", threads, cpus);
+}
+bool FFTW::fills_wraparound() const { return true; }
+bool FFTW::set_output(float *outbuf, int8_t *quantizedbuf) {
+    this->outbuf = outbuf;
+    this->quantizedbuf = quantizedbuf;
+    return true;
+}
 int FFTW::execute() {
-    fftwf_execute(p);
+    // New-array execute so set_output() can move the result between the
+    // pipelined FFT generations without replanning.  Same sizes, same
+    // alignment (fftwf_malloc) and still out-of-place, as FFTW requires.
+    {
+        StageTimer timer(Stage::FFT);
+        if (is_r2c) {
+            fftwf_execute_dft_r2c(p, inbuf, (fftwf_complex *)outbuf);
+        } else {
+            fftwf_execute_dft(p, (fftwf_complex *)inbuf,
+                              (fftwf_complex *)outbuf);
+        }
+    }
     // Calculate the waterfall buffers
+    StageTimer timer(Stage::QUANTIZE);
 
-    int base_idx = 0;
-    int normalize = size;
-    bool is_real = outbuf_len == size / 2;
+    SpectrumQuantizeJob job;
+    job.complexbuf = outbuf;
+    job.quantized = quantizedbuf;
+    job.n = outbuf_len;
     // For IQ input, the lowest frequency is in the middle
-    if (!is_real) {
-        base_idx = size / 2 + 1;
-    }
-    // outbuf is complex so we need to multiply by 2
-    // Also normalize the power by the number of bins
-    power_and_quantize(&outbuf[base_idx * 2], powerbuf, quantizedbuf, size,
-                       outbuf_len - base_idx, size_log2);
-    power_and_quantize(outbuf, &powerbuf[outbuf_len - base_idx],
-                       &quantizedbuf[outbuf_len - base_idx], size, base_idx,
-                       size_log2);
-
-    int out_len = outbuf_len;
-    int8_t *quantized_offset_buf = quantizedbuf;
-    float *power_offset_buf = powerbuf;
-    for (int i = 0; i < downsample_levels - 1; i++) {
-        half_and_quantize(power_offset_buf, power_offset_buf + out_len,
-                          quantized_offset_buf + out_len, out_len / 2,
-                          size_log2 - i - 1);
-        power_offset_buf += out_len;
-        quantized_offset_buf += out_len;
-        out_len /= 2;
+    job.base_idx = is_r2c ? 0 : size / 2 + 1;
+    job.normalize = size;
+    job.levels = downsample_levels;
+    job.power_offset = size_log2;
+    // Make audio slices near 0 Hz contiguous, see fills_wraparound()
+    job.wrap_bins = is_r2c ? 0 : additional_size;
+    if (!quantize_team || !quantize_spectrum_tiled(job, *quantize_team)) {
+        quantize_spectrum_passes(job, powerbuf);
     }
     return 0;
 }
@@ -183,9 +183,9 @@ FFTW::~FFTW() {
         fftwf_destroy_plan(p);
     }
     this->free(inbuf);
-    this->free(outbuf);
+    this->free(own_outbuf);
     operator delete[](powerbuf, std::align_val_t(32));
-    operator delete[](quantizedbuf, std::align_val_t(32));
+    operator delete[](own_quantizedbuf, std::align_val_t(32));
 }
 
 #ifdef CLFFT
@@ -394,6 +394,8 @@ int clFFT::load_complex_input(float *a1, float *a2) {
     return 0;
 }
 int clFFT::execute() {
+    // Power and quantize run on the GPU too, so it is all one stage
+    StageTimer timer(Stage::FFT);
     int err;
     /* Execute the plan. */
     err = clfftEnqueueTransform(planHandle, d, 1, &queue(), 0, NULL, NULL,
@@ -1,4 +1,6 @@
 #include "fft.h"
+#include "metrics.h"
+#include "spectrumquantize.h"
 
 mklFFT::mklFFT(size_t size, int nthreads, int downsample_levels, int brightness_offset)
     : FFT(size, nthreads, downsample_levels, brightness_offset) {}
@@ -55,34 +57,24 @@ int mklFFT::load_complex_input(float *a1, float *a2) {
     return 0;
 }
 int mklFFT::execute() {
-    DftiComputeForward(descriptor, inbuf, outbuf); // Compute the Forward FFT
+    {
+        StageTimer timer(Stage::FFT);
+        DftiComputeForward(descriptor, inbuf, outbuf); // Compute the Forward FFT
+    }
     // Calculate the waterfall buffers
+    StageTimer timer(Stage::QUANTIZE);
 
-    int base_idx = 0;
-    bool is_real = outbuf_len == size / 2;
+    SpectrumQuantizeJob job;
+    job.complexbuf = outbuf;
+    job.quantized = quantizedbuf;
+    job.n = outbuf_len;
     // For IQ input, the lowest frequency is in the middle
-    if (!is_real) {
-        base_idx = size / 2 + 1;
-    }
-    // outbuf is complex so we need to multiply by 2
-    // Also normalize the power by the number of bins
-    power_and_quantize(&outbuf[base_idx * 2], powerbuf, quantizedbuf, size,
-                       outbuf_len - base_idx, size_log2);
-    power_and_quantize(outbuf, &powerbuf[outbuf_len - base_idx],
-                       &quantizedbuf[outbuf_len - base_idx], size, base_idx,
-                       size_log2);
-
-    int out_len = outbuf_len;
-    int8_t *quantized_offset_buf = quantizedbuf;
-    float *power_offset_buf = powerbuf;
-    for (int i = 0; i < downsample_levels - 1; i++) {
-        half_and_quantize(power_offset_buf, power_offset_buf + out_len,
-                          quantized_offset_buf + out_len, out_len / 2,
-                          size_log2 - i - 1);
-        power_offset_buf += out_len;
-        quantized_offset_buf += out_len;
-        out_len /= 2;
-    }
+    job.base_idx = outbuf_len == size / 2 ? 0 : size / 2 + 1;
+    job.normalize = size;
+    job.levels = downsample_levels;
+    job.power_offset = size_log2;
+    job.wrap_bins = 0;
+    quantize_spectrum_passes(job, powerbuf);
     return 0;
 }
 mklFFT::~mklFFT() {
@@ -0,0 +1,116 @@
+#include "fftplancache.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "fft.h"
+
+FFTPlanCache &FFTPlanCache::instance() {
+    static FFTPlanCache cache;
+    return cache;
+}
+
+FFTPlanCache::~FFTPlanCache() {
+    std::scoped_lock lk(fftwf_planner_mutex);
+    for (auto &[key, plan] : plans) {
+        fftwf_destroy_plan(plan);
+    }
+}
+
+fftwf_plan FFTPlanCache::get(int n, plan_type type, int direction,
+                             int alignment) {
+    if (type != C2C) {
+        direction = 0;
+    }
+    const key_t key{n, type, direction, alignment};
+
+    // Planning happens under mtx, so a connect storm plans each key once and
+    // everyone else waits for that plan instead of making their own.
+    std::scoped_lock lk(mtx);
+    auto it = plans.find(key);
+    if (it != plans.end()) {
+        return it->second;
+    }
+    fftwf_plan plan = create(n, type, direction, alignment);
+    plans.emplace(key, plan);
+    return plan;
+}
+
+fftwf_plan FFTPlanCache::get_c2c(int n, int direction,
+                                 const fftwf_complex *in,
+                                 const fftwf_complex *out) {
+    const int alignment =
+        std::max(fftwf_alignment_of((float *)in), fftwf_alignment_of((float *)out));
+    return get(n, C2C, direction, alignment);
+}
+
+fftwf_plan FFTPlanCache::get_c2r(int n, const fftwf_complex *in,
+                                 const float *out) {
+    const int alignment =
+        std::max(fftwf_alignment_of((float *)in), fftwf_alignment_of((float *)out));
+    return get(n, C2R, 0, alignment);
+}
+
+fftwf_plan FFTPlanCache::get_r2c(int n, const float *in,
+                                 const fftwf_complex *out) {
+    const int alignment =
+        std::max(fftwf_alignment_of((float *)in), fftwf_alignment_of((float *)out));
+    return get(n, R2C, 0, alignment);
+}
+
+void FFTPlanCache::warm_audio(int audio_fft_size) {
+    // Same shapes AudioClient asks for: complex IFFT for AM/SAM/FM and the
+    // complex-to-real IFFT for USB/LSB, on fftwf_malloc'd (aligned) buffers.
+    get(audio_fft_size, C2C, FFTW_BACKWARD);
+    get(audio_fft_size, C2R, 0);
+}
+
+fftwf_plan FFTPlanCache::create(int n, plan_type type, int direction,
+                                int alignment) {
+    // Scratch arrays only for the planner; FFTW_MEASURE overwrites them.
+    // Misaligned keys get FFTW_UNALIGNED plans, which run on any pointer.
+    int flags = FFTW_MEASURE;
+    if (alignment != 0) {
+        flags |= FFTW_UNALIGNED;
+    }
+    fftwf_complex *in = fftwf_alloc_complex(n);
+    fftwf_complex *out = fftwf_alloc_complex(n);
+    if (!in || !out) {
+        fftwf_free(in);
+        fftwf_free(out);
+        throw std::bad_alloc();
+    }
+
+    fftwf_plan plan;
+    {
+        std::scoped_lock lk(fftwf_planner_mutex);
+        fftwf_plan_with_nthreads(1);
+        switch (type) {
+        case C2R:
+            plan = fftwf_plan_dft_c2r_1d(n, in, (float *)out, flags);
+            break;
+        case R2C:
+            plan = fftwf_plan_dft_r2c_1d(n, (float *)in, out, flags);
+            break;
+        default:
+            plan = fftwf_plan_dft_1d(n, in, out, direction, flags);
+            break;
+        }
+    }
+    fftwf_free(in);
+    fftwf_free(out);
+
+    if (!plan) {
+        throw std::runtime_error("FFTW plan creation failed for size " +
+                                 std::to_string(n));
+    }
+    std::cout << "[fftw] planned " << n << "-point "
+              << (type == C2R   ? "c2r"
+                  : type == R2C ? "r2c"
+                  : direction == FFTW_FORWARD ? "forward c2c"
+                                              : "backward c2c")
+              << (alignment ? " (unaligned)" : "") << std::endl;
+    return plan;
+}
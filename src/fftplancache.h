@@ -0,0 +1,56 @@
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include <map>
+#include <mutex>
+#include <tuple>
+
+#include <fftw3.h>
+
+// Process-wide cache of FFTW plans for the per-client transforms (the audio
+// demodulation IFFTs).  Every AudioClient uses the same audio_fft_size, so
+// planning them with FFTW_MEASURE on every connect only repeated the same work
+// while holding fftwf_planner_mutex — stalling the FFT thread and every other
+// connect.  Plans are created once per (size, type, direction, alignment) and
+// run on the caller's own buffers with the new-array execute functions
+// (fftwf_execute_dft / _dft_c2r / _dft_r2c), which FFTW allows from several
+// threads at once on the same plan.
+//
+// Cached plans are always out-of-place; callers must pass distinct input and
+// output arrays whose alignment matches the one the plan was looked up with
+// (use the pointer overloads, which compute it with fftwf_alignment_of()).
+// Plans live until process exit.
+class FFTPlanCache {
+  public:
+    enum plan_type { C2C, C2R, R2C };
+
+    static FFTPlanCache &instance();
+
+    // Plan for an n-point transform; direction is FFTW_FORWARD or
+    // FFTW_BACKWARD (ignored for C2R / R2C).  alignment is the
+    // fftwf_alignment_of() shared by the arrays it will run on.
+    fftwf_plan get(int n, plan_type type, int direction, int alignment = 0);
+
+    fftwf_plan get_c2c(int n, int direction, const fftwf_complex *in,
+                       const fftwf_complex *out);
+    fftwf_plan get_c2r(int n, const fftwf_complex *in, const float *out);
+    fftwf_plan get_r2c(int n, const float *in, const fftwf_complex *out);
+
+    // Plan the audio IFFTs ahead of the first connect.
+    void warm_audio(int audio_fft_size);
+
+    ~FFTPlanCache();
+
+  private:
+    FFTPlanCache() = default;
+    FFTPlanCache(const FFTPlanCache &) = delete;
+    FFTPlanCache &operator=(const FFTPlanCache &) = delete;
+
+    fftwf_plan create(int n, plan_type type, int direction, int alignment);
+
+    using key_t = std::tuple<int, plan_type, int, int>;
+    std::mutex mtx;
+    std::map<key_t, fftwf_plan> plans;
+};
+
+#endif
@@ -0,0 +1,409 @@
+#include "framedispatch.h"
+#include "metrics.h"
+#include "signal.h"
+#include "waterfall.h"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+using clock_t = std::chrono::steady_clock;
+
+// Timing for one waterfall frame.  Each encode task holds a shared_ptr to it;
+// whichever reference is dropped last — normally the slowest task — publishes
+// the frame into WaterfallEncodeStats from the destructor, so no task has to
+// know how many others there are.
+struct waterfall_frame_timing {
+    WaterfallEncodeStats &stats;
+    const clock_t::time_point start = clock_t::now();
+    std::atomic<uint64_t> tasks{0};
+    std::atomic<uint64_t> cpu_us{0};
+    std::atomic<int64_t>  end_us{0};   // latest completion, relative to start
+
+    explicit waterfall_frame_timing(WaterfallEncodeStats &stats) : stats{stats} {}
+
+    void add(clock_t::time_point t0, clock_t::time_point t1) {
+        using std::chrono::duration_cast;
+        using std::chrono::microseconds;
+        tasks.fetch_add(1, std::memory_order_relaxed);
+        const int64_t task_us = duration_cast<microseconds>(t1 - t0).count();
+        cpu_us.fetch_add(task_us, std::memory_order_relaxed);
+        metrics()
+            .stages[static_cast<int>(Stage::WATERFALL_ENCODE)]
+            .observe(static_cast<uint64_t>(task_us));
+        const int64_t end = duration_cast<microseconds>(t1 - start).count();
+        int64_t prev = end_us.load(std::memory_order_relaxed);
+        while (prev < end &&
+               !end_us.compare_exchange_weak(prev, end, std::memory_order_relaxed)) {}
+    }
+
+    ~waterfall_frame_timing() {
+        if (tasks.load(std::memory_order_relaxed) == 0) return;
+        const uint64_t wall = end_us.load(std::memory_order_relaxed);
+        stats.frames.fetch_add(1, std::memory_order_relaxed);
+        stats.wall_us_total.fetch_add(wall, std::memory_order_relaxed);
+        stats.cpu_us_total.fetch_add(cpu_us.load(std::memory_order_relaxed),
+                                     std::memory_order_relaxed);
+        stats.last_wall_us.store(wall, std::memory_order_relaxed);
+        uint64_t prev = stats.wall_us_max.load(std::memory_order_relaxed);
+        while (prev < wall &&
+               !stats.wall_us_max.compare_exchange_weak(prev, wall, std::memory_order_relaxed)) {}
+    }
+};
+
+// Holds a reference on an FFT generation for as long as a frame job that
+// reads it exists, whether the job runs or is dropped from the backlog.
+std::shared_ptr<void> hold_generation(FFTGeneration &gen) {
+    gen.acquire();
+    return std::shared_ptr<void>(&gen, [](void *p) {
+        static_cast<FFTGeneration *>(p)->release();
+    });
+}
+
+// Runs a client's frames in order until its backlog is empty.  The front
+// entry stays in the deque while it runs so dispatch_frame() sees it as
+// outstanding and never drops it.
+void drain_strand(std::shared_ptr<Client> client) {
+    auto &strand = client->strand;
+    while (true) {
+        std::function<void()> job;
+        {
+            std::scoped_lock lk(strand.mtx);
+            job = std::move(strand.backlog.front());
+        }
+        try {
+            job();
+        } catch (...) {
+        }
+        job = nullptr;   // release the generation before taking the lock
+        std::scoped_lock lk(strand.mtx);
+        strand.backlog.pop_front();
+        if (strand.backlog.empty()) return;
+    }
+}
+
+// Queue one frame for a client on a worker pool.  At most max_backlog frames
+// are outstanding per client; when a client is that far behind its oldest
+// queued (not running) frame is dropped so it catches up with the live signal,
+// and false is returned so the caller can count the skip.
+bool dispatch_frame(WorkerPool &pool, std::shared_ptr<Client> client,
+                    size_t max_backlog, std::function<void()> job,
+                    int shard = -1) {
+    bool skipped = false;
+    std::function<void()> dropped;   // destroyed outside the lock
+    {
+        auto &strand = client->strand;
+        std::scoped_lock lk(strand.mtx);
+        if (strand.backlog.size() >= max_backlog) {
+            skipped = true;
+            if (strand.backlog.size() < 2) return false;
+            dropped = std::move(strand.backlog[1]);
+            strand.backlog.erase(strand.backlog.begin() + 1);
+        }
+        strand.backlog.push_back(std::move(job));
+        if (strand.backlog.size() > 1) return !skipped;
+    }
+    pool.submit([client] { drain_strand(client); }, shard);
+    return !skipped;
+}
+} // namespace
+
+// Listeners whose channel keys match (same bins, mode, settings, codec and
+// framing; see DemodChannelKey) form a channel: one of them, the leader,
+// demodulates and encodes the frame and its encoder sends every packet to
+// the others as well.  Channels are worked out again on every frame.  A
+// listener that stops following a leader (it retuned, or the leader left)
+// first takes over the leader's demodulator state with try_adopt_dsp_state(),
+// so its own demodulator carries on from the last frame it heard instead of
+// from the frame it joined on.  The leader is kept for as long as it stays on
+// the channel, and when it leaves one of its followers takes over its state,
+// so nobody on the channel hears the hand-off.
+AudioFrameStats dispatch_audio_frame(PacketSender &sender, WorkerPool &pool,
+                                     const FrameDispatch &frame, int base_idx,
+                                     bool share_demod) {
+    AudioFrameStats stats;
+    std::complex<float> *fft_buffer = frame.gen.spectrum;
+    auto &signal_slices = sender.get_signal_slices();
+    std::scoped_lock lg(sender.get_signal_slice_mtx());
+
+    // Open listeners, in signal_slices order.  wants is false while the
+    // adaptive throttle holds a listener back; it still keeps its place in
+    // its channel so the channel does not churn.
+    struct Listener {
+        std::shared_ptr<AudioClient> client;
+        std::pair<int, int> slice;
+        std::optional<DemodChannelKey> key;
+        bool wants;
+        bool grouped = false;
+    };
+    std::vector<Listener> listeners;
+    listeners.reserve(signal_slices.size());
+    for (auto &[slice, data] : signal_slices) {
+        const std::optional<bool> wants =
+            sender.frame_wanted(*data, frame.frame_num);
+        if (!wants) continue;
+        std::optional<DemodChannelKey> key;
+        if (share_demod) key = data->channel_key();
+        listeners.push_back({data, slice, key, *wants});
+    }
+
+    // Work out every channel before any frame is queued, so the leaders
+    // try_adopt_dsp_state() reads from are still at the end of the last frame.
+    struct Job {
+        std::shared_ptr<AudioClient> client;
+        std::pair<int, int> slice;
+        std::vector<connection_hdl> subscribers;
+        bool to_self;
+    };
+    std::vector<Job> jobs;
+    jobs.reserve(listeners.size());
+
+    // True if none of the listener's own frames are queued or running, so
+    // packets from a leader cannot overtake them.
+    auto strand_idle = [](AudioClient &client) {
+        std::scoped_lock lk(client.strand.mtx);
+        return client.strand.backlog.empty();
+    };
+    // A listener demodulating for itself picks up where its leader, if it
+    // had one, left off.  That needs the leader's frames done, and this
+    // thread does not wait for them: while they are still queued or running
+    // the listener keeps following its old leader for one more frame
+    // (run_own() is false), and after that it starts from its own state.
+    auto run_own = [&](Listener &li) {
+        auto &ch = li.client->channel;
+        if (ch.leader) {
+            const bool adopted =
+                strand_idle(*li.client) && strand_idle(*ch.leader) &&
+                li.client->try_adopt_dsp_state(
+                    *ch.leader, li.key && ch.key.same_processing(*li.key));
+            if (!adopted && !ch.handoff_pending) {
+                ch.handoff_pending = true;
+                return false;
+            }
+            ch.leader = nullptr;
+            ch.handoff_pending = false;
+        }
+        ch.leading = false;
+        return true;
+    };
+    // Listeners following their old leader for one more frame, added to its
+    // job once every job exists
+    std::vector<size_t> still_following;
+    auto own_job = [&](size_t m) {
+        Listener &li = listeners[m];
+        if (!run_own(li)) {
+            still_following.push_back(m);
+        } else if (li.wants) {
+            jobs.push_back({li.client, li.slice, {}, true});
+        }
+    };
+
+    std::vector<size_t> members;
+    for (size_t i = 0; i < listeners.size(); i++) {
+        if (listeners[i].grouped) continue;
+        listeners[i].grouped = true;
+        members.assign(1, i);
+        // Equal keys have equal (l, r), so a channel's listeners are
+        // adjacent in signal_slices.
+        if (listeners[i].key) {
+            for (size_t j = i + 1; j < listeners.size() &&
+                                   listeners[j].slice == listeners[i].slice;
+                 j++) {
+                if (!listeners[j].grouped &&
+                    listeners[j].key == listeners[i].key) {
+                    listeners[j].grouped = true;
+                    members.push_back(j);
+                }
+            }
+        }
+
+        if (members.size() == 1) {
+            own_job(i);
+            continue;
+        }
+
+        // Leader: the one already leading this channel, else a follower of
+        // the channel's previous leader (it takes over that leader's
+        // state), else the first listener.
+        const DemodChannelKey &key = *listeners[i].key;
+        size_t lead = members[0];
+        bool lead_found = false;
+        for (size_t m : members) {
+            auto &ch = listeners[m].client->channel;
+            if (ch.leading && ch.key == key) {
+                lead = m;
+                lead_found = true;
+                break;
+            }
+        }
+        if (!lead_found) {
+            for (size_t m : members) {
+                auto &ch = listeners[m].client->channel;
+                if (ch.leader && ch.key == key) {
+                    lead = m;
+                    break;
+                }
+            }
+        }
+
+        Listener &leader = listeners[lead];
+        if (!run_own(leader)) {
+            // The channel's state is still in its old leader's frames: the
+            // listeners that followed it keep doing so this frame
+            still_following.push_back(lead);
+            for (size_t m : members) {
+                if (m != lead) own_job(m);
+            }
+            continue;
+        }
+        leader.client->channel.leading = true;
+        leader.client->channel.key = key;
+
+        Job job{leader.client, leader.slice, {}, leader.wants};
+        for (size_t m : members) {
+            if (m == lead) continue;
+            Listener &li = listeners[m];
+            auto &ch = li.client->channel;
+            // Join only once the listener's own frames have drained;
+            // until then it carries on by itself.
+            if (!ch.leader && !strand_idle(*li.client)) {
+                own_job(m);
+                continue;
+            }
+            if (!ch.leader) li.client->release_noise_reduction();
+            ch.leader = leader.client;
+            ch.key = key;
+            ch.leading = false;
+            if (li.wants) job.subscribers.push_back(li.client->hdl);
+        }
+        if (job.subscribers.empty() && !job.to_self) continue;
+        if (!job.subscribers.empty()) {
+            stats.channel_frames++;
+            stats.channel_sends += job.subscribers.size();
+        }
+        jobs.push_back(std::move(job));
+    }
+
+    // Anyone still following gets this frame from its old leader's job.
+    // Without one (the leader left, or is throttled) it misses this frame.
+    for (size_t m : still_following) {
+        Listener &li = listeners[m];
+        if (!li.wants) continue;
+        for (auto &job : jobs) {
+            if (job.client != li.client->channel.leader) continue;
+            if (job.subscribers.empty()) stats.channel_frames++;
+            stats.channel_sends++;
+            job.subscribers.push_back(li.client->hdl);
+            break;
+        }
+    }
+
+    for (auto &job : jobs) {
+        // Equivalent to
+        // data->send_audio(&fft_buffer[(l_idx + base_idx) % fft_result_size],
+        // frame_num);
+        // Runs on the DSP pool, NOT the io_service: demodulation and
+        // FLAC/Opus encoding used to serialise every listener on the one
+        // network thread.  send_binary_packet() posts the finished frame
+        // back to the I/O thread for the socket write.  The client's
+        // frames run in order through its strand; the generation stays
+        // alive until the job is done with it.
+        std::complex<float> *slice_buf =
+            &fft_buffer[(job.slice.first + base_idx) % frame.fft_result_size];
+        if (!dispatch_frame(pool, job.client, frame.max_backlog,
+                            [data = job.client, slice_buf,
+                             frame_num = frame.frame_num,
+                             subscribers = std::move(job.subscribers),
+                             to_self = job.to_self,
+                             hold = hold_generation(frame.gen)] {
+                                data->send_audio(slice_buf, frame_num,
+                                                 subscribers, to_self);
+                            })) {
+            stats.skipped++;
+        }
+    }
+    return stats;
+}
+
+uint64_t dispatch_waterfall_frame(PacketSender &sender, WorkerPool &pool,
+                                  const FrameDispatch &frame,
+                                  int downsample_levels, int tile_bins,
+                                  bool share_rows,
+                                  WaterfallEncodeStats &stats) {
+    uint64_t skipped = 0;
+    int8_t *fft_power_quantized = frame.gen.quantized;
+    auto &waterfall_slices = sender.get_waterfall_slices();
+    auto &waterfall_slice_mtx = sender.get_waterfall_slice_mtx();
+    auto timing = std::make_shared<waterfall_frame_timing>(stats);
+    for (int i = 0; i < downsample_levels; i++) {
+        // Iterate over each waterfall client and send each slice
+        std::scoped_lock lg(waterfall_slice_mtx[i]);
+        // The multimap is ordered by slice, so sharers of a row are adjacent
+        std::shared_ptr<SharedWaterfallFrame> shared;
+        // Tiles of this level, created for the first WIRE_PACKED_V2 client
+        std::shared_ptr<WaterfallTileFrame> tiles;
+        for (auto &[slice, data] : waterfall_slices[i]) {
+            auto &[l_idx, r_idx] = slice;
+            const std::optional<bool> wants =
+                sender.frame_wanted(*data, frame.frame_num);
+            if (!wants || !*wants) continue;
+
+            // Equivalent to
+            // data->send_waterfall(&fft_power_quantized[l_idx],frame_num);
+            // CBOR + zstd run on the waterfall pool, sharded by level so a
+            // level's row stays on one core unless another worker steals.
+            // The compressed packet goes back to the I/O thread through
+            // send_binary_packet().
+            int8_t *row = &fft_power_quantized[l_idx];
+            const uint8_t wire_version =
+                data->wire_version.load(std::memory_order_relaxed);
+            std::function<void()> job;
+            if (share_rows && wire_version >= WIRE_PACKED_V2) {
+                if (!tiles) {
+                    tiles = std::make_shared<WaterfallTileFrame>(
+                        fft_power_quantized, frame.fft_result_size >> i, i,
+                        tile_bins, frame.frame_num,
+                        hold_generation(frame.gen));
+                    stats.tiled_levels.fetch_add(1, std::memory_order_relaxed);
+                }
+                stats.tiled_sends.fetch_add(1, std::memory_order_relaxed);
+                job = [data, tiles, timing] {
+                    const auto t0 = std::chrono::steady_clock::now();
+                    data->send_waterfall_tiles(*tiles);
+                    timing->add(t0, std::chrono::steady_clock::now());
+                };
+            } else if (share_rows && wire_version != WIRE_CBOR) {
+                if (!shared || shared->l != l_idx || shared->r != r_idx) {
+                    shared = std::make_shared<SharedWaterfallFrame>(
+                        row, i, l_idx, r_idx, frame.frame_num,
+                        hold_generation(frame.gen));
+                    stats.shared_rows.fetch_add(1, std::memory_order_relaxed);
+                }
+                stats.shared_sends.fetch_add(1, std::memory_order_relaxed);
+                job = [data, shared, timing] {
+                    const auto t0 = std::chrono::steady_clock::now();
+                    data->send_waterfall_shared(*shared);
+                    timing->add(t0, std::chrono::steady_clock::now());
+                };
+            } else {
+                job = [data, row, frame_num = frame.frame_num, timing,
+                       hold = hold_generation(frame.gen)] {
+                    const auto t0 = std::chrono::steady_clock::now();
+                    data->send_waterfall(row, frame_num);
+                    timing->add(t0, std::chrono::steady_clock::now());
+                };
+            }
+            if (!dispatch_frame(pool, data, frame.max_backlog, std::move(job),
+                                i)) {
+                skipped++;
+            }
+        }
+
+        // Prevent overwrite of previous level's quantized waterfall
+        fft_power_quantized += (frame.fft_result_size >> i);
+    }
+    return skipped;
+}
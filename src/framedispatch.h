@@ -0,0 +1,99 @@
+#ifndef FRAMEDISPATCH_H
+#define FRAMEDISPATCH_H
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+#include "client.h"
+#include "workerpool.h"
+
+// Hands every client its share of one FFT frame.  broadcast_server's
+// signal_loop and waterfall_loop call these for the live server, and
+// spectrumbench load calls them with its own PacketSender, so the bench
+// measures the grouping, the strands and the backlog drop the server runs.
+//
+// Both walk the PacketSender's slice maps under their locks, ask
+// PacketSender::frame_wanted() which connections take this frame, and queue
+// each job on a pool behind the client's earlier frames (FrameStrand).
+
+// One generation of FFT output.  fft_task cycles through a ring of these
+// ([input] fft_pipeline_depth) so the FFT can start on the next frame while
+// the audio and waterfall workers are still reading the previous ones.  refs
+// counts the queued or running client tasks that still point into the
+// generation; fft_task only overwrites a generation once it is back to zero.
+struct FFTGeneration {
+    std::complex<float> *spectrum = nullptr;  // fft_result_size + IQ wrap tail
+    int8_t *quantized = nullptr;              // waterfall pyramid, all levels
+    bool owned = false;                       // allocated by fft_task
+    std::atomic<int> refs{0};
+
+    void acquire() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            refs.notify_all();
+        }
+    }
+    void wait_idle() {
+        int r;
+        while ((r = refs.load(std::memory_order_acquire)) != 0) {
+            refs.wait(r, std::memory_order_acquire);
+        }
+    }
+};
+
+// Waterfall encode timing, published once per waterfall frame by the last
+// encode task to finish (see dispatch_waterfall_frame).  wall is from
+// dispatch to the last client's packet being handed to the I/O thread; cpu is
+// the sum of the individual encode times across workers.
+struct WaterfallEncodeStats {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> wall_us_total{0};
+    std::atomic<uint64_t> wall_us_max{0};
+    std::atomic<uint64_t> cpu_us_total{0};
+    std::atomic<uint64_t> last_wall_us{0};
+    // Rows compressed for sharing between clients, and the sends they served
+    std::atomic<uint64_t> shared_rows{0};
+    std::atomic<uint64_t> shared_sends{0};
+    // Level tile sets built for WIRE_PACKED_V2 clients, and their sends
+    std::atomic<uint64_t> tiled_levels{0};
+    std::atomic<uint64_t> tiled_sends{0};
+};
+
+// The frame being handed out
+struct FrameDispatch {
+    FFTGeneration &gen;
+    int frame_num;
+    int fft_result_size;
+    // Frames a client may have queued or running; past that its oldest
+    // queued frame is dropped ([input] fft_pipeline_depth - 1)
+    size_t max_backlog;
+};
+
+// What dispatch_audio_frame() did with one frame
+struct AudioFrameStats {
+    uint64_t skipped = 0;          // frames dropped from slow clients' backlogs
+    uint64_t channel_frames = 0;   // frames demodulated once for a channel
+    uint64_t channel_sends = 0;    // extra listeners those frames served
+};
+
+// Queues frame for every listener in sender's signal_slices on pool.
+// base_idx is the bin of the lowest frequency (fft_size / 2 + 1 for IQ
+// input, where the spectrum starts at -sps / 2).  With share_demod,
+// listeners on the same channel are demodulated and encoded once.
+AudioFrameStats dispatch_audio_frame(PacketSender &sender, WorkerPool &pool,
+                                     const FrameDispatch &frame, int base_idx,
+                                     bool share_demod);
+
+// Queues frame for every client in sender's waterfall_slices on pool,
+// sharded by downsample level.  With share_rows (zstd), packed-format
+// clients share compressed rows and tiles.  Returns the frames dropped from
+// slow clients' backlogs.
+uint64_t dispatch_waterfall_frame(PacketSender &sender, WorkerPool &pool,
+                                  const FrameDispatch &frame,
+                                  int downsample_levels, int tile_bins,
+                                  bool share_rows,
+                                  WaterfallEncodeStats &stats);
+
+#endif
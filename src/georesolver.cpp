@@ -0,0 +1,286 @@
+#include "georesolver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <optional>
+
+#include <arpa/inet.h>
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+
+// ============================================================================
+// Lookups go to ip-api.com (free, no key, 45 req/min) only for public
+// addresses the database does not know.  Private IPs are short-circuited
+// locally and never sent to any external service.
+// ============================================================================
+namespace {
+// ip-api.com's free tier
+constexpr int kRequestsPerMinute = 45;
+// Networks waiting for ip-api at once; a flood beyond this gets no location
+constexpr size_t kMaxPending = 256;
+
+size_t geo_write_cb(char *ptr, size_t size, size_t nmemb, void *ud) {
+    static_cast<std::string *>(ud)->append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+// Convert ISO 3166-1 alpha-2 code → flag emoji (UTF-8).
+// Each regional-indicator letter is U+1F1E6..U+1F1FF.
+std::string country_flag(std::string_view cc) {
+    if (cc.size() != 2) return "";
+    auto encode4 = [](uint32_t cp) -> std::string {
+        std::string s;
+        s += char(0xF0 | (cp >> 18));
+        s += char(0x80 | ((cp >> 12) & 0x3F));
+        s += char(0x80 | ((cp >> 6)  & 0x3F));
+        s += char(0x80 | ( cp        & 0x3F));
+        return s;
+    };
+    return encode4(0x1F1E6u + uint32_t(std::toupper((unsigned char)cc[0]) - 'A'))
+         + encode4(0x1F1E6u + uint32_t(std::toupper((unsigned char)cc[1]) - 'A'));
+}
+
+// "🇬🇷 Athens, GR", or "🇬🇷 Greece" without a city
+std::string format_location(std::string_view city, std::string_view cc,
+                            std::string_view country) {
+    if (cc.empty() && country.empty()) return "";
+    const std::string flag = country_flag(cc);
+    if (city.empty())
+        return flag + " " + std::string(country.empty() ? cc : country);
+    return flag + " " + std::string(city) + ", " + std::string(cc);
+}
+
+// Returns true if the IP is RFC-1918 / loopback / link-local — skip API call.
+bool is_private_ip(const std::string &ip) {
+    if (ip.empty() || ip == "127.0.0.1" || ip == "::1") return true;
+    // IPv4 private ranges: 10.x, 172.16-31.x, 192.168.x
+    if (ip.rfind("10.",      0) == 0) return true;
+    if (ip.rfind("127.",     0) == 0) return true;
+    if (ip.rfind("192.168.", 0) == 0) return true;
+    if (ip.rfind("169.254.", 0) == 0) return true;
+    if (ip.rfind("172.",     0) == 0) {
+        const auto dot2 = ip.find('.', 4);
+        if (dot2 != std::string::npos) {
+            try {
+                int second = std::stoi(ip.substr(4, dot2 - 4));
+                if (second >= 16 && second <= 31) return true;
+            } catch (...) {
+                // Malformed octet — not a valid private range, continue
+            }
+        }
+    }
+    return false;
+}
+
+// "::ffff:82.104.1.2" (dual-stack sockets) → "82.104.1.2"
+std::string unmap_ipv4(const std::string &ip) {
+    if (ip.size() > 7 && (ip.rfind("::ffff:", 0) == 0 ||
+                          ip.rfind("::FFFF:", 0) == 0) &&
+        ip.find('.') != std::string::npos) {
+        return ip.substr(7);
+    }
+    return ip;
+}
+
+// Cache key: the /24 of an IPv4 address, the /64 of an IPv6 one
+std::string network_key(const std::string &ip) {
+    uint8_t addr[16];
+    if (inet_pton(AF_INET, ip.c_str(), addr) == 1) {
+        return std::string("4") + std::string(reinterpret_cast<char *>(addr), 3);
+    }
+    if (inet_pton(AF_INET6, ip.c_str(), addr) == 1) {
+        return std::string("6") + std::string(reinterpret_cast<char *>(addr), 8);
+    }
+    return ip;
+}
+
+// Blocking ip-api.com lookup.  nullopt when the request failed (worth
+// retrying later), "" when ip-api has no location for the address.
+std::optional<std::string> query_ip_api(const std::string &ip) {
+    CURL *curl = curl_easy_init();
+    if (!curl) return std::nullopt;
+
+    std::string response;
+    const std::string url =
+        "http://ip-api.com/json/" + ip +
+        "?fields=status,city,country,countryCode";
+
+    curl_easy_setopt(curl, CURLOPT_URL,            url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,  geo_write_cb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA,      &response);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT,        5L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL,       1L);
+
+    const CURLcode rc = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(curl);
+
+    if (rc != CURLE_OK || status != 200 || response.empty()) {
+        return std::nullopt;
+    }
+
+    try {
+        auto j = nlohmann::json::parse(response);
+        if (j.value("status", "") != "success") return "";
+        return format_location(j.value("city", ""), j.value("countryCode", ""),
+                               j.value("country", ""));
+    } catch (...) {
+        return std::nullopt;
+    }
+}
+} // namespace
+
+GeoResolver &GeoResolver::instance() {
+    static GeoResolver resolver;
+    return resolver;
+}
+
+void GeoResolver::configure(const std::string &database_path,
+                            int online_threads, size_t cache_entries,
+                            std::chrono::seconds cache_ttl) {
+    std::unique_ptr<MaxMindDB> db;
+    if (!database_path.empty()) {
+        try {
+            db = std::make_unique<MaxMindDB>(database_path);
+            std::cout << "[geoip] " << database_path << ": "
+                      << db->database_type() << ", " << db->nodes()
+                      << " nodes" << std::endl;
+        } catch (const std::exception &e) {
+            std::cout << "[geoip] " << e.what() << ", not using it"
+                      << std::endl;
+        }
+    }
+    std::unique_ptr<WorkerPool> workers;
+    if (online_threads > 0) {
+        workers = std::make_unique<WorkerPool>("geoip", online_threads);
+    }
+
+    std::scoped_lock lk(mtx);
+    database = std::move(db);
+    pool = std::move(workers);
+    cache_size = std::max<size_t>(cache_entries, 1);
+    ttl = cache_ttl;
+}
+
+void GeoResolver::stop() {
+    stopping = true;
+    std::unique_ptr<WorkerPool> workers;
+    {
+        std::scoped_lock lk(mtx);
+        workers = std::move(pool);
+    }
+    // The lookups still queued answer "" without going online
+    if (workers) workers->stop();
+}
+
+bool GeoResolver::cache_get(const std::string &key, std::string &location) {
+    auto it = cache.find(key);
+    if (it == cache.end()) return false;
+    if (it->second->expires < std::chrono::steady_clock::now()) {
+        lru.erase(it->second);
+        cache.erase(it);
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    location = it->second->location;
+    return true;
+}
+
+void GeoResolver::cache_put(const std::string &key,
+                            const std::string &location) {
+    const auto expires = std::chrono::steady_clock::now() + ttl;
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        it->second->location = location;
+        it->second->expires = expires;
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    lru.push_front({key, location, expires});
+    cache.emplace(key, lru.begin());
+    while (cache.size() > cache_size) {
+        cache.erase(lru.back().key);
+        lru.pop_back();
+    }
+}
+
+void GeoResolver::resolve(const std::string &raw_ip, Callback done) {
+    const std::string ip = unmap_ipv4(raw_ip);
+    if (is_private_ip(ip)) {
+        done("Local");
+        return;
+    }
+    const std::string key = network_key(ip);
+
+    std::string location;
+    {
+        std::scoped_lock lk(mtx);
+        bool answered = false;
+        if (cache_get(key, location)) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            answered = true;
+        } else if (database) {
+            const int64_t record = database->find(ip);
+            auto cc = database->get_string(record, {"country", "iso_code"});
+            if (cc.empty()) {
+                cc = database->get_string(record, {"registered_country", "iso_code"});
+            }
+            location = format_location(
+                database->get_string(record, {"city", "names", "en"}), cc,
+                database->get_string(record, {"country", "names", "en"}));
+            // A miss is only final if there is nobody to ask
+            if (!location.empty() || !pool) {
+                cache_put(key, location);
+                answered = true;
+            }
+        }
+
+        if (!answered && pool && !stopping) {
+            // Off to ip-api, unless someone is already asking for this network
+            if (auto it = pending.find(key); it != pending.end()) {
+                it->second.push_back(std::move(done));
+                return;
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (now - window_start >= std::chrono::minutes(1)) {
+                window_start = now;
+                window_count = 0;
+            }
+            if (pending.size() < kMaxPending &&
+                window_count < kRequestsPerMinute) {
+                window_count++;
+                pending[key].push_back(std::move(done));
+                pool->submit([this, key, ip] { lookup_online(key, ip); });
+                return;
+            }
+            refusals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    done(location);
+}
+
+void GeoResolver::lookup_online(const std::string &key, const std::string &ip) {
+    std::optional<std::string> location;
+    if (!stopping) {
+        lookups.fetch_add(1, std::memory_order_relaxed);
+        location = query_ip_api(ip);
+    }
+
+    std::vector<Callback> waiting;
+    {
+        std::scoped_lock lk(mtx);
+        // A failed request is not cached, so the next visitor tries again
+        if (location) cache_put(key, *location);
+        auto it = pending.find(key);
+        if (it != pending.end()) {
+            waiting = std::move(it->second);
+            pending.erase(it);
+        }
+    }
+    for (auto &done : waiting) {
+        done(location.value_or(""));
+    }
+}
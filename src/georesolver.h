@@ -0,0 +1,91 @@
+#ifndef GEORESOLVER_H
+#define GEORESOLVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mmdb.h"
+#include "workerpool.h"
+
+// Listener locations for users.json and the statistics log, as
+// "🇬🇷 Athens, GR", "Local" for private addresses, or "" when unknown.
+//
+// A local MaxMind DB ([server] geoip_database) answers in microseconds on
+// the caller's thread.  Addresses it does not know go to ip-api.com on a
+// small fixed pool ([server] geoip_online threads), with requests for the
+// same network coalesced and ip-api's free limit of 45 a minute respected.
+// Answers are kept in an LRU cache for [server] geoip_cache_hours, keyed by
+// network (/24 for IPv4, /64 for IPv6): a reconnecting listener, or a
+// flood from one network, costs one lookup.
+class GeoResolver {
+  public:
+    static GeoResolver &instance();
+
+    // online_threads 0 never goes online.  A database that fails to open
+    // is logged and left out.
+    void configure(const std::string &database, int online_threads,
+                   size_t cache_size, std::chrono::seconds ttl);
+
+    // Drops queued lookups and joins the pool.  Later lookups that would
+    // go online answer "".
+    void stop();
+
+    // Calls done with the location: inline for private addresses, cache
+    // and database hits, otherwise later from a resolver thread
+    void resolve(const std::string &ip,
+                 std::function<void(const std::string &)> done);
+
+    uint64_t cache_hits() const {
+        return hits.load(std::memory_order_relaxed);
+    }
+    uint64_t online_lookups() const {
+        return lookups.load(std::memory_order_relaxed);
+    }
+    // Lookups given up on: over the rate limit or the queue bound
+    uint64_t refused() const {
+        return refusals.load(std::memory_order_relaxed);
+    }
+
+  private:
+    using Callback = std::function<void(const std::string &)>;
+
+    struct CacheEntry {
+        std::string key;
+        std::string location;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    bool cache_get(const std::string &key, std::string &location);
+    void cache_put(const std::string &key, const std::string &location);
+    void lookup_online(const std::string &key, const std::string &ip);
+
+    std::mutex mtx;
+    std::unique_ptr<MaxMindDB> database;
+    std::unique_ptr<WorkerPool> pool;
+
+    // Most recently used first
+    size_t cache_size = 4096;
+    std::chrono::seconds ttl{24 * 3600};
+    std::list<CacheEntry> lru;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache;
+
+    // Networks being looked up, and who is waiting for each
+    std::unordered_map<std::string, std::vector<Callback>> pending;
+
+    // ip-api.com rate limit, per minute from window_start
+    std::chrono::steady_clock::time_point window_start{};
+    int window_count = 0;
+
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> hits{0}, lookups{0}, refusals{0};
+};
+
+#endif
@@ -581,6 +581,17 @@ void broadcast_server::on_http(connection_hdl hdl) {
         return;
     }
 
+    // ── /metrics ────────────────────────────────────────────────────────────
+    // Pipeline latency histograms, queue depths and drop counters in the
+    // Prometheus text exposition format (see metrics.h).
+    if (resource == "/metrics" && metrics_enabled) {
+        con->append_header("Content-Type", "text/plain; version=0.0.4");
+        con->append_header("Cache-Control", "no-store");
+        con->set_body(get_metrics());
+        con->set_status(websocketpp::http::status_code::ok);
+        return;
+    }
+
     if (resource == "/users" || resource == "/users.json") {
         // Live user list — always fresh from in-memory state, never from disk.
         const std::string body = get_users_json();
@@ -715,6 +726,36 @@ void broadcast_server::on_http(connection_hdl hdl) {
         return;
     }
 
+    // Static files are served from memory (see StaticAssetCache): no disk
+    // reads and no compression on the io_service thread.  The disk path
+    // below is only for files the cache left out or has not picked up yet.
+    if (static_cache) {
+        const std::string path = resource.substr(0, resource.find('?'));
+        if (auto asset = static_cache->find(path)) {
+            const auto encoding = StaticAssetCache::negotiate(
+                *asset, con->get_request_header("accept-encoding"));
+            con->append_header("Connection", "close");
+            con->append_header("Cache-Control", "max-age=30");
+            con->append_header("Vary", "Accept-Encoding");
+            con->append_header("ETag", StaticAssetCache::etag(*asset, encoding));
+            con->append_header("Last-Modified", asset->last_modified);
+            if (StaticAssetCache::not_modified(
+                    *asset, con->get_request_header("if-none-match"),
+                    con->get_request_header("if-modified-since"))) {
+                con->set_status(websocketpp::http::status_code::not_modified);
+                return;
+            }
+            con->append_header("content-type", asset->mime_type);
+            if (encoding != StaticAssetCache::IDENTITY) {
+                con->append_header("Content-Encoding",
+                                   StaticAssetCache::encoding_name(encoding));
+            }
+            con->set_body(asset->body[encoding]);
+            con->set_status(websocketpp::http::status_code::ok);
+            return;
+        }
+    }
+
     std::ifstream file;
     std::string filename;
     try {
@@ -0,0 +1,60 @@
+#include "listenerstore.h"
+
+ListenerStore::ListenerStore()
+    : current(std::make_shared<const Snapshot>()) {}
+
+void ListenerStore::update(const std::string &id, int l, double m, int r) {
+    std::scoped_lock lk(pending_mtx);
+    pending.push_back({id, l, m, r});
+}
+
+ListenerStore::Batch ListenerStore::publish() {
+    std::vector<Update> updates;
+    {
+        std::scoped_lock lk(pending_mtx);
+        updates.swap(pending);
+    }
+
+    const std::shared_ptr<const Snapshot> old = snapshot();
+    Batch batch;
+    batch.from_seq = batch.to_seq = old->seq;
+    if (updates.empty()) return batch;
+
+    // The last update of each listener, in the order they first appear
+    std::unordered_map<std::string, size_t> last;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < updates.size(); i++) {
+        auto [it, inserted] = last.try_emplace(updates[i].id, i);
+        if (inserted) order.push_back(i);
+        else it->second = i;
+    }
+
+    std::shared_ptr<Snapshot> next;
+    for (size_t first : order) {
+        const Update &u = updates[last[updates[first].id]];
+        auto prev = old->listeners.find(u.id);
+        const bool was_listening = prev != old->listeners.end();
+        if (u.l == -1) {
+            // Joined and left within the tick: nobody needs to hear of it
+            if (!was_listening) continue;
+            batch.changes.push_back({LEFT, u.id, {prev->second.handle, -1, -1, -1}});
+        } else if (!was_listening) {
+            batch.changes.push_back({JOINED, u.id, {next_handle++, u.l, u.m, u.r}});
+        } else {
+            const Listener &p = prev->second;
+            if (p.l == u.l && p.m == u.m && p.r == u.r) continue;
+            batch.changes.push_back({MOVED, u.id, {p.handle, u.l, u.m, u.r}});
+        }
+
+        if (!next) next = std::make_shared<Snapshot>(*old);
+        const Change &c = batch.changes.back();
+        if (c.kind == LEFT) next->listeners.erase(c.id);
+        else next->listeners.insert_or_assign(c.id, c.listener);
+    }
+    if (!next) return batch;
+
+    batch.to_seq = old->seq + batch.changes.size();
+    next->seq = batch.to_seq;
+    current.store(std::move(next), std::memory_order_release);
+    return batch;
+}
@@ -0,0 +1,79 @@
+#ifndef LISTENERSTORE_H
+#define LISTENERSTORE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Who is listening where, for the events socket.
+//
+// broadcast_signal_changes() records joins, retunes and leaves as they come
+// in.  Once a tick, publish() folds them into at most one change per
+// listener, applies that batch to a copy of the current snapshot and swaps
+// the copy in.  Each published change takes the next sequence number, so the
+// snapshot at seq S plus the batches after S is the current state.
+//
+// snapshot() is an atomic shared_ptr load: a new events connection builds
+// its initial state without taking signal_slice_mtx or any lock of the
+// store's, and keeps a consistent view for as long as it holds it.
+class ListenerStore {
+  public:
+    struct Listener {
+        uint32_t handle;   // short name for the id in binary deltas
+        int l;
+        double m;
+        int r;
+    };
+
+    struct Snapshot {
+        uint64_t seq = 0;
+        std::unordered_map<std::string, Listener> listeners;
+    };
+
+    enum ChangeKind : uint8_t { JOINED, MOVED, LEFT };
+
+    struct Change {
+        ChangeKind kind;
+        std::string id;
+        Listener listener;   // the handle only for LEFT
+    };
+
+    // Changes (from_seq, to_seq], in the order the listeners first changed
+    struct Batch {
+        uint64_t from_seq = 0;
+        uint64_t to_seq = 0;
+        std::vector<Change> changes;
+    };
+
+    ListenerStore();
+
+    // l == -1 is a listener leaving, as in broadcast_signal_changes()
+    void update(const std::string &id, int l, double m, int r);
+
+    // From one thread at a time (the events timer)
+    Batch publish();
+
+    std::shared_ptr<const Snapshot> snapshot() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+  private:
+    struct Update {
+        std::string id;
+        int l;
+        double m;
+        int r;
+    };
+
+    std::mutex pending_mtx;
+    std::vector<Update> pending;
+
+    uint32_t next_handle = 0;   // publish() only
+    std::atomic<std::shared_ptr<const Snapshot>> current;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace {
+std::atomic<unsigned> next_shard{0};
+
+unsigned thread_shard(unsigned shards) {
+    thread_local const unsigned shard =
+        next_shard.fetch_add(1, std::memory_order_relaxed);
+    return shard % shards;
+}
+
+void append_number(std::string &out, double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    out += buf;
+}
+
+// One histogram series in Prometheus text format; scale converts the base
+// unit to the exported one (microseconds to seconds)
+void render_histogram(std::string &out, const char *name, const char *label,
+                      const char *value, const Histogram::Snapshot &s,
+                      double scale) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i < Histogram::kBuckets; i++) {
+        cumulative += s.buckets[i];
+        out += name;
+        out += "_bucket{";
+        out += label;
+        out += "=\"";
+        out += value;
+        out += "\",le=\"";
+        append_number(out, static_cast<double>(uint64_t{1} << i) * scale);
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    cumulative += s.overflow;
+    out += name;
+    out += "_bucket{";
+    out += label;
+    out += "=\"";
+    out += value;
+    out += "\",le=\"+Inf\"} ";
+    out += std::to_string(cumulative);
+    out += '\n';
+    out += name;
+    out += "_sum{";
+    out += label;
+    out += "=\"";
+    out += value;
+    out += "\"} ";
+    append_number(out, static_cast<double>(s.sum) * scale);
+    out += '\n';
+    out += name;
+    out += "_count{";
+    out += label;
+    out += "=\"";
+    out += value;
+    out += "\"} ";
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+} // namespace
+
+void Histogram::observe(uint64_t v) {
+    // Bucket i holds values up to 2^i
+    const int bucket = v <= 1 ? 0 : std::bit_width(v - 1);
+    Shard &s = shards[thread_shard(kShards)];
+    s.buckets[std::min(bucket, kBuckets)].fetch_add(1,
+                                                   std::memory_order_relaxed);
+    s.sum.fetch_add(v, std::memory_order_relaxed);
+    s.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    for (const Shard &s : shards) {
+        for (int i = 0; i < kBuckets; i++) {
+            snap.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+        }
+        snap.overflow += s.buckets[kBuckets].load(std::memory_order_relaxed);
+        snap.sum += s.sum.load(std::memory_order_relaxed);
+        snap.count += s.count.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+Metrics &metrics() {
+    static Metrics m;
+    return m;
+}
+
+const char *stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::READ: return "read";
+    case Stage::WINDOW: return "window";
+    case Stage::FFT: return "fft";
+    case Stage::QUANTIZE: return "quantize";
+    case Stage::SIGNAL_DISPATCH: return "signal_dispatch";
+    case Stage::WATERFALL_DISPATCH: return "waterfall_dispatch";
+    case Stage::DEMOD: return "demod";
+    case Stage::NOISE_REDUCTION: return "noise_reduction";
+    case Stage::AUDIO_ENCODE: return "audio_encode";
+    case Stage::WATERFALL_ENCODE: return "waterfall_encode";
+    case Stage::SOCKET_WRITE: return "socket_write";
+    default: return "unknown";
+    }
+}
+
+const char *conn_kind_name(ConnKind kind) {
+    switch (kind) {
+    case ConnKind::AUDIO: return "audio";
+    case ConnKind::SIGNAL: return "signal";
+    case ConnKind::WATERFALL: return "waterfall";
+    case ConnKind::EVENTS: return "events";
+    default: return "unknown";
+    }
+}
+
+void metrics_header(std::string &out, const char *name, const char *help,
+                    const char *type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void metrics_labelled(std::string &out, const char *name, const char *label,
+                      const char *value, uint64_t v) {
+    out += name;
+    out += '{';
+    out += label;
+    out += "=\"";
+    out += value;
+    out += "\"} ";
+    out += std::to_string(v);
+    out += '\n';
+}
+
+void metrics_counter(std::string &out, const char *name, const char *help,
+                     uint64_t value) {
+    metrics_header(out, name, help, "counter");
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+void metrics_gauge(std::string &out, const char *name, const char *help,
+                   double value) {
+    metrics_header(out, name, help, "gauge");
+    out += name;
+    out += ' ';
+    append_number(out, value);
+    out += '\n';
+}
+
+void Metrics::render(std::string &out) const {
+    metrics_header(out, "phantomsdr_stage_seconds",
+                   "Time spent in each pipeline stage", "histogram");
+    for (int i = 0; i < static_cast<int>(Stage::COUNT); i++) {
+        render_histogram(out, "phantomsdr_stage_seconds", "stage",
+                         stage_name(static_cast<Stage>(i)),
+                         stages[i].snapshot(), 1e-6);
+    }
+
+    metrics_header(out, "phantomsdr_buffered_bytes",
+                   "Socket send buffer backlog seen when queueing a frame",
+                   "histogram");
+    for (int i = 0; i < static_cast<int>(ConnKind::COUNT); i++) {
+        const Histogram::Snapshot s = buffered[i].snapshot();
+        if (s.count == 0) continue;
+        render_histogram(out, "phantomsdr_buffered_bytes", "type",
+                         conn_kind_name(static_cast<ConnKind>(i)), s, 1.0);
+    }
+
+    metrics_header(out, "phantomsdr_payload_bytes_total",
+                   "Uncompressed payload sent to clients", "counter");
+    for (int i = 0; i < static_cast<int>(ConnKind::COUNT); i++) {
+        metrics_labelled(out, "phantomsdr_payload_bytes_total", "type",
+                         conn_kind_name(static_cast<ConnKind>(i)),
+                         payload_bytes[i].load(std::memory_order_relaxed));
+    }
+    metrics_header(out, "phantomsdr_frames_sent_total",
+                   "Frames sent to clients", "counter");
+    for (int i = 0; i < static_cast<int>(ConnKind::COUNT); i++) {
+        metrics_labelled(out, "phantomsdr_frames_sent_total", "type",
+                         conn_kind_name(static_cast<ConnKind>(i)),
+                         frames_sent[i].load(std::memory_order_relaxed));
+    }
+
+    metrics_counter(out, "phantomsdr_socket_messages_total",
+                    "WebSocket messages queued for writing",
+                    socket_messages.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_socket_bytes_total",
+                    "WebSocket payload bytes queued for writing",
+                    socket_bytes.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_input_samples_total",
+                    "Input samples taken by the FFT loop",
+                    input_samples.load(std::memory_order_relaxed));
+    metrics_counter(out, "phantomsdr_input_overruns_total",
+                    "Input hops lost because the FFT fell behind",
+                    input_overruns.load(std::memory_order_relaxed));
+    metrics_gauge(out, "phantomsdr_input_ring_depth",
+                  "Input hops waiting for the FFT",
+                  input_ring_depth.load(std::memory_order_relaxed));
+    metrics_gauge(out, "phantomsdr_input_ring_capacity",
+                  "Input ring size in hops",
+                  input_ring_capacity.load(std::memory_order_relaxed));
+    metrics_gauge(out, "phantomsdr_fft_generations_busy",
+                  "FFT output generations still read by client tasks",
+                  fft_generations_busy.load(std::memory_order_relaxed));
+}
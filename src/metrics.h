@@ -0,0 +1,128 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Process-wide performance telemetry, served in Prometheus text format on
+// /metrics (see broadcast_server::get_metrics()).
+//
+// Histograms are sharded per thread: every thread that records picks a shard
+// once (thread_local) and only does relaxed fetch_adds on that shard's cache
+// lines, so the hot paths — one observation per stage per frame, or per
+// client per frame — never contend.  A scrape sums the shards.  Buckets are
+// powers of two of the histogram's base unit.
+class Histogram {
+  public:
+    static constexpr int kBuckets = 24;
+
+    // Records v in base units (microseconds for stage latencies, bytes for
+    // buffered amounts)
+    void observe(uint64_t v);
+
+    struct Snapshot {
+        std::array<uint64_t, kBuckets> buckets{};   // not cumulative
+        uint64_t overflow = 0;                      // above the last bucket
+        uint64_t sum = 0;
+        uint64_t count = 0;
+    };
+    Snapshot snapshot() const;
+
+  private:
+    static constexpr int kShards = 16;
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[kBuckets + 1] = {};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> count{0};
+    };
+    Shard shards[kShards];
+};
+
+// Stages of the input → FFT → client pipeline that get a latency histogram
+enum class Stage {
+    READ,            // one input hop from the SDR driver (reader thread)
+    WINDOW,          // convert + window a frame into the FFT input
+    FFT,             // the wideband FFT itself
+    QUANTIZE,        // power, quantize and waterfall pyramid
+    SIGNAL_DISPATCH, // signal_loop: channels, queueing
+    WATERFALL_DISPATCH,
+    DEMOD,           // one audio frame for one channel, without encoding
+    NOISE_REDUCTION, // server-side noise reduction, part of DEMOD
+    AUDIO_ENCODE,    // FLAC / Opus encode and packetise
+    WATERFALL_ENCODE,
+    SOCKET_WRITE,    // queue_send() until con->send() has returned
+    COUNT
+};
+
+// Connection types with their own counters, see Client / conn_type
+enum class ConnKind { AUDIO, SIGNAL, WATERFALL, EVENTS, COUNT };
+
+struct Metrics {
+    Histogram stages[static_cast<int>(Stage::COUNT)];
+    // get_buffered_amount() seen by the adaptive throttles, in bytes
+    Histogram buffered[static_cast<int>(ConnKind::COUNT)];
+    // Payload handed to the encoders for sending, and frames sent
+    std::atomic<uint64_t> payload_bytes[static_cast<int>(ConnKind::COUNT)] = {};
+    std::atomic<uint64_t> frames_sent[static_cast<int>(ConnKind::COUNT)] = {};
+    // Messages and bytes written to sockets by queue_send()
+    std::atomic<uint64_t> socket_messages{0};
+    std::atomic<uint64_t> socket_bytes{0};
+    // Published by fft_task every frame, so a scrape never touches the
+    // input ring or the FFT generations themselves
+    std::atomic<uint64_t> input_samples{0};
+    std::atomic<uint64_t> input_overruns{0};
+    std::atomic<uint64_t> input_ring_depth{0};
+    std::atomic<uint64_t> input_ring_capacity{0};
+    std::atomic<uint64_t> fft_generations_busy{0};
+
+    // Appends the histograms and counters above
+    void render(std::string &out) const;
+};
+
+Metrics &metrics();
+
+const char *stage_name(Stage stage);
+const char *conn_kind_name(ConnKind kind);
+
+// Times a scope into a stage histogram.  stop() records early; the
+// destructor records if stop() was not called.
+class StageTimer {
+  public:
+    explicit StageTimer(Stage stage)
+        : stage{stage}, start{std::chrono::steady_clock::now()} {}
+    ~StageTimer() { stop(); }
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    void stop() {
+        if (stopped) return;
+        stopped = true;
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+        metrics().stages[static_cast<int>(stage)].observe(
+            static_cast<uint64_t>(us));
+    }
+
+  private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+    bool stopped = false;
+};
+
+// Prometheus text format helpers for the series broadcast_server adds
+void metrics_header(std::string &out, const char *name, const char *help,
+                    const char *type);
+// One sample of a labelled series; the header is written separately
+void metrics_labelled(std::string &out, const char *name, const char *label,
+                      const char *value, uint64_t v);
+void metrics_counter(std::string &out, const char *name, const char *help,
+                     uint64_t value);
+void metrics_gauge(std::string &out, const char *name, const char *help,
+                   double value);
+
+#endif
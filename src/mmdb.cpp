@@ -0,0 +1,289 @@
+#include "mmdb.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint8_t kMetadataMarker[] = {0xAB, 0xCD, 0xEF, 'M', 'a', 'x', 'M',
+                                       'i',  'n',  'd',  '.', 'c', 'o', 'm'};
+// The metadata is within the last 128 KiB of the file
+constexpr size_t kMetadataWindow = 128 * 1024;
+// Maps and arrays nest no deeper than this in any real database
+constexpr int kMaxDepth = 32;
+} // namespace
+
+MaxMindDB::MaxMindDB(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("mmdb: cannot open " + path + ": " +
+                                 strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("mmdb: " + path + " is empty");
+    }
+    length = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("mmdb: cannot map " + path + ": " +
+                                 strerror(errno));
+    }
+    // Lookups touch a few scattered pages each
+    madvise(map, length, MADV_RANDOM);
+    data = static_cast<const uint8_t *>(map);
+
+    // The last marker in the file starts the metadata map
+    const size_t window = std::min(length, kMetadataWindow);
+    const uint8_t *begin = data + length - window;
+    const uint8_t *marker = std::find_end(begin, data + length,
+                                          std::begin(kMetadataMarker),
+                                          std::end(kMetadataMarker));
+    if (marker == data + length) {
+        munmap(map, length);
+        throw std::runtime_error("mmdb: " + path + " is not a MaxMind DB");
+    }
+    data_end = static_cast<size_t>(marker - data);
+    const size_t meta = data_end + sizeof(kMetadataMarker);
+
+    auto meta_uint = [&](std::string_view key, uint64_t &value) {
+        size_t offset = meta;
+        return find_key(meta, offset, key) && read_uint(meta, offset, value);
+    };
+    uint64_t nodes = 0, bits = 0, version = 0;
+    if (!meta_uint("node_count", nodes) || !meta_uint("record_size", bits) ||
+        !meta_uint("ip_version", version) ||
+        (bits != 24 && bits != 28 && bits != 32) ||
+        (version != 4 && version != 6)) {
+        munmap(map, length);
+        throw std::runtime_error("mmdb: " + path + " has bad metadata");
+    }
+    node_count = static_cast<uint32_t>(nodes);
+    record_size = static_cast<uint32_t>(bits);
+    ip_version = static_cast<uint32_t>(version);
+    tree_size = static_cast<size_t>(node_count) * record_size / 4;
+    data_start = tree_size + 16;
+    if (data_start > data_end) {
+        munmap(map, length);
+        throw std::runtime_error("mmdb: " + path + " is truncated");
+    }
+    {
+        size_t offset = meta;
+        Field f;
+        if (find_key(meta, offset, "database_type") &&
+            decode(offset, f) && resolve(meta, f) && f.type == STRING) {
+            type.assign(reinterpret_cast<const char *>(data + f.payload),
+                        f.size);
+        }
+    }
+
+    // IPv4 addresses live under ::/96 of an IPv6 tree
+    ipv4_start = 0;
+    if (ip_version == 6) {
+        for (int i = 0; i < 96 && ipv4_start < node_count; i++) {
+            ipv4_start = record(ipv4_start, 0);
+        }
+    }
+}
+
+MaxMindDB::~MaxMindDB() {
+    munmap(const_cast<uint8_t *>(data), length);
+}
+
+uint32_t MaxMindDB::record(uint32_t node, int bit) const {
+    const uint8_t *p = data + static_cast<size_t>(node) * record_size / 4;
+    switch (record_size) {
+    case 24:
+        p += bit * 3;
+        return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+    case 28:
+        // The middle byte holds the top nibble of each record
+        if (bit == 0) {
+            return (uint32_t(p[3] & 0xF0) << 20) | (uint32_t(p[0]) << 16) |
+                   (uint32_t(p[1]) << 8) | p[2];
+        }
+        return (uint32_t(p[3] & 0x0F) << 24) | (uint32_t(p[4]) << 16) |
+               (uint32_t(p[5]) << 8) | p[6];
+    default:
+        p += bit * 4;
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+               (uint32_t(p[2]) << 8) | p[3];
+    }
+}
+
+int64_t MaxMindDB::find(const std::string &ip) const {
+    uint8_t addr[16];
+    int bits;
+    uint32_t node;
+    if (inet_pton(AF_INET, ip.c_str(), addr) == 1) {
+        bits = 32;
+        node = ip_version == 6 ? ipv4_start : 0;
+    } else if (inet_pton(AF_INET6, ip.c_str(), addr) == 1) {
+        static constexpr uint8_t mapped[12] = {0, 0, 0, 0, 0, 0,
+                                               0, 0, 0, 0, 0xFF, 0xFF};
+        if (std::equal(mapped, mapped + 12, addr)) {
+            // ::ffff:a.b.c.d, from a dual-stack socket
+            std::copy(addr + 12, addr + 16, addr);
+            bits = 32;
+            node = ip_version == 6 ? ipv4_start : 0;
+        } else if (ip_version == 4) {
+            return -1;
+        } else {
+            bits = 128;
+            node = 0;
+        }
+    } else {
+        return -1;
+    }
+
+    for (int i = 0; i < bits && node < node_count; i++) {
+        node = record(node, (addr[i >> 3] >> (7 - (i & 7))) & 1);
+    }
+    if (node <= node_count) return -1;   // == node_count: no data
+
+    const size_t offset = data_start + (node - node_count) - 16;
+    if (offset >= data_end) return -1;
+    return static_cast<int64_t>(offset);
+}
+
+bool MaxMindDB::decode(size_t offset, Field &f) const {
+    if (offset >= length) return false;
+    const uint8_t ctrl = data[offset++];
+    unsigned type = ctrl >> 5;
+
+    if (type == POINTER) {
+        // 001SSVVV: SS + 1 more bytes, with VVV on top for SS < 3
+        const unsigned ss = (ctrl >> 3) & 3;
+        if (offset + ss + 1 > length) return false;
+        const uint8_t *p = data + offset;
+        uint32_t target;
+        switch (ss) {
+        case 0:
+            target = ((ctrl & 7u) << 8) | p[0];
+            break;
+        case 1:
+            target = (((ctrl & 7u) << 16) | (p[0] << 8) | p[1]) + 2048;
+            break;
+        case 2:
+            target = (((ctrl & 7u) << 24) | (p[0] << 16) | (p[1] << 8) | p[2]) +
+                     526336;
+            break;
+        default:
+            target = (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            break;
+        }
+        f = {POINTER, target, offset + ss + 1};
+        return true;
+    }
+
+    if (type == 0) {
+        // Extended type in the next byte
+        if (offset >= length) return false;
+        type = 7u + data[offset++];
+        if (type <= MAP || type > FLOAT) return false;
+    }
+
+    uint32_t size = ctrl & 0x1F;
+    if (size >= 29) {
+        const unsigned extra = size - 28;
+        if (offset + extra > length) return false;
+        const uint8_t *p = data + offset;
+        if (size == 29) size = 29 + p[0];
+        else if (size == 30) size = 285 + ((p[0] << 8) | p[1]);
+        else size = 65821 + ((p[0] << 16) | (p[1] << 8) | p[2]);
+        offset += extra;
+    }
+    f = {static_cast<Type>(type), size, offset};
+    return true;
+}
+
+bool MaxMindDB::resolve(size_t base, Field &f) const {
+    if (f.type != POINTER) return true;
+    // A pointer never points at another pointer
+    return decode(base + f.size, f) && f.type != POINTER;
+}
+
+bool MaxMindDB::skip(size_t offset, size_t &next, int depth) const {
+    Field f;
+    if (depth > kMaxDepth || !decode(offset, f)) return false;
+    switch (f.type) {
+    case POINTER:
+    case BOOLEAN:
+        next = f.payload;   // no payload of its own
+        return true;
+    case MAP:
+    case ARRAY: {
+        const uint32_t items = f.type == MAP ? 2 * f.size : f.size;
+        next = f.payload;
+        for (uint32_t i = 0; i < items; i++) {
+            if (!skip(next, next, depth + 1)) return false;
+        }
+        return true;
+    }
+    default:
+        next = f.payload + f.size;
+        return next <= length;
+    }
+}
+
+bool MaxMindDB::read_uint(size_t base, size_t offset, uint64_t &value) const {
+    Field f;
+    if (!decode(offset, f) || !resolve(base, f)) return false;
+    if (f.type != UINT16 && f.type != UINT32 && f.type != UINT64) return false;
+    if (f.size > 8 || f.payload + f.size > length) return false;
+    value = 0;
+    for (uint32_t i = 0; i < f.size; i++) {
+        value = (value << 8) | data[f.payload + i];
+    }
+    return true;
+}
+
+bool MaxMindDB::find_key(size_t base, size_t &offset,
+                         std::string_view key) const {
+    Field map;
+    if (!decode(offset, map) || !resolve(base, map) || map.type != MAP) {
+        return false;
+    }
+    size_t at = map.payload;
+    for (uint32_t i = 0; i < map.size; i++) {
+        Field k;
+        if (!decode(at, k)) return false;
+        const size_t value = k.type == POINTER ? k.payload : k.payload + k.size;
+        if (!resolve(base, k) || k.type != STRING ||
+            k.payload + k.size > length) {
+            return false;
+        }
+        if (std::string_view(reinterpret_cast<const char *>(data + k.payload),
+                             k.size) == key) {
+            offset = value;
+            return true;
+        }
+        if (!skip(value, at)) return false;
+    }
+    return false;
+}
+
+std::string_view
+MaxMindDB::get_string(int64_t record,
+                      std::initializer_list<std::string_view> path) const {
+    if (record < 0) return {};
+    size_t offset = static_cast<size_t>(record);
+    for (std::string_view key : path) {
+        if (!find_key(data_start, offset, key)) return {};
+    }
+    Field f;
+    if (!decode(offset, f) || !resolve(data_start, f) ||
+        f.type != STRING || f.payload + f.size > length) {
+        return {};
+    }
+    return {reinterpret_cast<const char *>(data + f.payload), f.size};
+}
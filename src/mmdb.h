@@ -0,0 +1,82 @@
+#ifndef MMDB_H
+#define MMDB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Read-only MaxMind DB (.mmdb, e.g. GeoLite2-City or DB-IP Lite) mapped
+// into memory.  A lookup walks the binary search tree one bit of the
+// address at a time and decodes only the fields asked for, so it takes
+// microseconds and needs no network.  Every offset read from the file is
+// bounds checked; a damaged file gives misses, not crashes.
+//
+// Format: https://maxmind.github.io/MaxMind-DB/
+class MaxMindDB {
+  public:
+    // Throws std::runtime_error if the file cannot be mapped or is not a
+    // MaxMind DB
+    explicit MaxMindDB(const std::string &path);
+    ~MaxMindDB();
+
+    MaxMindDB(const MaxMindDB &) = delete;
+    MaxMindDB &operator=(const MaxMindDB &) = delete;
+
+    // Data section offset of the record for a textual IPv4 / IPv6 address,
+    // or -1 if the address is malformed or not in the database
+    int64_t find(const std::string &ip) const;
+
+    // The string at path in the record at offset, e.g. {"country",
+    // "iso_code"}.  Empty if a key is missing or is not a string.
+    std::string_view get_string(int64_t record,
+                                std::initializer_list<std::string_view> path) const;
+
+    const std::string &database_type() const { return type; }
+    uint32_t nodes() const { return node_count; }
+
+  private:
+    enum Type : uint8_t {
+        POINTER = 1, STRING = 2, DOUBLE = 3, BYTES = 4, UINT16 = 5,
+        UINT32 = 6, MAP = 7, INT32 = 8, UINT64 = 9, UINT128 = 10,
+        ARRAY = 11, CONTAINER = 12, END_MARKER = 13, BOOLEAN = 14,
+        FLOAT = 15
+    };
+
+    // A decoded control byte: the type, the payload size (the entry count
+    // for a map or array, the value for a boolean, the target for a
+    // pointer) and where the payload starts
+    struct Field {
+        Type type;
+        uint32_t size;
+        size_t payload;
+    };
+
+    // False past the end of the file
+    bool decode(size_t offset, Field &f) const;
+    // Follows a pointer field to what it points at.  base is where the
+    // offsets in pointers count from: the data section or the metadata.
+    bool resolve(size_t base, Field &f) const;
+    // Offset just past the field at offset (a pointer, not its target)
+    bool skip(size_t offset, size_t &next, int depth = 0) const;
+    bool read_uint(size_t base, size_t offset, uint64_t &value) const;
+    // Finds key in the map at offset; on success offset is its value
+    bool find_key(size_t base, size_t &offset, std::string_view key) const;
+
+    uint32_t record(uint32_t node, int bit) const;
+
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+
+    uint32_t node_count = 0;
+    uint32_t record_size = 0;   // bits: 24, 28 or 32
+    uint32_t ip_version = 0;
+    size_t tree_size = 0;
+    size_t data_start = 0;      // the data section, after the tree and 16 zeros
+    size_t data_end = 0;        // the metadata marker
+    uint32_t ipv4_start = 0;    // node of ::/96 in an IPv6 tree
+    std::string type;
+};
+
+#endif
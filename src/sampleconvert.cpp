@@ -0,0 +1,209 @@
+#include "sampleconvert.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAMPLECONVERT_X86 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace {
+
+template <typename T> inline float scalar_sample(T v) {
+    if constexpr (std::is_unsigned_v<T>) {
+        using S = std::make_signed_t<T>;
+        return (float)(S)(T)(v ^ ((T)1 << (sizeof(T) * 8 - 1)));
+    } else {
+        return (float)v;
+    }
+}
+
+template <typename T, bool Windowed>
+void convert_scalar(float *out, const T *in, const float *window, float gain,
+                    size_t i, size_t num) {
+    for (; i < num; i++) {
+        const float v = scalar_sample(in[i]);
+        out[i] = v * (Windowed ? window[i] : gain);
+    }
+}
+
+template <typename T>
+constexpr bool has_simd_kernel =
+    std::is_same_v<T, uint8_t> || std::is_same_v<T, int8_t> ||
+    std::is_same_v<T, uint16_t> || std::is_same_v<T, int16_t> ||
+    std::is_same_v<T, double>;
+
+#ifdef SAMPLECONVERT_X86
+
+// ── AVX2: 8 samples per load ────────────────────────────────────────────────
+template <typename T> TARGET_AVX2 inline __m256 load8_avx2(const T *p) {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+        return _mm256_cvtepi32_ps(_mm256_sub_epi32(v, _mm256_set1_epi32(128)));
+    } else if constexpr (std::is_same_v<T, int8_t>) {
+        return _mm256_cvtepi32_ps(
+            _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)p)));
+    } else if constexpr (std::is_same_v<T, uint16_t>) {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+        return _mm256_cvtepi32_ps(
+            _mm256_sub_epi32(v, _mm256_set1_epi32(32768)));
+    } else if constexpr (std::is_same_v<T, int16_t>) {
+        return _mm256_cvtepi32_ps(
+            _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p)));
+    } else {
+        const __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(p));
+        const __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(p + 4));
+        return _mm256_set_m128(hi, lo);
+    }
+}
+
+template <typename T, bool Windowed>
+TARGET_AVX2 void convert_avx2(float *out, const T *in, const float *window,
+                              float gain, size_t num) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= num; i += 16) {
+        // Both loads before either store: in may sit inside out (see header)
+        const __m256 a = load8_avx2(in + i);
+        const __m256 b = load8_avx2(in + i + 8);
+        const __m256 wa = Windowed ? _mm256_loadu_ps(window + i) : g;
+        const __m256 wb = Windowed ? _mm256_loadu_ps(window + i + 8) : g;
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(a, wa));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(b, wb));
+    }
+    convert_scalar<T, Windowed>(out, in, window, gain, i, num);
+}
+
+// ── AVX-512: 16 samples per load ────────────────────────────────────────────
+// GCC 12's avx512fintrin.h trips -Wmaybe-uninitialized on the undefined
+// pass-through operand of nearly every conversion intrinsic (GCC PR 105593).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+template <typename T> TARGET_AVX512 inline __m512 load16_avx512(const T *p) {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+        __m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)p));
+        return _mm512_cvtepi32_ps(_mm512_sub_epi32(v, _mm512_set1_epi32(128)));
+    } else if constexpr (std::is_same_v<T, int8_t>) {
+        return _mm512_cvtepi32_ps(
+            _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)p)));
+    } else if constexpr (std::is_same_v<T, uint16_t>) {
+        __m512i v =
+            _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)p));
+        return _mm512_cvtepi32_ps(
+            _mm512_sub_epi32(v, _mm512_set1_epi32(32768)));
+    } else if constexpr (std::is_same_v<T, int16_t>) {
+        return _mm512_cvtepi32_ps(
+            _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)p)));
+    } else {
+        const __m256 lo = _mm512_cvtpd_ps(_mm512_loadu_pd(p));
+        const __m256 hi = _mm512_cvtpd_ps(_mm512_loadu_pd(p + 8));
+        return _mm512_castpd_ps(_mm512_insertf64x4(
+            _mm512_castpd256_pd512(_mm256_castps_pd(lo)),
+            _mm256_castps_pd(hi), 1));
+    }
+}
+
+template <typename T, bool Windowed>
+TARGET_AVX512 void convert_avx512(float *out, const T *in,
+                                  const float *window, float gain,
+                                  size_t num) {
+    const __m512 g = _mm512_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 32 <= num; i += 32) {
+        const __m512 a = load16_avx512(in + i);
+        const __m512 b = load16_avx512(in + i + 16);
+        const __m512 wa = Windowed ? _mm512_loadu_ps(window + i) : g;
+        const __m512 wb = Windowed ? _mm512_loadu_ps(window + i + 16) : g;
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(a, wa));
+        _mm512_storeu_ps(out + i + 16, _mm512_mul_ps(b, wb));
+    }
+    convert_scalar<T, Windowed>(out, in, window, gain, i, num);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+template <typename T, bool Windowed>
+void convert_dispatch(float *out, const T *in, const float *window,
+                      float gain, size_t num) {
+#ifdef SAMPLECONVERT_X86
+    if constexpr (has_simd_kernel<T>) {
+        switch (convert_isa()) {
+        case ConvertISA::AVX512:
+            convert_avx512<T, Windowed>(out, in, window, gain, num);
+            return;
+        case ConvertISA::AVX2:
+            convert_avx2<T, Windowed>(out, in, window, gain, num);
+            return;
+        default:
+            break;
+        }
+    }
+#endif
+    convert_scalar<T, Windowed>(out, in, window, gain, 0, num);
+}
+
+} // namespace
+
+namespace {
+ConvertISA detect_isa() {
+#ifdef SAMPLECONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return ConvertISA::AVX512;
+    if (__builtin_cpu_supports("avx2")) return ConvertISA::AVX2;
+#endif
+    return ConvertISA::SCALAR;
+}
+
+std::atomic<ConvertISA> selected_isa{detect_isa()};
+} // namespace
+
+ConvertISA convert_isa() {
+    return selected_isa.load(std::memory_order_relaxed);
+}
+
+void force_convert_isa(ConvertISA isa) {
+    // Never pick kernels the CPU cannot run
+    if (isa > detect_isa()) isa = detect_isa();
+    selected_isa.store(isa, std::memory_order_relaxed);
+}
+
+const char *convert_isa_name(ConvertISA isa) {
+    switch (isa) {
+    case ConvertISA::AVX512:
+        return "AVX-512";
+    case ConvertISA::AVX2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+template <typename T>
+void convert_samples(float *out, const T *in, float gain, size_t num) {
+    convert_dispatch<T, false>(out, in, nullptr, gain, num);
+}
+
+template <typename T>
+void convert_samples_windowed(float *out, const T *in, const float *window,
+                              size_t num) {
+    convert_dispatch<T, true>(out, in, window, 0.f, num);
+}
+
+#define SAMPLECONVERT_INSTANTIATE(T)                                           \
+    template void convert_samples<T>(float *, const T *, float, size_t);       \
+    template void convert_samples_windowed<T>(float *, const T *,              \
+                                              const float *, size_t);
+
+SAMPLECONVERT_INSTANTIATE(uint8_t)
+SAMPLECONVERT_INSTANTIATE(int8_t)
+SAMPLECONVERT_INSTANTIATE(uint16_t)
+SAMPLECONVERT_INSTANTIATE(int16_t)
+SAMPLECONVERT_INSTANTIATE(uint32_t)
+SAMPLECONVERT_INSTANTIATE(int32_t)
+SAMPLECONVERT_INSTANTIATE(uint64_t)
+SAMPLECONVERT_INSTANTIATE(int64_t)
+SAMPLECONVERT_INSTANTIATE(float)
+SAMPLECONVERT_INSTANTIATE(double)
@@ -0,0 +1,50 @@
+#ifndef SAMPLECONVERT_H
+#define SAMPLECONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// Raw sample to float conversion kernels for SampleConverter<T> and the fused
+// convert + window input path of FFTW::load_converted_input().
+//
+// Integer samples are mapped to [-1, 1): unsigned formats are offset-binary
+// (the sign bit is flipped, i.e. x - 2^(bits-1)) and everything is divided by
+// 2^(bits-1).  Float formats pass through unscaled.
+//
+// u8 / s8 / u16 / s16 / f64 have hand-written AVX2 and AVX-512 kernels,
+// chosen once at runtime with CPUID so the binary still runs on older CPUs
+// (and on non-x86 builds, which always use the scalar loop).  The remaining
+// formats use the scalar loop.
+//
+// Input and output may overlap in the way SampleConverter<T>::read() uses
+// them: the raw samples sit at the tail of the float output buffer, and every
+// block is loaded before the floats for it are stored.
+
+enum class ConvertISA { SCALAR, AVX2, AVX512 };
+ConvertISA convert_isa();
+const char *convert_isa_name(ConvertISA isa);
+// Use a lower ISA than detected (benchmarks compare against scalar)
+void force_convert_isa(ConvertISA isa);
+
+// Full-scale value the samples are divided by
+template <typename T> constexpr float sample_full_scale() {
+    if constexpr (std::is_integral_v<T>) {
+        return (float)std::numeric_limits<std::make_signed_t<T>>::max() + 1.f;
+    } else {
+        return 1.f;
+    }
+}
+
+// out[i] = in[i] * gain (after the offset-binary fix-up)
+template <typename T>
+void convert_samples(float *out, const T *in, float gain, size_t num);
+
+// out[i] = in[i] * window[i] (after the offset-binary fix-up).  The window is
+// expected to already include the 1 / full scale factor.
+template <typename T>
+void convert_samples_windowed(float *out, const T *in, const float *window,
+                              size_t num);
+
+#endif
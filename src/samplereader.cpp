@@ -1,12 +1,22 @@
 #include "samplereader.h"
+#include "sampleconvert.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 FileSampleReader::FileSampleReader(FILE *f) : f{f} {}
 int FileSampleReader::read(void *arr, int num) {
     // FIX: fread_unlocked may return a short count on USB hiccups (RX-888).
@@ -30,31 +40,92 @@ int FileSampleReader::read(void *arr, int num) {
     return static_cast<int>(total);
 }
 
-SampleConverterBase::SampleConverterBase(std::unique_ptr<SampleReader> reader)
-    : reader(std::move(reader)) {}
+MmapSampleReader::MmapSampleReader(const std::string &path,
+                                   double bytes_per_second, bool loop)
+    : bytes_per_second{bytes_per_second}, loop{loop} {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("replay: cannot open " + path + ": " +
+                                 strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("replay: " + path + " is empty");
+    }
+    length = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("replay: cannot map " + path + ": " +
+                                 strerror(errno));
+    }
+    // Read ahead aggressively; pages already played can be dropped early
+    madvise(map, length, MADV_SEQUENTIAL);
+    data = static_cast<const uint8_t *>(map);
+}
 
-template <typename T>
-SampleConverter<T>::SampleConverter(std::unique_ptr<SampleReader> reader)
-    : SampleConverterBase(std::move(reader)) {}
+MmapSampleReader::~MmapSampleReader() {
+    munmap(const_cast<uint8_t *>(data), length);
+}
+
+void MmapSampleReader::pace(size_t num) {
+    if (bytes_per_second > 0) {
+        // Hand the data over no earlier than a live SDR would have it
+        if (delivered == 0) start = std::chrono::steady_clock::now();
+        delivered += num;
+        const std::chrono::duration<double> due(delivered / bytes_per_second);
+        std::this_thread::sleep_until(
+            start + std::chrono::duration_cast<std::chrono::nanoseconds>(due));
+    }
+}
 
-template <typename T> struct type_ {
-    using type = T;
-};
+std::span<const uint8_t> MmapSampleReader::read_view(size_t num,
+                                                     size_t align) {
+    if (pos == length && loop) pos = 0;
+    // Across the end of a looped recording only read() can join the pieces
+    if (num > length - pos ||
+        reinterpret_cast<uintptr_t>(data + pos) % align != 0) {
+        return {};
+    }
+    pace(num);
+    const uint8_t *view = data + pos;
+    pos += num;
+    return {view, num};
+}
 
-template <typename T, typename T_signed> void convert(float *arr, T_signed *scratch, float scale, size_t num) {
-    arr = std::assume_aligned<64>(arr);
-    scratch = std::assume_aligned<64>(scratch);
-    //[[assume(num % (64 / sizeof(T)) == 0)]];
-    [[assume(num > 0)]];
-    for (size_t i = 0; i < num; i++) {
-        if constexpr (std::is_unsigned<T>::value) {
-            scratch[i] = scratch[i] ^ ((T)1 << (sizeof(T) * 8 - 1));
+int MmapSampleReader::read(void *arr, int num) {
+    pace(num);
+    uint8_t *out = static_cast<uint8_t *>(arr);
+    size_t done = 0;
+    while (done < static_cast<size_t>(num)) {
+        if (pos == length) {
+            if (!loop) throw std::runtime_error("replay: end of recording");
+            pos = 0;
         }
-        arr[i] = ((float)scratch[i]) / scale;
+        const size_t n = std::min(length - pos, num - done);
+        memcpy(out + done, data + pos, n);
+        pos += n;
+        done += n;
     }
+    return num;
 }
 
+SampleConverterBase::SampleConverterBase(std::unique_ptr<SampleReader> reader)
+    : reader(std::move(reader)) {}
+
+template <typename T>
+SampleConverter<T>::SampleConverter(std::unique_ptr<SampleReader> reader)
+    : SampleConverterBase(std::move(reader)) {}
+
 template <typename T> void SampleConverter<T>::read(float *arr, int num) {
+    // A mapped recording converts in place, without the scratch copy
+    if (auto view = reader->read_view(sizeof(T) * num, alignof(T));
+        !view.empty()) {
+        convert_samples<T>(arr, reinterpret_cast<const T *>(view.data()),
+                           1.f / sample_full_scale<T>(), num);
+        return;
+    }
     // Use the last part of the array as a scratch buffer
     T *scratch;
     if constexpr (sizeof(T) > sizeof(float)) {
@@ -63,27 +134,29 @@ template <typename T> void SampleConverter<T>::read(float *arr, int num) {
         scratch = ((T *)&arr[num]) - num;
     }
     reader->read(scratch, sizeof(T) * num);
-    auto constexpr static unsigned_type = []() {
-        if constexpr (std::is_unsigned<T>::value) {
-            return type_<typename std::make_signed<T>::type>{};
-        } else {
-            return type_<T>{};
-        }
-    };
-    typedef typename decltype(unsigned_type())::type T_signed;
-    constexpr float scale = []() {
-        if constexpr (std::is_integral<T>::value) {
-            return (float)std::numeric_limits<T_signed>::max() + 1.;
-        } else {
-            return 1.;
-        }
-    }();
-    convert<T, T_signed>(arr, (T_signed*)scratch, scale, num);
+    // SIMD kernel picked at runtime, see sampleconvert.h.  It is safe on
+    // the overlapping in-place layout above.
+    convert_samples<T>(arr, scratch, 1.f / sample_full_scale<T>(), num);
     if constexpr (sizeof(T) > sizeof(float)) {
         delete[] scratch;
     }
 }
 
+template <typename T> void SampleConverter<T>::read_raw(void *arr, int num) {
+    reader->read(arr, sizeof(T) * num);
+}
+
+template <typename T> float SampleConverter<T>::full_scale() const {
+    return sample_full_scale<T>();
+}
+
+template <typename T>
+void SampleConverter<T>::convert_windowed(float *out, const void *raw,
+                                          const float *window,
+                                          int num) const {
+    convert_samples_windowed<T>(out, static_cast<const T *>(raw), window, num);
+}
+
 template class SampleConverter<uint8_t>;
 template class SampleConverter<int8_t>;
 template class SampleConverter<uint16_t>;
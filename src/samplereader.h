@@ -1,11 +1,24 @@
 #ifndef SAMPLEREADER_H
 #define SAMPLEREADER_H
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <memory>
+#include <span>
+#include <string>
 class SampleReader {
   public:
     virtual int read(void *arr, int num) = 0;
+    // Zero-copy form of read() for readers that already hold the samples in
+    // memory: the next num bytes in place, valid until the next call.  Empty,
+    // with nothing consumed, if the reader cannot (the default) or the bytes
+    // are not contiguous or not aligned to align; read() them instead.
+    virtual std::span<const uint8_t> read_view(size_t /*num*/,
+                                               size_t /*align*/) {
+        return {};
+    }
     virtual ~SampleReader() {}
 };
 
@@ -18,6 +31,37 @@ class FileSampleReader : public SampleReader {
     int read(void *arr, int num);
 };
 
+// Plays back a raw recording (e.g. a .sigmf-data file) mapped into memory:
+// no read() syscalls, the samples are copied straight out of the page cache,
+// or with read_view() not copied at all.
+// bytes_per_second paces the playback like a live SDR; 0 delivers the data
+// as fast as it is read.  At the end it starts over if loop is set, else it
+// throws like FileSampleReader at EOF.
+class MmapSampleReader : public SampleReader {
+  public:
+    MmapSampleReader(const std::string &path, double bytes_per_second,
+                     bool loop);
+    ~MmapSampleReader();
+
+    MmapSampleReader(const MmapSampleReader &) = delete;
+    MmapSampleReader &operator=(const MmapSampleReader &) = delete;
+
+    int read(void *arr, int num);
+    std::span<const uint8_t> read_view(size_t num, size_t align);
+
+  private:
+    void pace(size_t num);
+
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+    size_t pos = 0;
+    double bytes_per_second;
+    bool loop;
+    // Real-time pacing: bytes delivered since start
+    std::chrono::steady_clock::time_point start;
+    uint64_t delivered = 0;
+};
+
 class SampleConverterBase {
   protected:
     std::unique_ptr<SampleReader> reader;
@@ -25,6 +69,17 @@ class SampleConverterBase {
   public:
     SampleConverterBase(std::unique_ptr<SampleReader> reader);
     virtual void read(float *arr, int num) = 0;
+
+    // Split form of read() for the fused input path: read_raw() stores num
+    // unconverted samples (sample_size() bytes each) and convert_windowed()
+    // later turns them into floats multiplied by window, which must already
+    // include the 1 / full_scale() factor.  See FFT::load_raw_input().
+    virtual void read_raw(void *arr, int num) = 0;
+    virtual size_t sample_size() const = 0;
+    virtual float full_scale() const = 0;
+    virtual void convert_windowed(float *out, const void *raw,
+                                  const float *window, int num) const = 0;
+
     virtual ~SampleConverterBase() {}
 };
 
@@ -32,6 +87,11 @@ template <typename T> class SampleConverter : public SampleConverterBase {
   public:
     SampleConverter(std::unique_ptr<SampleReader> reader);
     virtual void read(float *arr, int num);
+    virtual void read_raw(void *arr, int num);
+    virtual size_t sample_size() const { return sizeof(T); }
+    virtual float full_scale() const;
+    virtual void convert_windowed(float *out, const void *raw,
+                                  const float *window, int num) const;
     virtual ~SampleConverter() {}
 };
 
@@ -0,0 +1,139 @@
+#include "samplering.h"
+#include "metrics.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include <pthread.h>
+
+SampleRing::overrun_policy
+SampleRing::policy_from_string(const std::string &name) {
+    if (name == "block") return BLOCK;
+    if (name == "drop") return DROP_NEWEST;
+    if (name == "skip") return SKIP_TO_NEWEST;
+    throw std::runtime_error("Unknown input_ring_policy '" + name +
+                             "' (expected block, drop or skip)");
+}
+
+const char *SampleRing::policy_name(overrun_policy policy) {
+    switch (policy) {
+    case BLOCK:
+        return "block";
+    case DROP_NEWEST:
+        return "drop";
+    default:
+        return "skip";
+    }
+}
+
+SampleRing::SampleRing(SampleConverterBase &reader, std::vector<float *> slots,
+                       int hop_floats, overrun_policy policy, bool raw)
+    : reader{reader}, slots{std::move(slots)},
+      capacity{this->slots.size() - 1}, hop_floats{hop_floats},
+      policy{policy}, raw{raw} {
+    // Two hops are held by the FFT while a third is being read
+    if (this->slots.size() < 4) {
+        throw std::invalid_argument("SampleRing needs at least 4 slots");
+    }
+}
+
+SampleRing::~SampleRing() { stop(); }
+
+void SampleRing::start() {
+    reader_thread = std::thread(&SampleRing::reader_loop, this);
+}
+
+void SampleRing::stop() {
+    stopping.store(true, std::memory_order_release);
+    consumed_seq.fetch_add(1, std::memory_order_release);
+    consumed_seq.notify_all();
+    produced_seq.fetch_add(1, std::memory_order_release);
+    produced_seq.notify_all();
+    if (reader_thread.joinable()) reader_thread.join();
+}
+
+void SampleRing::reader_loop() {
+    pthread_setname_np(pthread_self(), "sample-reader");
+
+    float *scratch = slots.back();
+    try {
+        while (!stopping.load(std::memory_order_acquire)) {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            const uint32_t seq = consumed_seq.load(std::memory_order_acquire);
+            const uint64_t fill = h - tail.load(std::memory_order_acquire);
+
+            if (fill >= capacity) {
+                if (policy == DROP_NEWEST) {
+                    // Keep the FIFO drained; the FFT sees a gap instead of
+                    // the driver dropping USB packets.
+                    read_hop(scratch);
+                    overruns.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    // BLOCK waits for the FFT; SKIP_TO_NEWEST waits for the
+                    // FFT to notice the full ring and jump ahead.
+                    consumed_seq.wait(seq, std::memory_order_acquire);
+                }
+                continue;
+            }
+
+            read_hop(slots[h % capacity]);
+            head.store(h + 1, std::memory_order_release);
+            produced_seq.fetch_add(1, std::memory_order_release);
+            produced_seq.notify_one();
+
+            uint64_t hw = high_water.load(std::memory_order_relaxed);
+            while (hw < fill + 1 &&
+                   !high_water.compare_exchange_weak(
+                       hw, fill + 1, std::memory_order_relaxed)) {
+            }
+        }
+    } catch (...) {
+        error = std::current_exception();
+        failed.store(true, std::memory_order_release);
+        produced_seq.fetch_add(1, std::memory_order_release);
+        produced_seq.notify_all();
+    }
+}
+
+void SampleRing::read_hop(float *slot) {
+    // Includes waiting for the driver, so about one hop period when the
+    // reader keeps up
+    StageTimer timer(Stage::READ);
+    if (raw) {
+        reader.read_raw(slot, hop_floats);
+    } else {
+        reader.read(slot, hop_floats);
+    }
+}
+
+bool SampleRing::wait_available(size_t n) {
+    while (true) {
+        const uint32_t seq = produced_seq.load(std::memory_order_acquire);
+        const uint64_t h = head.load(std::memory_order_acquire);
+        const uint64_t fill = h - tail_idx;
+
+        if (policy == SKIP_TO_NEWEST && fill >= capacity) {
+            // Jump to the newest n hops and let the reader carry on
+            const uint64_t skip = fill - n;
+            overruns.fetch_add(skip, std::memory_order_relaxed);
+            tail_idx += skip;
+            tail.store(tail_idx, std::memory_order_release);
+            consumed_seq.fetch_add(1, std::memory_order_release);
+            consumed_seq.notify_one();
+            return true;
+        }
+        if (fill >= n) return true;
+        if (failed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(error);
+        }
+        if (stopping.load(std::memory_order_acquire)) return false;
+        produced_seq.wait(seq, std::memory_order_acquire);
+    }
+}
+
+void SampleRing::pop() {
+    tail_idx++;
+    tail.store(tail_idx, std::memory_order_release);
+    consumed_seq.fetch_add(1, std::memory_order_release);
+    consumed_seq.notify_one();
+}
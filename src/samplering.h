@@ -0,0 +1,113 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "samplereader.h"
+
+// Single-producer / single-consumer ring of input hops between a persistent
+// reader thread and fft_task.
+//
+// fft_task used to start a std::async thread for every reader->read() and
+// rotate three buffers, so one slow FFT frame (or a thread start) left the
+// RX-888 FIFO undrained and the driver dropped USB samples.  The reader
+// thread now keeps reading into the ring on its own; the FFT consumes hops
+// whenever it gets to them.
+//
+// One hop is half an FFT (the 50% overlap): the consumer waits for two hops,
+// feeds them to the FFT and pops only the older one.  Indices are monotonic
+// 64-bit counters, each on its own cache line; the two sides only sleep when
+// the ring is empty or full (C++20 atomic wait/notify, no locks).
+//
+// The slot buffers are owned by the caller (they must come from FFT::malloc()
+// so accelerated backends can map them).  The last slot is reserved as the
+// scratch buffer for DROP_NEWEST, so the ring holds slots.size() - 1 hops.
+class SampleRing {
+  public:
+    // What the reader does when the FFT falls so far behind that the ring is
+    // full:
+    //   BLOCK          stop reading until a hop is consumed (the FIFO backs
+    //                  up and the driver drops samples upstream, as before)
+    //   DROP_NEWEST    keep draining the input and throw the new hop away
+    //   SKIP_TO_NEWEST the FFT skips the whole backlog and resumes at the
+    //                  newest hops (lowest latency after a stall)
+    enum overrun_policy { BLOCK, DROP_NEWEST, SKIP_TO_NEWEST };
+    static overrun_policy policy_from_string(const std::string &name);
+    static const char *policy_name(overrun_policy policy);
+
+    // raw: slots hold unconverted samples (SampleConverterBase::read_raw)
+    // for the fused convert + window path; otherwise converted floats.
+    SampleRing(SampleConverterBase &reader, std::vector<float *> slots,
+               int hop_floats, overrun_policy policy, bool raw = false);
+    ~SampleRing();
+
+    SampleRing(const SampleRing &) = delete;
+    SampleRing &operator=(const SampleRing &) = delete;
+
+    void start();
+    // Stops the reader thread.  Joins, so it returns once the read in
+    // progress (if any) has completed.
+    void stop();
+
+    // Consumer side.  Blocks until n hops are readable.  Rethrows the
+    // reader's exception (EOF, read error) once no hops are left, and returns
+    // false if the ring was stopped.
+    bool wait_available(size_t n);
+    // i-th oldest readable hop, valid until it is popped.  Raw samples
+    // when the ring was made with raw = true.
+    float *peek(size_t i) { return slots[(tail_idx + i) % capacity]; }
+    // Release the oldest hop back to the reader.
+    void pop();
+
+    // Statistics, safe to read from any thread
+    size_t get_capacity() const { return capacity; }
+    uint64_t get_overruns() const {
+        return overruns.load(std::memory_order_relaxed);
+    }
+    // Hops written by the reader and not yet popped
+    uint64_t get_depth() const {
+        return head.load(std::memory_order_relaxed) -
+               tail.load(std::memory_order_relaxed);
+    }
+    // Highest fill level since the last call
+    uint64_t take_high_water() {
+        return high_water.exchange(0, std::memory_order_relaxed);
+    }
+    overrun_policy get_policy() const { return policy; }
+
+  private:
+    void reader_loop();
+    void read_hop(float *slot);
+
+    SampleConverterBase &reader;
+    const std::vector<float *> slots;
+    const size_t capacity;
+    const int hop_floats;
+    const overrun_policy policy;
+    const bool raw;
+    std::thread reader_thread;
+
+    // Producer cache line: hops written, plus a wake-up sequence bumped on
+    // every publish, failure and stop (what the consumer sleeps on).
+    alignas(64) std::atomic<uint64_t> head{0};
+    std::atomic<uint32_t> produced_seq{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;   // written before failed is set
+
+    // Consumer cache line: hops consumed and its wake-up sequence.
+    // tail_idx is the consumer's private copy of tail.
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint32_t> consumed_seq{0};
+    uint64_t tail_idx = 0;
+
+    alignas(64) std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> high_water{0};
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "sigmf.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Recordings this server wrote, and so may delete for the disk budget
+constexpr const char *kPrefix = "phantom-";
+constexpr const char *kDataExt = ".sigmf-data";
+constexpr const char *kMetaExt = ".sigmf-meta";
+
+struct FormatType {
+    const char *format;
+    const char *type;       // SigMF type without the c / r prefix
+};
+constexpr FormatType kFormats[] = {
+    {"u8", "u8"},      {"s8", "i8"},      {"u16", "u16_le"},
+    {"s16", "i16_le"}, {"f32", "f32_le"}, {"f64", "f64_le"},
+};
+
+std::string utc_timestamp(std::time_t t, const char *format) {
+    std::tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), format, &tm);
+    return buf;
+}
+
+fs::path meta_path_for(const fs::path &data) {
+    fs::path meta = data;
+    meta.replace_extension(kMetaExt);
+    return meta;
+}
+} // namespace
+
+size_t sample_format_bytes(const std::string &format) {
+    if (format == "u8" || format == "s8") return 1;
+    if (format == "u16" || format == "s16") return 2;
+    if (format == "f32") return 4;
+    if (format == "f64") return 8;
+    return 0;
+}
+
+std::string sigmf_datatype(const std::string &format, bool is_real) {
+    for (const auto &f : kFormats) {
+        if (format == f.format) {
+            return (is_real ? "r" : "c") + std::string(f.type);
+        }
+    }
+    return "";
+}
+
+std::optional<std::string> sigmf_input_format(const std::string &datatype,
+                                              bool &is_real) {
+    if (datatype.size() < 2 || (datatype[0] != 'c' && datatype[0] != 'r')) {
+        return std::nullopt;
+    }
+    const std::string type = datatype.substr(1);
+    for (const auto &f : kFormats) {
+        if (type == f.type) {
+            is_real = datatype[0] == 'r';
+            return std::string(f.format);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<SigMFInfo> read_sigmf_meta(const std::string &path) {
+    const fs::path meta = meta_path_for(path);
+    std::ifstream in(meta);
+    if (!in) return std::nullopt;
+    try {
+        const nlohmann::json j = nlohmann::json::parse(in);
+        const auto &global = j.at("global");
+        SigMFInfo info;
+        auto format = sigmf_input_format(
+            global.at("core:datatype").get<std::string>(), info.is_real);
+        if (!format) return std::nullopt;
+        info.format = *format;
+        info.sample_rate = global.value("core:sample_rate", 0.0);
+        if (j.contains("captures") && !j["captures"].empty()) {
+            info.frequency = j["captures"][0].value("core:frequency", 0.0);
+        }
+        return info;
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
+
+// ── SigMFRecorder ───────────────────────────────────────────────────────────
+
+SigMFRecorder::SigMFRecorder(SigMFRecordOptions options)
+    : options{std::move(options)},
+      max_queued_bytes{std::clamp<uint64_t>(
+          2 * this->options.sample_rate *
+              sample_format_bytes(this->options.format) *
+              (this->options.is_real ? 1 : 2),
+          16 << 20, 256 << 20)} {
+    std::error_code ec;
+    fs::create_directories(this->options.directory, ec);
+    if (ec) {
+        std::cout << "[record] cannot create " << this->options.directory
+                  << ": " << ec.message() << std::endl;
+    }
+    writer = std::thread(&SigMFRecorder::writer_loop, this);
+}
+
+SigMFRecorder::~SigMFRecorder() {
+    {
+        std::scoped_lock lk(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    writer.join();
+}
+
+void SigMFRecorder::write(const void *data, size_t bytes) {
+    {
+        std::scoped_lock lk(mtx);
+        if (queued_bytes + bytes > max_queued_bytes) {
+            dropped_bytes += bytes;
+            gap = true;
+            return;
+        }
+        Chunk chunk;
+        if (!spare.empty()) {
+            chunk = std::move(spare.back());
+            spare.pop_back();
+        }
+        chunk.data.assign(static_cast<const uint8_t *>(data),
+                          static_cast<const uint8_t *>(data) + bytes);
+        chunk.after_gap = gap;
+        gap = false;
+        queued_bytes += bytes;
+        queue.push_back(std::move(chunk));
+    }
+    cv.notify_one();
+}
+
+uint64_t SigMFRecorder::get_dropped() const {
+    std::scoped_lock lk(mtx);
+    return dropped_bytes;
+}
+
+void SigMFRecorder::writer_loop() {
+    uint64_t dropped_reported = 0;
+    while (true) {
+        Chunk chunk;
+        uint64_t dropped;
+        {
+            std::unique_lock lk(mtx);
+            cv.wait(lk, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) break;   // stopping, everything written
+            chunk = std::move(queue.front());
+            queue.pop_front();
+            dropped = dropped_bytes;
+        }
+
+        if (chunk.after_gap ||
+            (file && options.file_bytes &&
+             file_written >= options.file_bytes)) {
+            close_recording();
+        }
+        if (!file && !failed) {
+            if (!open_recording()) {
+                failed = true;
+            } else if (options.max_bytes) {
+                enforce_budget();
+            }
+        }
+        if (file) {
+            if (fwrite(chunk.data.data(), 1, chunk.data.size(), file) !=
+                chunk.data.size()) {
+                std::cout << "[record] write failed: " << strerror(errno)
+                          << ", recording stopped" << std::endl;
+                close_recording();
+                failed = true;
+            } else {
+                file_written += chunk.data.size();
+            }
+        }
+        if (dropped != dropped_reported) {
+            std::cout << "[record] disk too slow, dropped "
+                      << (dropped - dropped_reported) / 1024
+                      << " KiB of input" << std::endl;
+            dropped_reported = dropped;
+        }
+
+        std::scoped_lock lk(mtx);
+        queued_bytes -= chunk.data.size();
+        if (spare.size() < 8) spare.push_back(std::move(chunk));
+    }
+    close_recording();
+}
+
+bool SigMFRecorder::open_recording() {
+    const auto now = std::chrono::system_clock::now();
+    const std::time_t t = std::chrono::system_clock::to_time_t(now);
+    char seq[16];
+    std::snprintf(seq, sizeof(seq), "-%06u", sequence++);
+    const std::string name =
+        kPrefix + utc_timestamp(t, "%Y%m%dT%H%M%SZ") + seq;
+    data_path = fs::path(options.directory) / (name + kDataExt);
+
+    nlohmann::json meta = {
+        {"global",
+         {{"core:datatype", sigmf_datatype(options.format, options.is_real)},
+          {"core:sample_rate", options.sample_rate},
+          {"core:version", "1.0.0"},
+          {"core:recorder", "PhantomSDR-Plus"}}},
+        {"captures",
+         {{{"core:sample_start", 0},
+           {"core:frequency", options.frequency},
+           {"core:datetime", utc_timestamp(t, "%Y-%m-%dT%H:%M:%SZ")}}}},
+        {"annotations", nlohmann::json::array()},
+    };
+    std::ofstream out(meta_path_for(data_path));
+    out << meta.dump(2) << '\n';
+    if (!out) {
+        std::cout << "[record] cannot write " << meta_path_for(data_path)
+                  << ", recording stopped" << std::endl;
+        return false;
+    }
+
+    file = fopen(data_path.c_str(), "wb");
+    if (!file) {
+        std::cout << "[record] cannot open " << data_path << ": "
+                  << strerror(errno) << ", recording stopped" << std::endl;
+        return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    file_written = 0;
+    std::cout << "[record] recording to " << data_path << std::endl;
+    return true;
+}
+
+void SigMFRecorder::close_recording() {
+    if (!file) return;
+    fclose(file);
+    file = nullptr;
+}
+
+void SigMFRecorder::enforce_budget() {
+    std::error_code ec;
+    std::vector<std::pair<fs::path, uint64_t>> recordings;
+    for (const auto &entry : fs::directory_iterator(options.directory, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (!name.starts_with(kPrefix) ||
+            entry.path().extension() != kDataExt) {
+            continue;
+        }
+        // A file that vanished or cannot be stat'ed counts for nothing
+        std::error_code size_ec;
+        const uint64_t size = entry.file_size(size_ec);
+        if (size_ec) continue;
+        recordings.emplace_back(entry.path(), size);
+    }
+    // The names start with the UTC time, so they sort oldest first
+    std::sort(recordings.begin(), recordings.end());
+
+    // Leave room for the recording just opened to reach file_bytes
+    uint64_t total = options.file_bytes;
+    for (const auto &[path, size] : recordings) {
+        if (path != data_path) total += size;
+    }
+    for (const auto &[path, size] : recordings) {
+        if (total <= options.max_bytes) break;
+        if (path == data_path) continue;
+        fs::remove(path, ec);
+        fs::remove(meta_path_for(path), ec);
+        total -= size;
+        std::cout << "[record] disk budget: removed " << path << std::endl;
+    }
+}
+
+// ── RecordingSampleReader ───────────────────────────────────────────────────
+
+RecordingSampleReader::RecordingSampleReader(
+    std::unique_ptr<SampleReader> reader,
+    std::unique_ptr<SigMFRecorder> recorder)
+    : reader{std::move(reader)}, recorder{std::move(recorder)} {}
+
+int RecordingSampleReader::read(void *arr, int num) {
+    const int n = reader->read(arr, num);
+    if (n > 0) recorder->write(arr, n);
+    return n;
+}
@@ -0,0 +1,123 @@
+#ifndef SIGMF_H
+#define SIGMF_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "samplereader.h"
+
+// Raw input recordings in SigMF (https://sigmf.org): a .sigmf-data file with
+// the samples exactly as the driver delivered them, before conversion, and a
+// .sigmf-meta JSON file describing them.  Recorded with [input.record],
+// played back with driver name = "replay" (MmapSampleReader).
+
+// Bytes per scalar sample of an input.driver.format, 0 if unknown
+size_t sample_format_bytes(const std::string &format);
+
+// SigMF core:datatype for an input format, e.g. "s16" IQ -> "ci16_le"
+std::string sigmf_datatype(const std::string &format, bool is_real);
+
+// Input format for a SigMF core:datatype, or nullopt if the server cannot
+// read it; is_real is set from the datatype
+std::optional<std::string> sigmf_input_format(const std::string &datatype,
+                                              bool &is_real);
+
+struct SigMFInfo {
+    std::string format;         // input.driver.format
+    bool is_real = false;
+    double sample_rate = 0;
+    double frequency = 0;
+};
+
+// Reads the .sigmf-meta next to a .sigmf-data path (or the meta file
+// itself).  nullopt if there is none or it is not a recording we can play.
+std::optional<SigMFInfo> read_sigmf_meta(const std::string &path);
+
+struct SigMFRecordOptions {
+    std::string directory = "recordings";
+    std::string format;            // input.driver.format
+    bool is_real = false;
+    int64_t sample_rate = 0;
+    int64_t frequency = 0;
+    uint64_t file_bytes = 0;       // start a new recording after this much,
+                                   // 0 = never
+    uint64_t max_bytes = 0;        // delete the oldest beyond this total,
+                                   // 0 = no limit
+};
+
+// Writes the raw input to rotating SigMF recordings on its own thread.
+//
+// write() copies the data into a queue and returns at once, so a slow disk
+// never holds up the SDR.  If the queue grows beyond a few seconds of input
+// the data is dropped and counted instead; the writer then starts a new
+// recording, so every recording holds contiguous samples.  A recording ends
+// at the first write() past file_bytes, and after each new one is opened the
+// oldest recordings in the directory are deleted until the total is within
+// max_bytes.
+class SigMFRecorder {
+  public:
+    explicit SigMFRecorder(SigMFRecordOptions options);
+    ~SigMFRecorder();
+
+    SigMFRecorder(const SigMFRecorder &) = delete;
+    SigMFRecorder &operator=(const SigMFRecorder &) = delete;
+
+    void write(const void *data, size_t bytes);
+
+    uint64_t get_dropped() const;
+
+  private:
+    struct Chunk {
+        std::vector<uint8_t> data;
+        bool after_gap = false;    // data was dropped just before this chunk
+    };
+
+    void writer_loop();
+    bool open_recording();
+    void close_recording();
+    void enforce_budget();
+
+    const SigMFRecordOptions options;
+    const uint64_t max_queued_bytes;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Chunk> queue;          // mtx
+    std::vector<Chunk> spare;         // mtx, reused buffers
+    uint64_t queued_bytes = 0;        // mtx
+    uint64_t dropped_bytes = 0;       // mtx
+    bool gap = false;                 // mtx
+    bool stopping = false;            // mtx
+
+    // Writer thread only
+    FILE *file = nullptr;
+    std::filesystem::path data_path;
+    uint64_t file_written = 0;
+    unsigned sequence = 0;
+    bool failed = false;              // gave up after a disk error
+
+    std::thread writer;
+};
+
+// Tees everything read from another reader into a SigMFRecorder
+class RecordingSampleReader : public SampleReader {
+  public:
+    RecordingSampleReader(std::unique_ptr<SampleReader> reader,
+                          std::unique_ptr<SigMFRecorder> recorder);
+    int read(void *arr, int num);
+
+  private:
+    std::unique_ptr<SampleReader> reader;
+    std::unique_ptr<SigMFRecorder> recorder;
+};
+
+#endif
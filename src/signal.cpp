@@ -1,6 +1,9 @@
 #include <complex>
 
 #include "fft.h"
+#include "fftplancache.h"
+#include "georesolver.h"
+#include "metrics.h"
 #include "signal.h"
 #include "utils/dsp.h"
 
@@ -11,246 +14,6 @@
 #include <iostream>
 #include <unordered_map>
 #include <cmath>
-#include <curl/curl.h>
-#include <nlohmann/json.hpp>
-
-// ---- Synchronous AM (SAM) product detector with simple PI-PLL ----
-namespace {
-struct SAM_PLL {
-    double fs = 48000.0;
-    double theta = 0.0;     // NCO phase
-    double dtheta = 0.0;    // nominal freq offset (rad/sample), keep at 0 for centered carrier
-    double ki = 0.0, kp = 0.0;
-    double acc = 0.0;       // integrator
-
-    // Separate DC blocker state for each channel
-    float xm1_L = 0.0f, ym1_L = 0.0f;       // Left channel
-    float xm1_R = 0.0f, ym1_R = 0.0f;       // Right channel
-    float xm1_mono = 0.0f, ym1_mono = 0.0f; // Mono (legacy SAM)
-
-    double dc_a_mono   = 0.999; // Gentler for natural bass
-    double dc_a_stereo = 0.999; // Even gentler for stereo imaging
-    double dc_a        = 0.997; // Current active coefficient
-
-    // Signal magnitude tracking for normalization
-    float mag_avg   = 1.0f;
-    float mag_alpha = 0.01f; // Responsive tracking
-
-    // Lock detector.  When the PLL is locked, the normalized in-phase carrier
-    // component (Ir) sits near +1 and the quadrature (Qr) near 0; unlocked, Ir
-    // wanders and its average collapses toward 0.  lock_ema is a slow average of
-    // Ir (~40 ms); `locked` is the hysteresis'd boolean the UI reads.
-    float lock_ema = 0.0f;
-    bool  locked   = false;
-
-    // Recompute the PI loop gains for a given loop bandwidth WITHOUT resetting
-    // the NCO/integrator state.  Lets us switch loop bandwidth per mode (narrow
-    // for mono SAM, wider for C-QUAM) without dropping lock.
-    inline void set_loop_bw(double loop_bw_hz) {
-        // Convert loop bandwidth to discrete PI gains (damping factor 0.707)
-        const double damping = 0.707;
-        const double wn = 2.0 * M_PI * loop_bw_hz / fs;
-        kp = 2.0 * damping * wn;
-        ki = wn * wn;
-    }
-
-    void setup(double sample_rate, double loop_bw_hz = 50.0) {
-        fs = sample_rate > 1.0 ? sample_rate : 48000.0;
-        set_loop_bw(loop_bw_hz);
-        // Reset state
-        theta = 0.0;
-        acc = 0.0;
-        xm1_L = xm1_R = xm1_mono = 0.0f;
-        ym1_L = ym1_R = ym1_mono = 0.0f;
-        mag_avg = 1.0f;
-        lock_ema = 0.0f;
-        locked = false;
-    }
-
-    // FIX: wrap() was defined here but never called — step() and step_cquam()
-    // both do inline phase wrapping with if-statements.  The dead function
-    // produced a -Wunused-function warning and has been removed.
-
-    // Set stereo mode (switches DC blocker coefficient)
-    inline void set_stereo_mode(bool stereo) {
-        dc_a = stereo ? dc_a_stereo : dc_a_mono;
-    }
-
-    // Separate DC blocking functions for each channel
-    inline float dcblock_L(float x) {
-        float y = x - xm1_L + (float)dc_a * ym1_L;
-        xm1_L = x;
-        ym1_L = y;
-        return y;
-    }
-
-    inline float dcblock_R(float x) {
-        float y = x - xm1_R + (float)dc_a * ym1_R;
-        xm1_R = x;
-        ym1_R = y;
-        return y;
-    }
-
-    inline float dcblock_mono(float x) {
-        float y = x - xm1_mono + (float)dc_a * ym1_mono;
-        xm1_mono = x;
-        ym1_mono = y;
-        return y;
-    }
-
-    // Mono SAM product detector.
-    //
-    // The PLL locks on the CARRIER phasor (Ic,Qc) — the baseband low-pass
-    // filtered to <500 Hz, i.e. essentially the pure carrier — which is far more
-    // stable than locking on carrier+sidebands: on deep modulation the full
-    // signal's in-phase term can swing negative and make atan2 jump by π,
-    // slipping the loop.  The carrier-locked phase then demodulates the FULL
-    // signal (Isig,Qsig) to produce the audio.
-    inline float step(float Ic, float Qc, float Isig, float Qsig) {
-        // Track carrier magnitude for phase-detector normalization (keeps loop
-        // gain independent of signal strength).
-        float mag = sqrtf(Ic * Ic + Qc * Qc);
-        if (mag > 0.0001f) {
-            mag_avg = mag_avg * (1.0f - mag_alpha) + mag * mag_alpha;
-        }
-        float norm_factor = (mag_avg > 0.0001f) ? (1.0f / mag_avg) : 1.0f;
-        float In = Ic * norm_factor;
-        float Qn = Qc * norm_factor;
-
-        // NCO rotation by -theta to bring the carrier to baseband.
-        float c = cosf((float)theta);
-        float s = sinf((float)theta);
-        float Ir =  In * c + Qn * s;
-        float Qr = -In * s + Qn * c;
-
-        // Phase detector — atan2 for robust acquisition over wide range.
-        float e = atan2f(Qr, Ir);
-
-        // PI loop filter with anti-windup clamp on the integrator (prevents
-        // wind-up and sudden phase jumps / stuttering on off-frequency signals).
-        acc += ki * e;
-        const double max_acc = M_PI / 4.0;
-        if (acc >  max_acc) acc =  max_acc;
-        if (acc < -max_acc) acc = -max_acc;
-        double u = kp * e + acc;
-
-        // Advance NCO and wrap phase to [-π, π].
-        theta += dtheta + u;
-        if (theta >  M_PI) theta -= 2.0 * M_PI;
-        if (theta <= -M_PI) theta += 2.0 * M_PI;
-
-        // Lock detector: slow-average the normalized in-phase carrier (≈1 when
-        // locked, →0 when not), then apply hysteresis for a steady indicator.
-        // Use cos(phase error) = Ir / |phasor|, which is amplitude-INDEPENDENT
-        // (robust to AM modulation depth): ~1 when phase-locked, ~0 when the loop
-        // is slipping.  Averaging raw Ir instead sagged below threshold on deeply
-        // modulated carriers, so lock was never indicated even when locked.
-        float phasor = sqrtf(Ir * Ir + Qr * Qr) + 1e-6f;
-        float cos_e  = Ir / phasor;
-        lock_ema += 0.002f * (cos_e - lock_ema);
-        if (lock_ema >= 0.85f) locked = true;
-        else if (lock_ema <= 0.60f) locked = false;
-
-        // Demodulate the FULL signal (carrier+sidebands) with the carrier-locked
-        // phase.  Reusing the same c,s as the phase detector makes the output the
-        // in-phase component of the raw baseband — identical amplitude to the
-        // previous full-signal detector, so AM loudness / AGC calibration is
-        // unchanged; only the lock is more robust.
-        float sigIr = Isig * c + Qsig * s;
-        return dcblock_mono(sigIr);
-    }
-
-    // C-QUAM stereo decoder with separate DC blockers
-    void step_cquam(float I, float Q, float &outL, float &outR) {
-        // Track signal magnitude for normalization
-        float mag = sqrtf(I * I + Q * Q);
-        if (mag > 0.0001f) {
-            mag_avg = mag_avg * (1.0f - mag_alpha) + mag * mag_alpha;
-        }
-
-        // Normalize inputs
-        float invmag = (mag_avg > 0.0001f) ? 1.0f / mag_avg : 1.0f;
-        float In = I * invmag;
-        float Qn = Q * invmag;
-
-        // Rotate into PLL tracking frame
-        float c = cosf((float)theta);
-        float s = sinf((float)theta);
-        float Ir =  In * c + Qn * s;
-        float Qr = -In * s + Qn * c;
-
-        // Phase detector: atan2 for robust lock
-        float e = atan2f(Qr, Ir);
-
-        // PI loop filter with anti-windup
-        acc += ki * e;
-        // Clamp integrator to prevent wind-up and sudden phase jumps (stuttering)
-        const double max_acc = M_PI / 4.0;
-        if (acc >  max_acc) acc =  max_acc;
-        if (acc < -max_acc) acc = -max_acc;
-        double u = kp * e + acc;
-
-        // Advance NCO and wrap phase
-        theta += dtheta + u;
-        if (theta >  M_PI) theta -= 2.0 * M_PI;
-        if (theta <= -M_PI) theta += 2.0 * M_PI;
-
-        // In C-QUAM, Ir ~ (L+R), Qr ~ (L-R) after proper normalization.
-        float sum  = Ir * mag_avg;
-        float diff = -Qr * mag_avg; // INVERTED: Fixes rapid gain changes / pumping effect.
-                                    // The quadrature demodulator output (L-R) had opposite
-                                    // polarity, causing L and R to fight each other → volume
-                                    // fluctuations. Inverting restores correct phase relationship.
-
-        float L = 0.5f * (sum + diff);
-        float R = 0.5f * (sum - diff);
-
-        // Use separate DC blockers for each channel
-        outL = dcblock_L(L);
-        outR = dcblock_R(R);
-    }
-
-    void reset() {
-        theta = 0.0;
-        acc = 0.0;
-        xm1_L = xm1_R = xm1_mono = 0.0f;
-        ym1_L = ym1_R = ym1_mono = 0.0f;
-        mag_avg = 1.0f;
-        lock_ema = 0.0f;
-        locked = false;
-    }
-};
-
-// Keep a per-AudioClient SAM_PLL instance without editing headers
-static std::unordered_map<const void*, std::shared_ptr<SAM_PLL>> g_sam_by_client;
-static std::mutex g_sam_mutex; // Thread-safe access to prevent crashes on rapid mode switching
-
-// Helper to get/create SAM for a client pointer.
-// Returns a shared_ptr so the PLL object survives concurrent cleanup_sam()
-// calls — the caller holds a live reference even if the map entry is erased.
-static std::shared_ptr<SAM_PLL> get_sam(const void* key, double fs) {
-    std::lock_guard<std::mutex> lock(g_sam_mutex);
-    auto it = g_sam_by_client.find(key);
-    if (it == g_sam_by_client.end()) {
-        auto sam = std::make_shared<SAM_PLL>();
-        sam->setup(fs, 50.0);
-        auto it2 = g_sam_by_client.emplace(key, sam);
-        return it2.first->second;
-    }
-    // Refresh fs if changed (resets PLL state — acceptable, sample rate changes are rare)
-    if (fabs(it->second->fs - fs) > 1.0) {
-        it->second->setup(fs, 50.0);
-    }
-    return it->second;
-}
-
-// Cleanup SAM instance for a client
-static void cleanup_sam(const void* key) {
-    std::lock_guard<std::mutex> lock(g_sam_mutex);
-    g_sam_by_client.erase(key);
-}
-
-} // namespace
 
 // --- Aggressive time-domain impulse blanker on complex baseband ---
 static void apply_impulse_blanker_complex(std::complex<float>* buf,
@@ -306,39 +69,12 @@ static void apply_impulse_blanker_complex(std::complex<float>* buf,
     }
 }
 
-// ============================================================================
-// GEO-LOCATION LOOKUP — async, one call per user connection
-// Uses ip-api.com (free, no key, 45 req/min).  Private IPs are short-circuited
-// locally and never sent to any external service.
-// ============================================================================
 namespace {
 
-static size_t geo_write_cb(char *ptr, size_t size, size_t nmemb, void *ud) {
-    static_cast<std::string *>(ud)->append(ptr, size * nmemb);
-    return size * nmemb;
-}
-
-// Convert ISO 3166-1 alpha-2 code → flag emoji (UTF-8).
-// Each regional-indicator letter is U+1F1E6..U+1F1FF.
-static std::string country_flag(const std::string &cc) {
-    if (cc.size() != 2) return "";
-    auto encode4 = [](uint32_t cp) -> std::string {
-        std::string s;
-        s += char(0xF0 | (cp >> 18));
-        s += char(0x80 | ((cp >> 12) & 0x3F));
-        s += char(0x80 | ((cp >> 6)  & 0x3F));
-        s += char(0x80 | ( cp        & 0x3F));
-        return s;
-    };
-    return encode4(0x1F1E6u + uint32_t(std::toupper((unsigned char)cc[0]) - 'A'))
-         + encode4(0x1F1E6u + uint32_t(std::toupper((unsigned char)cc[1]) - 'A'));
-}
-
-// Returns true if the IP is RFC-1918 / loopback / link-local — skip API call.
 // Returns only the IP address from a websocketpp remote_endpoint string.
 // websocketpp::get_remote_endpoint() returns "1.2.3.4:56789" for IPv4
 // and "[::1]:56789" for IPv6 — the port must be stripped before passing
-// the address to ip-api.com or any prefix-based private-IP check.
+// the address to the geo resolver or any prefix-based private-IP check.
 static std::string strip_port(const std::string &endpoint) {
     if (endpoint.empty()) return endpoint;
     // IPv6 bracketed form: [2001:db8::1]:12345
@@ -359,66 +95,6 @@ static std::string strip_port(const std::string &endpoint) {
     return all_digits ? endpoint.substr(0, colon) : endpoint;
 }
 
-static bool is_private_ip(const std::string &ip) {
-    if (ip.empty() || ip == "127.0.0.1" || ip == "::1") return true;
-    // IPv4 private ranges: 10.x, 172.16-31.x, 192.168.x
-    if (ip.rfind("10.",      0) == 0) return true;
-    if (ip.rfind("192.168.", 0) == 0) return true;
-    if (ip.rfind("169.254.", 0) == 0) return true;
-    if (ip.rfind("172.",     0) == 0) {
-        const auto dot2 = ip.find('.', 4);
-        if (dot2 != std::string::npos) {
-            try {
-                int second = std::stoi(ip.substr(4, dot2 - 4));
-                if (second >= 16 && second <= 31) return true;
-            } catch (...) {
-                // Malformed octet — not a valid private range, continue
-            }
-        }
-    }
-    return false;
-}
-
-// Blocking geo lookup — always called from a detached background thread.
-static std::string lookup_geo(const std::string &ip) {
-    if (is_private_ip(ip)) return "Local";
-
-    CURL *curl = curl_easy_init();
-    if (!curl) return "";
-
-    std::string response;
-    const std::string url =
-        "http://ip-api.com/json/" + ip +
-        "?fields=status,city,country,countryCode";
-
-    curl_easy_setopt(curl, CURLOPT_URL,            url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,  geo_write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA,      &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT,        5L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3L);
-    curl_easy_setopt(curl, CURLOPT_NOSIGNAL,       1L);
-
-    const CURLcode rc = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if (rc != CURLE_OK || response.empty()) return "";
-
-    try {
-        auto j = nlohmann::json::parse(response);
-        if (j.value("status", "") != "success") return "";
-
-        const std::string city = j.value("city",        "");
-        const std::string cc   = j.value("countryCode", "");
-        const std::string flag = country_flag(cc);
-
-        if (city.empty())
-            return flag + " " + j.value("country", cc);
-        return flag + " " + city + ", " + cc;
-    } catch (...) {
-        return "";
-    }
-}
-
 } // namespace
 
 // monitor_audio_thread_running is declared extern in signal.h;
@@ -461,12 +137,14 @@ AudioClient::AudioClient(connection_hdl hdl,
       audio_fft_size(audio_fft_size),
       fft_result_size(fft_result_size),
       audio_rate(audio_max_sps),
+      agc(0.1f, 100.0f, 30.0f, 100.0f, audio_max_sps),
+      noise_reduction(audio_max_sps),
       signal_slices(sender.get_signal_slices()),
-      signal_slice_mtx(sender.get_signal_slice_mtx()),
-      agc(0.1f, 100.0f, 30.0f, 100.0f, audio_max_sps) {
+      signal_slice_mtx(sender.get_signal_slice_mtx()) {
 
     base_audio_compression = audio_compression;
     this->encoder = make_audio_encoder(audio_compression, 1);
+    encoder_codec = encoder->get_codec();
 
 
     unique_id = generate_unique_id();
@@ -497,6 +175,7 @@ AudioClient::AudioClient(connection_hdl hdl,
     dc = DCBlocker<float>(audio_max_sps / 750 * 2);
     ma = MovingAverage<float>(10);
     mm = MovingMode<int>(10);
+    sam_pll.setup(audio_rate, 50.0);
 
     // Initialize noise gate with default preset (disabled by default)
     noise_gate.set_preset("balanced");
@@ -510,20 +189,23 @@ AudioClient::AudioClient(connection_hdl hdl,
     nco_crcf_pll_set_bandwidth(mixer, 0.001f);
 #endif
 
+    // IFFT plans come from the shared cache: every client has the same
+    // audio_fft_size, so only the first connect (or the warm-up in fft_task)
+    // pays for FFTW_MEASURE.  They run on this client's buffers through the
+    // new-array execute functions in send_audio().
     {
-        std::scoped_lock lg(fftwf_planner_mutex);
-        fftwf_plan_with_nthreads(1);
-        p_complex = fftwf_plan_dft_1d(
-            audio_fft_size, (fftwf_complex *)audio_fft_input.get(),
-            (fftwf_complex *)audio_complex_baseband.get(), FFTW_BACKWARD,
-            FFTW_MEASURE);
-        p_complex_carrier = fftwf_plan_dft_1d(
-            audio_fft_size, (fftwf_complex *)audio_fft_input.get(),
-            (fftwf_complex *)audio_complex_baseband_carrier.get(),
-            FFTW_BACKWARD, FFTW_MEASURE);
-        p_real = fftwf_plan_dft_c2r_1d(audio_fft_size,
-                                       (fftwf_complex *)audio_fft_input.get(),
-                                       audio_real.data(), FFTW_MEASURE);
+        auto &plans = FFTPlanCache::instance();
+        p_complex = plans.get_c2c(
+            audio_fft_size, FFTW_BACKWARD,
+            (fftwf_complex *)audio_fft_input.get(),
+            (fftwf_complex *)audio_complex_baseband.get());
+        p_complex_carrier = plans.get_c2c(
+            audio_fft_size, FFTW_BACKWARD,
+            (fftwf_complex *)audio_fft_input.get(),
+            (fftwf_complex *)audio_complex_baseband_carrier.get());
+        p_real = plans.get_c2r(audio_fft_size,
+                               (fftwf_complex *)audio_fft_input.get(),
+                               audio_real.data());
     }
 
     // C-QUAM AM stereo initialization
@@ -536,27 +218,24 @@ AudioClient::AudioClient(connection_hdl hdl,
     ip_address   = strip_port(sender.ip_from_hdl(hdl));
     connected_at = std::chrono::steady_clock::now();
 
-    // Geo lookup — run in background so constructor returns immediately.
+    // Geo lookup — GeoResolver answers from its cache or database at once,
+    // or later from its own threads, so the constructor returns immediately.
     //
     // FIX (weak_from_this in constructor): enable_shared_from_this only
     // registers the internal weak reference AFTER the constructor returns,
     // so weak_from_this() called here always yields an empty weak_ptr and
     // weak.lock() always returns null — geo_location was never being written.
     //
-    // Safe fix: capture shared_ptr copies of the two members that the thread
-    // needs to write.  These shared_ptrs are independent of the AudioClient
-    // lifetime so the write is safe even if the client disconnects before
-    // the HTTP lookup completes (typically 1–3 s).
-    {
-        std::string ip_copy = ip_address;
-        auto geo_loc_ptr   = geo_location_ptr;
-        auto geo_mtx_ptr   = geo_mutex_ptr;
-        std::thread([geo_loc_ptr, geo_mtx_ptr, ip_copy]() {
-            std::string result = lookup_geo(ip_copy);
+    // Safe fix: capture shared_ptr copies of the two members that the
+    // callback needs to write.  These shared_ptrs are independent of the
+    // AudioClient lifetime so the write is safe even if the client
+    // disconnects before an online lookup completes (typically 1–3 s).
+    GeoResolver::instance().resolve(
+        ip_address, [geo_loc_ptr = geo_location_ptr,
+                     geo_mtx_ptr = geo_mutex_ptr](const std::string &result) {
             std::lock_guard<std::mutex> lk(*geo_mtx_ptr);
             *geo_loc_ptr = result;
-        }).detach();
-    }
+        });
 }
 
 const char *AudioClient::get_mode_str() const {
@@ -586,9 +265,12 @@ void AudioClient::set_audio_range(int l, double m, int r) {
     // exactly one of set_audio_range / on_close touches the tree.
     if (closed.load()) return;
 
-    audio_mid = m;
-    this->l = l;
-    this->r = r;
+    {
+        std::scoped_lock lk(dsp_mtx_);
+        audio_mid = m;
+        this->l = l;
+        this->r = r;
+    }
 
     // Change the data structures to reflect the changes
     {
@@ -652,6 +334,7 @@ void AudioClient::on_set_codec_message(std::string &codec) {
         encoder->finish_encoder();
     }
     encoder = make_audio_encoder(AUDIO_PCM, 1);
+    encoder_codec = encoder->get_codec();
 }
 
 void AudioClient::set_am_stereo(bool enable) {
@@ -660,9 +343,12 @@ void AudioClient::set_am_stereo(bool enable) {
         am_stereo = enable;
         return;
     }
-    // If switching away from stereo, cleanup SAM PLL state
+    // If switching away from stereo, start the SAM PLL over from scratch
+    // (mono DC blocker coefficient included)
     if (!enable && am_stereo) {
-        cleanup_sam(this);
+        std::scoped_lock lk(sam_mtx_);
+        sam_pll = SAM_PLL();
+        sam_pll.setup(audio_rate, 50.0);
     }
 
     am_stereo = enable;
@@ -680,9 +366,9 @@ void AudioClient::set_am_stereo(bool enable) {
 
     // Only create/reset the SAM PLL when enabling stereo.
     if (enable) {
-        auto sam = get_sam(this, audio_rate);
-        sam->set_stereo_mode(true);
-        sam->reset(); // clears theta, acc, and internal DC blocker state
+        std::scoped_lock lk(sam_mtx_);
+        sam_pll.set_stereo_mode(true);
+        sam_pll.reset(); // clears the NCO, integrator and DC blocker state
     }
 
     // Recreate encoder with the correct channel count AND codec.
@@ -713,15 +399,93 @@ void AudioClient::set_am_stereo(bool enable) {
             const audio_compressor codec = base_audio_compression;
 #endif
             encoder = make_audio_encoder(codec, channels);
+            encoder_codec = encoder->get_codec();
         }
     }
 }
 
 const std::string &AudioClient::get_unique_id() { return unique_id; }
 
+std::optional<DemodChannelKey> AudioClient::channel_key() {
+    if (type == SIGNAL || codec_pinned_pcm.load(std::memory_order_relaxed)) {
+        return std::nullopt;
+    }
+    DemodChannelKey key;
+    {
+        std::scoped_lock lk(dsp_mtx_);
+        key.l          = l;
+        key.r          = r;
+        key.mid        = audio_mid;
+        key.noise_gate = noise_gate.settings();
+    }
+    key.noise_reduction = nr_stages.load(std::memory_order_relaxed);
+    key.codec        = encoder_codec.load(std::memory_order_relaxed);
+    key.demod        = demodulation.load(std::memory_order_relaxed);
+    key.stereo       = am_stereo.load(std::memory_order_relaxed);
+    key.sam          = sam_enabled.load(std::memory_order_relaxed);
+    key.agc          = agc_enabled.load(std::memory_order_relaxed);
+    key.wire_version = wire_version.load(std::memory_order_relaxed);
+    return key;
+}
+
+bool AudioClient::try_adopt_dsp_state(AudioClient &from,
+                                      bool with_processing) {
+    if (&from == this) return true;
+    // Called on the FFT thread, which must never wait out another client's
+    // demodulation and encoding
+    if (std::try_lock(frame_mtx_, from.frame_mtx_) != -1) return false;
+    std::scoped_lock frame_lk(std::adopt_lock, frame_mtx_, from.frame_mtx_);
+
+    // Overlap-add carry.  Every client has the same audio_fft_size.
+    const size_t n = audio_fft_size;
+    std::copy_n(from.audio_complex_baseband.get(), n,
+                audio_complex_baseband.get());
+    std::copy_n(from.audio_complex_baseband_prev.get(), n,
+                audio_complex_baseband_prev.get());
+    std::copy_n(from.audio_complex_baseband_carrier.get(), n,
+                audio_complex_baseband_carrier.get());
+    std::copy_n(from.audio_complex_baseband_carrier_prev.get(), n,
+                audio_complex_baseband_carrier_prev.get());
+    std::copy(from.audio_real.begin(), from.audio_real.end(),
+              audio_real.begin());
+    std::copy(from.audio_real_prev.begin(), from.audio_real_prev.end(),
+              audio_real_prev.begin());
+    dc = from.dc;
+    ma = from.ma;
+    mm = from.mm;
+
+    // The rest is only meaningful for the same mode and settings; after a
+    // mode change this client's own handlers have already reset it.
+    if (!with_processing) return true;
+    {
+        std::scoped_lock lk(agc_mtx_, from.agc_mtx_);
+        agc.copy_state_from(from.agc);
+    }
+    {
+        std::scoped_lock lk(dsp_mtx_, from.dsp_mtx_);
+        noise_gate = from.noise_gate;
+    }
+    {
+        std::scoped_lock lk(nr_mtx_, from.nr_mtx_);
+        noise_reduction.copy_state_from(from.noise_reduction);
+    }
+    {
+        std::scoped_lock lk(sam_mtx_, from.sam_mtx_);
+        sam_pll = from.sam_pll;
+    }
+    sam_locked.store(from.sam_locked.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    return true;
+}
+
 // Does the demodulation and sends the audio to the client.
 // buf is given offset by l.
-void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
+void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num,
+                             const std::vector<connection_hdl> &subscribers,
+                             bool to_self) {
+    std::scoped_lock frame_lk(frame_mtx_);
+    // Stopped where encoding starts, see the encoder blocks below
+    StageTimer demod_timer(Stage::DEMOD);
     try {
         // FIX (data race / consistency): load the two atomic mode flags once
         // so every branch within this frame sees the same values.  Without a
@@ -736,17 +500,33 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
         // SAM lock indicator defaults off; only the mono-SAM branch sets it.
         sam_locked.store(false, std::memory_order_relaxed);
 
+        // Snapshot the window: set_audio_range() may update it from the I/O
+        // thread while this frame is being demodulated on a DSP worker.
+        int cur_l, cur_r;
+        double cur_mid;
+        {
+            std::scoped_lock lk(dsp_mtx_);
+            cur_l   = l;
+            cur_r   = r;
+            cur_mid = audio_mid;
+        }
+
         // buf is pre-offset by l, so all local indices are relative to l.
         const int audio_l = 0;          // start of buf in relative coords (= l - l)
-        const int audio_r = r - l;
-        const int audio_m = floor(audio_mid) - l;
-        const int audio_m_idx = floor(audio_mid);
+        const int audio_r = cur_r - cur_l;
+        const int audio_m = floor(cur_mid) - cur_l;
+        const int audio_m_idx = floor(cur_mid);
 
         int len = audio_r - audio_l;
         // If the user requested the raw IQ signal, do not demodulate
         if (type == SIGNAL) {
             sender.send_binary_packet(hdl, buf,
                                       sizeof(std::complex<float>) * len);
+            auto &m = metrics();
+            m.payload_bytes[static_cast<int>(ConnKind::SIGNAL)].fetch_add(
+                sizeof(std::complex<float>) * len, std::memory_order_relaxed);
+            m.frames_sent[static_cast<int>(ConnKind::SIGNAL)].fetch_add(
+                1, std::memory_order_relaxed);
             return;
         }
 
@@ -769,7 +549,9 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
                     std::copy(buf + copy_l - audio_l, buf + copy_r - audio_l,
                             audio_fft_input.get() + copy_l - audio_m);
                 }
-                fftwf_execute(p_real);
+                fftwf_execute_dft_c2r(p_real,
+                                      (fftwf_complex *)audio_fft_input.get(),
+                                      audio_real.data());
             } else if (demod == LSB) {
                 // For LSB, just copy the inverted bins to the audio frequencies
                 std::fill(audio_fft_input.get(),
@@ -785,7 +567,9 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
                                     buf + copy_r - audio_l,
                                     audio_fft_input.get() + audio_m - copy_r + 1);
                 }
-                fftwf_execute(p_real);
+                fftwf_execute_dft_c2r(p_real,
+                                      (fftwf_complex *)audio_fft_input.get(),
+                                      audio_real.data());
                 std::reverse(audio_real.begin(), audio_real.end());
             }
             // On every other frame, the audio waveform is inverted due to the
@@ -845,7 +629,9 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
             }
 
             // Copy the bins to the complex baseband frequencies
-            fftwf_execute(p_complex);
+            fftwf_execute_dft(p_complex,
+                              (fftwf_complex *)audio_fft_input.get(),
+                              (fftwf_complex *)audio_complex_baseband.get());
 
             if (demod == AM) {
                 // Keep only the low frequencies < 500Hz for carrier estimation
@@ -853,7 +639,9 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
                 std::fill(audio_fft_input.get() + cutoff,
                           audio_fft_input.get() + audio_fft_size - cutoff,
                           0.0f);
-                fftwf_execute(p_complex_carrier);
+                fftwf_execute_dft(
+                    p_complex_carrier, (fftwf_complex *)audio_fft_input.get(),
+                    (fftwf_complex *)audio_complex_baseband_carrier.get());
             }
 
             if (frame_num % 2 == 1 && ((audio_m_idx % 2 == 0 && !is_real) ||
@@ -890,42 +678,28 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
                 // Narrow loop for mono SAM (cleaner lock, less phase noise);
                 // keep the wider loop for C-QUAM so its strong pilot/carrier
                 // acquires fast.  set_loop_bw() does not disturb lock state.
-                auto sam = get_sam(this, audio_rate);
-                sam->set_loop_bw(stereo ? 50.0 : 20.0);
+                std::scoped_lock sam_lk(sam_mtx_);
+                sam_pll.set_loop_bw(stereo ? 50.0 : 20.0);
                 if (stereo) {
-                    // C-QUAM: decode true stereo (L/R)
-                    for (int i = 0; i < audio_fft_size / 2; i++) {
-                        float L, R;
-                        sam->step_cquam(
-                            audio_complex_baseband[i].real(),
-                            audio_complex_baseband[i].imag(),
-                            L, R
-                        );
-                        audio_real[i]      = L;
-                        audio_real_prev[i] = R; // Right (temporary buffer in stereo mode)
-                    }
+                    // C-QUAM: decode true stereo (L/R).  Right goes to
+                    // audio_real_prev as a temporary buffer in stereo mode.
+                    sam_pll.process_cquam(audio_complex_baseband.get(),
+                                          audio_real.data(),
+                                          audio_real_prev.data(),
+                                          audio_fft_size / 2);
                 } else if (sam_enabled.load(std::memory_order_relaxed)) {
                     // Standard mono SAM: lock the PLL on the reconstructed
                     // carrier (<500 Hz), demodulate the full baseband with it.
-                    for (int i = 0; i < audio_fft_size / 2; i++) {
-                        audio_real[i] = sam->step(
-                            audio_complex_baseband_carrier[i].real(),
-                            audio_complex_baseband_carrier[i].imag(),
-                            audio_complex_baseband[i].real(),
-                            audio_complex_baseband[i].imag()
-                        );
-                    }
+                    sam_pll.process(audio_complex_baseband_carrier.get(),
+                                    audio_complex_baseband.get(),
+                                    audio_real.data(), audio_fft_size / 2);
                     // Publish PLL lock state for the AM-button "SAM" indicator.
-                    sam_locked.store(sam->locked, std::memory_order_relaxed);
+                    sam_locked.store(sam_pll.is_locked(), std::memory_order_relaxed);
                 } else {
-                    // Classic envelope (non-synchronous) AM: magnitude of the
-                    // complex baseband, DC-blocked to strip the carrier term.
-                    // No PLL, so sam_locked stays false (button reads "AM").
-                    for (int i = 0; i < audio_fft_size / 2; i++) {
-                        const float I = audio_complex_baseband[i].real();
-                        const float Q = audio_complex_baseband[i].imag();
-                        audio_real[i] = sam->dcblock_mono(sqrtf(I * I + Q * Q));
-                    }
+                    // Classic envelope (non-synchronous) AM.  No PLL, so
+                    // sam_locked stays false (button reads "AM").
+                    sam_pll.envelope(audio_complex_baseband.get(),
+                                     audio_real.data(), audio_fft_size / 2);
                 }
             } else if (demod == FM) {
                 // Polar discriminator for FM
@@ -947,8 +721,11 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
             std::copy(audio_real_prev.begin(), audio_real_prev.begin() + audio_fft_size / 2, cquam_R.begin());
 
             // Optional backend noise gate per channel
-            noise_gate.process(cquam_L.data(), audio_fft_size / 2);
-            noise_gate.process(cquam_R.data(), audio_fft_size / 2);
+            {
+                std::scoped_lock lk(dsp_mtx_);
+                noise_gate.process(cquam_L.data(), audio_fft_size / 2);
+                noise_gate.process(cquam_R.data(), audio_fft_size / 2);
+            }
 
             // Stereo-safe AGC: shared gain for both channels to preserve stereo image
             if (agc_on) {
@@ -997,12 +774,18 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
             // Set audio details with stereo channel count
             // Send interleaved stereo audio.
             // size argument is samples-per-channel, not total interleaved samples.
+            demod_timer.stop();
             {
+                StageTimer encode_timer(Stage::AUDIO_ENCODE);
                 std::scoped_lock lk(encoder_mtx_);
-                encoder->set_data(frame_num, audio_l, audio_mid, audio_r,
+                encoder->set_wire_version(
+                    wire_version.load(std::memory_order_relaxed));
+                encoder->set_data(frame_num, audio_l, cur_mid, audio_r,
                                   average_power, out_channels,
                                   sam_locked.load(std::memory_order_relaxed));
+                encoder->set_recipients(&subscribers, to_self);
                 encoder->process(audio_real_int16.data(), audio_fft_size / 2);
+                encoder->set_recipients(nullptr, true);
             }
             } else {
             // ===== MONO PROCESSING (USB, LSB, AM mono, FM, etc.) =====
@@ -1029,8 +812,17 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
             // DC removal
             dc.removeDC(audio_real.data(), audio_fft_size / 2);
 
+            // Server-side noise reduction, if the client asked for it
+            if (nr_stages.load(std::memory_order_relaxed)) {
+                std::scoped_lock lk(nr_mtx_);
+                noise_reduction.process(audio_real.data(), audio_fft_size / 2);
+            }
+
             // NOISE GATE - Apply before AGC to work on full dynamic range
-            noise_gate.process(audio_real.data(), audio_fft_size / 2);
+            {
+                std::scoped_lock lk(dsp_mtx_);
+                noise_gate.process(audio_real.data(), audio_fft_size / 2);
+            }
 
             // AGC (conditional — can be disabled)
             if (agc_on) {
@@ -1047,12 +839,18 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
 
             // Set audio details with mono channel count
             // Encode audio and send it off
+            demod_timer.stop();
             {
+                StageTimer encode_timer(Stage::AUDIO_ENCODE);
                 std::scoped_lock lk(encoder_mtx_);
-                encoder->set_data(frame_num, audio_l, audio_mid, audio_r,
+                encoder->set_wire_version(
+                    wire_version.load(std::memory_order_relaxed));
+                encoder->set_data(frame_num, audio_l, cur_mid, audio_r,
                                 average_power, out_channels,
                                 sam_locked.load(std::memory_order_relaxed));
+                encoder->set_recipients(&subscribers, to_self);
                 encoder->process(audio_real_int16.data(), audio_fft_size / 2);
+                encoder->set_recipients(nullptr, true);
             }
         }
 
@@ -1062,13 +860,22 @@ void AudioClient::send_audio(std::complex<float> *buf, size_t frame_num) {
         // Convert bytes to bits and add to the total_bits_sent
         size_t bits_sent = static_cast<size_t>(audio_fft_size / 2)
                          * static_cast<size_t>(out_channels)
-                         * 16; // frames * channels * 16 bits
+                         * 16  // frames * channels * 16 bits
+                         * (subscribers.size() + (to_self ? 1 : 0));
         total_audio_bits_sent.fetch_add(bits_sent, std::memory_order_relaxed);
+        auto &m = metrics();
+        m.payload_bytes[static_cast<int>(ConnKind::AUDIO)].fetch_add(
+            bits_sent / 8, std::memory_order_relaxed);
+        m.frames_sent[static_cast<int>(ConnKind::AUDIO)].fetch_add(
+            subscribers.size() + (to_self ? 1 : 0), std::memory_order_relaxed);
 
         // Increment the frame number
         frame_num++;
     } catch (const std::exception &exc) {
         // std::cout << "client disconnect" << std::endl;
+        // Never leave the encoder pointing at this call's subscriber list.
+        std::scoped_lock lk(encoder_mtx_);
+        if (encoder) encoder->set_recipients(nullptr, true);
     }
 }
 
@@ -1150,12 +957,15 @@ void AudioClient::on_demodulation_message(std::string &demodulation) {
 
     // Reset SAM PLL when switching to AM mode
     if (this->demodulation == AM) {
-        auto sam = get_sam(this, audio_rate);
-        sam->reset();
+        std::scoped_lock lk(sam_mtx_);
+        sam_pll.reset();
     }
 
     // Reset noise gate when changing modes
-    this->noise_gate.reset();
+    {
+        std::scoped_lock lk(dsp_mtx_);
+        this->noise_gate.reset();
+    }
 }
 
 // ============================================================================
@@ -1163,10 +973,12 @@ void AudioClient::on_demodulation_message(std::string &demodulation) {
 // ============================================================================
 
 void AudioClient::on_noise_gate_enable_message(bool enabled) {
+    std::scoped_lock lk(dsp_mtx_);
     noise_gate.set_enabled(enabled);
 }
 
 void AudioClient::on_noise_gate_preset_message(std::string &preset) {
+    std::scoped_lock lk(dsp_mtx_);
     noise_gate.set_preset(preset);
 }
 
@@ -1174,6 +986,24 @@ void AudioClient::on_agc_enable_message(bool enabled) {
     agc_enabled = enabled;
 }
 
+void AudioClient::on_noise_reduction_message(bool blanker, bool spectral,
+                                             std::string &lms) {
+    uint8_t stages = 0;
+    if (blanker) stages |= NR_BLANKER;
+    if (spectral) stages |= NR_SPECTRAL;
+    if (lms == "nr") stages |= NR_LMS;
+    else if (lms == "notch") stages |= NR_NOTCH;
+
+    std::scoped_lock lk(nr_mtx_);
+    noise_reduction.configure(stages);
+    nr_stages.store(noise_reduction.get_stages(), std::memory_order_relaxed);
+}
+
+void AudioClient::release_noise_reduction() {
+    std::scoped_lock lk(nr_mtx_);
+    noise_reduction.release();
+}
+
 void AudioClient::on_codec_caps_message(bool opus_supported) {
     // Remember whether the browser can decode Opus.  If C-QUAM is already
     // active when this arrives, re-run the codec selection so a no-Opus client
@@ -1202,23 +1032,11 @@ void AudioClient::on_close() {
         std::scoped_lock lk(signal_slice_mtx);
         signal_slices.erase(it);
     }
-
-    // Guard cleanup_sam so the destructor doesn't erase an already-absent key.
-    if (!sam_cleaned.exchange(true)) {
-        cleanup_sam(this);
-    }
 }
 
 AudioClient::~AudioClient() {
-    fftwf_destroy_plan(p_real);
-    fftwf_destroy_plan(p_complex_carrier);
-    fftwf_destroy_plan(p_complex);
+    // p_complex / p_complex_carrier / p_real belong to FFTPlanCache
 #ifdef HAS_LIQUID
     nco_crcf_destroy(mixer);
 #endif
-
-    // Only cleanup if on_close() wasn't already called (e.g. abnormal disconnect)
-    if (!sam_cleaned.exchange(true)) {
-        cleanup_sam(this);
-    }
 }
\ No newline at end of file
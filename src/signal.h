@@ -5,6 +5,8 @@
 #include "client.h"
 #include "utils.h"
 #include "utils/audioprocessing.h"
+#include "utils/noisereduction.h"
+#include "utils/sam.h"
 
 #include <atomic>
 #include <chrono>
@@ -13,7 +15,9 @@
 #include <cstring>   // memset
 #include <limits>    // std::numeric_limits
 #include <memory>    // std::unique_ptr
+#include <optional>
 #include <string>
+#include <vector>
 
 #include <boost/align/aligned_allocator.hpp>
 
@@ -116,6 +120,17 @@ public:
 
     bool is_enabled() const { return enabled; }
 
+    // Everything that shapes the gate's output, for comparing two gates
+    struct Settings {
+        bool  enabled;
+        float open_factor, close_factor, floor_gain, alpha_env, alpha_noise;
+        bool operator==(const Settings &) const = default;
+    };
+    Settings settings() const {
+        return {enabled, open_factor, close_factor, floor_gain, alpha_env,
+                alpha_noise};
+    }
+
     void set_preset(const std::string& preset) {
         if (preset == "aggressive") {
             alpha_env    = 0.0025f;   // Slower envelope for smoother response
@@ -200,6 +215,35 @@ public:
 };
 // ============================================================================
 
+// Everything that decides the packets a listener receives.  Listeners with
+// equal keys would demodulate the same bins the same way and encode the result
+// with the same codec and framing, so dispatch_audio_frame() lets one of them
+// do it for all of them and fans the encoded packets out (shared
+// demodulation).
+struct DemodChannelKey {
+    int l = 0;
+    int r = 0;
+    double mid = 0;
+    demodulation_mode demod = USB;
+    bool stereo = false;
+    bool sam = false;
+    bool agc = false;
+    NoiseGate::Settings noise_gate{};
+    uint8_t noise_reduction = 0;   // NoiseReductionStage bits
+    wire_codec codec = WIRE_CODEC_FLAC;
+    uint8_t wire_version = 0;
+
+    bool operator==(const DemodChannelKey &) const = default;
+
+    // Same processing chain, wherever it is tuned: the AGC, noise gate,
+    // noise reduction and SAM state of one listener are valid for the other.
+    bool same_processing(const DemodChannelKey &o) const {
+        return demod == o.demod && stereo == o.stereo && sam == o.sam &&
+               agc == o.agc && noise_gate == o.noise_gate &&
+               noise_reduction == o.noise_reduction;
+    }
+};
+
 class AudioClient : public Client,
                     public std::enable_shared_from_this<AudioClient> {
     // NOTE: if Client already inherits from enable_shared_from_this somewhere
@@ -236,6 +280,13 @@ class AudioClient : public Client,
     // AGC control methods
     void on_agc_enable_message(bool enabled);
 
+    // Server-side noise reduction (see NoiseReductionChain)
+    void on_noise_reduction_message(bool blanker, bool spectral,
+                                    std::string &lms) override;
+    // Gives up the noise reduction slot while this client follows a
+    // channel leader; its chain does not run then.
+    void release_noise_reduction();
+
     // Codec capability: false means this client cannot decode Opus, so C-QUAM
     // stays on FLAC for it (see set_am_stereo).
     void on_codec_caps_message(bool opus_supported) override;
@@ -243,9 +294,40 @@ class AudioClient : public Client,
     // Switch this client to raw PCM at runtime (autorun loopback client).
     void on_set_codec_message(std::string &codec) override;
 
-    void send_audio(std::complex<float> *buf, size_t frame_num);
+    // subscribers also receive every packet of this frame (shared
+    // demodulation); to_self = false demodulates without sending to this
+    // client, which keeps the channel going while it is throttled.
+    void send_audio(std::complex<float> *buf, size_t frame_num,
+                    const std::vector<connection_hdl> &subscribers = {},
+                    bool to_self = true);
     virtual ~AudioClient();
 
+    // ── Shared demodulation ──────────────────────────────────────────────
+    // The channel this client would share this frame, or nullopt if its
+    // packets are its own (raw IQ, or the PCM-pinned autorun client).
+    std::optional<DemodChannelKey> channel_key();
+
+    // Continue from another client's demodulator state, as if this client
+    // had run every frame that one ran: overlap buffers, DC blocker and, when
+    // with_processing is set, AGC, noise gate and SAM PLL too.  Used when a
+    // listener stops following a channel leader or takes over from it.
+    // Never waits: false, with nothing copied, if either client is in the
+    // middle of a frame.
+    bool try_adopt_dsp_state(AudioClient &from, bool with_processing);
+
+    // Channel membership, FFT thread only (under signal_slice_mtx).  leader
+    // is the client whose packets this one received on the last frame, and
+    // key the channel it was demodulating; leader is null while this client
+    // runs its own demodulator.  handoff_pending is set for the one extra
+    // frame a listener keeps following because the leader's state could not
+    // be taken over yet.
+    struct ChannelMembership {
+        std::shared_ptr<AudioClient> leader;
+        DemodChannelKey key;
+        bool leading = false;
+        bool handoff_pending = false;
+    } channel;
+
     // Returns the demodulation mode as a lowercase string (e.g. "usb", "am").
     const char *get_mode_str() const;
 
@@ -257,10 +339,10 @@ class AudioClient : public Client,
     std::chrono::steady_clock::time_point        connected_at;
 
     // Set to true at the start of on_close(), before signal_slices.erase().
-    // write_users_json() / get_users_json() skip clients where this is true so
+    // get_users_json() and the event counts skip clients where this is true so
     // the user count drops immediately on disconnect — fixing the off-by-one
     // where signal_clients was still N during the broadcast_signal_changes →
-    // write_users_json() window before erase() actually ran.
+    // erase() window.
     std::atomic<bool> disconnecting{false};
 
     // Geo location — filled asynchronously after construction.
@@ -302,7 +384,7 @@ class AudioClient : public Client,
     std::vector<float,   AlignedAllocator<float>>   cquam_L;
     std::vector<float,   AlignedAllocator<float>>   cquam_R;
 
-    // IFFT plans for demodulation
+    // IFFT plans for demodulation, shared through FFTPlanCache (not owned)
     fftwf_plan p_complex;
     fftwf_plan p_complex_carrier;
     fftwf_plan p_real;
@@ -317,6 +399,27 @@ class AudioClient : public Client,
     // Noise gate (backend processing)
     NoiseGate noise_gate;
 
+    // Noise reduction the client asked for, mono audio only.  nr_mtx_ is
+    // held for a whole frame's noise reduction, so the stage bits are
+    // mirrored in nr_stages for channel_key().
+    std::mutex nr_mtx_;
+    NoiseReductionChain noise_reduction;
+    std::atomic<uint8_t> nr_stages{0};
+
+    // Synchronous AM / C-QUAM detector, also the envelope detector's DC
+    // blocker.  sam_mtx_ is held for a whole frame's AM demodulation.
+    std::mutex sam_mtx_;
+    SAM_PLL sam_pll;
+
+    // Held by send_audio() for a whole frame so try_adopt_dsp_state() only
+    // ever sees the carried state between frames.
+    std::mutex frame_mtx_;
+
+    // send_audio() now runs on the DSP worker pool instead of the I/O thread,
+    // so it is no longer implicitly serialised with the message handlers.
+    // Guards l / r / audio_mid and noise_gate between the two.
+    std::mutex dsp_mtx_;
+
     // FIX: In-class initializers prevent UB from uninitialized reads if the
     // constructor body sets these fields late or a code path is ever added that
     // reads them before the constructor assignment.
@@ -343,8 +446,6 @@ class AudioClient : public Client,
     std::chrono::steady_clock::time_point debounce_last_change{
         std::chrono::steady_clock::now()};
 
-    // Guard against double cleanup_sam between on_close() and ~AudioClient()
-    std::atomic<bool> sam_cleaned{false};
     // Guard against on_close() being called by both the close and fail handlers.
     std::atomic<bool> closed{false};
 
@@ -355,6 +456,8 @@ class AudioClient : public Client,
     // Compression codec
     std::mutex encoder_mtx_;              // guards encoder against set_am_stereo races
     std::unique_ptr<AudioEncoder> encoder;
+    // encoder's codec, readable without encoder_mtx_ (channel_key)
+    std::atomic<wire_codec> encoder_codec{WIRE_CODEC_FLAC};
     // The codec configured in the .toml — the client's default when NOT in
     // C-QUAM.  set_am_stereo() overrides to Opus while stereo is active (Opus
     // sounds better on noisy C-QUAM) and restores this default when stereo is
@@ -0,0 +1,172 @@
+#include "spectrumquantize.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "threadteam.h"
+
+namespace {
+
+// Level-0 bins per tile: 16 KiB of powers, small enough to stay in L1
+constexpr size_t kTileBins = 4096;
+
+// Compiler autovectorization
+inline float vec_log2(float val, int power_offset) {
+    uint32_t bit_exponent;
+    memcpy(&bit_exponent, &val, sizeof(bit_exponent));  // avoids strict-aliasing UB
+    float log_val =
+        (float)((int)((bit_exponent >> 23) & 0xFF) - 128) + power_offset;
+    // Set exponent to 0
+    bit_exponent &= ~(255u << 23);
+    bit_exponent += 127u << 23;
+    memcpy(&val, &bit_exponent, sizeof(val));
+    log_val += ((-0.34484843f) * val + 2.02466578f) * val - 0.67487759f;
+    return log_val;
+}
+
+inline int8_t quantize_power(float power, int power_offset) {
+    return static_cast<int8_t>(std::clamp(
+        vec_log2(power, power_offset) * 0.3010299956639812f * 20.f + 127.f,
+        -128.f, 127.f));
+}
+
+void power_and_quantize(float *complexbuf, float *powerbuf,
+                        int8_t *quantizedbuf, float normalize,
+                        size_t outbuf_len, int power_offset) {
+#pragma omp parallel for simd
+    for (size_t i = 0; i < outbuf_len; i++) {
+        complexbuf[i * 2] /= normalize;
+        complexbuf[i * 2 + 1] /= normalize;
+        float re = complexbuf[i * 2];
+        float im = complexbuf[i * 2 + 1];
+        float power = re * re + im * im;
+        powerbuf[i] = power;
+        quantizedbuf[i] = quantize_power(power, power_offset);
+    }
+}
+
+void half_and_quantize(float *powerbuf, float *halfbuf, int8_t *quantizedbuf,
+                       size_t outbuf_len, int power_offset) {
+    powerbuf = (float *)__builtin_assume_aligned(powerbuf, 32);
+    halfbuf = (float *)__builtin_assume_aligned(halfbuf, 32);
+    quantizedbuf = (int8_t *)__builtin_assume_aligned(quantizedbuf, 32);
+#pragma omp parallel for simd
+    for (size_t i = 0; i < outbuf_len; i++) {
+        float power = powerbuf[i * 2] + powerbuf[i * 2 + 1];
+        halfbuf[i] = power;
+        quantizedbuf[i] = quantize_power(power, power_offset);
+    }
+}
+
+// Level 0 for bins [bin, bin + len) of the FFT, landing at row[0..len)
+inline void tile_level0(float *complexbuf, float *powers, int8_t *row,
+                        size_t bin, size_t len, float inv_normalize,
+                        int power_offset) {
+    float *c = complexbuf + bin * 2;
+#pragma omp simd
+    for (size_t i = 0; i < len; i++) {
+        const float re = c[i * 2] * inv_normalize;
+        const float im = c[i * 2 + 1] * inv_normalize;
+        c[i * 2] = re;
+        c[i * 2 + 1] = im;
+        const float power = re * re + im * im;
+        powers[i] = power;
+        row[i] = quantize_power(power, power_offset);
+    }
+}
+
+} // namespace
+
+void quantize_spectrum_passes(const SpectrumQuantizeJob &job,
+                              float *powerbuf) {
+    const size_t n = job.n;
+    const size_t base_idx = job.base_idx;
+    // outbuf is complex so we need to multiply by 2
+    // Also normalize the power by the number of bins
+    power_and_quantize(&job.complexbuf[base_idx * 2], powerbuf, job.quantized,
+                       job.normalize, n - base_idx, job.power_offset);
+    power_and_quantize(job.complexbuf, &powerbuf[n - base_idx],
+                       &job.quantized[n - base_idx], job.normalize, base_idx,
+                       job.power_offset);
+
+    size_t out_len = n;
+    int8_t *quantized_offset_buf = job.quantized;
+    float *power_offset_buf = powerbuf;
+    for (int i = 0; i < job.levels - 1; i++) {
+        half_and_quantize(power_offset_buf, power_offset_buf + out_len,
+                          quantized_offset_buf + out_len, out_len / 2,
+                          job.power_offset - i - 1);
+        power_offset_buf += out_len;
+        quantized_offset_buf += out_len;
+        out_len /= 2;
+    }
+
+    if (job.wrap_bins) {
+        memmove(&job.complexbuf[n * 2], job.complexbuf,
+                sizeof(float) * 2 * job.wrap_bins);
+    }
+}
+
+bool quantize_spectrum_tiled(const SpectrumQuantizeJob &job,
+                             ThreadTeam &team) {
+    const size_t n = job.n;
+    // A tile must halve cleanly through every level
+    const size_t tile = std::min(n, kTileBins);
+    if (job.levels < 1 || n % tile != 0 ||
+        tile % (size_t(1) << (job.levels - 1)) != 0) {
+        return false;
+    }
+    const int tiles = static_cast<int>(n / tile);
+
+    // Start of each level in the quantized buffer
+    size_t level_offset[32];
+    if (job.levels > 32) return false;
+    level_offset[0] = 0;
+    for (int k = 1; k < job.levels; k++) {
+        level_offset[k] = level_offset[k - 1] + (n >> (k - 1));
+    }
+
+    const float inv_normalize = 1.f / job.normalize;
+    team.run(tiles, [&](int t) {
+        alignas(64) float powers[kTileBins];
+        const size_t j0 = static_cast<size_t>(t) * tile;
+
+        // Row index j shows FFT bin (j + base_idx) mod n: at most one wrap
+        // inside a tile
+        size_t bin = j0 + job.base_idx;
+        if (bin >= n) bin -= n;
+        const size_t first = std::min(tile, n - bin);
+        tile_level0(job.complexbuf, powers, job.quantized + j0, bin, first,
+                    inv_normalize, job.power_offset);
+        if (first < tile) {
+            tile_level0(job.complexbuf, powers + first,
+                        job.quantized + j0 + first, 0, tile - first,
+                        inv_normalize, job.power_offset);
+        }
+
+        // Wrap copy for audio slices near 0 Hz, while the bins are hot
+        const auto copy_wrap = [&](size_t b, size_t len) {
+            if (b >= job.wrap_bins) return;
+            len = std::min(len, job.wrap_bins - b);
+            memcpy(&job.complexbuf[(n + b) * 2], &job.complexbuf[b * 2],
+                   sizeof(float) * 2 * len);
+        };
+        copy_wrap(bin, first);
+        if (first < tile) copy_wrap(0, tile - first);
+
+        // Pyramid levels from the tile's own powers, halving in place
+        size_t len = tile;
+        for (int k = 1; k < job.levels; k++) {
+            len /= 2;
+            int8_t *row = job.quantized + level_offset[k] + (j0 >> k);
+            const int offset = job.power_offset - k;
+#pragma omp simd
+            for (size_t i = 0; i < len; i++) {
+                const float power = powers[i * 2] + powers[i * 2 + 1];
+                powers[i] = power;
+                row[i] = quantize_power(power, offset);
+            }
+        }
+    });
+    return true;
+}
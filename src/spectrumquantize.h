@@ -0,0 +1,37 @@
+#ifndef SPECTRUMQUANTIZE_H
+#define SPECTRUMQUANTIZE_H
+
+#include <cstddef>
+#include <cstdint>
+
+class ThreadTeam;
+
+// Post-FFT pass shared by the CPU FFT backends: normalise the spectrum in
+// place, compute the per-bin power, quantise it to the int8 waterfall row and
+// build every downsampled pyramid level (each level sums pairs of the level
+// above).  For IQ input the row starts at base_idx so the lowest frequency
+// comes first, and the first wrap_bins normalised bins are also copied past
+// the end of the spectrum so audio slices near 0 Hz stay contiguous.
+struct SpectrumQuantizeJob {
+    float *complexbuf;      // interleaved FFT output, normalised in place
+    int8_t *quantized;      // pyramid: n bytes, then n / 2, n / 4, ...
+    size_t n;               // bins in the level-0 row
+    size_t base_idx;        // FFT bin shown first (IQ: size / 2 + 1)
+    float normalize;        // divide the spectrum by this (the FFT size)
+    int levels;             // downsample levels, including level 0
+    int power_offset;       // log2 brightness offset of level 0
+    size_t wrap_bins;       // bins copied to complexbuf[n...], 0 for none
+};
+
+// Original algorithm: one full pass per step (normalise + power + quantise,
+// then each pyramid level, then the wrap copy).  powerbuf holds 2 * n floats.
+// Kept for sizes the tiled pass cannot split and as the benchmark baseline.
+void quantize_spectrum_passes(const SpectrumQuantizeJob &job, float *powerbuf);
+
+// Cache-blocked version: every tile of the level-0 row is normalised,
+// quantised and reduced through all pyramid levels while it is still in L1/L2,
+// with the tiles spread over team.  Returns false (and does nothing) if n
+// cannot be split into tiles covering whole bins at every level.
+bool quantize_spectrum_tiled(const SpectrumQuantizeJob &job, ThreadTeam &team);
+
+#endif
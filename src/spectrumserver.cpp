@@ -1,10 +1,14 @@
 #include "spectrumserver.h"
 #include "chat.h"
+#include "georesolver.h"
 #include "samplereader.h"
+#include "sigmf.h"
 #include "crash_handler.h"
 #include "listing/software_info.h"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <bit>
 #include <boost/algorithm/string.hpp>
 #include <cerrno>
 #include <cstdio>
@@ -148,6 +152,9 @@ void broadcast_server::cleanup_dead_connections() {
             }
             ++it;
         }
+        std::erase_if(events_delta_seq, [&](const auto &entry) {
+            return !events_connections.count(entry.first);
+        });
     }
 }
 
@@ -169,6 +176,32 @@ broadcast_server::broadcast_server(
 
     server_threads = config["server"]["threads"].value_or(1);
 
+    // ── DSP worker pool ───────────────────────────────────────────────────
+    // dsp_threads <= 0 means "all cores but one".  dsp_cpus optionally pins
+    // the workers, e.g. dsp_cpus = [2, 3, 4, 5] to keep them off the cores
+    // running the FFT and the I/O thread.
+    dsp_threads = config["server"]["dsp_threads"].value_or(0);
+    // Listeners on the same channel with the same settings are demodulated
+    // and encoded once, see dispatch_audio_frame().
+    share_demod = config["server"]["share_demod"].value_or(true);
+    if (auto *cpus = config["server"]["dsp_cpus"].as_array()) {
+        for (const auto &node : *cpus) {
+            if (auto cpu = node.value<int>())
+                dsp_cpus.push_back(*cpu);
+        }
+    }
+
+    // ── Waterfall encode pool ─────────────────────────────────────────────
+    // Same conventions as the DSP pool.  Tasks are sharded by downsample
+    // level and idle workers steal, so a handful of threads is usually plenty.
+    waterfall_threads = config["server"]["waterfall_threads"].value_or(0);
+    if (auto *cpus = config["server"]["waterfall_cpus"].as_array()) {
+        for (const auto &node : *cpus) {
+            if (auto cpu = node.value<int>())
+                waterfall_cpus.push_back(*cpu);
+        }
+    }
+
     // ── Input: sample rate ────────────────────────────────────────────────
     auto sps_config = config["input"]["sps"].value<int>();
     if (!sps_config.has_value())
@@ -201,8 +234,34 @@ broadcast_server::broadcast_server(
     fft_size          = config["input"]["fft_size"].value_or(131072);
     audio_max_sps     = config["input"]["audio_sps"].value_or(12000);
     min_waterfall_fft = config["input"]["waterfall_size"].value_or(1024);
+    // Tiles must split every pyramid level evenly: a power of two no wider
+    // than the smallest level.
+    waterfall_tile_bins = std::clamp(
+        config["input"]["waterfall_tile_size"].value_or(256), 16,
+        std::clamp(min_waterfall_fft, 16, 32768));
+    waterfall_tile_bins = std::bit_floor((unsigned)waterfall_tile_bins);
     brightness_offset = config["input"]["brightness_offset"].value_or(0);
+    // Generations of FFT output in flight; at least 2 so the FFT can always
+    // run one frame ahead of the slowest client.
+    fft_pipeline_depth =
+        std::max(2, config["input"]["fft_pipeline_depth"].value_or(3));
+    // Input hops buffered between the reader thread and the FFT, and what
+    // to do when the FFT falls behind by that much (block, drop or skip).
+    input_ring_hops =
+        std::max(3, config["input"]["input_ring_hops"].value_or(8));
+    input_ring_policy = SampleRing::policy_from_string(
+        config["input"]["input_ring_policy"].value_or("drop"));
+    // Threads for the per-frame power / quantize / waterfall pyramid pass,
+    // counting the FFT thread itself; <= 0 means "all cores but one".
+    quantize_threads = config["input"]["quantize_threads"].value_or(0);
+    if (auto *cpus = config["input"]["quantize_cpus"].as_array()) {
+        for (const auto &node : *cpus) {
+            if (auto cpu = node.value<int>())
+                quantize_cpus.push_back(*cpu);
+        }
+    }
     show_other_users  = config["server"]["otherusers"].value_or(1) > 0;
+    metrics_enabled   = config["server"]["metrics"].value_or(true);
 
     // FIX: default_frequency previously used value_or(basefreq) before basefreq
     // was assigned.  Read as a raw value here; resolve against basefreq below.
@@ -247,6 +306,17 @@ broadcast_server::broadcast_server(
     limit_audio   = config["limits"]["audio"].value_or(1000);
     limit_waterfall = config["limits"]["waterfall"].value_or(1000);
     limit_events  = config["limits"]["events"].value_or(1000);
+    // Server-side noise reduction: chains running at once (a shared channel
+    // runs one), and the share of real time one stage of one chain may use
+    NoiseReductionLimits::instance().configure(
+        config["limits"]["noise_reduction"].value_or(16),
+        config["limits"]["noise_reduction_cpu"].value_or(5.0) / 100.0);
+    // Listener locations: the local database first, then ip-api.com
+    GeoResolver::instance().configure(
+        config["server"]["geoip_database"].value_or(""),
+        config["server"]["geoip_online"].value_or(2),
+        config["server"]["geoip_cache"].value_or(4096),
+        std::chrono::hours(config["server"]["geoip_cache_hours"].value_or(24)));
 
     // ── Derive basefreq and fft_result_size ───────────────────────────────
     // For IQ, the left edge of the baseband is (centre − sps/2).
@@ -379,6 +449,7 @@ broadcast_server::broadcast_server(
             fft_size, fft_threads, downsample_levels, brightness_offset);
     }
     fft->set_output_additional_size(audio_max_fft_size);
+    fft->set_quantize_threads(quantize_threads, quantize_cpus);
 
     // ── WebSocket server ──────────────────────────────────────────────────
     m_server.init_asio();
@@ -411,6 +482,23 @@ void broadcast_server::run(uint16_t port) {
     marker_update_thread  =
         std::thread(&broadcast_server::check_and_update_markers, this);
 
+    // users.json is rewritten every second while anyone listens; it is
+    // served by on_http itself, so the cache neither holds nor watches it
+    static_cache = std::make_unique<StaticAssetCache>(
+        m_docroot, std::vector<std::string>{"users.json", "users.json.tmp"});
+    static_cache->load();
+    static_cache->watch();
+
+    {
+        // Strip any trailing slash from docroot to avoid a double slash
+        std::string docroot = m_docroot;
+        while (docroot.size() > 1 && docroot.back() == '/') docroot.pop_back();
+        user_log = std::make_unique<UserLogWriter>(
+            docroot + "/users.json", "logs",
+            [this] { return get_users_json_body(); });
+        user_log->start();
+    }
+
     m_server.set_listen_backlog(8192);
     m_server.set_reuse_addr(true);
     try {
@@ -425,6 +513,10 @@ void broadcast_server::run(uint16_t port) {
     // individual chat messages in real time without restarting the server.
     ChatClient::start_admin_listener();
 
+    // The worker pools must exist before fft_task starts dispatching.
+    dsp_pool       = std::make_unique<WorkerPool>("dsp", dsp_threads, dsp_cpus);
+    waterfall_pool = std::make_unique<WorkerPool>("waterfall", waterfall_threads,
+                                                  waterfall_cpus);
     fft_thread = std::thread(&broadcast_server::fft_task, this);
     set_event_timer();
 
@@ -475,7 +567,10 @@ void broadcast_server::run(uint16_t port) {
     //
     // All CPU-heavy work (FFT, audio, waterfall, geo-IP) already runs on
     // dedicated std::threads outside this loop, so there is zero throughput
-    // loss from keeping the websocketpp io_context single-threaded.
+    // loss from keeping the websocketpp io_context single-threaded.  Audio
+    // demodulation/encoding runs on dsp_pool and waterfall compression on
+    // waterfall_pool; only the finished message is posted back here for the
+    // socket write (see queue_send()).
     // The server_threads config key is retained for compatibility but
     // intentionally ignored here.
     m_server.run();  // blocks until stop() calls m_server.stop()
@@ -483,9 +578,16 @@ void broadcast_server::run(uint16_t port) {
     // Background service threads: websdr listing, WebSDR.org, marker updater,
     // and the FFT task.  Each checks its own atomic flag and exits cleanly.
     if (fft_thread.joinable())            fft_thread.join();
+    // fft_task has waited for every FFT generation to be released by the
+    // audio/waterfall tasks, so nothing can submit to the pools any more.
+    if (dsp_pool)                         dsp_pool->stop();
+    if (waterfall_pool)                   waterfall_pool->stop();
     if (websdr_thread.joinable())         websdr_thread.join();
     if (websdr_org_thread_.joinable())    websdr_org_thread_.join();
     if (marker_update_thread.joinable())  marker_update_thread.join();
+    if (static_cache)                     static_cache->stop();
+    if (user_log)                         user_log->stop();
+    GeoResolver::instance().stop();
 }
 
 // ============================================================================
@@ -505,11 +607,11 @@ void broadcast_server::stop() {
 
     // FIX (deadlock): do NOT join any threads here.
     // stop() is called from a boost::asio signal-handler completion, which runs
-    // on one of the io_service threads.  If we tried to join fft_thread here:
-    //   • fft_task() may be blocked on signal_futures / waterfall_futures,
-    //   • those futures were posted to the io_service with use_future,
-    //   • with server_threads=1 the only io_service thread is us, occupied
-    //     waiting in join() → the futures can never execute → deadlock.
+    // on the io_service thread.  Joining fft_thread here would block the only
+    // thread that performs socket writes while fft_task may still be waiting
+    // for the client tasks to release its FFT generations (these used to be
+    // posted to the io_service with use_future, which deadlocked outright;
+    // they now run on the worker pools, but the rule stays).
     // All joins are done in run() after m_server.run() has returned.
 
     // ── Step 2: stop accepting new connections ────────────────────────────
@@ -968,15 +1070,81 @@ int main(int argc, char **argv) {
     std::string input_format =
         config["input"]["driver"]["format"].value_or("f32");
     boost::algorithm::to_lower(input_format);
+    const bool input_is_real =
+        boost::algorithm::to_lower_copy(
+            config["input"]["signal"].value_or(std::string("iq"))) == "real";
+    const int64_t input_sps = config["input"]["sps"].value_or(0);
 
     // Initialise multi-threaded FFTW if requested
     int fft_threads = config["input"]["fft_threads"].value_or(1);
     if (fft_threads > 1)
         fftwf_init_threads();
 
-    // Reopen stdin in binary mode for the raw IQ/real sample stream
-    freopen(nullptr, "rb", stdin);
-    auto reader = std::make_unique<FileSampleReader>(stdin);
+    std::unique_ptr<SampleReader> reader;
+    if (*driver_type == "replay") {
+        // Play back a recording made with [input.record] (or any raw file
+        // in input.driver.format).  Its SigMF metadata, when present, sets
+        // the format; the rest of [input] must still match the recording.
+        auto replay_file =
+            config["input"]["driver"]["replay_file"].value<std::string>();
+        if (!replay_file.has_value()) {
+            std::cout << "Specify input.driver.replay_file" << std::endl;
+            return 1;
+        }
+        if (auto meta = read_sigmf_meta(*replay_file)) {
+            input_format = meta->format;
+            if (meta->is_real != input_is_real ||
+                (int64_t)meta->sample_rate != input_sps) {
+                std::cout << "Replay: recording is "
+                          << (meta->is_real ? "real" : "IQ") << " at "
+                          << (int64_t)meta->sample_rate
+                          << " S/s, [input] does not match" << std::endl;
+            }
+        }
+        const bool realtime =
+            config["input"]["driver"]["replay_realtime"].value_or(true);
+        const bool loop =
+            config["input"]["driver"]["replay_loop"].value_or(true);
+        const double bytes_per_second =
+            realtime ? (double)input_sps * sample_format_bytes(input_format) *
+                           (input_is_real ? 1 : 2)
+                     : 0;
+        try {
+            reader = std::make_unique<MmapSampleReader>(*replay_file,
+                                                        bytes_per_second, loop);
+        } catch (const std::exception &e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Replaying " << *replay_file
+                  << (realtime ? " in real time" : " as fast as possible")
+                  << std::endl;
+    } else {
+        // Reopen stdin in binary mode for the raw IQ/real sample stream
+        freopen(nullptr, "rb", stdin);
+        reader = std::make_unique<FileSampleReader>(stdin);
+    }
+
+    // Tee the raw input, before conversion, into SigMF recordings
+    if (config["input"]["record"]["enabled"].value_or(false) &&
+        sample_format_bytes(input_format) != 0) {
+        SigMFRecordOptions record;
+        record.directory =
+            config["input"]["record"]["directory"].value_or("recordings");
+        record.format = input_format;
+        record.is_real = input_is_real;
+        record.sample_rate = input_sps;
+        record.frequency = config["input"]["frequency"].value_or(int64_t{0});
+        record.file_bytes =
+            (uint64_t)std::max<int64_t>(
+                0, config["input"]["record"]["file_mb"].value_or(1024)) << 20;
+        record.max_bytes =
+            (uint64_t)std::max<int64_t>(
+                0, config["input"]["record"]["max_mb"].value_or(8192)) << 20;
+        reader = std::make_unique<RecordingSampleReader>(
+            std::move(reader), std::make_unique<SigMFRecorder>(record));
+    }
+
     std::unique_ptr<SampleConverterBase> driver;
 
     if      (input_format == "u8")  driver = std::make_unique<SampleConverter<uint8_t>> (std::move(reader));
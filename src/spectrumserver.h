@@ -1,6 +1,8 @@
 #ifndef SPECTRUMSERVER_H
 #define SPECTRUMSERVER_H
 
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <map>
 #include <mutex>
@@ -13,10 +15,16 @@
 
 #include "client.h"
 #include "fft.h"
+#include "framedispatch.h"
+#include "listenerstore.h"
 #include "samplereader.h"
+#include "samplering.h"
 #include "signal.h"
+#include "staticcache.h"
+#include "userlog.h"
 #include "waterfall.h"
 #include "websocket.h"
+#include "workerpool.h"
 #include "chat.h"
 
 using websocketpp::connection_hdl;
@@ -71,15 +79,21 @@ class broadcast_server : public PacketSender {
     void on_close_chat(connection_hdl hdl);
 
     // Events socket
-    std::string get_event_info();
+    // The JSON tick for events connections on the text format, the binary
+    // delta for the rest, and the snapshot a connection starts (or catches
+    // up) from
+    std::string get_event_info(const ListenerStore::Batch &batch);
+    std::string get_event_delta(const ListenerStore::Batch &batch);
     std::string get_initial_state_info();
     std::string get_users_json();   // real-time user list as JSON
-    void        write_users_json(); // atomically writes users.json to docroot
+    std::string get_users_json_body(); // the same without its timestamp line
+    std::string get_metrics();      // Prometheus text for /metrics
     void        append_user_log(const std::string &event,
                                 const std::string &unique_id,
                                 int l, double audio_mid, int r); // JSONL statistics log
     void on_open_events(connection_hdl hdl);
     void on_message_control(connection_hdl hdl);
+    void on_message_events(connection_hdl hdl, server::message_ptr msg);
     void on_close_events(connection_hdl hdl);
     void set_event_timer();
     void on_timer(websocketpp::lib::error_code const &ec);
@@ -101,23 +115,42 @@ class broadcast_server : public PacketSender {
     // Signal functions, audio demodulation
     void on_open_signal(connection_hdl hdl, conn_type signal_type);
     void on_close_signal(connection_hdl hdl, std::shared_ptr<AudioClient> &d);
-    std::vector<std::future<void>> signal_loop();
+    void signal_loop(FFTGeneration &gen);
 
     // Waterfall functions
     void on_open_waterfall(connection_hdl hdl);
     void on_close_waterfall(connection_hdl hdl,
                             std::shared_ptr<WaterfallClient> &d);
-    std::vector<std::future<void>> waterfall_loop(int8_t *fft_power_quantized);
+    void waterfall_loop(FFTGeneration &gen);
+
+    // Hands a fully built message to the websocketpp I/O thread for the
+    // actual socket write (inline when already on that thread).
+    void queue_send(server::connection_ptr con, server::message_ptr msg);
+    // queue_send() for a prepared message, unless the connection is gone or
+    // too far behind; true if it was queued
+    bool queue_prepared(connection_hdl hdl, server::message_ptr msg);
+    // Frames payload once into a message that can be queued to any number
+    // of connections as is (see broadcast_text_packet())
+    server::message_ptr prepare_message(websocketpp::frame::opcode::value op,
+                                        const std::string &payload);
+    // Copies [begin, end) of (data, size) pairs into one binary message
+    template <typename It>
+    void send_binary_gather(connection_hdl hdl, It begin, It end);
 
     virtual void send_binary_packet(
         connection_hdl hdl,
         const std::initializer_list<std::pair<const void *, size_t>> &bufs);
     virtual void send_binary_packet(connection_hdl hdl, const void *data,
                                     size_t size);
+    virtual void send_binary_packet(
+        connection_hdl hdl,
+        const std::vector<std::pair<const void *, size_t>> &bufs);
     virtual void
     send_text_packet(connection_hdl hdl,
                      const std::initializer_list<std::string> &data);
     virtual void send_text_packet(connection_hdl hdl, const std::string &data);
+    virtual size_t broadcast_text_packet(const std::vector<connection_hdl> &hdls,
+                                         const std::string &data);
     virtual std::string ip_from_hdl(connection_hdl hdl);
     virtual void log(connection_hdl hdl, const std::string &msg);
 
@@ -125,6 +158,7 @@ class broadcast_server : public PacketSender {
     virtual waterfall_mutexes_t &get_waterfall_slice_mtx();
     virtual signal_slices_t &get_signal_slices();
     virtual std::mutex &get_signal_slice_mtx();
+    virtual std::optional<bool> frame_wanted(Client &client, int frame_num);
 
     virtual void broadcast_signal_changes(const std::string &unique_id, int l,
                                           double m, int r,
@@ -133,6 +167,11 @@ class broadcast_server : public PacketSender {
   private:
     std::unique_ptr<FFT> fft;
     std::unique_ptr<SampleConverterBase> reader;
+    // Input hops between the reader thread and fft_task ([input]
+    // input_ring_hops, input_ring_policy).  Lives for the duration of fft_task.
+    int input_ring_hops;
+    SampleRing::overrun_policy input_ring_policy;
+    std::unique_ptr<SampleRing> input_ring;
     server m_server;
     server::timer_ptr m_timer;
 
@@ -142,6 +181,8 @@ class broadcast_server : public PacketSender {
     int sps;
     int64_t basefreq;
     int min_waterfall_fft;
+    // Width of a waterfall tile at every level ([input] waterfall_tile_size)
+    int waterfall_tile_bins;
     bool is_real;
     int downsample_levels;
     int audio_max_sps;
@@ -149,8 +190,16 @@ class broadcast_server : public PacketSender {
     int audio_max_fft_size;
     int brightness_offset;
     int fft_threads;
+    // Post-FFT quantize team ([input] quantize_threads, quantize_cpus)
+    int quantize_threads;
+    std::vector<int> quantize_cpus;
     std::string input_format;
     std::string m_docroot;
+    // html_root held in memory for on_http, built and watched by run()
+    std::unique_ptr<StaticAssetCache> static_cache;
+    // users.json and the JSONL statistics log, written off the I/O thread.
+    // Created by run().
+    std::unique_ptr<UserLogWriter> user_log;
     // Secret token gating the internal PCM-tap loopback exemption. Generated at
     // startup, written to ./.tap_token (mode 600). A loopback client (the
     // autorun spot daemon) must present it as ?tap=<token> on /audio; every
@@ -158,6 +207,8 @@ class broadcast_server : public PacketSender {
     std::string tap_token;
     std::atomic<bool> running{false};
     bool show_other_users;
+    // Serve /metrics ([server] metrics)
+    bool metrics_enabled;
     int server_threads;
     int frame_num;
     waterfall_compressor waterfall_compression;
@@ -193,19 +244,56 @@ class broadcast_server : public PacketSender {
 
     event_con_list events_connections;
     std::mutex events_connections_mtx;  // Mutex for thread-safe access to events_connections
-    
-    std::unordered_map<std::string, std::tuple<int, double, int>>
-        signal_changes;
-    std::mutex signal_changes_mtx;
-
-    // FFT output to send to clients
-    std::complex<float> *fft_buffer = nullptr;
+    // Events connections on binary deltas, and the listener seq each is at
+    // (kEventsResync: needs a snapshot).  Under events_connections_mtx.
+    std::map<connection_hdl, uint64_t, std::owner_less<connection_hdl>>
+        events_delta_seq;
+    static constexpr uint64_t kEventsResync = ~uint64_t{0};
+
+    // Listener positions for the events socket, fed by
+    // broadcast_signal_changes() and published by on_timer()
+    ListenerStore listener_store;
+    // Counts from the last events tick, for the state sent to new connections
+    std::atomic<size_t> events_signal_clients{0};
+    std::atomic<size_t> events_waterfall_clients{0};
+
+    // FFT output to send to clients, see FFTGeneration.  Owned by fft_task.
+    int fft_pipeline_depth;
+    std::unique_ptr<FFTGeneration[]> fft_generations;
+    // Frames a client missed because it was already fft_pipeline_depth - 1
+    // frames behind, and FFT frames that had to wait for a generation.
+    std::atomic<uint64_t> audio_frames_skipped{0};
+    // Shared demodulation ([server] share_demod): frames demodulated once for
+    // a channel of listeners, and the extra listeners those frames served.
+    bool share_demod;
+    std::atomic<uint64_t> audio_channel_frames{0};
+    std::atomic<uint64_t> audio_channel_sends{0};
+    std::atomic<uint64_t> waterfall_frames_skipped{0};
+    std::atomic<uint64_t> fft_pipeline_stalls{0};
     // std::shared_mutex fft_mutex;
     std::condition_variable_any fft_processed;
 
     // Dedicated threads for FFT
     std::thread fft_thread;
 
+    // Worker pool for per-client audio DSP and encoding ([server] dsp_threads,
+    // dsp_cpus).  Created in run(), stopped after fft_thread has joined.
+    int dsp_threads;
+    std::vector<int> dsp_cpus;
+    std::unique_ptr<WorkerPool> dsp_pool;
+
+    // Work-stealing pool for waterfall compression, sharded by downsample
+    // level ([server] waterfall_threads, waterfall_cpus).  Same lifetime as
+    // dsp_pool.
+    int waterfall_threads;
+    std::vector<int> waterfall_cpus;
+    std::unique_ptr<WorkerPool> waterfall_pool;
+    WaterfallEncodeStats waterfall_encode_stats;
+    // Window for the periodic encode-time report (FFT thread only).
+    std::chrono::steady_clock::time_point waterfall_report_at{};
+    std::chrono::steady_clock::time_point waterfall_last_frame_at{};
+    uint64_t waterfall_interval_us_total = 0;
+
     // Markers
     void check_and_update_markers();
     std::thread marker_update_thread;
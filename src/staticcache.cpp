@@ -0,0 +1,462 @@
+#include "staticcache.h"
+#include "compression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <unordered_set>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <zstd.h>
+#ifdef HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+// http.cpp
+std::string get_mime_type(std::string &extension);
+
+namespace {
+namespace fs = std::filesystem;
+
+// How long the tree has to be quiet before a rebuild, so a frontend build
+// that rewrites every file costs one rebuild and not hundreds
+constexpr auto kSettle = std::chrono::milliseconds(300);
+
+constexpr uint32_t kWatchMask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                                IN_DELETE_SELF | IN_MOVE_SELF;
+
+const char *kEtagSuffix[StaticAssetCache::ENCODINGS] = {"", "-gz", "-zst",
+                                                        "-br"};
+
+uint64_t fnv1a(const std::string &data) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        h = (h ^ c) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string http_date(int64_t t) {
+    std::time_t tt = static_cast<std::time_t>(t);
+    std::tm tm{};
+    gmtime_r(&tt, &tm);
+    char buf[64];
+    std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+// -1 if s is not an IMF-fixdate
+int64_t parse_http_date(std::string_view s) {
+    std::string str(s);
+    std::tm tm{};
+    const char *end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) return -1;
+    return static_cast<int64_t>(timegm(&tm));
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+        s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back())))
+        s.remove_suffix(1);
+    return s;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+               return std::tolower(static_cast<unsigned char>(x)) ==
+                      std::tolower(static_cast<unsigned char>(y));
+           });
+}
+
+// Calls fn(item) for every comma-separated item of a header value
+template <typename F> void for_each_item(std::string_view list, F &&fn) {
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        fn(trim(list.substr(0, comma)));
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+}
+
+std::string compress_zstd(const std::string &data) {
+    std::string out(ZSTD_compressBound(data.size()), '\0');
+    const size_t n = ZSTD_compress(out.data(), out.size(), data.data(),
+                                   data.size(), 19);
+    if (ZSTD_isError(n)) return {};
+    out.resize(n);
+    return out;
+}
+
+std::string compress_brotli(const std::string &data) {
+#ifdef HAS_BROTLI
+    size_t n = BrotliEncoderMaxCompressedSize(data.size());
+    if (n == 0) return {};
+    std::string out(n, '\0');
+    if (!BrotliEncoderCompress(
+            BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+            data.size(), reinterpret_cast<const uint8_t *>(data.data()), &n,
+            reinterpret_cast<uint8_t *>(out.data()))) {
+        return {};
+    }
+    out.resize(n);
+    return out;
+#else
+    (void)data;
+    return {};
+#endif
+}
+
+// Reads a file and builds its asset with every encoding.  Null if the file
+// cannot be read.
+std::shared_ptr<StaticAssetCache::Asset>
+read_asset(const fs::path &real, uint64_t size,
+           std::optional<fs::file_time_type> ftime) {
+    using Asset = StaticAssetCache::Asset;
+    std::ifstream file(real, std::ios::binary);
+    if (!file) return nullptr;
+    auto asset = std::make_shared<Asset>();
+    std::string &identity = asset->body[StaticAssetCache::IDENTITY];
+    identity.assign(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+    if (!file.good() && !file.eof()) return nullptr;
+
+    std::string extension = real.extension().string();
+    asset->mime_type = get_mime_type(extension);
+
+    asset->file_size = size;
+    if (ftime) {
+        asset->file_time = ftime->time_since_epoch().count();
+        asset->mtime = std::chrono::duration_cast<std::chrono::seconds>(
+                           std::chrono::file_clock::to_sys(*ftime)
+                               .time_since_epoch())
+                           .count();
+    }
+    asset->last_modified = http_date(asset->mtime);
+
+    char hash[32];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+                  static_cast<unsigned long long>(fnv1a(identity)));
+    asset->etag = std::string("\"") + hash + "\"";
+
+    if (!identity.empty()) {
+        asset->body[StaticAssetCache::GZIP] = Gzip::compress(identity);
+        asset->body[StaticAssetCache::ZSTD] = compress_zstd(identity);
+        asset->body[StaticAssetCache::BROTLI] = compress_brotli(identity);
+        for (int e = StaticAssetCache::GZIP; e < StaticAssetCache::ENCODINGS; e++) {
+            if (asset->body[e].size() >= identity.size()) {
+                asset->body[e].clear();
+            }
+        }
+    }
+    return asset;
+}
+
+// Watches root and every directory below it.  Returns the inotify fd, or -1.
+int arm_watches(const std::string &root) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return -1;
+    if (inotify_add_watch(fd, root.c_str(), kWatchMask) < 0) {
+        close(fd);
+        return -1;
+    }
+    std::error_code ec;
+    for (fs::recursive_directory_iterator
+             it(root, fs::directory_options::skip_permission_denied, ec),
+         end;
+         !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec)) {
+            inotify_add_watch(fd, it->path().c_str(), kWatchMask);
+        }
+    }
+    return fd;
+}
+} // namespace
+
+StaticAssetCache::StaticAssetCache(std::string root,
+                                   std::vector<std::string> ignore,
+                                   size_t max_file_bytes)
+    : root(std::move(root)), ignore(std::move(ignore)),
+      max_file_bytes(max_file_bytes) {}
+
+bool StaticAssetCache::ignored(std::string_view name) const {
+    return std::find(ignore.begin(), ignore.end(), name) != ignore.end();
+}
+
+StaticAssetCache::~StaticAssetCache() { stop(); }
+
+const char *StaticAssetCache::encoding_name(Encoding e) {
+    switch (e) {
+    case GZIP:
+        return "gzip";
+    case ZSTD:
+        return "zstd";
+    case BROTLI:
+        return "br";
+    default:
+        return "identity";
+    }
+}
+
+std::shared_ptr<const StaticAssetCache::Snapshot>
+StaticAssetCache::build(const std::shared_ptr<const Snapshot> &previous,
+                        size_t &rebuilt) const {
+    auto snap = std::make_shared<Snapshot>();
+    rebuilt = 0;
+
+    std::error_code ec;
+    const fs::path base = fs::canonical(root, ec);
+    if (ec) return snap;
+    const std::string base_str = base.string();
+
+    for (fs::recursive_directory_iterator
+             it(base, fs::directory_options::skip_permission_denied, ec),
+         end;
+         !ec && it != end; it.increment(ec)) {
+        std::error_code fec;
+        if (!it->is_regular_file(fec)) continue;
+        if (ignored(it->path().filename().string())) continue;
+
+        // Same docroot boundary as on_http: a symlink may not lead out
+        const fs::path real = fs::canonical(it->path(), fec);
+        if (fec || real.string().rfind(base_str + "/", 0) != 0) continue;
+
+        const auto size = fs::file_size(real, fec);
+        if (fec || size > max_file_bytes) continue;
+        const auto ftime = fs::last_write_time(real, fec);
+        const int64_t file_time = fec ? 0 : ftime.time_since_epoch().count();
+
+        const fs::path rel = it->path().lexically_relative(base);
+        const std::string key = "/" + rel.generic_string();
+        std::shared_ptr<const Asset> asset;
+        if (previous && !fec) {
+            auto old = previous->find(key);
+            if (old != previous->end() && old->second->file_size == size &&
+                old->second->file_time == file_time) {
+                asset = old->second;
+            }
+        }
+        if (!asset) {
+            asset = read_asset(real, size, fec ? std::nullopt
+                                               : std::optional(ftime));
+            if (!asset) continue;
+            rebuilt++;
+        }
+
+        (*snap)[key] = asset;
+        if (rel.filename() == "index.html") {
+            // "/", "/analog" and "/analog/" all serve the directory's index
+            const std::string dir = "/" + rel.parent_path().generic_string();
+            (*snap)[dir] = asset;
+            if (dir != "/") (*snap)[dir + "/"] = asset;
+        }
+    }
+    // A directory removed under the walk ends it early: better the old
+    // snapshot than a partial one
+    if (ec) return nullptr;
+    return snap;
+}
+
+bool StaticAssetCache::load() {
+    const auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const Snapshot> previous;
+    {
+        std::scoped_lock lk(snapshot_mtx);
+        previous = snapshot;
+    }
+    size_t rebuilt = 0;
+    auto snap = build(previous, rebuilt);
+    if (!snap) return false;
+
+    // Directory keys alias their index.html, count each asset once
+    std::unordered_set<const Asset *> seen;
+    size_t bytes[ENCODINGS] = {};
+    for (const auto &[key, asset] : *snap) {
+        if (!seen.insert(asset.get()).second) continue;
+        for (int e = 0; e < ENCODINGS; e++) {
+            bytes[e] += asset->body[e].empty() ? asset->body[IDENTITY].size()
+                                               : asset->body[e].size();
+        }
+    }
+    {
+        std::scoped_lock lk(snapshot_mtx);
+        snapshot = std::move(snap);
+    }
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    std::cout << "[http] Cached " << seen.size() << " files from " << root
+              << " (" << rebuilt << " read) in " << ms << " ms: " << bytes[IDENTITY] / 1024 << " kB, gzip "
+              << bytes[GZIP] / 1024 << " kB, zstd " << bytes[ZSTD] / 1024
+              << " kB";
+#ifdef HAS_BROTLI
+    std::cout << ", br " << bytes[BROTLI] / 1024 << " kB";
+#endif
+    std::cout << std::endl;
+    return true;
+}
+
+std::shared_ptr<const StaticAssetCache::Asset>
+StaticAssetCache::find(std::string_view path) const {
+    std::shared_ptr<const Snapshot> snap;
+    {
+        std::scoped_lock lk(snapshot_mtx);
+        snap = snapshot;
+    }
+    if (!snap) return nullptr;
+
+    std::string key =
+        fs::path("/" + std::string(path)).lexically_normal().generic_string();
+    // lexically_normal keeps a leading "//" (a POSIX root-name)
+    while (key.size() > 1 && key[1] == '/') key.erase(0, 1);
+
+    auto it = snap->find(key);
+    return it == snap->end() ? nullptr : it->second;
+}
+
+StaticAssetCache::Encoding
+StaticAssetCache::negotiate(const Asset &asset,
+                            std::string_view accept_encoding) {
+    // q-value of each coding, -1 where the header does not name it
+    float q[ENCODINGS] = {-1.0f, -1.0f, -1.0f, -1.0f};
+    float any = -1.0f;
+    for_each_item(accept_encoding, [&](std::string_view item) {
+        const size_t semi = item.find(';');
+        const std::string_view name = trim(item.substr(0, semi));
+        float value = 1.0f;
+        if (semi != std::string_view::npos) {
+            std::string_view param = trim(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') &&
+                param[1] == '=') {
+                value = std::strtof(std::string(param.substr(2)).c_str(),
+                                    nullptr);
+            }
+        }
+        if (name == "*") any = value;
+        else if (iequals(name, "gzip") || iequals(name, "x-gzip"))
+            q[GZIP] = value;
+        else if (iequals(name, "zstd")) q[ZSTD] = value;
+        else if (iequals(name, "br")) q[BROTLI] = value;
+    });
+
+    // Highest q wins; on a tie the smaller encoding, br > zstd > gzip
+    Encoding best = IDENTITY;
+    float best_q = 0.0f;
+    for (Encoding e : {BROTLI, ZSTD, GZIP}) {
+        const float qe = q[e] >= 0.0f ? q[e] : any;
+        if (qe > best_q && !asset.body[e].empty()) {
+            best = e;
+            best_q = qe;
+        }
+    }
+    return best;
+}
+
+bool StaticAssetCache::not_modified(const Asset &asset,
+                                    std::string_view if_none_match,
+                                    std::string_view if_modified_since) {
+    if_none_match = trim(if_none_match);
+    if (!if_none_match.empty()) {
+        if (if_none_match == "*") return true;
+        // Weak comparison, against the tag of any of the asset's variants
+        const std::string_view tag =
+            std::string_view(asset.etag).substr(0, asset.etag.size() - 1);
+        bool match = false;
+        for_each_item(if_none_match, [&](std::string_view item) {
+            if (item.starts_with("W/")) item.remove_prefix(2);
+            if (!item.starts_with(tag) || !item.ends_with('"')) return;
+            const std::string_view suffix =
+                item.substr(tag.size(), item.size() - tag.size() - 1);
+            for (const char *s : kEtagSuffix) {
+                if (suffix == s) match = true;
+            }
+        });
+        return match;
+    }
+    const int64_t since = parse_http_date(trim(if_modified_since));
+    return since >= 0 && asset.mtime <= since;
+}
+
+std::string StaticAssetCache::etag(const Asset &asset, Encoding e) {
+    if (e == IDENTITY) return asset.etag;
+    std::string tag = asset.etag;
+    tag.insert(tag.size() - 1, kEtagSuffix[e]);
+    return tag;
+}
+
+void StaticAssetCache::watch() {
+    if (watching.exchange(true)) return;
+    watcher = std::thread(&StaticAssetCache::watch_loop, this);
+}
+
+void StaticAssetCache::stop() {
+    watching = false;
+    if (watcher.joinable()) watcher.join();
+}
+
+void StaticAssetCache::watch_loop() {
+    int fd = arm_watches(root);
+    if (fd < 0) {
+        std::cout << "[http] Cannot watch " << root
+                  << ", static files will not be reloaded" << std::endl;
+    }
+
+    // A first load() that failed is retried here
+    bool dirty;
+    {
+        std::scoped_lock lk(snapshot_mtx);
+        dirty = !snapshot;
+    }
+    auto last_event = std::chrono::steady_clock::now();
+    alignas(struct inotify_event) char buf[4096];
+
+    while (watching) {
+        if (fd >= 0) {
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) > 0) {
+                ssize_t n;
+                while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                    for (char *p = buf; p < buf + n;) {
+                        const auto *ev = reinterpret_cast<inotify_event *>(p);
+                        if (!ev->len || !ignored(ev->name)) {
+                            dirty = true;
+                            last_event = std::chrono::steady_clock::now();
+                        }
+                        p += sizeof(inotify_event) + ev->len;
+                    }
+                }
+                continue;
+            }
+        } else {
+            // Root missing or unwatchable: look again once a second
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            fd = arm_watches(root);
+            dirty = fd >= 0;
+            continue;
+        }
+        if (!dirty || std::chrono::steady_clock::now() - last_event < kSettle) {
+            continue;
+        }
+
+        // New directories need watches, deleted ones have dropped theirs.
+        // Re-arm before rebuilding so nothing written meanwhile is missed.
+        close(fd);
+        fd = arm_watches(root);
+        dirty = !load();
+        last_event = std::chrono::steady_clock::now();
+    }
+    if (fd >= 0) close(fd);
+}
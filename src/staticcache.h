@@ -0,0 +1,103 @@
+#ifndef STATICCACHE_H
+#define STATICCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// In-memory copy of html_root, so on_http never touches the disk or a
+// compressor on the io_service thread.
+//
+// Every regular file under the root is read once and stored with its
+// gzip, zstd and (when built with brotli) brotli encodings, each kept only
+// if it is smaller than the file itself.  A request picks the variant its
+// Accept-Encoding allows and is served with a copy of the prebuilt body.
+//
+// An inotify watcher rebuilds the snapshot off to the side once the tree has
+// been quiet for a moment (a frontend build rewrites everything at once) and
+// swaps it in; requests in flight keep the snapshot they started with.  A
+// rebuild only reads and compresses files whose size or mtime changed, the
+// other assets carry over from the old snapshot.
+class StaticAssetCache {
+  public:
+    enum Encoding { IDENTITY, GZIP, ZSTD, BROTLI, ENCODINGS };
+
+    struct Asset {
+        std::string mime_type;
+        std::string etag;            // identity's: quoted, from the contents
+        std::string last_modified;   // IMF-fixdate
+        int64_t mtime = 0;           // seconds since the epoch
+        // What a rebuild compares to reuse the asset
+        uint64_t file_size = 0;
+        int64_t file_time = 0;       // file_clock ticks
+        // Empty for an encoding that is not smaller than identity
+        std::string body[ENCODINGS];
+    };
+
+    // Files bigger than max_file_bytes are left out, and served from disk.
+    // Files named in ignore are neither cached nor watched.
+    explicit StaticAssetCache(std::string root,
+                              std::vector<std::string> ignore = {},
+                              size_t max_file_bytes = 64 << 20);
+    ~StaticAssetCache();
+
+    StaticAssetCache(const StaticAssetCache &) = delete;
+    StaticAssetCache &operator=(const StaticAssetCache &) = delete;
+
+    // Build a snapshot and swap it in.  Call once before serving.  False,
+    // keeping the old one, if the tree changed under the walk.
+    bool load();
+
+    // Start / stop the inotify watcher.  stop() joins it and is idempotent.
+    void watch();
+    void stop();
+
+    // The asset for a request path (query already stripped), with "/" and
+    // directories resolved to their index.html.  Null on a miss.
+    std::shared_ptr<const Asset> find(std::string_view path) const;
+
+    // Best encoding present in asset that accept_encoding allows
+    static Encoding negotiate(const Asset &asset,
+                              std::string_view accept_encoding);
+
+    // True if the request's validators match: If-None-Match when present,
+    // else If-Modified-Since
+    static bool not_modified(const Asset &asset, std::string_view if_none_match,
+                             std::string_view if_modified_since);
+
+    // The asset's ETag for one of its variants
+    static std::string etag(const Asset &asset, Encoding e);
+
+    static const char *encoding_name(Encoding e);
+
+  private:
+    using Snapshot =
+        std::unordered_map<std::string, std::shared_ptr<const Asset>>;
+
+    // Assets of unchanged files are taken from previous (may be null).
+    // rebuilt counts the files read and compressed.
+    std::shared_ptr<const Snapshot>
+    build(const std::shared_ptr<const Snapshot> &previous,
+          size_t &rebuilt) const;
+    void watch_loop();
+
+    bool ignored(std::string_view name) const;
+
+    std::string root;
+    std::vector<std::string> ignore;
+    size_t max_file_bytes;
+
+    mutable std::mutex snapshot_mtx;
+    std::shared_ptr<const Snapshot> snapshot;
+
+    std::thread watcher;
+    std::atomic<bool> watching{false};
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "threadteam.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+ThreadTeam::ThreadTeam(const std::string &name, int threads,
+                       const std::vector<int> &cpus)
+    : name{name}, cpus{cpus} {
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    workers.reserve(threads - 1);
+    for (int i = 0; i < threads - 1; i++) {
+        workers.emplace_back(&ThreadTeam::worker_loop, this, i);
+    }
+}
+
+ThreadTeam::~ThreadTeam() {
+    stopping.store(true, std::memory_order_release);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+    for (auto &t : workers) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void ThreadTeam::work() {
+    int task;
+    while ((task = next_task.fetch_add(1, std::memory_order_relaxed)) <
+           job_tasks) {
+        (*job)(task);
+    }
+}
+
+void ThreadTeam::run(int tasks, const std::function<void(int)> &fn) {
+    if (workers.empty() || tasks <= 1) {
+        for (int i = 0; i < tasks; i++) fn(i);
+        return;
+    }
+
+    job = &fn;
+    job_tasks = tasks;
+    next_task.store(0, std::memory_order_relaxed);
+    busy.store(static_cast<int>(workers.size()), std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    work();
+
+    // Every worker takes part in every generation, so the next run() can
+    // never overlap a straggler from this one.
+    int b;
+    while ((b = busy.load(std::memory_order_acquire)) != 0) {
+        busy.wait(b, std::memory_order_acquire);
+    }
+}
+
+void ThreadTeam::worker_loop(int index) {
+    {
+        std::string tname = name.substr(0, 11) + "/" + std::to_string(index);
+        pthread_setname_np(pthread_self(), tname.substr(0, 15).c_str());
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[index % cpus.size()], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            std::cerr << "[" << name << "] could not pin worker " << index
+                      << " to CPU " << cpus[index % cpus.size()] << std::endl;
+        }
+    }
+
+    uint32_t seen = 0;
+    while (true) {
+        generation.wait(seen, std::memory_order_acquire);
+        seen = generation.load(std::memory_order_acquire);
+        if (stopping.load(std::memory_order_acquire)) return;
+
+        work();
+        if (busy.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            busy.notify_one();
+        }
+    }
+}
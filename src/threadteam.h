@@ -0,0 +1,55 @@
+#ifndef THREADTEAM_H
+#define THREADTEAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Persistent fork/join team for data-parallel loops on the FFT thread (the
+// per-frame power / quantize / waterfall pyramid pass).
+//
+// Replaces per-loop `#pragma omp parallel for` regions: the workers are
+// created once, optionally pinned, and sleep on an atomic between frames.
+// run() hands out task indices through a shared counter; the calling thread
+// works along with the team and returns once every task has finished.
+//
+// Unlike WorkerPool there are no queues or futures — one job at a time, and
+// run() must not be called concurrently or from inside a task.
+class ThreadTeam {
+  public:
+    // threads is the total including the calling thread; threads <= 0
+    // selects hardware_concurrency() - 1 (at least 1).  Worker i (the
+    // calling thread is not pinned) is bound to cpus[i % cpus.size()].
+    ThreadTeam(const std::string &name, int threads,
+               const std::vector<int> &cpus = {});
+    ~ThreadTeam();
+
+    ThreadTeam(const ThreadTeam &) = delete;
+    ThreadTeam &operator=(const ThreadTeam &) = delete;
+
+    void run(int tasks, const std::function<void(int)> &fn);
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+  private:
+    void worker_loop(int index);
+    void work();
+
+    std::string name;
+    std::vector<int> cpus;
+    std::vector<std::thread> workers;
+
+    // Current job, published by the release increment of generation
+    const std::function<void(int)> *job = nullptr;
+    int job_tasks = 0;
+
+    alignas(64) std::atomic<int> next_task{0};
+    alignas(64) std::atomic<int> busy{0};   // workers still in the job
+    alignas(64) std::atomic<uint32_t> generation{0};
+    std::atomic<bool> stopping{false};
+};
+
+#endif
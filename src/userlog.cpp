@@ -0,0 +1,197 @@
+#include "userlog.h"
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr auto kTick = std::chrono::milliseconds(250);
+// How often users.json is looked at: its durations tick in seconds
+constexpr int kUsersEvery = 4;
+
+void format_utc(std::chrono::system_clock::time_point t, const char *fmt,
+                char *out, size_t size) {
+    const std::time_t tt = std::chrono::system_clock::to_time_t(t);
+    std::tm tm_utc{};
+    gmtime_r(&tt, &tm_utc);
+    std::strftime(out, size, fmt, &tm_utc);
+}
+
+// Quotes and backslashes escaped for a JSON string literal
+void append_escaped(std::string &out, const std::string &s) {
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+}
+} // namespace
+
+UserLogWriter::UserLogWriter(std::string users_json_path, std::string log_dir,
+                             std::function<std::string()> users_json)
+    : users_json_path(std::move(users_json_path)), log_dir(std::move(log_dir)),
+      users_json(std::move(users_json)) {}
+
+UserLogWriter::~UserLogWriter() {
+    stop();
+    // Anything pushed after stop()
+    for (Node *n = head.exchange(nullptr); n;) {
+        Node *next = n->next;
+        delete n;
+        n = next;
+    }
+}
+
+void UserLogWriter::start() {
+    if (running.exchange(true)) return;
+    thread = std::thread(&UserLogWriter::run, this);
+}
+
+void UserLogWriter::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void UserLogWriter::push(UserLogEvent event) {
+    Node *node = new Node{std::move(event), head.load(std::memory_order_relaxed)};
+    while (!head.compare_exchange_weak(node->next, node,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+void UserLogWriter::run() {
+    // Below the I/O, FFT and DSP threads: nothing here is urgent
+    setpriority(PRIO_PROCESS, gettid(), 10);
+
+    int tick = 0;
+    bool stopping = false;
+    while (!stopping) {
+        std::this_thread::sleep_for(kTick);
+        stopping = !running;
+
+        if (Node *list = head.exchange(nullptr, std::memory_order_acquire)) {
+            write_log(list);
+        }
+        if (++tick >= kUsersEvery || stopping) {
+            tick = 0;
+            write_users_json();
+        }
+    }
+    if (log.is_open()) log.close();
+}
+
+void UserLogWriter::write_log(Node *list) {
+    // The list is newest first
+    Node *ordered = nullptr;
+    while (list) {
+        Node *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+
+    std::string line;
+    while (ordered) {
+        const UserLogEvent &e = ordered->event;
+        char ts[32], date[12];
+        format_utc(e.at, "%Y-%m-%dT%H:%M:%SZ", ts, sizeof(ts));
+        format_utc(e.at, "%Y-%m-%d", date, sizeof(date));
+
+        char freq[64];
+        std::snprintf(freq, sizeof(freq), "%lld,\"freq_khz\":%.3f",
+                      static_cast<long long>(e.freq_hz),
+                      static_cast<double>(e.freq_hz) / 1000.0);
+        line.clear();
+        line += "{\"ts\":\"";
+        line += ts;
+        line += "\",\"event\":\"";
+        line += e.disconnect ? "disconnect" : "tune";
+        line += "\",\"id\":\"";
+        line += e.unique_id;
+        line += "\",\"ip\":\"";
+        line += e.ip;
+        line += "\",\"geo\":\"";
+        append_escaped(line, e.geo);
+        line += "\",\"freq_hz\":";
+        line += freq;
+        line += ",\"mode\":\"";
+        line += e.mode;
+        line += "\",\"duration_s\":";
+        line += std::to_string(e.duration_s);
+        line += "}\n";
+
+        // Dedup: a line byte-for-byte identical to the last one logged for
+        // this client is dropped.  broadcast_signal_changes() is often called
+        // twice within the same second with the same arguments (the initial
+        // set_audio_range at connect-time followed by the client's first
+        // window message, or rapid re-tunes in the same 1-second timestamp).
+        // A disconnect is always logged and clears the entry, so the map only
+        // holds connected clients.
+        bool keep = true;
+        if (e.disconnect) {
+            last_logged.erase(e.unique_id);
+        } else {
+            auto [it, inserted] = last_logged.try_emplace(e.unique_id, line);
+            if (!inserted) {
+                if (it->second == line) keep = false;
+                else it->second = line;
+            }
+        }
+
+        if (keep) {
+            if (log_date != date || !log.is_open()) {
+                // Daily rotation: logs/users_YYYY-MM-DD.jsonl
+                if (log.is_open()) log.close();
+                ::mkdir(log_dir.c_str(), 0755);
+                const std::string file =
+                    log_dir + "/users_" + date + ".jsonl";
+                log.open(file, std::ios::app);
+                log_date = date;
+                if (!log) {
+                    std::cerr << "append_user_log: cannot open " << file
+                              << "\n";
+                }
+            }
+            if (log) log << line;
+        }
+
+        Node *next = ordered->next;
+        delete ordered;
+        ordered = next;
+    }
+    if (log) log.flush();
+}
+
+void UserLogWriter::write_users_json() {
+    std::string users = users_json();
+    // The timestamp is left out of the comparison, so a server nobody is
+    // listening to stops writing altogether
+    if (users == last_users) return;
+
+    char ts[32];
+    format_utc(std::chrono::system_clock::now(), "%Y-%m-%dT%H:%M:%SZ", ts,
+               sizeof(ts));
+
+    // Atomic write: write to a .tmp file then rename so readers never see a
+    // partial file (rename is atomic on POSIX when src and dst are on the
+    // same filesystem, which they always are here).
+    const std::string tmp = users_json_path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::trunc);
+        if (!f) {
+            std::cerr << "write_users_json: cannot open " << tmp << "\n";
+            return;
+        }
+        f << "{\n  \"timestamp\": \"" << ts << "\",\n" << users;
+    }
+    if (std::rename(tmp.c_str(), users_json_path.c_str()) != 0) {
+        std::cerr << "write_users_json: rename failed for " << users_json_path
+                  << "\n";
+        return;
+    }
+    last_users = std::move(users);
+}
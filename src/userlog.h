@@ -0,0 +1,79 @@
+#ifndef USERLOG_H
+#define USERLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// One line of the JSONL statistics log, captured when the event happened
+// (a disconnecting client is gone by the time the line is written)
+struct UserLogEvent {
+    std::chrono::system_clock::time_point at;
+    bool disconnect = false;
+    std::string unique_id;
+    std::string ip;
+    std::string geo;
+    std::string mode = "?";
+    int64_t freq_hz = 0;       // 0 for a disconnect
+    long duration_s = 0;
+};
+
+// Writes users.json and the daily JSONL statistics log on a thread of its
+// own, at a lowered priority, so tune storms never wait on the disk.
+//
+// push() puts an event on a lock-free list and returns; the thread takes
+// the whole list every tick, appends the lines to the day's log (kept open,
+// flushed once per tick, reopened when the UTC date changes) and rewrites
+// users.json if the user list has changed.
+class UserLogWriter {
+  public:
+    // users_json is called on the writer thread once per tick and returns
+    // the users.json body without its timestamp line
+    UserLogWriter(std::string users_json_path, std::string log_dir,
+                  std::function<std::string()> users_json);
+    ~UserLogWriter();
+
+    UserLogWriter(const UserLogWriter &) = delete;
+    UserLogWriter &operator=(const UserLogWriter &) = delete;
+
+    void start();
+    // Writes out what is queued, then joins.  Idempotent.
+    void stop();
+
+    // Never blocks
+    void push(UserLogEvent event);
+
+  private:
+    struct Node {
+        UserLogEvent event;
+        Node *next;
+    };
+
+    void run();
+    void write_log(Node *list);
+    void write_users_json();
+
+    std::string users_json_path;
+    std::string log_dir;
+    std::function<std::string()> users_json;
+
+    // Newest first; the writer takes the whole list with one exchange
+    std::atomic<Node *> head{nullptr};
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Writer thread only
+    std::ofstream log;
+    std::string log_date;
+    std::string last_users;
+    // Last line logged per client, to drop exact repeats (see write_log)
+    std::unordered_map<std::string, std::string> last_logged;
+};
+
+#endif
@@ -1,16 +1,19 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
 #include <complex>
+#include <cstddef>
 #include <iostream>
 #include <numeric>
 #include <queue>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-
-#include <boost/circular_buffer.hpp>
+#include <vector>
 
 std::string generate_unique_id();
 
@@ -73,86 +76,164 @@ template <typename T> class Klein {
     T cc;
 };
 
+// The filters below keep their history in a ring whose capacity is a power
+// of two, indexed by a running position masked to the capacity, so neither
+// insert() nor the block calls branch on wrap-around or allocate.
+
+// Average of the last length values inserted (zeros before that).  The sum
+// is carried in double for float, so it does not drift however long it runs.
 template <typename T> class MovingAverage {
   public:
-    MovingAverage(){};
-    MovingAverage(int length) : length{length}, num{0}, q{length, 0}, sum{0} {}
+    MovingAverage() : MovingAverage(1) {}
+    MovingAverage(int length)
+        : length{length}, mask{std::bit_ceil(2 * (size_t)length) - 1},
+          q(mask + 1, T{0}), scratch(length), sum{0} {}
     inline T insert(T val) {
-        sum -= q.back();
-        q.push_front(val);
-        sum += val;
+        const T old = q[(pos - length) & mask];
+        q[pos++ & mask] = val;
+        // Old value out, then new value in: for double and integer types
+        // the same sums, bit for bit, as the boost::circular_buffer version
+        sum -= (Sum)old;
+        sum += (Sum)val;
         return getAverage();
     }
-    inline T getAverage() { return sum / length; }
+    inline T getAverage() const { return (T)(sum / length); }
+    // Value inserted age values ago, 0 = the latest; age < 2 * length
+    inline T history(size_t age) const { return q[(pos - 1 - age) & mask]; }
+    // The n values inserted from age + n - 1 ago to age ago, oldest first
+    void history(T *out, size_t n, size_t age) const {
+        const size_t start = (pos - age - n) & mask;
+        const size_t first = std::min(n, mask + 1 - start);
+        std::copy_n(q.data() + start, first, out);
+        std::copy_n(q.data(), n - first, out + first);
+    }
+    // insert() each of in[0, n), writing the averages to out (may be in)
+    void process(const T *in, T *out, size_t n) {
+        for (size_t done = 0; done < n;) {
+            // At most length at a time, so the values read back (positions
+            // pos - length on) and those written (pos on) never overlap: the
+            // ring holds 2 * length.  Neither span may wrap, so both loops
+            // run over contiguous memory.
+            const size_t w = pos & mask, r = (pos - length) & mask;
+            const size_t m = std::min({n - done, (size_t)length, mask + 1 - w,
+                                       mask + 1 - r});
+            const T *x = in + done;
+            const T *qr = q.data() + r;
+            // Summed in the order insert() sums
+            for (size_t i = 0; i < m; i++) {
+                sum -= (Sum)qr[i];
+                sum += (Sum)x[i];
+                scratch[i] = sum;
+            }
+            std::copy_n(x, m, q.data() + w);
+            pos += m;
+            T *y = out + done;
+#pragma omp simd
+            for (size_t i = 0; i < m; i++) {
+                y[i] = (T)(scratch[i] / length);
+            }
+            done += m;
+        }
+    }
     inline void reset() {
         sum = 0;
-        fill(q.begin(), q.end(), 0);
+        pos = 0;
+        std::fill(q.begin(), q.end(), T{0});
     }
-    boost::circular_buffer<T> &getBuffer() { return q; }
 
   protected:
+    using Sum = std::conditional_t<std::is_same_v<T, float>, double, T>;
+
     int length;
-    int num;
-    boost::circular_buffer<T> q;
-    std::conditional<std::is_floating_point<T>::value, Neumaier<T>, T>::type
-        sum;
+    size_t mask;
+    size_t pos = 0;
+    std::vector<T> q;
+    std::vector<Sum> scratch;
+    Sum sum;
 };
 
+// Most frequent of the last length values inserted, the largest on a tie,
+// 0 before the first.  Meant for short windows: each insert() scans the ring
+// once, with no branches or allocations.
 template <class T> class MovingMode {
   public:
-    MovingMode(){};
-    MovingMode(int length) : length{length}, q{length, 0} {}
+    MovingMode() : MovingMode(1) {}
+    MovingMode(int length)
+        : length{length}, mask{std::bit_ceil((size_t)length) - 1},
+          q(mask + 1, T{0}), count(mask + 1, 0) {}
     inline T insert(T val) {
-        increment(q.back(), -1);
-        q.push_front(val);
-        increment(val, 1);
-        return getMode();
-    }
-    inline void increment(T val, int amount) {
-        v.erase({m[val], val});
-        m[val] += amount;
-        if (m[val] > 0) {
-            v.insert({m[val], val});
-        } else {
-            m.erase(val);
+        // The value leaving the window, if the window is full
+        const size_t out = (pos - length) & mask;
+        const T old = q[out];
+        const int leaving = count[out] > 0;
+        count[out] = 0;
+        // count[i] is how often q[i] occurs in the window, 0 for an empty
+        // slot; every copy of a value holds the same count
+        const size_t in = pos++ & mask;
+        int same = 1;
+        for (size_t i = 0; i <= mask; i++) {
+            const int live = count[i] > 0;
+            count[i] -= live & leaving & (q[i] == old);
+            const int match = (count[i] > 0) & (q[i] == val);
+            count[i] += match;
+            same += match;
         }
+        q[in] = val;
+        count[in] = same;
+        return getMode();
     }
-    inline T getMode() {
-        if (v.empty()) {
-            return 0;
+    inline T getMode() const {
+        T mode = 0;
+        int best = 0;
+        for (size_t i = 0; i <= mask; i++) {
+            if (count[i] > best || (count[i] == best && best > 0 && q[i] > mode)) {
+                best = count[i];
+                mode = q[i];
+            }
         }
-        return v.begin()->second;
+        return mode;
     }
     inline void reset() {
-        m.clear();
-        v.clear();
-        fill(q.begin(), q.end(), 0);
+        pos = 0;
+        std::fill(count.begin(), count.end(), 0);
     }
 
   protected:
     int length;
-    boost::circular_buffer<T> q;
-    std::set<std::pair<int, T>, std::greater<std::pair<int, T>>> v;
-    std::unordered_map<T, int> m;
+    size_t mask;
+    size_t pos = 0;
+    std::vector<T> q;
+    std::vector<int> count;
 };
 
+// Two cascaded moving averages of delay samples subtracted from the input
+// delayed to their centre: a linear-phase DC notch.
 template <class T> class DCBlocker {
   public:
     DCBlocker() : DCBlocker(256) {}
     DCBlocker(int delay)
-        : delay{delay}, last{0}, movingAverage1{delay}, movingAverage2{delay} {}
+        : delay{delay}, movingAverage1{delay}, movingAverage2{delay},
+          averaged(delay) {}
     void setAlpha(float alpha) { this->alpha = alpha; }
     inline T processSample(T s) {
-        float ma1 = movingAverage1.insert(s);
-        float ma2 = movingAverage2.insert(ma1);
-        return movingAverage1.getBuffer()[delay - 1] - ma2;
+        T ma1 = movingAverage1.insert(s);
+        T ma2 = movingAverage2.insert(ma1);
+        return movingAverage1.history(delay - 1) - ma2;
     }
     void removeDC(T *arr, int length) {
-        for (int i = 0; i < length; i++) {
-            arr[i] = processSample(arr[i]);
-            /*T temp = arr[i] + alpha * last;
-            arr[i] = temp - last;
-            last = temp;*/
+        for (int done = 0; done < length;) {
+            // The delayed input of a block of up to delay samples is still
+            // in the first average's ring after the block went in
+            const int m = std::min(length - done, delay);
+            T *x = arr + done;
+            movingAverage1.process(x, averaged.data(), m);
+            movingAverage2.process(averaged.data(), averaged.data(), m);
+            movingAverage1.history(x, m, delay - 1);
+#pragma omp simd
+            for (int i = 0; i < m; i++) {
+                x[i] -= averaged[i];
+            }
+            done += m;
         }
     }
     void reset() {
@@ -162,10 +243,10 @@ template <class T> class DCBlocker {
 
   protected:
     int delay;
-    T last;
     T alpha = 0.95;
     MovingAverage<T> movingAverage1;
     MovingAverage<T> movingAverage2;
+    std::vector<T> averaged;   // removeDC scratch, one block
 };
 
 #endif
\ No newline at end of file
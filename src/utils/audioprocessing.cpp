@@ -1,6 +1,7 @@
 #include "audioprocessing.h"
 #include <cmath>
 #include <algorithm>
+#include <bit>
 #include <mutex>
 
 // Local mutex for FFTW thread safety in audioprocessing.
@@ -21,6 +22,7 @@ AGC::AGC(float desiredLevel, float attackTimeMs, float releaseTimeMs, float look
 
     // Look-ahead buffer in samples
     look_ahead_samples = static_cast<size_t>(lookAheadTimeMs * sample_rate / 1000.0f);
+    resize_lookahead();
 
     // Attack/release time constants (per-sample coefficients).
     // Both use 0.001f to convert milliseconds → seconds correctly.
@@ -31,7 +33,7 @@ AGC::AGC(float desiredLevel, float attackTimeMs, float releaseTimeMs, float look
     release_coeff = 1.0f - std::exp(-1.0f / (releaseTimeMs * 0.001f * sample_rate * kReleaseStretch));
 
     // Multiple gain stages (RF, IF1, IF2, IF3, Audio) – kept for future use
-    gains.resize(5, 1.0f);
+    gains.fill(1.0f);
 
     // Limit how loud AGC can go.
     // Effective max linear gain = max_gain × 0.01f (output scale applied in process()).
@@ -171,28 +173,44 @@ void AGC::configureForQUAM() {
 // Lookahead buffer management
 // --------------------------------------------------------------------------
 
+// The window holds look_ahead_samples samples, one more while push() has
+// added a sample and not yet dropped the oldest, so both rings need room for
+// look_ahead_samples + 1.  Each sample enters and leaves the peak queue at
+// most once, which makes push() O(1) amortized.
+void AGC::resize_lookahead() {
+    const size_t capacity = std::bit_ceil(look_ahead_samples + 1);
+    lookahead_ring.assign(capacity, 0.0f);
+    lookahead_peaks.assign(capacity, LookaheadPeak{});
+    lookahead_mask = capacity - 1;
+    lookahead_next = lookahead_first = 0;
+    peaks_head = peaks_tail = 0;
+}
+
 void AGC::push(float sample) {
-    lookahead_buffer.push_back(sample);
-    while (!lookahead_max.empty() && std::abs(lookahead_max.back()) < std::abs(sample)) {
-        lookahead_max.pop_back();
+    const float magnitude = std::abs(sample);
+    lookahead_ring[lookahead_next & lookahead_mask] = sample;
+    while (peaks_tail != peaks_head &&
+           lookahead_peaks[(peaks_tail - 1) & lookahead_mask].magnitude < magnitude) {
+        peaks_tail--;
     }
-    lookahead_max.push_back(sample);
+    lookahead_peaks[peaks_tail++ & lookahead_mask] = {lookahead_next++, magnitude};
 
-    if (lookahead_buffer.size() > look_ahead_samples) {
+    if (lookahead_next - lookahead_first > look_ahead_samples) {
         pop();
     }
 }
 
 void AGC::pop() {
-    float sample = lookahead_buffer.front();
-    lookahead_buffer.pop_front();
-    if (!lookahead_max.empty() && sample == lookahead_max.front()) {
-        lookahead_max.pop_front();
+    if (peaks_head != peaks_tail &&
+        lookahead_peaks[peaks_head & lookahead_mask].position == lookahead_first) {
+        peaks_head++;
     }
+    lookahead_first++;
 }
 
-float AGC::max() {
-    return lookahead_max.empty() ? 0.0f : std::abs(lookahead_max.front());
+float AGC::max() const {
+    return peaks_head == peaks_tail ? 0.0f
+                                    : lookahead_peaks[peaks_head & lookahead_mask].magnitude;
 }
 
 // --------------------------------------------------------------------------
@@ -201,29 +219,31 @@ float AGC::max() {
 // Input blocks stride by nb_overlap and are nb_fft_size wide, so consecutive
 // blocks overlap by (nb_fft_size - nb_overlap) samples — correct for
 // overlap-save.  Only the LAST nb_overlap samples of each IFFT block are the
-// valid, non-aliased output region and are written to processed_buffer.
+// valid, non-aliased output region and are written back.
 // Writing the full nb_fft_size output samples per stride would cause later
 // blocks to clobber earlier ones in the overlap region.
 //
+// The block at i reads [i, i + nb_fft_size) and writes only [i, i + nb_overlap),
+// and no later block reads below its own start, so the blanker works in place.
+//
 // Spectral processing is Wiener-style: the IFFT output provides a magnitude
 // estimate used to derive a reduction factor, which is then applied to the
 // original time-domain input sample.  This avoids IFFT ringing in the output
 // while still using the spectral estimate for gating decisions.
 // --------------------------------------------------------------------------
 
-void AGC::applyNoiseBlanker(std::vector<float>& buffer) {
+void AGC::applyNoiseBlanker(float *buffer, size_t len) {
     if (!nb_enabled.load(std::memory_order_relaxed) || !nb_fft_plan || !nb_ifft_plan) {
         return;
     }
 
-    std::vector<float> processed_buffer(buffer.size(), 0.0f);
     const float norm         = 1.0f / static_cast<float>(nb_fft_size);
     const size_t valid_start = nb_fft_size - nb_overlap; // first valid output index per block
 
-    for (size_t i = 0; i < buffer.size(); i += nb_overlap) {
+    for (size_t i = 0; i < len; i += nb_overlap) {
         // Copy available samples then zero-pad so the FFT never sees stale data.
-        size_t copy_size = std::min(nb_fft_size, buffer.size() - i);
-        std::copy(buffer.begin() + i, buffer.begin() + i + copy_size, nb_buffer.begin());
+        size_t copy_size = std::min(nb_fft_size, len - i);
+        std::copy(buffer + i, buffer + i + copy_size, nb_buffer.begin());
         if (copy_size < nb_fft_size) {
             std::fill(nb_buffer.begin() + copy_size, nb_buffer.end(), 0.0f);
         }
@@ -238,20 +258,18 @@ void AGC::applyNoiseBlanker(std::vector<float>& buffer) {
         // FIX: magnitude_spectrum covers DC through Nyquist inclusive (N/2 + 1 bins).
         // Previously it was sized N/2, causing the Nyquist bin to be read from the
         // wrong index (N/2 - 1, i.e. the bin below Nyquist).
-        std::vector<float> magnitude_spectrum(nb_fft_size / 2 + 1);
-        for (size_t j = 0; j <= nb_fft_size / 2; ++j) {
-            magnitude_spectrum[j] = std::sqrt(nb_fft_out[j][0] * nb_fft_out[j][0] +
-                                              nb_fft_out[j][1] * nb_fft_out[j][1]);
-        }
-
+        //
         // Incremental running-average update — O(N/2) instead of O(N/2 × W).
-        // Subtract the evicted bin, add the new bin.
+        // Subtract the evicted bin, add the new bin.  The new spectrum goes
+        // straight into the history slot it replaces.
+        std::vector<float> &magnitude_spectrum = nb_spectrum_history[nb_history_index];
         for (size_t j = 0; j <= nb_fft_size / 2; ++j) {
+            float magnitude = std::sqrt(nb_fft_out[j][0] * nb_fft_out[j][0] +
+                                        nb_fft_out[j][1] * nb_fft_out[j][1]);
             nb_spectrum_average[j] +=
-                (magnitude_spectrum[j] - nb_spectrum_history[nb_history_index][j])
-                / static_cast<float>(nb_average_windows);
+                (magnitude - magnitude_spectrum[j]) / static_cast<float>(nb_average_windows);
+            magnitude_spectrum[j] = magnitude;
         }
-        nb_spectrum_history[nb_history_index] = magnitude_spectrum;
         nb_history_index = (nb_history_index + 1) % nb_average_windows;
 
         // Derive threshold from average spectral level
@@ -301,7 +319,7 @@ void AGC::applyNoiseBlanker(std::vector<float>& buffer) {
         // are discarded; they correspond to the circular-aliased region in overlap-save.
         for (size_t j = valid_start; j < nb_fft_size; ++j) {
             size_t out_idx = i + (j - valid_start);
-            if (out_idx >= buffer.size()) break;
+            if (out_idx >= len) break;
 
             // Normalise IFFT output by 1/N to get true amplitude estimate
             float real_out  = nb_fft_in[j][0] * norm;
@@ -312,14 +330,10 @@ void AGC::applyNoiseBlanker(std::vector<float>& buffer) {
             // applied to original input sample to avoid IFFT ringing in output.
             if (magnitude > dynamic_threshold) {
                 float reduction_factor = dynamic_threshold / (magnitude + 1e-12f);
-                processed_buffer[out_idx] = buffer[out_idx] * reduction_factor;
-            } else {
-                processed_buffer[out_idx] = buffer[out_idx];
+                buffer[out_idx] *= reduction_factor;
             }
         }
     }
-
-    buffer = processed_buffer;
 }
 
 // --------------------------------------------------------------------------
@@ -327,19 +341,20 @@ void AGC::applyNoiseBlanker(std::vector<float>& buffer) {
 // --------------------------------------------------------------------------
 
 void AGC::process(float *arr, size_t len) {
-    // Copy input buffer so we can run the noise blanker
-    std::vector<float> buffer(arr, arr + len);
-
-    // Apply Noise Blanker if enabled (atomic load for thread safety)
+    // Noise Blanker works in place (atomic load for thread safety)
     if (nb_enabled.load(std::memory_order_relaxed)) {
-        applyNoiseBlanker(buffer);
+        applyNoiseBlanker(arr, len);
     }
 
-    // --- ZERO-LOOKAHEAD / MINIMUM-LATENCY PATH ---
+    if (gain_scratch.size() < len) {
+        gain_scratch.resize(len);
+    }
+    float *gain = gain_scratch.data();
+
     if (look_ahead_samples == 0) {
+        // --- ZERO-LOOKAHEAD / MINIMUM-LATENCY PATH ---
         for (size_t i = 0; i < len; ++i) {
-            float sample      = buffer[i];
-            float peak_sample = std::fabs(sample);
+            float peak_sample = std::fabs(arr[i]);
 
             float desired_gain = std::min(
                 desired_level / (peak_sample + 1e-15f),
@@ -348,46 +363,40 @@ void AGC::process(float *arr, size_t len) {
 
             applyProgressiveAGC(desired_gain);
 
-            float total_gain = 1.0f;
-            for (float g : gains) {
-                total_gain *= g;
-            }
-            total_gain = std::min(total_gain, max_gain);
-
             // 0.01f output scale: max_gain 1000 → 10× (+20 dB) effective ceiling
-            arr[i] = sample * (total_gain * 0.01f);
+            gain[i] = total_gain() * 0.01f;
         }
-        return;
-    }
+    } else {
+        // --- LOOKAHEAD PATH (adds lookAheadTimeMs latency) ---
+        // arr[i] is pushed before it is overwritten by the delayed sample
+        for (size_t i = 0; i < len; ++i) {
+            push(arr[i]);
 
-    // --- LOOKAHEAD PATH (adds lookAheadTimeMs latency) ---
-    for (size_t i = 0; i < len; ++i) {
-        push(buffer[i]);
+            if (lookahead_next - lookahead_first == look_ahead_samples) {
+                float current_sample = lookahead_ring[lookahead_first & lookahead_mask];
+                float peak_sample    = max();
 
-        if (lookahead_buffer.size() == look_ahead_samples) {
-            float current_sample = lookahead_buffer.front();
-            float peak_sample    = max();
+                float desired_gain = std::min(
+                    desired_level / (peak_sample + 1e-15f),
+                    max_gain
+                );
 
-            float desired_gain = std::min(
-                desired_level / (peak_sample + 1e-15f),
-                max_gain
-            );
+                applyProgressiveAGC(desired_gain);
 
-            applyProgressiveAGC(desired_gain);
-
-            float total_gain = 1.0f;
-            for (float g : gains) {
-                total_gain *= g;
+                arr[i]  = current_sample;
+                gain[i] = total_gain() * 0.01f;
+            } else {
+                // Still filling lookahead buffer – mute until full window available
+                arr[i]  = 0.0f;
+                gain[i] = 0.0f;
             }
-            total_gain = std::min(total_gain, max_gain);
-
-            // 0.01f output scale: max_gain 1000 → 10× (+20 dB) effective ceiling
-            arr[i] = current_sample * (total_gain * 0.01f);
-        } else {
-            // Still filling lookahead buffer – mute until full window available
-            arr[i] = 0.0f;
         }
     }
+
+#pragma omp simd
+    for (size_t i = 0; i < len; ++i) {
+        arr[i] *= gain[i];
+    }
 }
 
 void AGC::process_stereo(float *left, float *right, size_t len) {
@@ -431,8 +440,15 @@ void AGC::applyProgressiveAGC(float desired_gain) {
         hang_counter--;
     }
 
-    for (size_t i = 0; i < gains.size(); ++i) {
-        float stage_desired_gain = std::min(std::pow(desired_gain, 1.0f / gains.size()), max_gain);
+    // Every stage aims for the same share of the total gain.  desired_gain
+    // only changes with the look-ahead peak, so the root is usually cached.
+    if (desired_gain != last_desired_gain) {
+        last_desired_gain  = desired_gain;
+        last_stage_desired = std::min(std::pow(desired_gain, 1.0f / kGainStages), max_gain);
+    }
+    const float stage_desired_gain = last_stage_desired;
+
+    for (size_t i = 0; i < kGainStages; ++i) {
 
         // Re-arm hang timer when signal drops sharply
         if (stage_desired_gain < gains[i] * hang_threshold) {
@@ -465,11 +481,70 @@ void AGC::applyProgressiveAGC(float desired_gain) {
     }
 }
 
+// Product of the stage gains, limited to max_gain
+float AGC::total_gain() const {
+    float total = 1.0f;
+    for (float g : gains) {
+        total *= g;
+    }
+    return std::min(total, max_gain);
+}
+
 void AGC::reset() {
-    std::fill(gains.begin(), gains.end(), 1.0f);
-    lookahead_buffer.clear();
-    lookahead_max.clear();
+    gains.fill(1.0f);
+    last_desired_gain = -1.0f;
+    lookahead_next = lookahead_first = 0;
+    peaks_head = peaks_tail = 0;
     hang_counter = 0;
     stereo_level = 0.1f;
     stereo_gain  = 1.0f;
+}
+
+// Copies the running state and the mode profile of another AGC.  The noise
+// blanker's FFTW plans and scratch arrays stay with this instance; only its
+// averaging history is taken over.
+void AGC::copy_state_from(const AGC &other) {
+    if (this == &other) return;
+    desired_level      = other.desired_level;
+    attack_coeff       = other.attack_coeff;
+    release_coeff      = other.release_coeff;
+    fast_attack_coeff  = other.fast_attack_coeff;
+    am_attack_coeff    = other.am_attack_coeff;
+    am_release_coeff   = other.am_release_coeff;
+    look_ahead_samples = other.look_ahead_samples;
+    gains              = other.gains;
+    last_desired_gain  = other.last_desired_gain;
+    last_stage_desired = other.last_stage_desired;
+    lookahead_ring     = other.lookahead_ring;
+    lookahead_peaks    = other.lookahead_peaks;
+    lookahead_mask     = other.lookahead_mask;
+    lookahead_next     = other.lookahead_next;
+    lookahead_first    = other.lookahead_first;
+    peaks_head         = other.peaks_head;
+    peaks_tail         = other.peaks_tail;
+    sample_rate        = other.sample_rate;
+    max_gain           = other.max_gain;
+
+    nb_enabled          = other.nb_enabled.load();
+    nb_threshold        = other.nb_threshold;
+    nb_threshold_factor = other.nb_threshold_factor;
+    nb_smoothing_factor = other.nb_smoothing_factor;
+    nb_buffer           = other.nb_buffer;
+    nb_spectrum_history = other.nb_spectrum_history;
+    nb_spectrum_average = other.nb_spectrum_average;
+    nb_history_index    = other.nb_history_index;
+
+    hang_time      = other.hang_time;
+    hang_counter   = other.hang_counter;
+    hang_threshold = other.hang_threshold;
+
+    stereo_level              = other.stereo_level;
+    stereo_gain               = other.stereo_gain;
+    stereo_min_gain           = other.stereo_min_gain;
+    stereo_max_gain           = other.stereo_max_gain;
+    stereo_attack_alpha       = other.stereo_attack_alpha;
+    stereo_release_alpha_fast = other.stereo_release_alpha_fast;
+    stereo_release_alpha_slow = other.stereo_release_alpha_slow;
+    stereo_level_alpha        = other.stereo_level_alpha;
+    stereo_target_level       = other.stereo_target_level;
 }
\ No newline at end of file
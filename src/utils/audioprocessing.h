@@ -1,8 +1,9 @@
 #ifndef AUDIO_PROCESSING_H
 #define AUDIO_PROCESSING_H
 
+#include <array>
 #include <cstddef>
-#include <deque>
+#include <cstdint>
 #include <vector>
 #include "fftw3.h"
 #include <functional>
@@ -21,9 +22,29 @@ class AGC {
     float am_attack_coeff;
     float am_release_coeff;
     size_t look_ahead_samples;
-    std::vector<float> gains;
-    std::deque<float> lookahead_buffer;
-    std::deque<float> lookahead_max;
+    static constexpr size_t kGainStages = 5;
+    std::array<float, kGainStages> gains;
+    // Per-stage share of the last desired gain, see applyProgressiveAGC()
+    float last_desired_gain = -1.0f;
+    float last_stage_desired = 1.0f;
+
+    // Look-ahead window: the last look_ahead_samples input samples in a ring
+    // whose capacity is a power of two, and a monotonic queue (a ring of the
+    // same capacity) of the samples that can still become the window's peak,
+    // largest first.  Positions count samples since reset().
+    struct LookaheadPeak {
+        uint64_t position;
+        float magnitude;
+    };
+    std::vector<float> lookahead_ring;
+    std::vector<LookaheadPeak> lookahead_peaks;
+    size_t lookahead_mask;
+    uint64_t lookahead_next;     // position of the next sample pushed
+    uint64_t lookahead_first;    // oldest sample in the window
+    uint64_t peaks_head, peaks_tail;
+    // Output gain per sample of one process() call, applied in a pass of
+    // its own so the multiply vectorizes
+    std::vector<float> gain_scratch;
     float sample_rate;
     float max_gain;  // Maximum allowed gain
 
@@ -62,11 +83,13 @@ class AGC {
     float stereo_level_alpha;
     float stereo_target_level;
 
+    void resize_lookahead();
     void push(float sample);
     void pop();
-    float max();
+    float max() const;
     void applyProgressiveAGC(float desired_gain);
-    void applyNoiseBlanker(std::vector<float>& buffer);
+    float total_gain() const;
+    void applyNoiseBlanker(float *buffer, size_t len);
 
 public:
     AGC(float desiredLevel,
@@ -92,6 +115,9 @@ public:
     void process(float *arr, size_t len);
     void process_stereo(float *left, float *right, size_t len);
     void reset();
+    // Take over another AGC's gain, hang and look-ahead state (shared
+    // demodulation hand-off, see AudioClient::try_adopt_dsp_state)
+    void copy_state_from(const AGC &other);
     void configureForSSB();
     void configureForAM();
     void configureForQUAM();
@@ -0,0 +1,512 @@
+#include "noisereduction.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include "../fftplancache.h"
+#include "../metrics.h"
+
+// ── SpectralNR ──────────────────────────────────────────────────────────────
+
+namespace {
+constexpr float kPsThr = 0.99f;  // threshold for smoothed speech probability
+constexpr float kPnSaf = 0.01f;  // noise probability safety value
+constexpr float kPsIni = 0.5f;   // initial speech probability
+constexpr float kPsPri = 0.5f;   // prior speech probability
+// Noise and speech probability smoothing per hop.  The original derives
+// them from time constants that are a multiple of the hop time, which
+// leaves 0.8 and 0.9 at any sample rate.
+constexpr float kAx = 0.8f;
+constexpr float kAp = 0.9f;
+constexpr int kInitHops = 20;    // noise estimate averaged over these first
+constexpr float kSnrPrioMin = 0.001f;    // -30 dB
+constexpr float kGainLimit = 0.001f;
+constexpr int kSmoothWidth = 4;
+// Bins that are weighted; the original leaves DC and Nyquist alone
+constexpr int kLow = 1;
+constexpr int kHigh = SpectralNR::kFFT / 2;
+} // namespace
+
+SpectralNR::SpectralNR(float gain, float alpha, float asnr)
+    : gain{gain}, alpha{alpha}, xih1r{1.0f / (1.0f + asnr) - 1.0f},
+      pfac{(1.0f / kPsPri - 1.0f) * (1.0f + asnr)}, window(kFFT),
+      time(kFFT), spectrum(kBins), last_input(kHop), last_output(kHop),
+      X(kBins), xt(kBins), pslp(kBins), SNR_post(kBins), SNR_prio(kBins),
+      Hk_old(kBins), G(kBins), smoothed(kBins), in_hop(kHop), out_hop(kHop) {
+    // Periodic sqrt-Hann, so analysis times synthesis window overlap-adds
+    // to exactly one at 50 % overlap
+    for (int i = 0; i < kFFT; i++) {
+        window[i] = std::sin(static_cast<float>(M_PI) * i / kFFT);
+    }
+    auto &plans = FFTPlanCache::instance();
+    forward = plans.get_r2c(kFFT, time.data(),
+                            (fftwf_complex *)spectrum.data());
+    backward = plans.get_c2r(kFFT, (const fftwf_complex *)spectrum.data(),
+                             time.data());
+    reset();
+}
+
+void SpectralNR::reset() {
+    std::fill(last_input.begin(), last_input.end(), 0.0f);
+    std::fill(last_output.begin(), last_output.end(), 0.0f);
+    std::fill(in_hop.begin(), in_hop.end(), 0.0f);
+    std::fill(out_hop.begin(), out_hop.end(), 0.0f);
+    std::fill(xt.begin(), xt.end(), 0.0f);
+    std::fill(pslp.begin(), pslp.end(), 0.5f);
+    std::fill(SNR_post.begin(), SNR_post.end(), 2.0f);
+    std::fill(SNR_prio.begin(), SNR_prio.end(), 1.0f);
+    std::fill(Hk_old.begin(), Hk_old.end(), 1.0f);
+    std::fill(G.begin(), G.end(), 1.0f);
+    hop_fill = 0;
+    init_hops = 0;
+}
+
+void SpectralNR::process(float *audio, size_t len) {
+    // Each sample goes into the hop being collected and is replaced by the
+    // sample at the same place in the previous hop's output
+    size_t pos = 0;
+    while (pos < len) {
+        const size_t n = std::min(len - pos, size_t{kHop} - hop_fill);
+        for (size_t i = 0; i < n; i++) {
+            const float in = audio[pos + i];
+            audio[pos + i] = out_hop[hop_fill + i];
+            in_hop[hop_fill + i] = in;
+        }
+        pos += n;
+        hop_fill += n;
+        if (hop_fill == kHop) {
+            process_hop(in_hop.data(), out_hop.data());
+            hop_fill = 0;
+        }
+    }
+}
+
+void SpectralNR::process_hop(const float *in, float *out) {
+#pragma omp simd
+    for (int i = 0; i < kHop; i++) {
+        time[i] = last_input[i] * window[i];
+        time[kHop + i] = in[i] * window[kHop + i];
+    }
+    std::copy_n(in, kHop, last_input.data());
+
+    fftwf_execute_dft_r2c(forward, time.data(),
+                          (fftwf_complex *)spectrum.data());
+    for (int b = 0; b < kBins; b++) {
+        X[b] = std::norm(spectrum[b]);
+    }
+    // Keeps X / xt a number while the noise estimate is still zero
+    constexpr float xt_min = std::numeric_limits<float>::min();
+
+    if (init_hops < kInitHops) {
+        // Average the noise over the first hops, about 100 ms at 12 kHz,
+        // and leave the audio as it is meanwhile
+        for (int b = 0; b < kBins; b++) {
+            xt[b] += kPsIni * X[b] / kInitHops;
+        }
+        init_hops++;
+    } else {
+        // MMSE noise estimate
+        for (int b = 0; b < kBins; b++) {
+            const float snr = X[b] / std::max(xt[b], xt_min);
+            float ph1y = 1.0f / (1.0f + pfac * std::exp(xih1r * snr));
+            pslp[b] = kAp * pslp[b] + (1.0f - kAp) * ph1y;
+            ph1y = pslp[b] > kPsThr ? 1.0f - kPnSaf : std::min(ph1y, 1.0f);
+            const float xtr = (1.0f - ph1y) * X[b] + ph1y * xt[b];
+            xt[b] = kAx * xt[b] + (1.0f - kAx) * xtr;
+        }
+
+        // A posteriori and a priori SNR, then the gains
+        for (int b = 0; b < kBins; b++) {
+            SNR_post[b] = std::clamp(X[b] / std::max(xt[b], xt_min),
+                                     kSnrPrioMin, 1000.0f);
+            SNR_prio[b] = std::max(
+                alpha * Hk_old[b] +
+                    (1.0f - alpha) * std::max(SNR_post[b] - 1.0f, 0.0f),
+                0.0f);
+        }
+        float pre_power = 0, post_power = 0;
+        for (int b = kLow; b < kHigh; b++) {
+            const float v = SNR_prio[b] * SNR_post[b] / (1.0f + SNR_prio[b]);
+            G[b] = std::max(1.0f / SNR_post[b] * std::sqrt(0.7212f * v + v * v),
+                            kGainLimit);
+            Hk_old[b] = SNR_post[b] * G[b] * G[b];
+            pre_power += X[b];
+            post_power += G[b] * G[b] * X[b];
+        }
+
+        // Musical noise: the more the frame was attenuated, the wider the
+        // moving average over the gains (DL2FW)
+        constexpr float power_threshold = 0.4f;
+        const float power_ratio = pre_power > 0 ? post_power / pre_power : 1;
+        const int nn =
+            power_ratio > power_threshold
+                ? 1
+                : 1 + 2 * static_cast<int>(
+                              0.5f + kSmoothWidth *
+                                         (1.0f - power_ratio / power_threshold));
+        if (nn > 1) {
+            for (int b = kLow; b < kHigh; b++) {
+                // Centred, or one-sided within nn / 2 of the edges
+                const int first =
+                    std::clamp(b - nn / 2, kLow, kHigh - nn);
+                float sum = 0;
+                for (int m = first; m < first + nn; m++) sum += G[m];
+                smoothed[b] = sum / nn;
+            }
+            std::copy(smoothed.begin() + kLow, smoothed.begin() + kHigh,
+                      G.begin() + kLow);
+        }
+    }
+
+    for (int b = kLow; b < kHigh; b++) {
+        spectrum[b] *= G[b];
+    }
+    fftwf_execute_dft_c2r(backward, (fftwf_complex *)spectrum.data(),
+                          time.data());
+
+    // FFTW leaves the inverse unscaled
+    const float scale = gain / kFFT;
+#pragma omp simd
+    for (int i = 0; i < kHop; i++) {
+        out[i] = (time[i] * window[i] + last_output[i]) * scale;
+        last_output[i] = time[kHop + i] * window[kHop + i];
+    }
+}
+
+// ── LmsANR ──────────────────────────────────────────────────────────────────
+
+namespace {
+constexpr float kLidxMin = 120.0f;
+constexpr float kLidxMax = 200.0f;
+constexpr float kLincr = 1.0f;
+constexpr float kLdecr = 3.0f;
+constexpr float kDenMult = 6.25e-10f;
+} // namespace
+
+LmsANR::LmsANR(bool notch, int taps, int delay, float two_mu, float gamma)
+    : notch{notch}, taps{std::clamp(taps, 1, kLine / 2)},
+      delay{std::clamp(delay, 0, kLine / 2 - 1)}, two_mu{two_mu},
+      gamma{gamma}, d(2 * kLine), w(this->taps) {}
+
+void LmsANR::reset() {
+    std::fill(d.begin(), d.end(), 0.0f);
+    std::fill(w.begin(), w.end(), 0.0f);
+    lidx = kLidxMin;
+    ngamma = 0.001f;
+    in_idx = 0;
+}
+
+void LmsANR::process(float *audio, size_t len) {
+    float *__restrict coeffs = w.data();
+    for (size_t i = 0; i < len; i++) {
+        const float x = audio[i];
+        d[in_idx] = x;
+        d[in_idx + kLine] = x;
+        const float *__restrict taps_in = &d[in_idx + delay];
+
+        float y = 0, sigma = 0;
+#pragma omp simd reduction(+ : y, sigma)
+        for (int j = 0; j < taps; j++) {
+            y += coeffs[j] * taps_in[j];
+            sigma += taps_in[j] * taps_in[j];
+        }
+
+        const float inv_sigp = 1.0f / (sigma + 1e-10f);
+        const float error = x - y;
+        audio[i] = notch ? error : y * 4.0f;
+
+        const float nel = std::abs(error * (1.0f - two_mu * sigma * inv_sigp));
+        const float nev = std::abs(x - (1.0f - two_mu * ngamma) * y -
+                                   two_mu * error * sigma * inv_sigp);
+        // As in wdsp, where the else binds to the inner if: the leak only
+        // moves while the filter is doing better than the leak-free one
+        if (nev < nel) {
+            if ((lidx += kLincr) > kLidxMax)
+                lidx = kLidxMax;
+            else if ((lidx -= kLdecr) < kLidxMin)
+                lidx = kLidxMin;
+        }
+        ngamma = gamma * (lidx * lidx) * (lidx * lidx) * kDenMult;
+
+        const float c0 = 1.0f - two_mu * ngamma;
+        const float c1 = two_mu * error * inv_sigp;
+#pragma omp simd
+        for (int j = 0; j < taps; j++) {
+            coeffs[j] = c0 * coeffs[j] + c1 * taps_in[j];
+        }
+
+        in_idx = (in_idx + kMask) & kMask;
+    }
+}
+
+// ── WildNB ──────────────────────────────────────────────────────────────────
+
+namespace {
+float dot(const float *a, const float *b, int n) {
+    float sum = 0;
+#pragma omp simd reduction(+ : sum)
+    for (int i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+} // namespace
+
+WildNB::WildNB(float threshold, int taps, int impulse_samples)
+    : threshold{threshold}, order{std::clamp(taps, 1, 40)},
+      pl{(std::clamp(impulse_samples, 3, 41) | 1) / 2},
+      working(2 * (order + pl)), lpcs(order + 1), reverse_lpcs(order + 1),
+      R(order + 1), any(order + 1), Wfw(2 * pl + 1), Wbw(2 * pl + 1),
+      Rfw(2 * pl + 1 + order), Rbw(2 * pl + 1 + order) {
+    // Weights for combining the forward and backward predictions
+    const int impulse_length = 2 * pl + 1;
+    for (int i = 0; i < impulse_length; i++) {
+        Wbw[i] = static_cast<float>(i) / (impulse_length - 1);
+        Wfw[impulse_length - i - 1] = Wbw[i];
+    }
+}
+
+void WildNB::reset() {
+    std::fill(working.begin(), working.end(), 0.0f);
+}
+
+// Works one frame behind: the frame analysed is the previous frame's end and
+// this frame's start, so impulses near the edges can still be predicted from
+// both sides.  Delays the audio by order + pl samples.
+void WildNB::process(float *audio, size_t len) {
+    if (len == 0) return;
+    const int n = static_cast<int>(len);
+    const int impulse_length = 2 * pl + 1;
+    const int carry = 2 * (order + pl);
+    if (working.size() < static_cast<size_t>(n + carry)) {
+        working.resize(n + carry);
+        residual.resize(n);
+        fir_state.resize(n + order);
+    }
+    std::copy_n(audio, n, &working[carry]);
+    float *frame = &working[order + pl];
+
+    // Autocorrelation, then the LPC coefficients by Levinson-Durbin
+    for (int i = 0; i <= order; i++) {
+        R[i] = dot(frame, frame + i, n - i);
+    }
+    R[0] *= 1.0f + 1.0e-9f;
+    std::fill(lpcs.begin(), lpcs.end(), 0.0f);
+    lpcs[0] = 1;
+    float alfa = R[0];
+    for (int m = 1; m <= order && alfa > 0; m++) {
+        float s = 0;
+        for (int u = 1; u < m; u++) s += lpcs[u] * R[m - u];
+        const float k = -(R[m] + s) / alfa;
+        for (int v = 1; v < m; v++) any[v] = lpcs[v] + k * lpcs[m - v];
+        for (int v = 1; v < m; v++) lpcs[v] = any[v];
+        lpcs[m] = k;
+        alfa *= 1 - k * k;
+    }
+    for (int o = 0; o <= order; o++) reverse_lpcs[order - o] = lpcs[o];
+
+    // Inverse filter to take out the voice, then a matched filter to bring
+    // out the impulses.  Both start from silence, as arm_fir_f32 did.
+    auto fir = [&](const float *coeffs, const float *in, float *out) {
+        std::fill_n(fir_state.begin(), order, 0.0f);
+        std::copy_n(in, n, &fir_state[order]);
+        for (int i = 0; i < n; i++) {
+            out[i] = dot(coeffs, &fir_state[i], order + 1);
+        }
+    };
+    fir(reverse_lpcs.data(), frame, residual.data());
+    fir(lpcs.data(), residual.data(), residual.data());
+
+    float mean = 0;
+    for (int i = 0; i < n; i++) mean += residual[i];
+    mean /= n;
+    float sigma2 = 0;
+    for (int i = 0; i < n; i++) {
+        sigma2 += (residual[i] - mean) * (residual[i] - mean);
+    }
+    sigma2 /= std::max(n - 1, 1);
+    const float lpc_power = dot(lpcs.data(), lpcs.data(), order);
+    const float impulse_threshold =
+        threshold * std::sqrt(sigma2 * lpc_power);
+
+    int impulses[kMaxImpulses];
+    int impulse_count = 0;
+    for (int pos = order + pl; pos < n && impulse_count < kMaxImpulses;
+         pos++) {
+        if (std::abs(residual[pos]) > impulse_threshold) {
+            // Corrected for the filter delay
+            impulses[impulse_count++] = pos - order;
+            // This area is repaired anyway
+            pos += pl;
+        }
+    }
+
+    // Forward and backward predictors: the negated coefficients without
+    // the leading one
+    for (int i = 1; i <= order; i++) lpcs[i] = -lpcs[i];
+    for (int i = 0; i < order; i++) reverse_lpcs[i] = -reverse_lpcs[i];
+
+    for (int j = 0; j < impulse_count; j++) {
+        const int start = order + impulses[j];   // in working
+        for (int k = 0; k < order; k++) {
+            Rfw[k] = working[impulses[j] + k];
+            Rbw[impulse_length + k] = working[start + impulse_length + k];
+        }
+        for (int i = 0; i < impulse_length; i++) {
+            Rfw[i + order] = dot(reverse_lpcs.data(), &Rfw[i], order);
+            Rbw[impulse_length - i - 1] =
+                dot(&lpcs[1], &Rbw[impulse_length - i], order);
+        }
+        for (int i = 0; i < impulse_length; i++) {
+            working[start + i] =
+                Wfw[i] * Rfw[order + i] + Wbw[i] * Rbw[i];
+        }
+    }
+
+    std::copy_n(frame, n, audio);
+    std::copy_n(&working[n], carry, working.begin());
+}
+
+// ── NoiseReductionLimits ────────────────────────────────────────────────────
+
+NoiseReductionLimits &NoiseReductionLimits::instance() {
+    static NoiseReductionLimits limits;
+    return limits;
+}
+
+void NoiseReductionLimits::configure(int max_chains, double cpu_budget) {
+    this->max_chains = max_chains;
+    budget = cpu_budget;
+}
+
+bool NoiseReductionLimits::try_acquire() {
+    int n = chains.load(std::memory_order_relaxed);
+    while (max_chains < 0 || n < max_chains) {
+        if (chains.compare_exchange_weak(n, n + 1,
+                                         std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NoiseReductionLimits::count_refusal() {
+    refusals.fetch_add(1, std::memory_order_relaxed);
+}
+
+void NoiseReductionLimits::release() {
+    chains.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// ── NoiseReductionChain ─────────────────────────────────────────────────────
+
+namespace {
+constexpr const char *kStageNames[3] = {"noise blanker", "spectral NR",
+                                        "LMS filter"};
+constexpr uint8_t kStageBits[3] = {NR_BLANKER, NR_SPECTRAL,
+                                   NR_LMS | NR_NOTCH};
+// Frames averaged before a stage can go over its budget
+constexpr int kBudgetWarmup = 8;
+
+template <typename T>
+void copy_stage(std::unique_ptr<T> &to, const std::unique_ptr<T> &from) {
+    if (!from) {
+        to.reset();
+    } else if (to) {
+        *to = *from;
+    } else {
+        to = std::make_unique<T>(*from);
+    }
+}
+} // namespace
+
+NoiseReductionChain::NoiseReductionChain(float sample_rate)
+    : sample_rate{sample_rate} {}
+
+NoiseReductionChain::~NoiseReductionChain() { release(); }
+
+void NoiseReductionChain::configure(uint8_t new_stages) {
+    // One LMS filter, either way round
+    if (new_stages & NR_NOTCH) new_stages &= ~NR_LMS;
+
+    if ((new_stages & NR_BLANKER) && !nb) nb = std::make_unique<WildNB>();
+    if (!(new_stages & NR_BLANKER)) nb.reset();
+    if ((new_stages & NR_SPECTRAL) && !nr) nr = std::make_unique<SpectralNR>();
+    if (!(new_stages & NR_SPECTRAL)) nr.reset();
+    const uint8_t lms = new_stages & (NR_LMS | NR_NOTCH);
+    if (lms != (stages & (NR_LMS | NR_NOTCH))) {
+        anr = lms ? std::make_unique<LmsANR>(lms == NR_NOTCH) : nullptr;
+    }
+
+    stages = new_stages;
+    bypassed = 0;
+    std::fill(std::begin(load), std::end(load), 0.0f);
+    std::fill(std::begin(measured), std::end(measured), 0);
+    if (!stages) release();
+}
+
+void NoiseReductionChain::release() {
+    if (has_slot) {
+        NoiseReductionLimits::instance().release();
+        has_slot = false;
+    }
+    refused = false;
+}
+
+void NoiseReductionChain::copy_state_from(const NoiseReductionChain &other) {
+    copy_stage(nb, other.nb);
+    copy_stage(nr, other.nr);
+    copy_stage(anr, other.anr);
+    stages = other.stages;
+    bypassed = other.bypassed;
+    std::copy(std::begin(other.load), std::end(other.load), load);
+    std::copy(std::begin(other.measured), std::end(other.measured), measured);
+    if (!stages) release();
+}
+
+template <typename F>
+void NoiseReductionChain::run_stage(int index, F &&stage, size_t len) {
+    if (bypassed & kStageBits[index]) return;
+    const auto start = std::chrono::steady_clock::now();
+    stage();
+    const double budget = NoiseReductionLimits::instance().cpu_budget();
+    if (budget <= 0 || len == 0) return;
+
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    const float share = static_cast<float>(seconds * sample_rate / len);
+    load[index] = measured[index] ? load[index] + 0.1f * (share - load[index])
+                                  : share;
+    if (++measured[index] >= kBudgetWarmup && load[index] > budget) {
+        bypassed |= kStageBits[index];
+        std::cout << "[nr] " << kStageNames[index] << " used "
+                  << load[index] * 100 << "% of real time, over the "
+                  << budget * 100 << "% budget; bypassed" << std::endl;
+    }
+}
+
+void NoiseReductionChain::process(float *audio, size_t len) {
+    if (!stages) return;
+    if (!has_slot) {
+        if (!NoiseReductionLimits::instance().try_acquire()) {
+            if (!refused) {
+                NoiseReductionLimits::instance().count_refusal();
+                std::cout << "[nr] limit of concurrent noise reduction "
+                             "reached, audio left unprocessed"
+                          << std::endl;
+                refused = true;
+            }
+            return;
+        }
+        has_slot = true;
+        refused = false;
+    }
+
+    StageTimer timer(Stage::NOISE_REDUCTION);
+    if (nb) run_stage(0, [&] { nb->process(audio, len); }, len);
+    if (nr) run_stage(1, [&] { nr->process(audio, len); }, len);
+    if (anr) run_stage(2, [&] { anr->process(audio, len); }, len);
+}
@@ -0,0 +1,194 @@
+#ifndef NOISE_REDUCTION_H
+#define NOISE_REDUCTION_H
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <boost/align/aligned_allocator.hpp>
+
+#include "fftw3.h"
+
+// Server-side versions of the browser's noise reduction (jsdsp/lib/*.c), so
+// listeners on slow devices can have it done for them.  Each works in place
+// on one frame of mono float audio at a time, of any length, and allocates
+// only on the first frame longer than any before.  The state is plain data:
+// assigning one stage to another carries the filter over (shared
+// demodulation hand-off).
+
+template <typename T>
+using NRVector = std::vector<T, boost::alignment::aligned_allocator<T, 64>>;
+
+// Spectral weighting noise reduction (NR_spectral.c, DD4WH / DL2FW after
+// Kim & Ruwisch 2002 and Romanin et al. 2009): 512-point sqrt-Hann STFT with
+// 50 % overlap, MMSE noise estimate and musical noise smoothing.  Delays the
+// audio by two hops (512 samples): one to collect a hop, one for the
+// overlap-add.
+class SpectralNR {
+  public:
+    static constexpr int kFFT = 512;
+    static constexpr int kHop = kFFT / 2;
+    static constexpr int kBins = kFFT / 2 + 1;
+
+    explicit SpectralNR(float gain = 1.0f, float alpha = 0.95f,
+                        float asnr = 30.0f);
+
+    void process(float *audio, size_t len);
+    void reset();
+
+  private:
+    void process_hop(const float *in, float *out);
+
+    float gain, alpha;
+    float xih1r, pfac;       // from asnr
+    int init_hops = 0;       // noise estimate warm-up, see process_hop
+
+    NRVector<float> window;
+    NRVector<float> time;                // FFT input / IFFT output
+    NRVector<std::complex<float>> spectrum;
+    fftwf_plan forward, backward;        // FFTPlanCache, not owned
+
+    NRVector<float> last_input, last_output;   // previous hop, overlap-add
+    NRVector<float> X, xt, pslp, SNR_post, SNR_prio, Hk_old, G, smoothed;
+
+    // One hop of input being collected, and the previous hop's output
+    // being returned in its place
+    NRVector<float> in_hop, out_hop;
+    size_t hop_fill = 0;
+};
+
+// Variable-leak LMS automatic noise reduction or notch (ANR.c, from Warren
+// Pratt's wdsp).  notch = true keeps the error (removes carriers), false
+// the prediction (removes noise).
+class LmsANR {
+  public:
+    explicit LmsANR(bool notch = false, int taps = 64, int delay = 16,
+                    float two_mu = 1e-4f, float gamma = 0.1f);
+
+    void process(float *audio, size_t len);
+    void reset();
+
+  private:
+    static constexpr int kLine = 512;   // delay line, power of two
+    static constexpr int kMask = kLine - 1;
+
+    bool notch;
+    int taps, delay;
+    float two_mu, gamma;
+    float lidx = 120.0f, ngamma = 0.001f;
+    int in_idx = 0;
+    // The delay line is stored twice over, so taps from any position are
+    // contiguous and the two inner loops vectorize
+    NRVector<float> d;
+    NRVector<float> w;
+};
+
+// Wild noise blanker (NB.c, DD4WH): finds impulses in the LPC residual of
+// the frame and replaces them by forward and backward predictions.
+class WildNB {
+  public:
+    explicit WildNB(float threshold = 0.95f, int taps = 10,
+                    int impulse_samples = 7);
+
+    void process(float *audio, size_t len);
+    void reset();
+
+  private:
+    static constexpr int kMaxImpulses = 20;
+
+    float threshold;
+    int order;          // LPC order
+    int pl;             // half the impulse length
+    // Previous frame's last 2 * (order + pl) samples, then this frame
+    NRVector<float> working;
+    // Scratch, sized for the longest frame seen
+    NRVector<float> residual, fir_state;
+    NRVector<float> lpcs, reverse_lpcs, R, any, Wfw, Wbw, Rfw, Rbw;
+};
+
+// Stages of a NoiseReductionChain, as a bit set
+enum NoiseReductionStage : uint8_t {
+    NR_BLANKER = 1,    // WildNB
+    NR_SPECTRAL = 2,   // SpectralNR
+    NR_LMS = 4,        // LmsANR, noise reduction
+    NR_NOTCH = 8,      // LmsANR, automatic notch
+};
+
+// Process-wide limits from [limits]: how many chains may run at once, and
+// the share of a core one stage of one chain may use.  A chain holds a slot
+// from the first frame it processes until it is switched off, destroyed or
+// released, so listeners following a shared channel's leader hold none.
+class NoiseReductionLimits {
+  public:
+    static NoiseReductionLimits &instance();
+
+    // max_chains < 0 is unlimited; cpu_budget is a fraction of real time,
+    // <= 0 for no budget
+    void configure(int max_chains, double cpu_budget);
+
+    bool try_acquire();
+    void release();
+    // A chain that wanted a slot and got none
+    void count_refusal();
+
+    double cpu_budget() const { return budget; }
+    int active() const { return chains.load(std::memory_order_relaxed); }
+    uint64_t refused() const {
+        return refusals.load(std::memory_order_relaxed);
+    }
+
+  private:
+    int max_chains = 16;
+    double budget = 0.05;
+    std::atomic<int> chains{0};
+    std::atomic<uint64_t> refusals{0};
+};
+
+// The noise reduction a listener asked for: blanker first, then the spectral
+// NR and the LMS filter.  A stage whose average run time goes over the CPU
+// budget is bypassed until the listener asks again.
+class NoiseReductionChain {
+  public:
+    explicit NoiseReductionChain(float sample_rate);
+    ~NoiseReductionChain();
+
+    NoiseReductionChain(const NoiseReductionChain &) = delete;
+    NoiseReductionChain &operator=(const NoiseReductionChain &) = delete;
+
+    // Stages to run (NoiseReductionStage bits).  Builds the stages turned
+    // on, drops the ones turned off and clears any budget bypass.
+    void configure(uint8_t stages);
+    uint8_t get_stages() const { return stages; }
+
+    // Leaves the audio untouched if no stage is on, or no slot is free
+    void process(float *audio, size_t len);
+
+    // Gives up the slot but keeps the filter state
+    void release();
+
+    // Take over another chain's stages and filter state
+    void copy_state_from(const NoiseReductionChain &other);
+
+  private:
+    template <typename F> void run_stage(int index, F &&stage, size_t len);
+
+    float sample_rate;
+    uint8_t stages = 0;
+    uint8_t bypassed = 0;      // over the CPU budget
+    bool has_slot = false;
+    bool refused = false;      // no slot on the last try, logged once
+
+    std::unique_ptr<WildNB> nb;
+    std::unique_ptr<SpectralNR> nr;
+    std::unique_ptr<LmsANR> anr;
+
+    // Per stage (blanker, spectral, LMS): smoothed run time as a fraction
+    // of the audio it processed, and frames measured
+    float load[3] = {};
+    int measured[3] = {};
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "sam.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr float kPi = 3.14159265358979f;
+
+// atan2 to within about 2e-6 rad: a minimax polynomial for atan on [0, 1]
+// folded out to the four quadrants.  The fold is a multiply-add whose terms
+// come from comparisons, so it runs alongside the division and polynomial.
+inline float fast_atan2(float y, float x) {
+    const float ax = std::fabs(x), ay = std::fabs(y);
+    const float hi = std::max(ax, ay), lo = std::min(ax, ay);
+    const float a = hi > 0.0f ? lo / hi : 0.0f;
+    const float s = a * a;
+    const float p = 0.99997726f +
+                    s * (-0.33262347f +
+                         s * (0.19354346f +
+                              s * (-0.11643287f +
+                                   s * (0.05265332f + s * -0.01172120f))));
+    // |y| > |x|: pi/2 - atan, then x < 0: pi - that
+    const bool steep = ay > ax, left = x < 0.0f;
+    const float offset = steep ? 0.5f * kPi : (left ? kPi : 0.0f);
+    const float sign = (steep != left) ? -1.0f : 1.0f;
+    return std::copysign(offset + sign * a * p, y);
+}
+
+// One-pole DC blocker, y = x - x[-1] + a * y[-1], in place
+void dc_block(float *x, size_t n, float a, float &xm1, float &ym1) {
+    for (size_t i = 0; i < n; i++) {
+        const float y = x[i] - xm1 + a * ym1;
+        xm1 = x[i];
+        ym1 = y;
+        x[i] = y;
+    }
+}
+
+void magnitudes(const std::complex<float> *in, float *mag, size_t n) {
+#pragma omp simd
+    for (size_t i = 0; i < n; i++) {
+        const float I = in[i].real(), Q = in[i].imag();
+        mag[i] = std::sqrt(I * I + Q * Q);
+    }
+}
+} // namespace
+
+void SAM_PLL::set_loop_bw(double loop_bw_hz) {
+    // Convert loop bandwidth to discrete PI gains (damping factor 0.707)
+    const double damping = 0.707;
+    const double wn = 2.0 * M_PI * loop_bw_hz / fs;
+    kp = 2.0 * damping * wn;
+    ki = wn * wn;
+}
+
+void SAM_PLL::setup(double sample_rate, double loop_bw_hz) {
+    fs = sample_rate > 1.0 ? sample_rate : 48000.0;
+    set_loop_bw(loop_bw_hz);
+    reset();
+}
+
+void SAM_PLL::set_stereo_mode(bool stereo) {
+    dc_a = stereo ? dc_a_stereo : dc_a_mono;
+}
+
+void SAM_PLL::reset() {
+    nco_c = 1.0f;
+    nco_s = 0.0f;
+    acc = 0.0;
+    xm1_L = xm1_R = xm1_mono = 0.0f;
+    ym1_L = ym1_R = ym1_mono = 0.0f;
+    lock_ema = 0.0f;
+    locked = false;
+}
+
+void SAM_PLL::track(const std::complex<float> *in, size_t n,
+                    bool detect_lock, float *c, float *s) {
+    // Loop state in locals: the stores to c / s could alias members
+    const float max_acc = (float)(M_PI / 4.0);
+    const float fkp = (float)kp, fki = (float)ki, fdtheta = (float)dtheta;
+    float nc = nco_c, ns = nco_s, integ = (float)acc;
+    float ema = lock_ema;
+    bool lock = locked;
+    // The phase detector and the lock detector are ratios, so the input needs
+    // no normalisation; the output level is left to the AGC.
+    for (size_t i = 0; i < n; i++) {
+        // NCO rotation by -theta to bring the carrier to baseband.
+        const float I = in[i].real(), Q = in[i].imag();
+        const float Ir =  I * nc + Q * ns;
+        const float Qr = -I * ns + Q * nc;
+        c[i] = nc;
+        s[i] = ns;
+
+        // Phase detector — atan2 for robust acquisition over wide range.
+        const float e = fast_atan2(Qr, Ir);
+
+        // PI loop filter with anti-windup clamp on the integrator (prevents
+        // wind-up and sudden phase jumps / stuttering on off-frequency signals).
+        integ = std::clamp(integ + fki * e, -max_acc, max_acc);
+        const float u = fdtheta + fkp * e + integ;
+
+        // Advance the NCO by u: rotate the phasor by cos u / sin u from their
+        // Taylor series (|u| < 1 at audio rates, error < 1e-6).
+        const float u2 = u * u;
+        const float cu = 1.0f - u2 * (1.0f / 2 - u2 * (1.0f / 24 -
+                         u2 * (1.0f / 720 - u2 * (1.0f / 40320))));
+        const float su = u * (1.0f - u2 * (1.0f / 6 - u2 * (1.0f / 120 -
+                         u2 * (1.0f / 5040))));
+        const float rc = nc * cu - ns * su;
+        ns = ns * cu + nc * su;
+        nc = rc;
+
+        if (detect_lock) {
+            // Lock detector: slow-average cos(phase error) = Ir / |phasor|,
+            // which is amplitude-INDEPENDENT (robust to AM modulation depth):
+            // ~1 when phase-locked, ~0 when the loop is slipping.  Averaging
+            // raw Ir instead sagged below threshold on deeply modulated
+            // carriers.  Hysteresis keeps the indicator steady.
+            const float cos_e = Ir / (std::sqrt(Ir * Ir + Qr * Qr) + 1e-30f);
+            ema += 0.002f * (cos_e - ema);
+            if (ema >= 0.85f) lock = true;
+            else if (ema <= 0.60f) lock = false;
+        }
+    }
+    // The rotations leave the phasor's length off by about 1e-7 a sample;
+    // one Newton step per block puts it back on the unit circle.
+    const float g = 1.5f - 0.5f * (nc * nc + ns * ns);
+    nco_c = nc * g;
+    nco_s = ns * g;
+    acc = integ;
+    lock_ema = ema;
+    locked = lock;
+}
+
+void SAM_PLL::process(const std::complex<float> *carrier,
+                      const std::complex<float> *signal, float *out,
+                      size_t n) {
+    alignas(64) float c[kBlock], s[kBlock];
+    for (size_t done = 0; done < n; done += kBlock) {
+        const size_t m = std::min(kBlock, n - done);
+        const std::complex<float> *sig = signal + done;
+        float *y = out + done;
+
+        track(carrier + done, m, true, c, s);
+
+        // Demodulate the full signal (carrier+sidebands) with the
+        // carrier-locked phase: the in-phase component of the raw baseband.
+#pragma omp simd
+        for (size_t i = 0; i < m; i++) {
+            y[i] = sig[i].real() * c[i] + sig[i].imag() * s[i];
+        }
+        dc_block(y, m, (float)dc_a, xm1_mono, ym1_mono);
+    }
+}
+
+void SAM_PLL::process_cquam(const std::complex<float> *in, float *left,
+                            float *right, size_t n) {
+    alignas(64) float c[kBlock], s[kBlock];
+    for (size_t done = 0; done < n; done += kBlock) {
+        const size_t m = std::min(kBlock, n - done);
+        const std::complex<float> *x = in + done;
+        float *l = left + done;
+        float *r = right + done;
+
+        track(x, m, false, c, s);
+
+#pragma omp simd
+        for (size_t i = 0; i < m; i++) {
+            const float I = x[i].real(), Q = x[i].imag();
+            // In C-QUAM, Ir ~ (L+R), Qr ~ (L-R)
+            const float sum  = I * c[i] + Q * s[i];
+            // INVERTED: the quadrature demodulator output (L-R) has opposite
+            // polarity; without the inversion L and R fight each other and
+            // the volume pumps.
+            const float diff = I * s[i] - Q * c[i];
+            l[i] = 0.5f * (sum + diff);
+            r[i] = 0.5f * (sum - diff);
+        }
+        // Separate DC blockers for each channel
+        dc_block(l, m, (float)dc_a, xm1_L, ym1_L);
+        dc_block(r, m, (float)dc_a, xm1_R, ym1_R);
+    }
+}
+
+void SAM_PLL::envelope(const std::complex<float> *in, float *out, size_t n) {
+    magnitudes(in, out, n);
+    dc_block(out, n, (float)dc_a, xm1_mono, ym1_mono);
+}
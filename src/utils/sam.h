@@ -0,0 +1,81 @@
+#ifndef SAM_H
+#define SAM_H
+
+#include <complex>
+#include <cstddef>
+
+// Synchronous AM (SAM) product detector and C-QUAM stereo decoder around a
+// PI phase-locked loop.  Each AudioClient owns one.
+//
+// Works on a block at a time.  Only the loop itself runs sample by sample:
+// the NCO is a unit phasor advanced by rotation (no sinf / cosf) and the
+// phase detector is a polynomial atan2.  Magnitudes, demodulation and the
+// DC blockers are passes of their own over the block.
+class SAM_PLL {
+  public:
+    void setup(double sample_rate, double loop_bw_hz = 50.0);
+
+    // Recompute the PI loop gains for a given loop bandwidth WITHOUT
+    // resetting the NCO/integrator state.  Lets us switch loop bandwidth per
+    // mode (narrow for mono SAM, wider for C-QUAM) without dropping lock.
+    void set_loop_bw(double loop_bw_hz);
+
+    // Set stereo mode (switches DC blocker coefficient)
+    void set_stereo_mode(bool stereo);
+
+    void reset();
+
+    // Mono SAM.  The PLL locks on the CARRIER phasor — the baseband low-pass
+    // filtered to <500 Hz, i.e. essentially the pure carrier — which is far
+    // more stable than locking on carrier+sidebands: on deep modulation the
+    // full signal's in-phase term can swing negative and make atan2 jump by
+    // π, slipping the loop.  The carrier-locked phase then demodulates the
+    // FULL signal, so AM loudness / AGC calibration match the plain detector.
+    void process(const std::complex<float> *carrier,
+                 const std::complex<float> *signal, float *out, size_t n);
+
+    // C-QUAM stereo: Ir ~ (L+R), Qr ~ (L-R) once locked
+    void process_cquam(const std::complex<float> *in, float *left,
+                       float *right, size_t n);
+
+    // Classic envelope AM: magnitude of the baseband, DC-blocked to strip
+    // the carrier term.  Leaves the PLL alone.
+    void envelope(const std::complex<float> *in, float *out, size_t n);
+
+    // PLL lock, for the AM-button "SAM" indicator (mono SAM only)
+    bool is_locked() const { return locked; }
+
+    double sample_rate() const { return fs; }
+
+  private:
+    static constexpr size_t kBlock = 256;
+
+    // Runs the loop over n <= kBlock samples of in and leaves the NCO
+    // phasor each sample was rotated by in c / s
+    void track(const std::complex<float> *in, size_t n, bool detect_lock,
+               float *c, float *s);
+
+    double fs = 48000.0;
+    float nco_c = 1.0f, nco_s = 0.0f;  // NCO phasor, cos / sin of its phase
+    double dtheta = 0.0;    // nominal freq offset (rad/sample), keep at 0 for centered carrier
+    double ki = 0.0, kp = 0.0;
+    double acc = 0.0;       // integrator
+
+    // Separate DC blocker state for each channel
+    float xm1_L = 0.0f, ym1_L = 0.0f;       // Left channel
+    float xm1_R = 0.0f, ym1_R = 0.0f;       // Right channel
+    float xm1_mono = 0.0f, ym1_mono = 0.0f; // Mono (legacy SAM)
+
+    double dc_a_mono   = 0.999; // Gentler for natural bass
+    double dc_a_stereo = 0.999; // Even gentler for stereo imaging
+    double dc_a        = 0.997; // Current active coefficient
+
+    // Lock detector.  When the PLL is locked, the normalized in-phase carrier
+    // component (Ir) sits near +1 and the quadrature (Qr) near 0; unlocked, Ir
+    // wanders and its average collapses toward 0.  lock_ema is a slow average of
+    // Ir (~40 ms); `locked` is the hysteresis'd boolean the UI reads.
+    float lock_ema = 0.0f;
+    bool  locked   = false;
+};
+
+#endif
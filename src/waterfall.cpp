@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <cmath>
 
 #include "waterfall.h"
 #include "waterfallcompression.h"
+#include "metrics.h"
 #include <atomic>
 #include <chrono>
 #include <thread>
@@ -21,6 +23,15 @@ void monitor_data_rate() {
     }
 }
 
+// /metrics counters for one frame sent to one client
+static void count_waterfall_frame(size_t bits) {
+    auto &m = metrics();
+    m.payload_bytes[static_cast<int>(ConnKind::WATERFALL)].fetch_add(
+        bits / 8, std::memory_order_relaxed);
+    m.frames_sent[static_cast<int>(ConnKind::WATERFALL)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
 static std::once_flag waterfall_monitor_once_flag;
 
 void ensure_monitor_thread_runs() {
@@ -118,6 +129,8 @@ void WaterfallClient::send_waterfall(int8_t *buf, size_t frame_num) {
         int len = snap_r - snap_l;
         size_t bits_sent = static_cast<size_t>(len) * 8;
 
+        waterfall_encoder->set_wire_version(
+            wire_version.load(std::memory_order_relaxed));
         waterfall_encoder->send(buf, len, frame_num,
                                 snap_l << snap_level,
                                 snap_r << snap_level);
@@ -127,6 +140,78 @@ void WaterfallClient::send_waterfall(int8_t *buf, size_t frame_num) {
 
         // Add to the total bits sent
         total_bits_sent.fetch_add(bits_sent, std::memory_order_relaxed);
+        count_waterfall_frame(bits_sent);
+    } catch (...) {
+        // Handle error (client disconnect, etc.)
+    }
+}
+
+void WaterfallClient::send_waterfall_shared(SharedWaterfallFrame &frame) {
+    try {
+        bool same_slice;
+        {
+            std::scoped_lock lk(range_mtx_);
+            same_slice = l == frame.l && r == frame.r && level == frame.level;
+        }
+        if (!same_slice) {
+            send_waterfall(frame.row, frame.frame_num);
+            return;
+        }
+
+        const std::vector<uint8_t> &packet = frame.packet();
+        if (packet.empty()) return;
+        sender.send_binary_packet(hdl, packet.data(), packet.size());
+
+        ensure_monitor_thread_runs();
+        total_bits_sent.fetch_add(static_cast<size_t>(frame.r - frame.l) * 8,
+                                  std::memory_order_relaxed);
+        count_waterfall_frame(static_cast<size_t>(frame.r - frame.l) * 8);
+    } catch (...) {
+        // Handle error (client disconnect, etc.)
+    }
+}
+
+void WaterfallClient::send_waterfall_tiles(WaterfallTileFrame &frame) {
+    try {
+        int snap_l, snap_r, snap_level;
+        {
+            std::scoped_lock lk(range_mtx_);
+            snap_l     = l;
+            snap_r     = r;
+            snap_level = level;
+        }
+        if (snap_l >= snap_r || snap_level != frame.level) return;
+
+        const int tile_bins = frame.tile_bins;
+        const int first = snap_l / tile_bins;
+        const int last =
+            std::min(frame.tile_count(), (snap_r + tile_bins - 1) / tile_bins);
+        if (first >= last) return;
+
+        WaterfallTilesHeader h;
+        h.frame_num = frame.frame_num;
+        h.l = (first * tile_bins) << snap_level;
+        h.r = (last * tile_bins) << snap_level;
+        h.level = static_cast<uint8_t>(snap_level);
+        h.tile_count = static_cast<uint16_t>(last - first);
+        h.tile_bins = static_cast<uint16_t>(tile_bins);
+        uint8_t header[WIRE_WATERFALL_TILES_HEADER_BYTES];
+        pack_waterfall_tiles_header(header, h);
+
+        // Reused per client: the gather list for header + tiles
+        tile_bufs.clear();
+        tile_bufs.emplace_back(header, sizeof(header));
+        for (int t = first; t < last; t++) {
+            const std::vector<uint8_t> &tile = frame.tile(t);
+            tile_bufs.emplace_back(tile.data(), tile.size());
+        }
+        sender.send_binary_packet(hdl, tile_bufs);
+
+        ensure_monitor_thread_runs();
+        total_bits_sent.fetch_add(
+            static_cast<size_t>(last - first) * tile_bins * 8,
+            std::memory_order_relaxed);
+        count_waterfall_frame(static_cast<size_t>(last - first) * tile_bins * 8);
     } catch (...) {
         // Handle error (client disconnect, etc.)
     }
@@ -17,6 +17,14 @@ class WaterfallClient : public Client {
                     int min_waterfall_fft);
     void set_waterfall_range(int level, int l, int r);
     void send_waterfall(int8_t *buf, size_t frame_num);
+    // Send a row compressed once for every client on the same slice.  Falls
+    // back to send_waterfall() if this client has moved off the slice since
+    // the frame was dispatched.
+    void send_waterfall_shared(SharedWaterfallFrame &frame);
+    // Send the tiles covering this client's current view (WIRE_PACKED_V2).
+    // Pans within the level need no re-encoding; a frame dispatched for the
+    // level the client just left is skipped.
+    void send_waterfall_tiles(WaterfallTileFrame &frame);
     virtual void on_window_message(int l, std::optional<double> &m, int r,
                                    std::optional<int> &level);
     void on_close();
@@ -35,6 +43,9 @@ class WaterfallClient : public Client {
     std::mutex range_mtx_; // protects l, r, level against send_waterfall races
     // Compression codec variables for waterfall
     std::unique_ptr<WaterfallEncoder> waterfall_encoder;
+    // Scratch gather list for send_waterfall_tiles (its frames run one at a
+    // time per client, on the client's strand)
+    std::vector<std::pair<const void *, size_t>> tile_bufs;
 
     waterfall_slices_t &waterfall_slices;
     waterfall_mutexes_t &waterfall_slice_mtx;
@@ -1,6 +1,7 @@
 #include "waterfallcompression.h"
 
 #include <boost/container/small_vector.hpp>
+#include <cstring>
 #include <iostream>
 
 #define ZSTD_STATIC_LINKING_ONLY
@@ -23,6 +24,23 @@ ZstdEncoder::~ZstdEncoder() { ZSTD_freeCStream(stream); }
 
 int ZstdEncoder::send(const void *buffer, size_t bytes, uint64_t frame_num,
                       int l, int r) {
+    if (wire_version != WIRE_CBOR) {
+        // Header and row go through the compressor together, like the CBOR
+        // map did, so one decompressed chunk is still one frame.  Each row
+        // ends its zstd frame, so these packets are interchangeable with
+        // SharedWaterfallFrame ones.  Both buffers only grow, so steady
+        // state allocates nothing.
+        packed_row.resize(WIRE_WATERFALL_HEADER_BYTES + bytes);
+        pack_waterfall_header(packed_row.data(), {frame_num, l, r});
+        memcpy(packed_row.data() + WIRE_WATERFALL_HEADER_BYTES, buffer, bytes);
+        compressed.resize(ZSTD_compressBound(packed_row.size()));
+        ZSTD_inBuffer data = {packed_row.data(), packed_row.size(), 0};
+        ZSTD_outBuffer packet_out = {compressed.data(), compressed.size(), 0};
+        ZSTD_compressStream2(stream, &packet_out, &data, ZSTD_e_end);
+        sender.send_binary_packet(hdl, packet_out.dst, packet_out.pos);
+        return 0;
+    }
+
     set_data(frame_num, l, r);
     packet["data"] = json::binary(
         std::vector<uint8_t>((uint8_t *)buffer, (uint8_t *)buffer + bytes));
@@ -36,6 +54,55 @@ int ZstdEncoder::send(const void *buffer, size_t bytes, uint64_t frame_num,
     return 0;
 }
 
+namespace {
+// One compression context per waterfall worker, reused for every shared row
+// and tile it encodes
+ZSTD_CCtx *worker_cctx() {
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> cctx{
+        ZSTD_createCCtx(), ZSTD_freeCCtx};
+    return cctx.get();
+}
+} // namespace
+
+const std::vector<uint8_t> &SharedWaterfallFrame::packet() {
+    std::call_once(encoded, [this] {
+        const size_t bytes = static_cast<size_t>(r - l);
+        std::vector<uint8_t> packed(WIRE_WATERFALL_HEADER_BYTES + bytes);
+        pack_waterfall_header(packed.data(),
+                              {frame_num, l << level, r << level});
+        memcpy(packed.data() + WIRE_WATERFALL_HEADER_BYTES, row, bytes);
+        compressed.resize(ZSTD_compressBound(packed.size()));
+        const size_t out = ZSTD_compress2(worker_cctx(), compressed.data(),
+                                          compressed.size(), packed.data(),
+                                          packed.size());
+        compressed.resize(ZSTD_isError(out) ? 0 : out);
+    });
+    return compressed;
+}
+
+WaterfallTileFrame::WaterfallTileFrame(const int8_t *row, size_t bins,
+                                       int level, int tile_bins,
+                                       uint64_t frame_num,
+                                       std::shared_ptr<void> hold)
+    : row{row}, level{level}, tile_bins{tile_bins}, frame_num{frame_num},
+      hold{std::move(hold)}, tiles(bins / tile_bins) {}
+
+const std::vector<uint8_t> &WaterfallTileFrame::tile(size_t index) {
+    Tile &t = tiles[index];
+    std::call_once(t.encoded, [&] {
+        const size_t bound = ZSTD_compressBound(tile_bins);
+        t.bytes.resize(WIRE_WATERFALL_TILE_PREFIX_BYTES + bound);
+        size_t out = ZSTD_compress2(
+            worker_cctx(), t.bytes.data() + WIRE_WATERFALL_TILE_PREFIX_BYTES,
+            bound, row + index * tile_bins, tile_bins);
+        if (ZSTD_isError(out)) out = 0;
+        const uint32_t size = static_cast<uint32_t>(out);
+        memcpy(t.bytes.data(), &size, sizeof(size));
+        t.bytes.resize(WIRE_WATERFALL_TILE_PREFIX_BYTES + out);
+    });
+    return t.bytes;
+}
+
 #ifdef HAS_LIBAOM
 AV1Encoder::AV1Encoder(connection_hdl hdl, PacketSender &sender,
                        int waterfall_size)
@@ -2,6 +2,7 @@
 #define WATERFALLCOMPRESSION_H
 
 #include "client.h"
+#include "wireformat.h"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -13,6 +14,11 @@ using json = nlohmann::json;
 
 #include <zstd.h>
 
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #define WATERFALL_COALESCE 8
 
 class WaterfallEncoder {
@@ -20,6 +26,8 @@ class WaterfallEncoder {
     WaterfallEncoder(connection_hdl hdl, PacketSender &sender)
         : hdl{hdl}, sender{sender} {}
     virtual int send(const void *buffer, size_t bytes, uint64_t frame_num, int l, int r) = 0;
+    // Framing for the following rows (WIRE_CBOR or a packed version)
+    void set_wire_version(uint8_t version) { wire_version = version; }
     virtual ~WaterfallEncoder(){};
 
   protected:
@@ -28,6 +36,7 @@ class WaterfallEncoder {
     websocketpp::connection_hdl hdl;
     PacketSender &sender;
 
+    uint8_t wire_version = WIRE_CBOR;
     json packet;
 };
 
@@ -39,6 +48,64 @@ class ZstdEncoder : public WaterfallEncoder {
 
   protected:
     ZSTD_CStream *stream;
+    // Reused per row: packed header + row going in, compressed frame out
+    std::vector<uint8_t> packed_row;
+    std::vector<uint8_t> compressed;
+};
+
+// One waterfall row compressed once for all packed-format zstd clients that
+// watch the same (level, l, r) slice (see dispatch_waterfall_frame()).  Each
+// subscriber's task calls packet(); the first one to run compresses, the
+// others wait for it and send the same bytes.  The row stays valid for as long
+// as the frame holds its FFT generation.
+class SharedWaterfallFrame {
+  public:
+    SharedWaterfallFrame(int8_t *row, int level, int l, int r,
+                         uint64_t frame_num, std::shared_ptr<void> hold)
+        : row{row}, level{level}, l{l}, r{r}, frame_num{frame_num},
+          hold{std::move(hold)} {}
+
+    // Packed v1 header + row as one complete zstd frame
+    const std::vector<uint8_t> &packet();
+
+    int8_t *const row;
+    const int level;
+    const int l, r;                 // slice at this level
+    const uint64_t frame_num;
+
+  private:
+    std::shared_ptr<void> hold;     // keeps the FFT generation alive
+    std::once_flag encoded;
+    std::vector<uint8_t> compressed;
+};
+
+// One downsample level of one frame cut into tile_bins-wide tiles, for
+// clients on WIRE_PACKED_V2 (see wireformat.h).  Tiles are compressed on
+// first use by whichever subscriber task needs them and then reused by all,
+// so the cost follows the number of distinct tiles on screen, not clients.
+class WaterfallTileFrame {
+  public:
+    WaterfallTileFrame(const int8_t *row, size_t bins, int level,
+                       int tile_bins, uint64_t frame_num,
+                       std::shared_ptr<void> hold);
+
+    // u32 byte count + complete zstd frame of tile index
+    const std::vector<uint8_t> &tile(size_t index);
+
+    int tile_count() const { return static_cast<int>(tiles.size()); }
+
+    const int8_t *const row;    // the whole level
+    const int level;
+    const int tile_bins;
+    const uint64_t frame_num;
+
+  private:
+    struct Tile {
+        std::once_flag encoded;
+        std::vector<uint8_t> bytes;
+    };
+    std::shared_ptr<void> hold;     // keeps the FFT generation alive
+    std::deque<Tile> tiles;         // deque: once_flag is not movable
 };
 
 #ifdef HAS_LIBAOM
@@ -1,4 +1,5 @@
 #include "client.h"
+#include "metrics.h"
 #include "signal.h"
 #include "spectrumserver.h"
 #include "waterfall.h"
@@ -6,7 +7,9 @@
 
 #include "glaze/glaze.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <iostream>
 #include <map>
 
 // ---------------------------------------------------------------------------
@@ -132,6 +135,14 @@ inline bool should_send_adaptive(throttle_state &st,
     st.last_frame_sent = frame_num;
     return true;
 }
+
+// Bytes a connection may have waiting in websocketpp's send queue before
+// further text packets to it are dropped
+constexpr size_t kTextBufferLimit = 2000000;
+
+// Share of the waterfall frame interval that waterfall encoding may take
+// before waterfall_loop reports it
+constexpr double kWaterfallReportShare = 0.5;
 } // namespace
 
 void broadcast_server::send_basic_info(connection_hdl hdl,
@@ -372,64 +383,70 @@ void broadcast_server::on_open_chat(connection_hdl hdl) {
         std::placeholders::_2, std::static_pointer_cast<Client>(client)));
 }
 
-// Iterates through the client list to send the slices
-std::vector<std::future<void>> broadcast_server::signal_loop() {
-    int base_idx = 0;
-    if (!is_real) {
-        base_idx = fft_size / 2 + 1;
-    }
-    std::scoped_lock lg(signal_slice_mtx);
-    auto &io_service = m_server.get_io_service();
-
-    // Completion futures
-    std::vector<std::future<void>> futures;
-    futures.reserve(signal_slices.size());
-
-    // Send the apprioriate signal slice to the client
-    for (auto &[slice, data] : signal_slices) {
-        auto &[l_idx, r_idx] = slice;
-        // Adaptive throttling for audio: never starve the client forever.
-        // When buffered_amount rises (common in background tabs), reduce
-        // send rate instead of hard-dropping everything.
-        
-        try {
-            auto con = m_server.get_con_from_hdl(data->hdl);
-            
-            // Check connection state before sending
-            if (!con || con->get_state() != websocketpp::session::state::open) {
-                continue;
-            }
+// Whether client takes this frame: its connection must be open, and the
+// adaptive throttle may hold it back while its send queue is backing up.
+std::optional<bool> broadcast_server::frame_wanted(Client &client,
+                                                   int frame_num) {
+    // Adaptive throttling: never starve the client forever.  When
+    // buffered_amount rises (common in background tabs), reduce send rate
+    // instead of hard-dropping everything.  Audio needs tighter timing than
+    // the waterfall, so each has its own thresholds.
+    try {
+        auto con = m_server.get_con_from_hdl(client.hdl);
 
-            // FIX (dangling pointer): previously a pointer into g_audio_throttle
-            // was taken under the lock and then used *after* the lock was released.
-            // If the close handler ran in that window it would erase the entry,
-            // making the pointer dangle.  Fix: hold the lock for the full call —
-            // should_send_adaptive is pure arithmetic so the added hold time is
-            // negligible.
-            const size_t buffered = con->get_buffered_amount();
-            bool do_send_audio;
-            {
-                std::lock_guard<std::mutex> tlk(g_audio_throttle_mtx);
-                do_send_audio = should_send_adaptive(
-                    g_audio_throttle[data->hdl], buffered,
-                    static_cast<uint64_t>(frame_num), 20, true);
-            }
-            if (!do_send_audio) {
-                continue;
-            }
+        // Check connection state before sending
+        if (!con || con->get_state() != websocketpp::session::state::open) {
+            return std::nullopt;
+        }
 
-            // Equivalent to
-            // data->send_audio(&fft_buffer[(l_idx + base_idx) % fft_result_size],
-            // frame_num);
-            futures.emplace_back(io_service.post(boost::asio::use_future(std::bind(
-                &AudioClient::send_audio, data,
-                &fft_buffer[(l_idx + base_idx) % fft_result_size], frame_num))));
-        } catch (...) {
-            // Connection no longer valid, skip
-            continue;
+        // FIX (dangling pointer): previously a pointer into the throttle map
+        // was taken under the lock and then used *after* the lock was
+        // released.  If the close handler ran in that window it would erase
+        // the entry, making the pointer dangle.  Fix: hold the lock for the
+        // full call — should_send_adaptive is pure arithmetic so the added
+        // hold time is negligible.
+        const size_t buffered = con->get_buffered_amount();
+        if (client.type == WATERFALL) {
+            metrics()
+                .buffered[static_cast<int>(ConnKind::WATERFALL)]
+                .observe(buffered);
+            std::lock_guard<std::mutex> tlk(g_waterfall_throttle_mtx);
+            return should_send_adaptive(g_waterfall_throttle[client.hdl],
+                                        buffered,
+                                        static_cast<uint64_t>(frame_num), 40,
+                                        false);
         }
+        metrics()
+            .buffered[static_cast<int>(client.type == SIGNAL
+                                           ? ConnKind::SIGNAL
+                                           : ConnKind::AUDIO)]
+            .observe(buffered);
+        std::lock_guard<std::mutex> tlk(g_audio_throttle_mtx);
+        return should_send_adaptive(g_audio_throttle[client.hdl], buffered,
+                                    static_cast<uint64_t>(frame_num), 20,
+                                    true);
+    } catch (...) {
+        // Connection no longer valid, skip
+        return std::nullopt;
     }
-    return futures;
+}
+
+// Iterates through the client list to send the slices, see
+// dispatch_audio_frame()
+void broadcast_server::signal_loop(FFTGeneration &gen) {
+    int base_idx = 0;
+    if (!is_real) {
+        base_idx = fft_size / 2 + 1;
+    }
+    const size_t max_backlog = std::max(1, fft_pipeline_depth - 1);
+    const AudioFrameStats stats = dispatch_audio_frame(
+        *this, *dsp_pool, {gen, frame_num, fft_result_size, max_backlog},
+        base_idx, share_demod);
+    audio_frames_skipped.fetch_add(stats.skipped, std::memory_order_relaxed);
+    audio_channel_frames.fetch_add(stats.channel_frames,
+                                   std::memory_order_relaxed);
+    audio_channel_sends.fetch_add(stats.channel_sends,
+                                  std::memory_order_relaxed);
 }
 
 void broadcast_server::on_open_waterfall(connection_hdl hdl) {
@@ -474,65 +491,64 @@ void broadcast_server::on_open_waterfall(connection_hdl hdl) {
         std::placeholders::_2, std::static_pointer_cast<Client>(client)));
 }
 
-std::vector<std::future<void>>
-broadcast_server::waterfall_loop(int8_t *fft_power_quantized) {
-    // FIX: was futures.reserve(signal_slices.size()) — wrong container.
-    // Approximate the total waterfall client count across all downsample levels.
-    // No lock required here; this is only a pre-allocation hint.
-    std::vector<std::future<void>> futures;
-    {
-        size_t approx = 0;
-        for (const auto &wf : waterfall_slices) approx += wf.size();
-        futures.reserve(approx);
-    }
-
-    auto &io_service = m_server.get_io_service();
-    for (int i = 0; i < downsample_levels; i++) {
-        // Iterate over each waterfall client and send each slice
-        std::scoped_lock lg(waterfall_slice_mtx[i]);
-        for (auto &[slice, data] : waterfall_slices[i]) {
-            auto &[l_idx, r_idx] = slice;
-            // If the client is slow, avoid unnecessary buffering and
-            // drop the packet - changed from 50000 to 100000
-            
-            try {
-                auto con = m_server.get_con_from_hdl(data->hdl);
-                
-                // Check connection state before sending
-                if (!con || con->get_state() != websocketpp::session::state::open) {
-                    continue;
-                }
+void broadcast_server::waterfall_loop(FFTGeneration &gen) {
+    const size_t max_backlog = std::max(1, fft_pipeline_depth - 1);
 
-                // FIX (dangling pointer): same race as audio throttle — hold the
-                // lock for the full should_send_adaptive call.
-                const size_t buffered = con->get_buffered_amount();
-                bool do_send_wf;
-                {
-                    std::lock_guard<std::mutex> tlk(g_waterfall_throttle_mtx);
-                    do_send_wf = should_send_adaptive(
-                        g_waterfall_throttle[data->hdl], buffered,
-                        static_cast<uint64_t>(frame_num), 40, false);
-                }
-                if (!do_send_wf) {
-                    continue;
-                }
-                
-                // Equivalent to
-                // data->send_waterfall(&fft_power_quantized[l_idx],frame_num);
-                futures.emplace_back(
-                    io_service.post(boost::asio::use_future(
-                        std::bind(&WaterfallClient::send_waterfall, data,
-                                  &fft_power_quantized[l_idx], frame_num))));
-            } catch (...) {
-                // Connection no longer valid, skip
-                continue;
+    // Every 10 s, report the encode time if it used more than
+    // kWaterfallReportShare of the interval between waterfall frames (the
+    // budget).  The per-task histogram is on /metrics as the
+    // waterfall_encode stage.
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (waterfall_last_frame_at.time_since_epoch().count() != 0) {
+            waterfall_interval_us_total +=
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - waterfall_last_frame_at).count();
+        }
+        waterfall_last_frame_at = now;
+
+        if (waterfall_report_at.time_since_epoch().count() == 0) {
+            waterfall_report_at = now;
+        } else if (now - waterfall_report_at >= std::chrono::seconds(10)) {
+            auto &st = waterfall_encode_stats;
+            const uint64_t frames = st.frames.exchange(0);
+            const uint64_t wall   = st.wall_us_total.exchange(0);
+            const uint64_t wmax   = st.wall_us_max.exchange(0);
+            const uint64_t cpu    = st.cpu_us_total.exchange(0);
+            const uint64_t shared_rows  = st.shared_rows.exchange(0);
+            const uint64_t shared_sends = st.shared_sends.exchange(0);
+            const uint64_t tiled_levels = st.tiled_levels.exchange(0);
+            const uint64_t tiled_sends  = st.tiled_sends.exchange(0);
+            if (frames > 0 && waterfall_interval_us_total > 0 &&
+                wall > kWaterfallReportShare * waterfall_interval_us_total) {
+                std::cout << "[waterfall] encode " << wall / frames
+                          << " us avg, " << wmax << " us max, "
+                          << cpu / frames << " us cpu per frame; budget "
+                          << waterfall_interval_us_total / frames << " us ("
+                          << 100 * wall / waterfall_interval_us_total
+                          << "% used), " << waterfall_pool->size()
+                          << " workers, " << waterfall_pool->get_steals()
+                          << " steals, " << shared_rows
+                          << " shared rows for " << shared_sends
+                          << " sends, " << tiled_levels
+                          << " tiled levels for " << tiled_sends << " sends"
+                          << std::endl;
             }
+            waterfall_interval_us_total = 0;
+            waterfall_report_at = now;
         }
-
-        // Prevent overwrite of previous level's quantized waterfall
-        fft_power_quantized += (fft_result_size >> i);
     }
-    return futures;
+
+    // Clients on the packed wire format take self-contained zstd frames, so
+    // everyone on the same (level, l, r) slice can share one compressed row.
+    // Most viewers sit on the default full-band view.
+    const bool share_rows = waterfall_compression == WATERFALL_ZSTD;
+    waterfall_frames_skipped.fetch_add(
+        dispatch_waterfall_frame(
+            *this, *waterfall_pool,
+            {gen, frame_num, fft_result_size, max_backlog}, downsample_levels,
+            waterfall_tile_bins, share_rows, waterfall_encode_stats),
+        std::memory_order_relaxed);
 }
 
 void broadcast_server::on_open_unknown(connection_hdl hdl) {
@@ -729,7 +745,7 @@ void broadcast_server::send_text_packet(
         
         // Don't drop important control text packets too aggressively.
         // We allow moderate buffering so background tabs can recover.
-        if (con->get_buffered_amount() > 2000000) {
+        if (con->get_buffered_amount() > kTextBufferLimit) {
             return;
         }
 
@@ -741,15 +757,8 @@ void broadcast_server::send_text_packet(
         for (auto &str : data) {
             msg_ptr->append_payload(str);
         }
-        
-        websocketpp::lib::error_code ec;
-        ec = con->send(msg_ptr);
-        
-        // Silently ignore send errors (connection likely dead)
-        if (ec) {
-            // Connection is broken, will be cleaned up by close handler
-            return;
-        }
+
+        queue_send(con, msg_ptr);
     } catch (const websocketpp::exception& e) {
         // Connection no longer valid
     } catch (const std::exception& e) {
@@ -762,7 +771,18 @@ void broadcast_server::send_text_packet(
 void broadcast_server::send_binary_packet(
     connection_hdl hdl,
     const std::initializer_list<std::pair<const void *, size_t>> &bufs) {
-    
+    send_binary_gather(hdl, bufs.begin(), bufs.end());
+}
+
+void broadcast_server::send_binary_packet(
+    connection_hdl hdl,
+    const std::vector<std::pair<const void *, size_t>> &bufs) {
+    send_binary_gather(hdl, bufs.begin(), bufs.end());
+}
+
+template <typename It>
+void broadcast_server::send_binary_gather(connection_hdl hdl, It begin,
+                                          It end) {
     try {
         auto con = m_server.get_con_from_hdl(hdl);
         
@@ -777,21 +797,18 @@ void broadcast_server::send_binary_packet(
         }
 
         auto total_size =
-            std::accumulate(bufs.begin(), bufs.end(), size_t{0},
+            std::accumulate(begin, end, size_t{0},
                             [](size_t acc, auto &p) { return acc + p.second; });
         
+        // The payload is copied into the message here, on the calling (DSP
+        // worker) thread, so the caller's scratch buffers are free to reuse as
+        // soon as we return.
         auto msg_ptr = con->get_message(websocketpp::frame::opcode::binary, total_size);
-        for (auto &bp : bufs) {
-            msg_ptr->append_payload(bp.first, bp.second);
-        }
-        
-        websocketpp::lib::error_code ec;
-        ec = con->send(msg_ptr);
-        
-        // Silently ignore send errors
-        if (ec) {
-            return;
+        for (It bp = begin; bp != end; ++bp) {
+            msg_ptr->append_payload(bp->first, bp->second);
         }
+
+        queue_send(con, msg_ptr);
     } catch (const websocketpp::exception& e) {
         // Connection no longer valid
     } catch (const std::exception& e) {
@@ -801,6 +818,89 @@ void broadcast_server::send_binary_packet(
     }
 }
 
+void broadcast_server::queue_send(server::connection_ptr con,
+                                  server::message_ptr msg) {
+    // con->send() touches the connection's write queue and transport, which
+    // websocketpp expects to be driven from the io_service thread.  dispatch()
+    // runs inline when we are already on it (events timer, chat, HTTP) and
+    // posts otherwise (DSP workers, FFT thread, admin listener).  Posted writes
+    // for one connection keep their order since the io_service is
+    // single-threaded.
+    auto &m = metrics();
+    m.socket_messages.fetch_add(1, std::memory_order_relaxed);
+    m.socket_bytes.fetch_add(msg->get_payload().size(),
+                             std::memory_order_relaxed);
+    boost::asio::dispatch(m_server.get_io_service(),
+                          [con, msg, queued = std::chrono::steady_clock::now()]() {
+        try {
+            // Silently ignore send errors (connection likely dead); the close
+            // handler cleans up.
+            websocketpp::lib::error_code ec = con->send(msg);
+            (void)ec;
+            // From queueing to the write, including the wait for the I/O
+            // thread
+            metrics()
+                .stages[static_cast<int>(Stage::SOCKET_WRITE)]
+                .observe(std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - queued)
+                             .count());
+        } catch (...) {
+            // Connection no longer valid
+        }
+    });
+}
+
+server::message_ptr
+broadcast_server::prepare_message(websocketpp::frame::opcode::value op,
+                                  const std::string &payload) {
+    // What the hybi13 processor does in con->send() for an unprepared
+    // message.  Server frames are never masked, so the header and payload
+    // are the same bytes for every connection; a prepared message goes onto
+    // each write queue as is and nothing writes to it afterwards.
+    using message_type = server::message_ptr::element_type;
+    auto msg = websocketpp::lib::make_shared<message_type>(
+        message_type::con_msg_man_ptr(), op, payload.size());
+    msg->set_payload(payload);
+    websocketpp::frame::basic_header header(op, payload.size(), true, false);
+    websocketpp::frame::extended_header extended(payload.size());
+    msg->set_header(websocketpp::frame::prepare_header(header, extended));
+    msg->set_prepared(true);
+    return msg;
+}
+
+size_t broadcast_server::broadcast_text_packet(
+    const std::vector<connection_hdl> &hdls, const std::string &data) {
+    if (hdls.empty()) return 0;
+    // Framed once, however many connections it goes to
+    server::message_ptr msg =
+        prepare_message(websocketpp::frame::opcode::text, data);
+    size_t sent = 0;
+    for (auto &hdl : hdls) {
+        if (queue_prepared(hdl, msg)) sent++;
+    }
+    return sent;
+}
+
+bool broadcast_server::queue_prepared(connection_hdl hdl,
+                                      server::message_ptr msg) {
+    try {
+        auto con = m_server.get_con_from_hdl(hdl);
+        if (!con || con->get_state() != websocketpp::session::state::open) {
+            return false;
+        }
+        // A connection this far behind misses this one and catches up with
+        // a later one
+        if (con->get_buffered_amount() > kTextBufferLimit) {
+            return false;
+        }
+        queue_send(con, msg);
+        return true;
+    } catch (...) {
+        // Connection no longer valid
+        return false;
+    }
+}
+
 // --- Wrapper overloads to satisfy existing virtual interface ---
 void broadcast_server::send_text_packet(connection_hdl hdl, const std::string &str) {
     this->send_text_packet(hdl, {str});
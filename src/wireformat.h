@@ -0,0 +1,178 @@
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Framing of the binary audio and waterfall websocket messages.
+//
+// WIRE_CBOR is the original format: an nlohmann::json map serialised with
+// json::to_cbor, with the payload as a CBOR byte string.  Every client starts
+// on it, so frontends that never negotiate keep working.
+//
+// WIRE_PACKED_V1 is a fixed little-endian header followed directly by the
+// payload, written straight into the websocket message with no intermediate
+// buffers.  A client opts in with {"cmd": "wire_format", "version": 1}.
+// The first byte is the version; it can never be mistaken for a CBOR map
+// (0xa0..0xbf), so a frontend can tell the two apart per message.
+//
+// Audio, 32-byte header then the encoded audio (FLAC / Opus / PCM):
+//   0  u8   version (1)        4  i32  l            16  f64  m
+//   1  u8   codec (wire_codec) 8  u64  frame_num    24  i32  r
+//   2  u8   channels                                28  f32  pwr
+//   3  u8   flags (bit 0: SAM locked)
+//
+// Waterfall, 20-byte header then the int8 row.  For zstd the header and row
+// go through the compressor together, as the CBOR map did:
+//   0  u8   version (1)        4  i32  l            16  i32  r
+//   1  u8[3] reserved (0)      8  u64  frame_num
+//
+// WIRE_PACKED_V2 keeps the v1 audio and row framing and adds tiled waterfall
+// messages (zstd only).  The waterfall pyramid is cut into fixed-width tiles
+// that are compressed once per frame for every client; a client gets the
+// tiles covering its view, so l / r are widened to tile boundaries.  The
+// header is not compressed:
+//   0  u8   version (2)        4  i32  l            16  i32  r
+//   1  u8   level              8  u64  frame_num    20  u16  tile_count
+//   2  u8   'T'                                     22  u16  tile_bins
+//   3  u8   reserved (0)
+// followed by tile_count tiles, each a u32 byte count and one complete zstd
+// frame holding tile_bins int8 values.  Read as a zstd block header, the
+// first three bytes give a block larger than zstd allows, so a frontend can
+// never confuse a tile message with part of a zstd stream.
+//
+// Events deltas, on the events socket once the client has sent
+// {"cmd": "wire_format", "version": 1} there (see ListenerStore).  Until
+// then it gets the JSON messages.  After it, a JSON snapshot whenever it has
+// to catch up, and otherwise one binary message per tick with the listener
+// changes since the last, only ever sent to a client at from_seq:
+//   0  u8   'D'                 8  u64  from_seq     28  f32  waterfall_kbits
+//   1  u8   version (1)        16  u64  to_seq       32  f32  audio_kbits
+//   2  u16  change_count       24  u32  waterfall_clients
+//   4  u32  signal_clients
+// followed by change_count changes, each a u8 kind and the u32 handle the
+// snapshot or the join gave the listener, then:
+//   joined (0)   u8 id_length, the id, i32 l, f64 m, i32 r
+//   moved (1)    i32 l, f64 m, i32 r
+//   left (2)     nothing
+
+constexpr uint8_t WIRE_CBOR = 0;
+constexpr uint8_t WIRE_PACKED_V1 = 1;
+constexpr uint8_t WIRE_PACKED_V2 = 2;
+constexpr uint8_t WIRE_LATEST = WIRE_PACKED_V2;
+
+enum wire_codec : uint8_t { WIRE_CODEC_FLAC, WIRE_CODEC_OPUS, WIRE_CODEC_PCM };
+
+constexpr uint8_t WIRE_AUDIO_SAM_LOCKED = 1 << 0;
+constexpr uint8_t WIRE_TILES_MARKER = 'T';
+
+constexpr size_t WIRE_AUDIO_HEADER_BYTES = 32;
+constexpr size_t WIRE_WATERFALL_HEADER_BYTES = 20;
+constexpr size_t WIRE_WATERFALL_TILES_HEADER_BYTES = 24;
+constexpr size_t WIRE_WATERFALL_TILE_PREFIX_BYTES = 4;
+
+constexpr uint8_t WIRE_EVENTS_DELTA_MARKER = 'D';
+constexpr uint8_t WIRE_EVENTS_DELTA_V1 = 1;
+constexpr size_t WIRE_EVENTS_DELTA_HEADER_BYTES = 36;
+
+// The headers are written with memcpy in host byte order
+static_assert(std::endian::native == std::endian::little,
+              "packed wire format assumes a little-endian host");
+
+struct AudioFrameHeader {
+    uint64_t frame_num = 0;
+    int32_t l = 0;
+    int32_t r = 0;
+    double m = 0;
+    double pwr = 0;     // sent as f32
+    uint8_t channels = 1;
+    bool sam_locked = false;
+    wire_codec codec = WIRE_CODEC_FLAC;
+};
+
+struct WaterfallFrameHeader {
+    uint64_t frame_num = 0;
+    int32_t l = 0;
+    int32_t r = 0;
+};
+
+struct WaterfallTilesHeader {
+    uint64_t frame_num = 0;
+    int32_t l = 0;
+    int32_t r = 0;
+    uint8_t level = 0;
+    uint16_t tile_count = 0;
+    uint16_t tile_bins = 0;
+};
+
+struct EventsDeltaHeader {
+    uint64_t from_seq = 0;
+    uint64_t to_seq = 0;
+    uint32_t signal_clients = 0;
+    uint32_t waterfall_clients = 0;
+    double waterfall_kbits = 0;   // sent as f32
+    double audio_kbits = 0;       // sent as f32
+    uint16_t change_count = 0;
+};
+
+namespace wire_detail {
+template <typename T> inline void put(uint8_t *out, size_t offset, T value) {
+    memcpy(out + offset, &value, sizeof(T));
+}
+} // namespace wire_detail
+
+inline void pack_audio_header(uint8_t (&out)[WIRE_AUDIO_HEADER_BYTES],
+                              const AudioFrameHeader &h) {
+    using wire_detail::put;
+    out[0] = WIRE_PACKED_V1;
+    out[1] = h.codec;
+    out[2] = h.channels;
+    out[3] = h.sam_locked ? WIRE_AUDIO_SAM_LOCKED : 0;
+    put<int32_t>(out, 4, h.l);
+    put<uint64_t>(out, 8, h.frame_num);
+    put<double>(out, 16, h.m);
+    put<int32_t>(out, 24, h.r);
+    put<float>(out, 28, static_cast<float>(h.pwr));
+}
+
+inline void pack_waterfall_header(uint8_t *out, const WaterfallFrameHeader &h) {
+    using wire_detail::put;
+    out[0] = WIRE_PACKED_V1;
+    out[1] = out[2] = out[3] = 0;
+    put<int32_t>(out, 4, h.l);
+    put<uint64_t>(out, 8, h.frame_num);
+    put<int32_t>(out, 16, h.r);
+}
+
+inline void pack_waterfall_tiles_header(
+    uint8_t (&out)[WIRE_WATERFALL_TILES_HEADER_BYTES],
+    const WaterfallTilesHeader &h) {
+    using wire_detail::put;
+    out[0] = WIRE_PACKED_V2;
+    out[1] = h.level;
+    out[2] = WIRE_TILES_MARKER;
+    out[3] = 0;
+    put<int32_t>(out, 4, h.l);
+    put<uint64_t>(out, 8, h.frame_num);
+    put<int32_t>(out, 16, h.r);
+    put<uint16_t>(out, 20, h.tile_count);
+    put<uint16_t>(out, 22, h.tile_bins);
+}
+
+inline void pack_events_delta_header(
+    uint8_t (&out)[WIRE_EVENTS_DELTA_HEADER_BYTES], const EventsDeltaHeader &h) {
+    using wire_detail::put;
+    out[0] = WIRE_EVENTS_DELTA_MARKER;
+    out[1] = WIRE_EVENTS_DELTA_V1;
+    put<uint16_t>(out, 2, h.change_count);
+    put<uint32_t>(out, 4, h.signal_clients);
+    put<uint64_t>(out, 8, h.from_seq);
+    put<uint64_t>(out, 16, h.to_seq);
+    put<uint32_t>(out, 24, h.waterfall_clients);
+    put<float>(out, 28, static_cast<float>(h.waterfall_kbits));
+    put<float>(out, 32, static_cast<float>(h.audio_kbits));
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "workerpool.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <pthread.h>
+#include <sched.h>
+
+WorkerPool::WorkerPool(const std::string &name, int threads,
+                       const std::vector<int> &cpus)
+    : name{name}, cpus{cpus} {
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    queues.resize(threads);
+    workers.reserve(threads);
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&WorkerPool::worker_loop, this, i);
+    }
+
+    std::cout << "[" << name << "] " << threads << " worker thread"
+              << (threads == 1 ? "" : "s");
+    if (!cpus.empty()) {
+        std::cout << " pinned to CPUs";
+        for (int cpu : cpus) std::cout << " " << cpu;
+    }
+    std::cout << std::endl;
+}
+
+WorkerPool::~WorkerPool() { stop(); }
+
+void WorkerPool::stop() {
+    {
+        std::scoped_lock lk(wake_mtx);
+        stopping = true;
+    }
+    wake_cv.notify_all();
+    for (auto &t : workers) {
+        if (t.joinable()) t.join();
+    }
+}
+
+bool WorkerPool::enqueue(std::function<void()> task, int shard) {
+    const size_t n = queues.size();
+    const size_t idx = shard >= 0
+                           ? static_cast<size_t>(shard) % n
+                           : next_queue.fetch_add(1, std::memory_order_relaxed) % n;
+
+    // Holding wake_mtx across the push makes "not stopping" and "pending
+    // counted" one step, so a worker can never exit with a task still queued.
+    std::scoped_lock lk(wake_mtx);
+    if (stopping) return false;
+    {
+        std::scoped_lock qlk(queues[idx].mtx);
+        queues[idx].tasks.push_back(std::move(task));
+    }
+    pending++;
+    wake_cv.notify_one();
+    return true;
+}
+
+bool WorkerPool::try_pop(int index, std::function<void()> &task) {
+    const size_t n = queues.size();
+
+    // Own deque first, oldest task first, so a shard keeps its frame order.
+    {
+        auto &q = queues[index];
+        std::scoped_lock lk(q.mtx);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back of the others' deques.
+    for (size_t k = 1; k < n; k++) {
+        auto &q = queues[(index + k) % n];
+        std::scoped_lock lk(q.mtx);
+        if (!q.tasks.empty()) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::worker_loop(int index) {
+    // Thread names are limited to 15 characters by the kernel.
+    {
+        std::string tname = name.substr(0, 11) + "/" + std::to_string(index);
+        pthread_setname_np(pthread_self(), tname.substr(0, 15).c_str());
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[index % cpus.size()], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            std::cerr << "[" << name << "] could not pin worker " << index
+                      << " to CPU " << cpus[index % cpus.size()] << std::endl;
+        }
+    }
+
+    while (true) {
+        {
+            std::unique_lock lk(wake_mtx);
+            wake_cv.wait(lk, [this] { return stopping || pending > 0; });
+            // Drain everything before exiting so no submitted future is left
+            // without a value.
+            if (pending == 0) return;
+            // Claim one task.  Tasks are pushed before pending is raised, so
+            // every claim is backed by a task sitting in some deque.
+            pending--;
+        }
+
+        std::function<void()> task;
+        while (!try_pop(index, task)) {
+            // Another claimer is mid-pop on the deque holding our task.
+            std::this_thread::yield();
+        }
+        task();
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool for CPU-heavy per-client work (audio
+// demodulation and encoding, waterfall compression).
+//
+// The websocketpp io_service must stay single-threaded (see the comment in
+// broadcast_server::run()), so anything that does real DSP or compression work
+// is submitted here instead and only the final socket write is marshalled back
+// onto the I/O thread by broadcast_server::queue_send().
+//
+// Every worker owns a task deque.  submit() with a shard hint always lands the
+// task on the same worker (e.g. one waterfall downsample level per worker, so
+// the level's quantized row stays in that core's cache); without a hint tasks
+// are spread round-robin.  A worker that runs dry steals from the back of the
+// other workers' deques, so an uneven shard never leaves cores idle.
+//
+// Workers may optionally be pinned to a list of CPUs: worker i is bound to
+// cpus[i % cpus.size()].  An empty list leaves scheduling to the kernel.
+class WorkerPool {
+  public:
+    // threads <= 0 selects hardware_concurrency() - 1 (at least 1), leaving a
+    // core free for the FFT and I/O threads.
+    WorkerPool(const std::string &name, int threads,
+               const std::vector<int> &cpus = {});
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Queue a task.  The returned future becomes ready when the task has run
+    // (or thrown — the exception is stored in the future, never propagated
+    // into the worker).  Tasks submitted after stop() are run inline so a
+    // caller waiting on the future can never hang during shutdown.
+    template <typename F>
+    std::future<void> submit(F &&fn, int shard = -1) {
+        auto task = std::make_shared<std::packaged_task<void()>>(
+            std::forward<F>(fn));
+        std::future<void> fut = task->get_future();
+        if (!enqueue([task] { (*task)(); }, shard)) {
+            (*task)();
+        }
+        return fut;
+    }
+
+    // Finish everything already queued, then join the workers.  Idempotent.
+    void stop();
+
+    int size() const { return static_cast<int>(workers.size()); }
+
+    // Tasks queued and not yet picked up by a worker.
+    size_t get_pending() {
+        std::scoped_lock lk(wake_mtx);
+        return pending;
+    }
+
+    // Number of tasks a worker took from another worker's deque.
+    uint64_t get_steals() const {
+        return steals.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct TaskQueue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // Returns false if the pool is stopping and the task was not queued.
+    bool enqueue(std::function<void()> task, int shard);
+    bool try_pop(int index, std::function<void()> &task);
+    void worker_loop(int index);
+
+    std::string name;
+    std::vector<int> cpus;
+    std::vector<std::thread> workers;
+    std::deque<TaskQueue> queues;   // one per worker; deque keeps mutexes stable
+
+    // wake_mtx orders submit() against stop() and guards the sleep/wake
+    // handshake; the task deques themselves have their own locks.
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;
+    size_t pending = 0;             // queued but not yet claimed (wake_mtx)
+    bool stopping = false;          // wake_mtx
+
+    std::atomic<unsigned> next_queue{0};
+    std::atomic<uint64_t> steals{0};
+};
+
+#endif